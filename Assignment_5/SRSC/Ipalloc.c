@@ -0,0 +1,299 @@
+/***************************************************************************
+ * File: ipalloc.c                                                         *
+ *                                                                         *
+ * Desc: the buffer pool behind IP_MALLOC and IP_FREE. every block starts  *
+ *       on an IP_ALIGN boundary and is rounded up to a size class, four   *
+ *       classes to each doubling, so a freed image or row is kept on its  *
+ *       class's list and handed out again to the next request of about    *
+ *       the same size instead of going back to the heap                   *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ipsys.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <pthread.h>
+#endif
+
+/* number of size classes, enough for any size_t */
+#define POOL_CLASSES  (4 * 64)
+
+/* marks in a block header, to catch pointers that are not pool blocks */
+#define BLOCK_LIVE    0x1badb10cu
+#define BLOCK_CACHED  0x0ddba115u
+
+/* header kept in the IP_ALIGN bytes before each block */
+typedef struct pool_block
+{
+	struct pool_block *next;    /* next cached block of the class */
+	size_t size;                /* bytes asked for */
+	int cls;                    /* size class */
+	unsigned int mark;          /* BLOCK_LIVE or BLOCK_CACHED */
+} pool_block;
+
+#ifdef _WIN32
+static SRWLOCK pool_lock = SRWLOCK_INIT;
+#else
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static pool_block *free_list[POOL_CLASSES];     /* cached blocks per class */
+static size_t pool_keep = IP_POOL_KEEP;         /* most bytes to cache */
+static ip_pool_info pool;                       /* statistics */
+
+/* take and release the pool lock */
+
+static void lock(void)
+{
+#ifdef _WIN32
+	AcquireSRWLockExclusive(&pool_lock);
+#else
+	pthread_mutex_lock(&pool_lock);
+#endif
+}
+
+static void unlock(void)
+{
+#ifdef _WIN32
+	ReleaseSRWLockExclusive(&pool_lock);
+#else
+	pthread_mutex_unlock(&pool_lock);
+#endif
+}
+
+/***************************************************************************
+ * Func: size_class                                                        *
+ *                                                                         *
+ * Desc: finds the class of a request. sizes are counted in IP_ALIGN       *
+ *       units; 1 to 4 units have a class each, and above that each        *
+ *       doubling is split into four steps, so a block is at most a        *
+ *       quarter bigger than asked                                         *
+ *                                                                         *
+ * Params: size - bytes asked for                                          *
+ *         bytes - set to the bytes of the class                           *
+ *                                                                         *
+ * Returns: the class                                                      *
+ ***************************************************************************/
+
+static int size_class(size_t size, size_t *bytes)
+{
+	size_t units = (size + IP_ALIGN - 1) / IP_ALIGN;
+	size_t step;
+	int e;                      /* highest bit of units - 1 */
+
+	if (units <= 4)
+	{
+		units = (units == 0) ? 1 : units;
+		*bytes = units * IP_ALIGN;
+		return (int)units - 1;
+	}
+
+	for (e = 2; ((units - 1) >> (e + 1)) != 0; e++)
+		;
+	step = (size_t)1 << (e - 2);
+	units = (((units - 1) >> (e - 2)) + 1) * step;
+	*bytes = units * IP_ALIGN;
+	return 4 * (e - 1) + (int)(units / step) - 5;
+}
+
+/* get and give back a block of the system heap */
+
+static pool_block *system_alloc(size_t bytes)
+{
+	void *p;
+
+#ifdef _WIN32
+	p = _aligned_malloc(IP_ALIGN + bytes, IP_ALIGN);
+#else
+	if (posix_memalign(&p, IP_ALIGN, IP_ALIGN + bytes) != 0)
+		p = NULL;
+#endif
+	return (pool_block *)p;
+}
+
+static void system_free(pool_block *b)
+{
+#ifdef _WIN32
+	_aligned_free(b);
+#else
+	free(b);
+#endif
+}
+
+/***************************************************************************
+ * Func: ip_alloc                                                          *
+ *                                                                         *
+ * Desc: hands out a block of at least size bytes aligned to IP_ALIGN,     *
+ *       from the pool when a block of its class is cached. safe to call   *
+ *       from any thread                                                   *
+ *                                                                         *
+ * Params: size - bytes wanted                                             *
+ *                                                                         *
+ * Returns: the block, or NULL when the heap is exhausted                  *
+ ***************************************************************************/
+
+void *ip_alloc(size_t size)
+{
+	pool_block *b;
+	size_t bytes;
+	int cls;
+
+	if (size > (size_t)-1 - 2 * IP_ALIGN - (size >> 2))
+		return NULL;
+	cls = size_class(size, &bytes);
+
+	lock();
+	pool.allocs++;
+	b = free_list[cls];
+	if (b != NULL)
+	{
+		free_list[cls] = b->next;
+		pool.cached -= bytes;
+		pool.hits++;
+	}
+	unlock();
+
+	if (b == NULL && (b = system_alloc(bytes)) == NULL)
+		return NULL;
+
+	b->size = size;
+	b->cls = cls;
+	b->mark = BLOCK_LIVE;
+
+	lock();
+	pool.live += size;
+	if (pool.live > pool.peak)
+		pool.peak = pool.live;
+	unlock();
+
+	return (unsigned char *)b + IP_ALIGN;
+}
+
+/***************************************************************************
+ * Func: ip_free                                                           *
+ *                                                                         *
+ * Desc: gives a block from ip_alloc back to the pool. it is cached for    *
+ *       reuse unless that would take the cache past its limit, in which   *
+ *       case it goes back to the heap                                     *
+ *                                                                         *
+ * Params: p - the block, or NULL                                          *
+ ***************************************************************************/
+
+void ip_free(void *p)
+{
+	pool_block *b;
+	size_t bytes;
+
+	if (p == NULL)
+		return;
+	b = (pool_block *)((unsigned char *)p - IP_ALIGN);
+	if (b->mark != BLOCK_LIVE)
+	{
+		printf("ip_free: %p is not a live pool block\n", p);
+		exit(1);
+	}
+	size_class(b->size, &bytes);
+
+	lock();
+	pool.live -= b->size;
+	if (pool.cached + bytes <= pool_keep)
+	{
+		b->mark = BLOCK_CACHED;
+		b->next = free_list[b->cls];
+		free_list[b->cls] = b;
+		pool.cached += bytes;
+		b = NULL;
+	}
+	unlock();
+
+	if (b != NULL)
+	{
+		b->mark = 0;
+		system_free(b);
+	}
+}
+
+/***************************************************************************
+ * Func: ip_pool_trim                                                      *
+ *                                                                         *
+ * Desc: gives every cached block back to the heap                         *
+ ***************************************************************************/
+
+void ip_pool_trim(void)
+{
+	pool_block *list[POOL_CLASSES];
+	pool_block *b;
+	int cls;
+
+	lock();
+	for (cls = 0; cls < POOL_CLASSES; cls++)
+	{
+		list[cls] = free_list[cls];
+		free_list[cls] = NULL;
+	}
+	pool.cached = 0;
+	unlock();
+
+	for (cls = 0; cls < POOL_CLASSES; cls++)
+		while ((b = list[cls]) != NULL)
+		{
+			list[cls] = b->next;
+			b->mark = 0;
+			system_free(b);
+		}
+}
+
+/***************************************************************************
+ * Func: ip_pool_limit                                                     *
+ *                                                                         *
+ * Desc: sets the most bytes the pool keeps cached, IP_POOL_KEEP at first. *
+ *       0 turns caching off; blocks already cached past the new limit     *
+ *       stay until ip_pool_trim                                           *
+ *                                                                         *
+ * Params: bytes - the limit                                               *
+ ***************************************************************************/
+
+void ip_pool_limit(size_t bytes)
+{
+	lock();
+	pool_keep = bytes;
+	unlock();
+}
+
+/***************************************************************************
+ * Func: ip_pool_stats                                                     *
+ *                                                                         *
+ * Desc: copies the pool statistics                                        *
+ *                                                                         *
+ * Params: info - set to the statistics                                    *
+ ***************************************************************************/
+
+void ip_pool_stats(ip_pool_info *info)
+{
+	lock();
+	*info = pool;
+	unlock();
+}
+
+/***************************************************************************
+ * Func: ip_pool_report                                                    *
+ *                                                                         *
+ * Desc: prints the pool statistics                                        *
+ ***************************************************************************/
+
+void ip_pool_report(void)
+{
+	ip_pool_info info;
+
+	ip_pool_stats(&info);
+	printf("pool: %llu bytes live, %llu peak, %llu cached\n",
+		info.live, info.peak, info.cached);
+	printf("pool: %llu allocations, %llu from the pool (%.1f%%)\n",
+		info.allocs, info.hits,
+		info.allocs ? 100.0 * info.hits / info.allocs : 0.0);
+}
@@ -0,0 +1,559 @@
+/***************************************************************************
+ * File: ipbmp.c                                                           *
+ *                                                                         *
+ * Desc: Windows BMP reader and writer. images are turned into the same    *
+ *       PGM/PPM layout read_pnm gives, so every kernel in iplib.c takes   *
+ *       BMP input directly                                                *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ip.h"
+#include "ipsys.h"
+
+#define BMP_FILE_HEADER   14        /* bytes before the info header */
+#define BMP_HEADER_BYTES  54        /* file header + BITMAPINFOHEADER */
+
+#define BI_RGB        0             /* uncompressed */
+#define BI_RLE8       1             /* 8-bit run length encoding */
+#define BI_BITFIELDS  3             /* uncompressed with channel masks */
+
+/***************************************************************************
+ * Func: bmp_field                                                         *
+ *                                                                         *
+ * Desc: decodes a little endian field of a BMP header                     *
+ *                                                                         *
+ * Params: p - first byte of the field                                     *
+ *         n - size of the field in bytes                                  *
+ *                                                                         *
+ * Returns: value of the field                                             *
+ ***************************************************************************/
+
+static unsigned long bmp_field(unsigned char *p, int n)
+{
+	unsigned long value = 0;
+
+	while (n-- > 0)
+		value = (value << 8) | p[n];
+	return value;
+}
+
+/***************************************************************************
+ * Func: put_field                                                         *
+ *                                                                         *
+ * Desc: stores a little endian field of a BMP header                      *
+ *                                                                         *
+ * Params: p - first byte of the field                                     *
+ *         n - size of the field in bytes                                  *
+ *         value - value to store                                          *
+ ***************************************************************************/
+
+static void put_field(unsigned char *p, int n, unsigned long value)
+{
+	while (n-- > 0)
+	{
+		*p++ = (unsigned char)value;
+		value >>= 8;
+	}
+}
+
+/***************************************************************************
+ * Func: swap_rb_scalar, bgra_to_rgb_scalar                                *
+ *                                                                         *
+ * Desc: turn a row of BGR or BGRA pixels into RGB. swapping the first     *
+ *       and third bytes also turns RGB back into BGR for write_bmp        *
+ *                                                                         *
+ * Params: src - source pixels                                             *
+ *         dst - RGB pixels, must not overlap src                          *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+static void swap_rb_scalar(unsigned char *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+
+	for (i = 0; i < n; i++, src += 3, dst += 3)
+	{
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+	}
+}
+
+static void bgra_to_rgb_scalar(unsigned char *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+
+	for (i = 0; i < n; i++, src += 4, dst += 3)
+	{
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+	}
+}
+
+/* swizzles picked by select_bmp_kernels */
+static void (*swap_rb)(unsigned char *src, unsigned char *dst, int n);
+static void (*bgra_to_rgb)(unsigned char *src, unsigned char *dst, int n);
+
+/***************************************************************************
+ * Func: select_bmp_kernels                                                *
+ *                                                                         *
+ * Desc: points the swizzles at the widest versions this cpu runs          *
+ ***************************************************************************/
+
+static void select_bmp_kernels(void)
+{
+	int cpu = ip_cpu_features();
+
+	swap_rb = swap_rb_scalar;
+	bgra_to_rgb = bgra_to_rgb_scalar;
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+	{
+		swap_rb = swap_rb_sse41;
+		bgra_to_rgb = bgra_to_rgb_sse41;
+	}
+	if (cpu & IP_CPU_AVX2)
+	{
+		swap_rb = swap_rb_avx2;
+		bgra_to_rgb = bgra_to_rgb_avx2;
+	}
+#endif
+}
+
+/***************************************************************************
+ * Func: read_bmp_header                                                   *
+ *                                                                         *
+ * Desc: reads the file and info headers in one go. the fields are         *
+ *       decoded one by one, since the C struct would have padding and     *
+ *       a long is not 4 bytes everywhere                                  *
+ *                                                                         *
+ * Params: fp - BMP file positioned at its start                           *
+ *         filename - name of the file, for messages                       *
+ *         info - header fields                                            *
+ ***************************************************************************/
+
+static void read_bmp_header(FILE *fp, char *filename, bmp_info *info)
+{
+	unsigned char head[BMP_HEADER_BYTES + 12];  /* headers and BI_BITFIELDS masks */
+
+	if (fread(head, 1, BMP_HEADER_BYTES, fp) != BMP_HEADER_BYTES
+		|| head[0] != 'B' || head[1] != 'M')
+	{
+		printf("%s is not a BMP file\n", filename);
+		exit(1);
+	}
+
+	info->offset = bmp_field(head + 10, 4);
+	info->header_size = bmp_field(head + 14, 4);
+	info->width = (long)(int)bmp_field(head + 18, 4);
+	info->height = (long)(int)bmp_field(head + 22, 4);
+	info->bit_count = (int)bmp_field(head + 28, 2);
+	info->compression = (int)bmp_field(head + 30, 4);
+	info->data_size = bmp_field(head + 34, 4);
+	info->colors = (int)bmp_field(head + 46, 4);
+
+	/* the masks follow a BITMAPINFOHEADER, and are part of the longer
+	   V4 and V5 headers at the same offset */
+	info->masks[0] = info->masks[1] = info->masks[2] = 0;
+	if (info->compression == BI_BITFIELDS)
+	{
+		if (fread(head + BMP_HEADER_BYTES, 1, 12, fp) != 12)
+		{
+			printf("%s: BMP header is cut short\n", filename);
+			exit(1);
+		}
+		info->masks[0] = bmp_field(head + 54, 4);
+		info->masks[1] = bmp_field(head + 58, 4);
+		info->masks[2] = bmp_field(head + 62, 4);
+	}
+}
+
+/***************************************************************************
+ * Func: decode_rle8                                                       *
+ *                                                                         *
+ * Desc: expands BI_RLE8 data into one palette index per pixel, rows in    *
+ *       file order. pixels skipped by a delta or an early end of line     *
+ *       are left at index 0                                               *
+ *                                                                         *
+ * Params: code - compressed data                                          *
+ *         size - bytes of compressed data                                 *
+ *         index - rows * cols palette indices                             *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ ***************************************************************************/
+
+static void decode_rle8(unsigned char *code, unsigned long size,
+	unsigned char *index, int rows, int cols)
+{
+	unsigned long p;            /* position in code */
+	int x, y;                   /* pixel the next run starts at */
+	int count, value;           /* the two bytes of a run */
+	int n;                      /* pixels of a run inside the row */
+
+	memset(index, 0, (unsigned long)rows * cols);
+	p = 0;
+	x = y = 0;
+	while (p + 1 < size && y < rows)
+	{
+		count = code[p++];
+		value = code[p++];
+
+		if (count > 0)
+		{
+			/* encoded run: count copies of value */
+			n = MIN(count, cols - x);
+			if (n > 0)
+				memset(index + (unsigned long)y * cols + x, value, n);
+			x += count;
+		}
+		else if (value == 0)
+		{
+			/* end of line */
+			x = 0;
+			y++;
+		}
+		else if (value == 1)
+			break;              /* end of bitmap */
+		else if (value == 2)
+		{
+			/* delta: move right and up */
+			if (p + 1 >= size)
+				break;
+			x += code[p];
+			y += code[p + 1];
+			p += 2;
+		}
+		else
+		{
+			/* absolute run of value indices, padded to 16 bits */
+			if (p + value > size)
+				break;
+			n = MIN(value, cols - x);
+			if (n > 0)
+				memcpy(index + (unsigned long)y * cols + x, code + p, n);
+			x += value;
+			p += (value + 1) & ~1;
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: palette_row                                                       *
+ *                                                                         *
+ * Desc: looks up a row of palette indices                                 *
+ *                                                                         *
+ * Params: src - palette indices                                           *
+ *         dst - output row, grey levels or RGB pixels                     *
+ *         n - number of pixels                                            *
+ *         lut - 256 RGB entries                                           *
+ *         channels - 1 when the palette is grey, else 3                   *
+ ***************************************************************************/
+
+static void palette_row(unsigned char *src, unsigned char *dst, int n,
+	unsigned char *lut, int channels)
+{
+	int i;                      /* pixel index */
+	unsigned char *entry;       /* palette entry of the pixel */
+
+	if (channels == 1)
+	{
+		for (i = 0; i < n; i++)
+			dst[i] = lut[3 * src[i]];
+		return;
+	}
+
+	for (i = 0; i < n; i++, dst += 3)
+	{
+		entry = lut + 3 * src[i];
+		dst[0] = entry[0];
+		dst[1] = entry[1];
+		dst[2] = entry[2];
+	}
+}
+
+/***************************************************************************
+ * Func: read_bmp                                                          *
+ *                                                                         *
+ * Desc: reads a BMP file. 8-bit files (plain or BI_RLE8) come back as     *
+ *       PGM when the palette is grey and as PPM otherwise; 24 and 32-bit  *
+ *       files come back as PPM. rows are read straight into their place   *
+ *       in the image, so bottom-up and top-down files cost the same       *
+ *                                                                         *
+ * Params: filename - name of image file to read                           *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         type - 5 = PGM   6 = PPM                                        *
+ *         info - header fields, NULL if not wanted                        *
+ *                                                                         *
+ * Returns: pointer to the image just read into memory                     *
+ ***************************************************************************/
+
+image_ptr read_bmp(char *filename, int *rows, int *cols, int *type,
+	bmp_info *info)
+{
+	FILE *fp;                   /* input file pointer */
+	bmp_info bi;                /* header fields */
+	unsigned char lut[3 * 256]; /* palette as RGB triples */
+	unsigned char quad[4 * 256];/* palette as stored in the file */
+	int colors;                 /* palette entries */
+	int channels;               /* samples per output pixel */
+	int top_down;               /* first row in the file is the top one */
+	unsigned long stride;       /* padded bytes per row in the file */
+	unsigned long line;         /* bytes per row of the image */
+	unsigned char *row;         /* one row as stored in the file */
+	unsigned char *code;        /* BI_RLE8 data, then its indices */
+	image_ptr image, dst;       /* image and its current row */
+	int i, y;                   /* file row and image row */
+
+	if ((fp = fopen(filename, "rb")) == NULL)
+	{
+		printf("Unable to open %s for reading\n", filename);
+		exit(1);
+	}
+	read_bmp_header(fp, filename, &bi);
+
+	if (bi.bit_count != 8 && bi.bit_count != 24 && bi.bit_count != 32)
+	{
+		printf("%s: %d-bit BMP files are not supported\n", filename, bi.bit_count);
+		exit(1);
+	}
+	if (!(bi.compression == BI_RGB
+		|| (bi.compression == BI_RLE8 && bi.bit_count == 8 && bi.height > 0)
+		|| (bi.compression == BI_BITFIELDS && bi.bit_count == 32
+			&& bi.masks[0] == 0xff0000 && bi.masks[1] == 0xff00 && bi.masks[2] == 0xff)))
+	{
+		printf("%s: BMP compression %d is not supported\n", filename, bi.compression);
+		exit(1);
+	}
+	if (bi.width <= 0 || bi.height == 0)
+	{
+		printf("%s: bad BMP size %ld x %ld\n", filename, bi.width, bi.height);
+		exit(1);
+	}
+
+	*cols = (int)bi.width;
+	top_down = (bi.height < 0);
+	*rows = (int)(top_down ? -bi.height : bi.height);
+	channels = 3;
+
+	/* the palette follows the info header; an entry is B, G, R, 0 */
+	if (bi.bit_count == 8)
+	{
+		colors = (bi.colors > 0 && bi.colors <= 256) ? bi.colors : 256;
+		memset(quad, 0, sizeof(quad));
+		fseek(fp, BMP_FILE_HEADER + bi.header_size, SEEK_SET);
+		if (fread(quad, 4, colors, fp) != (size_t)colors)
+		{
+			printf("%s: BMP palette is cut short\n", filename);
+			exit(1);
+		}
+
+		channels = 1;
+		for (i = 0; i < 256; i++)
+		{
+			lut[3 * i] = quad[4 * i + 2];
+			lut[3 * i + 1] = quad[4 * i + 1];
+			lut[3 * i + 2] = quad[4 * i];
+			if (i < colors && (quad[4 * i] != quad[4 * i + 1] || quad[4 * i] != quad[4 * i + 2]))
+				channels = 3;
+		}
+	}
+	*type = (channels == 1) ? 5 : 6;
+
+	select_bmp_kernels();
+	line = (unsigned long)*cols * channels;
+	stride = ((unsigned long)*cols * bi.bit_count / 8 + 3) & ~3UL;
+	image = (image_ptr)IP_MALLOC(line * *rows);
+	row = (unsigned char *)malloc(stride);
+	if (image == NULL || row == NULL)
+	{
+		printf("Unable to malloc BMP buffers\n");
+		exit(1);
+	}
+
+	fseek(fp, bi.offset, SEEK_SET);
+
+	if (bi.compression == BI_RLE8)
+	{
+		/* bi.data_size is the size of the compressed data. writers may
+		   leave it 0, and then the data runs to the end of the file */
+		if (bi.data_size == 0)
+		{
+			fseek(fp, 0, SEEK_END);
+			if (ftell(fp) <= (long)bi.offset)
+			{
+				printf("%s: BMP has no RLE8 data\n", filename);
+				exit(1);
+			}
+			bi.data_size = (unsigned long)(ftell(fp) - (long)bi.offset);
+			fseek(fp, bi.offset, SEEK_SET);
+		}
+		code = (unsigned char *)malloc(bi.data_size + (unsigned long)*rows * *cols);
+		if (code == NULL)
+		{
+			printf("Unable to malloc BMP buffers\n");
+			exit(1);
+		}
+		bi.data_size = (unsigned long)fread(code, 1, bi.data_size, fp);
+		decode_rle8(code, bi.data_size, code + bi.data_size, *rows, *cols);
+		for (i = 0; i < *rows; i++)
+			palette_row(code + bi.data_size + (unsigned long)i * *cols,
+				image + (unsigned long)(*rows - 1 - i) * line, *cols, lut, channels);
+		free(code);
+	}
+	else
+	{
+		for (i = 0; i < *rows; i++)
+		{
+			y = top_down ? i : *rows - 1 - i;
+			dst = image + (unsigned long)y * line;
+			/* some writers leave out the padding of the last row */
+			if (fread(row, 1, stride, fp) < (unsigned long)*cols * bi.bit_count / 8)
+			{
+				printf("%s: BMP pixel data is cut short\n", filename);
+				exit(1);
+			}
+
+			if (bi.bit_count == 8)
+				palette_row(row, dst, *cols, lut, channels);
+			else if (bi.bit_count == 24)
+				swap_rb(row, dst, *cols);
+			else
+				bgra_to_rgb(row, dst, *cols);
+		}
+	}
+
+	if (info != NULL)
+		*info = bi;
+	free(row);
+	fclose(fp);
+	return image;
+}
+
+/***************************************************************************
+ * Func: write_bmp                                                         *
+ *                                                                         *
+ * Desc: writes an image as an uncompressed bottom-up BMP file: PGM as     *
+ *       8-bit with a grey palette, PPM as 24-bit                          *
+ *                                                                         *
+ * Params: ptr - pointer to image in memory                                *
+ *         filename - name of file to write image to                       *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         type - 5 = PGM   6 = PPM                                        *
+ ***************************************************************************/
+
+void write_bmp(image_ptr ptr, char *filename, int rows, int cols, int type)
+{
+	FILE *fp;                   /* output file pointer */
+	unsigned char head[BMP_HEADER_BYTES];
+	unsigned char quad[4 * 256];/* grey palette */
+	int channels;               /* samples per pixel */
+	unsigned long line;         /* bytes per row of the image */
+	unsigned long stride;       /* padded bytes per row in the file */
+	unsigned long offset;       /* file offset of the pixel array */
+	unsigned char *row;         /* one row as stored in the file */
+	image_ptr src;              /* current row of the image */
+	int i;
+
+	if (type != 5 && type != 6)
+	{
+		printf("write_bmp: only PGM and PPM images can be written\n");
+		exit(1);
+	}
+	channels = (type == 5) ? 1 : 3;
+	line = (unsigned long)cols * channels;
+	stride = (line + 3) & ~3UL;
+	offset = BMP_HEADER_BYTES + ((type == 5) ? sizeof(quad) : 0);
+
+	if ((fp = fopen(filename, "wb")) == NULL)
+	{
+		printf("Unable to open %s for output\n", filename);
+		exit(1);
+	}
+
+	memset(head, 0, sizeof(head));
+	head[0] = 'B';
+	head[1] = 'M';
+	put_field(head + 2, 4, offset + stride * rows);
+	put_field(head + 10, 4, offset);
+	put_field(head + 14, 4, BMP_HEADER_BYTES - BMP_FILE_HEADER);
+	put_field(head + 18, 4, cols);
+	put_field(head + 22, 4, rows);
+	put_field(head + 26, 2, 1);
+	put_field(head + 28, 2, 8 * channels);
+	put_field(head + 30, 4, BI_RGB);
+	put_field(head + 34, 4, stride * rows);
+	put_field(head + 38, 4, 2835);          /* 72 dpi */
+	put_field(head + 42, 4, 2835);
+	put_field(head + 46, 4, (type == 5) ? 256 : 0);
+	fwrite(head, 1, sizeof(head), fp);
+
+	if (type == 5)
+	{
+		for (i = 0; i < 256; i++)
+		{
+			quad[4 * i] = quad[4 * i + 1] = quad[4 * i + 2] = (unsigned char)i;
+			quad[4 * i + 3] = 0;
+		}
+		fwrite(quad, 1, sizeof(quad), fp);
+	}
+
+	select_bmp_kernels();
+	row = (unsigned char *)calloc(stride, 1);
+	if (row == NULL)
+	{
+		printf("Unable to malloc BMP buffers\n");
+		exit(1);
+	}
+
+	/* bottom row first */
+	for (i = rows - 1; i >= 0; i--)
+	{
+		src = ptr + (unsigned long)i * line;
+		if (type == 5)
+			memcpy(row, src, line);
+		else
+			swap_rb(src, row, cols);
+		fwrite(row, 1, stride, fp);
+	}
+
+	free(row);
+	fclose(fp);
+}
+
+/***************************************************************************
+ * Func: read_image                                                        *
+ *                                                                         *
+ * Desc: reads a PNM or BMP file, telling them apart by their first bytes  *
+ *                                                                         *
+ * Params: filename - name of image file to read                           *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         type - file type, 6 for colour BMP files and 5 for grey ones    *
+ *                                                                         *
+ * Returns: pointer to the image just read into memory                     *
+ ***************************************************************************/
+
+image_ptr read_image(char *filename, int *rows, int *cols, int *type)
+{
+	FILE *fp;                   /* input file pointer */
+	unsigned char magic[2];     /* first two bytes of the file */
+	size_t got;
+
+	if ((fp = fopen(filename, "rb")) == NULL)
+	{
+		printf("Unable to open %s for reading\n", filename);
+		exit(1);
+	}
+	got = fread(magic, 1, 2, fp);
+	fclose(fp);
+
+	if (got == 2 && magic[0] == 'B' && magic[1] == 'M')
+		return read_bmp(filename, rows, cols, type, NULL);
+	return read_pnm(filename, rows, cols, type);
+}
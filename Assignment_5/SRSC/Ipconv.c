@@ -0,0 +1,1022 @@
+/***************************************************************************
+ * File: ipconv.c                                                          *
+ *                                                                         *
+ * Desc: spatial filtering of PGM and PPM images: convolution with any     *
+ *       kernel, run as two 1-D passes when the kernel separates, box      *
+ *       filters with running sums, and grey erosion and dilation with a   *
+ *       rectangle. borders follow one of the EDGE_ modes. the output is   *
+ *       cut into tiles by ip_run_tiles, so on a wide image the rows a     *
+ *       task keeps stay in the cache                                      *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* output rows of one tile */
+#define CONV_ROWS      64
+
+/* most fraction bits of the fixed point weights */
+#define CONV_MAX_BITS  20
+
+/* state shared by the tasks of convolve */
+
+typedef struct
+    {
+    image_ptr in;           /* source image */
+    image_ptr out;          /* filtered image */
+    long in_stride;         /* bytes from one source row to the next */
+    long out_stride;        /* the same for the filtered image */
+    int rows;
+    int cols;
+    int channels;           /* samples per pixel, 1 = PGM   3 = PPM */
+    int krows;              /* kernel size */
+    int kcols;
+    int separable;          /* vweight down, then hweight across */
+    int *vweight;           /* krows weights down, separable only */
+    int *hweight;           /* kcols weights, krows * kcols if not separable */
+    int bias;               /* added before the shift, with rounding */
+    int shift;              /* fraction bits of the result */
+    int edge;               /* EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO */
+    void (*vpass)(unsigned char **src, int *weight, int taps, int *dst, int n);
+    void (*hpass)(int *src, int *weight, int taps, int step, int *acc, int n);
+    void (*store)(int *acc, int bias, int shift, unsigned char *dst, int n);
+    } conv_job;
+
+/* state shared by the tasks of box_filter */
+
+typedef struct
+    {
+    image_ptr in;           /* source image */
+    image_ptr out;          /* filtered image */
+    long in_stride;         /* bytes from one source row to the next */
+    long out_stride;        /* the same for the filtered image */
+    int rows;
+    int cols;
+    int channels;           /* samples per pixel, 1 = PGM   3 = PPM */
+    int width;              /* box size */
+    int height;
+    unsigned long long inverse; /* 2^40 / (width * height), rounded up */
+    int edge;               /* EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO */
+    } box_job;
+
+/* state shared by the tasks of grey_morphology */
+
+typedef struct
+    {
+    image_ptr in;           /* source image */
+    image_ptr out;          /* filtered image */
+    long in_stride;         /* bytes from one source row to the next */
+    long out_stride;        /* the same for the filtered image */
+    int rows;
+    int cols;
+    int channels;           /* samples per pixel, 1 = PGM   3 = PPM */
+    int width;              /* rectangle size */
+    int height;
+    int op;                 /* GREY_ERODE or GREY_DILATE */
+    int edge;               /* EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO */
+    } grey_job;
+
+/***************************************************************************
+ * Func: edge_index                                                        *
+ *                                                                         *
+ * Desc: maps a row or column index that may lie outside the image to the  *
+ *       one that supplies its value                                       *
+ *                                                                         *
+ * Params: i - index, possibly negative or past the end                    *
+ *         n - rows or columns of the image                                *
+ *         edge - EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO                     *
+ *                                                                         *
+ * Returns: index inside 0 .. n - 1, or -1 for a zero sample               *
+ ***************************************************************************/
+
+static int edge_index(int i, int n, int edge)
+{
+	if (i >= 0 && i < n)
+		return i;
+	if (edge == EDGE_ZERO)
+		return -1;
+	if (edge == EDGE_CLAMP || n == 1)
+		return (i < 0) ? 0 : n - 1;
+
+	/* mirror about the border sample, which is not repeated */
+	i %= 2 * n - 2;
+	if (i < 0)
+		i = -i;
+	if (i >= n)
+		i = 2 * n - 2 - i;
+	return i;
+}
+
+/***************************************************************************
+ * Func: pad_row                                                           *
+ *                                                                         *
+ * Desc: copies a piece of a source row into a buffer. the piece may       *
+ *       reach past either end of the row; those pixels are filled in by   *
+ *       the edge mode                                                     *
+ *                                                                         *
+ * Params: in - source image                                               *
+ *         stride - bytes from one source row to the next                  *
+ *         y - row, possibly outside the image                             *
+ *         rows, cols, channels - size of the image                        *
+ *         x0 - first column of the piece, possibly negative               *
+ *         count - pixels in the piece                                     *
+ *         edge - EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO                     *
+ *         dst - count * channels samples                                  *
+ ***************************************************************************/
+
+static void pad_row(image_ptr in, long stride, int y, int rows, int cols, int channels,
+	int x0, int count, int edge, unsigned char *dst)
+{
+	image_ptr src;              /* the row that supplies row y */
+	int x, c, xi;               /* column, channel and source column */
+	int a, b;                   /* columns of the piece inside the image */
+
+	y = edge_index(y, rows, edge);
+	if (y < 0)
+	{
+		memset(dst, 0, count * channels);
+		return;
+	}
+
+	src = in + y * stride;
+	a = MAX(x0, 0);
+	b = MIN(x0 + count, cols);
+	if (a < b)
+		memcpy(dst + (a - x0) * channels, src + a * channels, (b - a) * channels);
+	else
+		a = b = x0 + count;
+	for (x = x0; x < a; x++)
+	{
+		xi = edge_index(x, cols, edge);
+		for (c = 0; c < channels; c++)
+			dst[(x - x0) * channels + c] = (xi < 0) ? 0 : src[xi * channels + c];
+	}
+	for (x = b; x < x0 + count; x++)
+	{
+		xi = edge_index(x, cols, edge);
+		for (c = 0; c < channels; c++)
+			dst[(x - x0) * channels + c] = (xi < 0) ? 0 : src[xi * channels + c];
+	}
+}
+
+/***************************************************************************
+ * Func: conv_vpass_scalar                                                 *
+ *                                                                         *
+ * Desc: weighted sum of source rows, dst[i] = sum weight[k] * src[k][i]   *
+ *                                                                         *
+ * Params: src - taps rows of bytes                                        *
+ *         weight - taps fixed point weights                               *
+ *         taps - number of rows                                           *
+ *         dst - n sums                                                    *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+static void conv_vpass_scalar(unsigned char **src, int *weight, int taps,
+	int *dst, int n)
+{
+	int i, k;                   /* sample and tap */
+	int sum;
+
+	for (i = 0; i < n; i++)
+	{
+		sum = 0;
+		for (k = 0; k < taps; k++)
+			sum += weight[k] * src[k][i];
+		dst[i] = sum;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_hpass_scalar                                                 *
+ *                                                                         *
+ * Desc: adds a weighted sum along a row to an accumulator, acc[i] +=      *
+ *       sum weight[k] * src[i + k * step]                                 *
+ *                                                                         *
+ * Params: src - row from conv_vpass, padded by (taps - 1) * step          *
+ *         weight - taps fixed point weights                               *
+ *         taps - number of samples summed                                 *
+ *         step - distance between neighbours, channels of the image       *
+ *         acc - n sums to add to                                          *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+static void conv_hpass_scalar(int *src, int *weight, int taps, int step,
+	int *acc, int n)
+{
+	int i, k;                   /* sample and tap */
+	int sum;
+
+	for (i = 0; i < n; i++)
+	{
+		sum = acc[i];
+		for (k = 0; k < taps; k++)
+			sum += weight[k] * src[i + k * step];
+		acc[i] = sum;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_store_scalar                                                 *
+ *                                                                         *
+ * Desc: turns fixed point sums into clipped bytes                         *
+ *                                                                         *
+ * Params: acc - n sums                                                    *
+ *         bias - added before the shift, rounding included                *
+ *         shift - fraction bits of the sums                               *
+ *         dst - n bytes                                                   *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+static void conv_store_scalar(int *acc, int bias, int shift, unsigned char *dst,
+	int n)
+{
+	int i;                      /* sample index */
+	int v;
+
+	for (i = 0; i < n; i++)
+	{
+		v = (acc[i] + bias) >> shift;
+		CLIP(v, 0, 255);
+		dst[i] = (unsigned char)v;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_task                                                         *
+ *                                                                         *
+ * Desc: tile task: filters tile t. the source pieces under the tile and   *
+ *       its halo are kept in a ring of krows, so each is read and padded  *
+ *       once per tile                                                     *
+ ***************************************************************************/
+
+static void conv_task(void *arg, ip_tile *t)
+{
+	conv_job *job = (conv_job *)arg;
+	unsigned char *ring;        /* krows padded source rows */
+	unsigned char **row;        /* ring rows in kernel order */
+	int *wide;                  /* row from the vertical pass, padded */
+	int *acc;                   /* sums of one output row */
+	int one = 1;                /* weight that copies a row */
+	int width, n;               /* samples in a padded and an output row */
+	int ay, ax;                 /* kernel anchor */
+	int x0, count;              /* source columns of the tile and halo */
+	int y, k;                   /* row and kernel row */
+	image_ptr out;              /* pixel (t->x0, 0) of the output */
+
+	ay = job->krows / 2;
+	ax = job->kcols / 2;
+	x0 = t->x0 - ax;
+	count = t->x1 - t->x0 + job->kcols - 1;
+	n = (t->x1 - t->x0) * job->channels;
+	width = count * job->channels;
+	out = job->out + t->x0 * job->channels;
+
+	ring = (unsigned char *)malloc(width * job->krows);
+	row = (unsigned char **)malloc(sizeof(unsigned char *) * job->krows);
+	wide = (int *)malloc(sizeof(int) * width);
+	acc = (int *)malloc(sizeof(int) * n);
+	if (ring == NULL || row == NULL || wide == NULL || acc == NULL)
+	{
+		printf("Error allocating convolution rows\n");
+		exit(1);
+	}
+
+	/* source row y - ay + k lives in slot (y - ay + k) mod krows */
+	for (k = 0; k < job->krows - 1; k++)
+		pad_row(job->in, job->in_stride, t->y0 - ay + k, job->rows, job->cols,
+			job->channels, x0, count, job->edge,
+			ring + width * ((t->y0 - ay + k + job->krows) % job->krows));
+
+	for (y = t->y0; y < t->y1; y++)
+	{
+		k = job->krows - 1;
+		pad_row(job->in, job->in_stride, y - ay + k, job->rows, job->cols,
+			job->channels, x0, count, job->edge,
+			ring + width * ((y - ay + k + job->krows) % job->krows));
+		for (k = 0; k < job->krows; k++)
+			row[k] = ring + width * ((y - ay + k + job->krows) % job->krows);
+
+		memset(acc, 0, sizeof(int) * n);
+		if (job->separable)
+		{
+			job->vpass(row, job->vweight, job->krows, wide, width);
+			job->hpass(wide, job->hweight, job->kcols, job->channels, acc, n);
+		}
+		else
+			for (k = 0; k < job->krows; k++)
+			{
+				job->vpass(row + k, &one, 1, wide, width);
+				job->hpass(wide, job->hweight + k * job->kcols, job->kcols,
+					job->channels, acc, n);
+			}
+		job->store(acc, job->bias, job->shift, out + y * job->out_stride, n);
+	}
+
+	free(ring);
+	free(row);
+	free(wide);
+	free(acc);
+}
+
+/***************************************************************************
+ * Func: separate_kernel                                                   *
+ *                                                                         *
+ * Desc: tries to write a kernel as a column times a row. the two factors  *
+ *       are scaled to the same total weight so both keep their precision  *
+ *       in fixed point                                                    *
+ *                                                                         *
+ * Params: kernel - krows * kcols weights, row by row                      *
+ *         krows, kcols - kernel size                                      *
+ *         column - krows weights to fill                                  *
+ *         row - kcols weights to fill                                     *
+ *                                                                         *
+ * Returns: 1 if kernel = column * row to within rounding, else 0          *
+ ***************************************************************************/
+
+static int separate_kernel(float *kernel, int krows, int kcols, double *column,
+	double *row)
+{
+	double pivot;               /* largest weight */
+	double csum, rsum, scale;   /* total weights of the factors */
+	int pr, pc;                 /* row and column of the pivot */
+	int i, j;
+
+	pr = pc = 0;
+	for (i = 0; i < krows; i++)
+		for (j = 0; j < kcols; j++)
+			if (fabs(kernel[i * kcols + j]) > fabs(kernel[pr * kcols + pc]))
+			{
+				pr = i;
+				pc = j;
+			}
+	pivot = kernel[pr * kcols + pc];
+	if (pivot == 0.0)
+	{
+		for (i = 0; i < krows; i++)
+			column[i] = 0.0;
+		for (j = 0; j < kcols; j++)
+			row[j] = 0.0;
+		return 1;
+	}
+
+	for (i = 0; i < krows; i++)
+		column[i] = kernel[i * kcols + pc];
+	for (j = 0; j < kcols; j++)
+		row[j] = kernel[pr * kcols + j] / pivot;
+
+	for (i = 0; i < krows; i++)
+		for (j = 0; j < kcols; j++)
+			if (fabs(kernel[i * kcols + j] - column[i] * row[j]) > 1e-5 * fabs(pivot))
+				return 0;
+
+	csum = rsum = 0.0;
+	for (i = 0; i < krows; i++)
+		csum += fabs(column[i]);
+	for (j = 0; j < kcols; j++)
+		rsum += fabs(row[j]);
+	scale = sqrt(csum / rsum);
+	for (i = 0; i < krows; i++)
+		column[i] /= scale;
+	for (j = 0; j < kcols; j++)
+		row[j] *= scale;
+	return 1;
+}
+
+/***************************************************************************
+ * Func: quantize_weights                                                  *
+ *                                                                         *
+ * Desc: rounds weights to fixed point. the largest weight takes up the    *
+ *       rounding errors, so a kernel that sums to 1 still sums to 1 and   *
+ *       leaves flat areas unchanged                                       *
+ *                                                                         *
+ * Params: weight - n weights                                              *
+ *         n - number of weights                                           *
+ *         bits - fraction bits                                            *
+ *         q - n fixed point weights to fill                               *
+ ***************************************************************************/
+
+static void quantize_weights(double *weight, int n, int bits, int *q)
+{
+	double one = (double)(1L << bits);
+	double total;               /* sum of the weights */
+	int qtotal;                 /* sum of the rounded weights */
+	int i, big;                 /* weight and the largest one */
+
+	total = 0.0;
+	qtotal = 0;
+	big = 0;
+	for (i = 0; i < n; i++)
+	{
+		q[i] = (int)floor(weight[i] * one + 0.5);
+		total += weight[i];
+		qtotal += q[i];
+		if (fabs(weight[i]) > fabs(weight[big]))
+			big = i;
+	}
+	q[big] += (int)floor(total * one + 0.5) - qtotal;
+}
+
+/***************************************************************************
+ * Func: convolve_rows                                                     *
+ *                                                                         *
+ * Desc: the engine behind convolve and convolve_desc, for rows any        *
+ *       number of bytes apart                                             *
+ *                                                                         *
+ * Params: in, in_stride - source image and bytes between its rows         *
+ *         out, out_stride - filtered image and bytes between its rows     *
+ *         rows, cols, channels - size of the image                        *
+ *         others as convolve                                              *
+ ***************************************************************************/
+
+static void convolve_rows(image_ptr in, long in_stride, image_ptr out,
+	long out_stride, int rows, int cols, int channels, float *kernel, int krows,
+	int kcols, float bias, int edge)
+{
+	conv_job job;               /* kernel shared by the tasks */
+	double *column, *row;       /* factors of a separable kernel */
+	double *weight;             /* kernel as doubles */
+	double total;               /* sum of the absolute weights */
+	double csum, rsum;          /* the same for each factor */
+	int bits, vbits;            /* fraction bits, and those of vweight */
+	int i;
+	int cpu = ip_cpu_features();
+
+	if (krows < 1 || kcols < 1)
+	{
+		printf("convolve: empty %d x %d kernel\n", kcols, krows);
+		exit(1);
+	}
+
+	job.in = in;
+	job.out = out;
+	job.in_stride = in_stride;
+	job.out_stride = out_stride;
+	job.rows = rows;
+	job.cols = cols;
+	job.channels = channels;
+	job.krows = krows;
+	job.kcols = kcols;
+	job.edge = edge;
+
+	column = (double *)malloc(sizeof(double) * (krows + kcols + krows * kcols));
+	job.vweight = (int *)malloc(sizeof(int) * (krows + krows * kcols));
+	if (column == NULL || job.vweight == NULL)
+	{
+		printf("Error allocating convolution kernel\n");
+		exit(1);
+	}
+	row = column + krows;
+	weight = row + kcols;
+	job.hweight = job.vweight + krows;
+
+	job.separable = separate_kernel(kernel, krows, kcols, column, row);
+	if (job.separable)
+	{
+		csum = rsum = 0.0;
+		for (i = 0; i < krows; i++)
+			csum += fabs(column[i]);
+		for (i = 0; i < kcols; i++)
+			rsum += fabs(row[i]);
+		total = csum * rsum;
+	}
+	else
+	{
+		total = 0.0;
+		for (i = 0; i < krows * kcols; i++)
+		{
+			weight[i] = kernel[i];
+			total += fabs(weight[i]);
+		}
+	}
+
+	/* the largest possible sum, the bias and the rounding must fit in an
+	   int; 256 rather than 255 leaves room for rounded weights */
+	for (bits = CONV_MAX_BITS; bits > 0; bits--)
+		if ((256.0 * total + fabs(bias) + 1.0) * (double)(1L << bits) < 2147483647.0)
+			break;
+
+	if (job.separable)
+	{
+		vbits = bits / 2;
+		quantize_weights(column, krows, vbits, job.vweight);
+		quantize_weights(row, kcols, bits - vbits, job.hweight);
+	}
+	else
+		quantize_weights(weight, krows * kcols, bits, job.hweight);
+	free(column);
+
+	job.shift = bits;
+	job.bias = (int)floor(bias * (double)(1L << bits) + 0.5);
+	if (bits > 0)
+		job.bias += 1 << (bits - 1);
+
+	job.vpass = conv_vpass_scalar;
+	job.hpass = conv_hpass_scalar;
+	job.store = conv_store_scalar;
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+	{
+		job.vpass = conv_vpass_sse41;
+		job.hpass = conv_hpass_sse41;
+		job.store = conv_store_sse41;
+	}
+	if (cpu & IP_CPU_AVX2)
+	{
+		job.vpass = conv_vpass_avx2;
+		job.hpass = conv_hpass_avx2;
+		job.store = conv_store_avx2;
+	}
+#endif
+
+	/* a tile keeps krows source pieces and two rows of sums */
+	ip_run_tiles(rows, cols, CONV_ROWS, ip_tile_cols(cols,
+		(krows + 2 * sizeof(int)) * channels, kcols - 1), conv_task, &job);
+
+	free(job.vweight);
+}
+
+/***************************************************************************
+ * Func: convolve                                                          *
+ *                                                                         *
+ * Desc: filters an image with a krows x kcols kernel. out(y, x) = bias +  *
+ *       sum kernel[i][j] * in(y + i - krows / 2, x + j - kcols / 2),      *
+ *       rounded and clipped to 0 .. 255; PPM channels are filtered one    *
+ *       by one. a kernel that is a column times a row runs as two 1-D     *
+ *       passes. weights are turned into fixed point with as many          *
+ *       fraction bits as the kernel's total weight leaves room for        *
+ *                                                                         *
+ * Params: in - source image                                               *
+ *         out - filtered image, NULL to allocate one; not in itself       *
+ *         rows, cols - size of the image                                  *
+ *         type - 5 = PGM   6 = PPM                                        *
+ *         kernel - krows * kcols weights, row by row                      *
+ *         krows, kcols - kernel size                                      *
+ *         bias - added to every result, e.g. 128 to show a high pass      *
+ *         edge - EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO                     *
+ *                                                                         *
+ * Returns: the filtered image                                             *
+ ***************************************************************************/
+
+image_ptr convolve(image_ptr in, image_ptr out, int rows, int cols, int type,
+	float *kernel, int krows, int kcols, float bias, int edge)
+{
+	int channels = (type == PPM) ? 3 : 1;
+	long line = (long)cols * channels;  /* bytes in one row */
+
+	if (out == NULL)
+	{
+		out = (image_ptr)IP_MALLOC((unsigned long)rows * line);
+		if (out == NULL)
+		{
+			printf("Unable to malloc output image\n");
+			exit(1);
+		}
+	}
+
+	convolve_rows(in, line, out, line, rows, cols, channels, kernel, krows, kcols,
+		bias, edge);
+	return out;
+}
+
+/* rounded mean of a box sum: sum + half is below 2^24, so the 40-bit
+   reciprocal gives the exact quotient */
+#define BOX_MEAN(sum)  ((unsigned char)(((sum) + half) * inverse >> 40))
+
+/***************************************************************************
+ * Func: box_task                                                          *
+ *                                                                         *
+ * Desc: tile task: box filters tile t. column sums over the box height    *
+ *       are updated by one row in and one row out per output row, and a   *
+ *       running sum across them gives each output, so the cost per pixel  *
+ *       does not grow with the box                                        *
+ ***************************************************************************/
+
+static void box_task(void *arg, ip_tile *t)
+{
+	box_job *job = (box_job *)arg;
+	unsigned char *ring;        /* height + 1 padded source rows */
+	unsigned char *enter, *leave;   /* rows entering and leaving the box */
+	int *colsum;                /* sums down the box, padded row */
+	image_ptr out;              /* current output row */
+	unsigned int sum;           /* sum over the box */
+	unsigned int half;          /* rounds the mean */
+	unsigned long long inverse; /* reciprocal of the box area */
+	int slots;                  /* rows in the ring */
+	int width, n, step;         /* samples in a padded and an output row */
+	int ay, ax;                 /* box anchor */
+	int x0, count;              /* source columns of the tile and halo */
+	int y0, y1;                 /* rows of the tile */
+	int span;                   /* samples across the box */
+	int y, c, k, i;
+
+	y0 = t->y0;
+	y1 = t->y1;
+	ay = job->height / 2;
+	ax = job->width / 2;
+	x0 = t->x0 - ax;
+	count = t->x1 - t->x0 + job->width - 1;
+	step = job->channels;
+	n = (t->x1 - t->x0) * step;
+	width = count * step;
+	slots = job->height + 1;
+	half = job->width * job->height / 2;
+	inverse = job->inverse;
+	span = job->width * step;
+
+	ring = (unsigned char *)malloc(width * slots);
+	colsum = (int *)malloc(sizeof(int) * width);
+	if (ring == NULL || colsum == NULL)
+	{
+		printf("Error allocating box filter rows\n");
+		exit(1);
+	}
+
+	/* source row y lives in slot (y + slots) mod slots */
+	memset(colsum, 0, sizeof(int) * width);
+	for (k = y0 - ay; k < y0 - ay + job->height; k++)
+	{
+		enter = ring + width * ((k + slots) % slots);
+		pad_row(job->in, job->in_stride, k, job->rows, job->cols, step, x0,
+			count, job->edge, enter);
+		for (i = 0; i < width; i++)
+			colsum[i] += enter[i];
+	}
+
+	for (y = y0; y < y1; y++)
+	{
+		out = job->out + y * job->out_stride + t->x0 * step;
+		for (c = 0; c < step; c++)
+		{
+			sum = 0;
+			for (k = 0; k < job->width; k++)
+				sum += colsum[c + k * step];
+			out[c] = BOX_MEAN(sum);
+			for (i = c + step; i < n; i += step)
+			{
+				sum += colsum[i - step + span] - colsum[i - step];
+				out[i] = BOX_MEAN(sum);
+			}
+		}
+
+		/* slide the box down a row */
+		if (y + 1 < y1)
+		{
+			k = y + 1 - ay + job->height - 1;
+			enter = ring + width * ((k + slots) % slots);
+			leave = ring + width * ((y - ay + slots) % slots);
+			pad_row(job->in, job->in_stride, k, job->rows, job->cols, step, x0,
+				count, job->edge, enter);
+			for (i = 0; i < width; i++)
+				colsum[i] += enter[i] - leave[i];
+		}
+	}
+
+	free(ring);
+	free(colsum);
+}
+
+/***************************************************************************
+ * Func: box_rows                                                          *
+ *                                                                         *
+ * Desc: the engine behind box_filter and box_filter_desc, for rows any    *
+ *       number of bytes apart                                             *
+ *                                                                         *
+ * Params: in, in_stride - source image and bytes between its rows         *
+ *         out, out_stride - filtered image and bytes between its rows     *
+ *         rows, cols, channels - size of the image                        *
+ *         others as box_filter                                            *
+ ***************************************************************************/
+
+static void box_rows(image_ptr in, long in_stride, image_ptr out,
+	long out_stride, int rows, int cols, int channels, int width, int height,
+	int edge)
+{
+	box_job job;                /* box shared by the tasks */
+
+	if (width < 1 || height < 1 || width * height > 65536)
+	{
+		printf("box_filter: %d x %d box is out of range\n", width, height);
+		exit(1);
+	}
+
+	job.in = in;
+	job.out = out;
+	job.in_stride = in_stride;
+	job.out_stride = out_stride;
+	job.rows = rows;
+	job.cols = cols;
+	job.channels = channels;
+	job.width = width;
+	job.height = height;
+	job.inverse = (1ULL << 40) / (width * height) + 1;
+	job.edge = edge;
+
+	/* a tile keeps height + 1 source pieces and a row of column sums */
+	ip_run_tiles(rows, cols, CONV_ROWS, ip_tile_cols(cols,
+		(height + 1 + sizeof(int)) * channels, width - 1), box_task, &job);
+}
+
+/***************************************************************************
+ * Func: box_filter                                                        *
+ *                                                                         *
+ * Desc: replaces every sample by the rounded mean of a width x height     *
+ *       box around it, anchored like convolve. running sums make the      *
+ *       cost the same for any box size                                    *
+ *                                                                         *
+ * Params: in - source image                                               *
+ *         out - filtered image, NULL to allocate one; not in itself       *
+ *         rows, cols - size of the image                                  *
+ *         type - 5 = PGM   6 = PPM                                        *
+ *         width, height - box size                                        *
+ *         edge - EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO                     *
+ *                                                                         *
+ * Returns: the filtered image                                             *
+ ***************************************************************************/
+
+image_ptr box_filter(image_ptr in, image_ptr out, int rows, int cols, int type,
+	int width, int height, int edge)
+{
+	int channels = (type == PPM) ? 3 : 1;
+	long line = (long)cols * channels;  /* bytes in one row */
+
+	if (out == NULL)
+	{
+		out = (image_ptr)IP_MALLOC((unsigned long)rows * line);
+		if (out == NULL)
+		{
+			printf("Unable to malloc output image\n");
+			exit(1);
+		}
+	}
+
+	box_rows(in, line, out, line, rows, cols, channels, width, height, edge);
+	return out;
+}
+
+/***************************************************************************
+ * Func: extreme_row                                                       *
+ *                                                                         *
+ * Desc: folds a row into a running minimum or maximum, acc[i] =           *
+ *       min(acc[i], src[i]) for GREY_ERODE, max for GREY_DILATE           *
+ *                                                                         *
+ * Params: acc - n samples to update                                       *
+ *         src - n samples folded in                                       *
+ *         n - samples in a row                                            *
+ *         op - GREY_ERODE or GREY_DILATE                                  *
+ ***************************************************************************/
+
+static void extreme_row(unsigned char *acc, unsigned char *src, int n, int op)
+{
+	int i;                      /* sample index */
+
+	if (op == GREY_ERODE)
+	{
+		for (i = 0; i < n; i++)
+			acc[i] = MIN(acc[i], src[i]);
+	}
+	else
+	{
+		for (i = 0; i < n; i++)
+			acc[i] = MAX(acc[i], src[i]);
+	}
+}
+
+/***************************************************************************
+ * Func: grey_task                                                         *
+ *                                                                         *
+ * Desc: tile task: erodes or dilates tile t. the source pieces under the  *
+ *       tile and its halo are kept in a ring of height; each output row   *
+ *       takes the extreme down the ring, then across the rectangle        *
+ ***************************************************************************/
+
+static void grey_task(void *arg, ip_tile *t)
+{
+	grey_job *job = (grey_job *)arg;
+	unsigned char *ring;        /* height padded source pieces */
+	unsigned char *column;      /* extremes down the rectangle */
+	image_ptr out;              /* current output row */
+	int slots;                  /* rows in the ring */
+	int width, n, step;         /* samples in a padded and an output row */
+	int ay, ax;                 /* rectangle anchor */
+	int x0, count;              /* source columns of the tile and halo */
+	int y, k;
+
+	ay = job->height / 2;
+	ax = job->width / 2;
+	x0 = t->x0 - ax;
+	count = t->x1 - t->x0 + job->width - 1;
+	step = job->channels;
+	n = (t->x1 - t->x0) * step;
+	width = count * step;
+	slots = job->height;
+
+	ring = (unsigned char *)malloc(width * slots);
+	column = (unsigned char *)malloc(width);
+	if (ring == NULL || column == NULL)
+	{
+		printf("Error allocating morphology rows\n");
+		exit(1);
+	}
+
+	/* source row y lives in slot (y + slots) mod slots */
+	for (k = t->y0 - ay; k < t->y0 - ay + slots - 1; k++)
+		pad_row(job->in, job->in_stride, k, job->rows, job->cols, step, x0,
+			count, job->edge, ring + width * ((k + slots) % slots));
+
+	for (y = t->y0; y < t->y1; y++)
+	{
+		k = y - ay + slots - 1;
+		pad_row(job->in, job->in_stride, k, job->rows, job->cols, step, x0,
+			count, job->edge, ring + width * ((k + slots) % slots));
+
+		memcpy(column, ring, width);
+		for (k = 1; k < slots; k++)
+			extreme_row(column, ring + width * k, width, job->op);
+
+		out = job->out + y * job->out_stride + t->x0 * step;
+		memcpy(out, column, n);
+		for (k = 1; k < job->width; k++)
+			extreme_row(out, column + k * step, n, job->op);
+	}
+
+	free(ring);
+	free(column);
+}
+
+/***************************************************************************
+ * Func: grey_rows                                                         *
+ *                                                                         *
+ * Desc: the engine behind grey_morphology and grey_morphology_desc, for   *
+ *       rows any number of bytes apart                                    *
+ *                                                                         *
+ * Params: in, in_stride - source image and bytes between its rows         *
+ *         out, out_stride - filtered image and bytes between its rows     *
+ *         rows, cols, channels - size of the image                        *
+ *         others as grey_morphology                                       *
+ ***************************************************************************/
+
+static void grey_rows(image_ptr in, long in_stride, image_ptr out,
+	long out_stride, int rows, int cols, int channels, int op, int width,
+	int height, int edge)
+{
+	grey_job job;               /* rectangle shared by the tasks */
+
+	if (width < 1 || height < 1)
+	{
+		printf("grey_morphology: %d x %d rectangle is out of range\n", width,
+			height);
+		exit(1);
+	}
+	if (op != GREY_ERODE && op != GREY_DILATE)
+	{
+		printf("grey_morphology: unknown operation %d\n", op);
+		exit(1);
+	}
+
+	job.in = in;
+	job.out = out;
+	job.in_stride = in_stride;
+	job.out_stride = out_stride;
+	job.rows = rows;
+	job.cols = cols;
+	job.channels = channels;
+	job.width = width;
+	job.height = height;
+	job.op = op;
+	job.edge = edge;
+
+	/* a tile keeps height source pieces and a row of extremes */
+	ip_run_tiles(rows, cols, CONV_ROWS, ip_tile_cols(cols,
+		(height + 1) * channels, width - 1), grey_task, &job);
+}
+
+/***************************************************************************
+ * Func: grey_morphology                                                   *
+ *                                                                         *
+ * Desc: grey level erosion or dilation with a flat width x height         *
+ *       rectangle, anchored like convolve: every sample is replaced by    *
+ *       the smallest (GREY_ERODE) or largest (GREY_DILATE) sample of the  *
+ *       rectangle around it. PPM channels are done one by one. erosion    *
+ *       with EDGE_ZERO darkens the border, so EDGE_CLAMP is the usual     *
+ *       mode                                                              *
+ *                                                                         *
+ * Params: in - source image                                               *
+ *         out - filtered image, NULL to allocate one; not in itself       *
+ *         rows, cols - size of the image                                  *
+ *         type - 5 = PGM   6 = PPM                                        *
+ *         op - GREY_ERODE or GREY_DILATE                                  *
+ *         width, height - rectangle size                                  *
+ *         edge - EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO                     *
+ *                                                                         *
+ * Returns: the filtered image                                             *
+ ***************************************************************************/
+
+image_ptr grey_morphology(image_ptr in, image_ptr out, int rows, int cols,
+	int type, int op, int width, int height, int edge)
+{
+	int channels = (type == PPM) ? 3 : 1;
+	long line = (long)cols * channels;  /* bytes in one row */
+
+	if (out == NULL)
+	{
+		out = (image_ptr)IP_MALLOC((unsigned long)rows * line);
+		if (out == NULL)
+		{
+			printf("Unable to malloc output image\n");
+			exit(1);
+		}
+	}
+
+	grey_rows(in, line, out, line, rows, cols, channels, op, width, height,
+		edge);
+	return out;
+}
+
+/***************************************************************************
+ * Func: convolve_desc                                                     *
+ *                                                                         *
+ * Desc: convolve for image descriptors, so a window of a larger image or  *
+ *       rows with padding are filtered where they lie. a planar image is  *
+ *       filtered plane by plane. samples outside in are never read; the   *
+ *       edge mode supplies them as at the border of a whole image         *
+ *                                                                         *
+ * Params: in - source image, 8 bits per sample                            *
+ *         out - filtered image of the same size and layout; not in itself *
+ *         others as convolve                                              *
+ ***************************************************************************/
+
+void convolve_desc(image_desc *in, image_desc *out, float *kernel, int krows,
+	int kcols, float bias, int edge)
+{
+	image_desc src, dst;        /* one plane of each */
+	int k;
+
+	match_images(in, out, 8, "convolve_desc");
+	for (k = 0; k < image_planes(in); k++)
+	{
+		src = image_plane(in, k);
+		dst = image_plane(out, k);
+		convolve_rows(src.data, src.stride, dst.data, dst.stride, src.height,
+			src.width, src.channels, kernel, krows, kcols, bias, edge);
+	}
+}
+
+/***************************************************************************
+ * Func: box_filter_desc                                                   *
+ *                                                                         *
+ * Desc: box_filter for image descriptors; see convolve_desc               *
+ *                                                                         *
+ * Params: in - source image, 8 bits per sample                            *
+ *         out - filtered image of the same size and layout; not in itself *
+ *         width, height - box size                                        *
+ *         edge - EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO                     *
+ ***************************************************************************/
+
+void box_filter_desc(image_desc *in, image_desc *out, int width, int height,
+	int edge)
+{
+	image_desc src, dst;        /* one plane of each */
+	int k;
+
+	match_images(in, out, 8, "box_filter_desc");
+	for (k = 0; k < image_planes(in); k++)
+	{
+		src = image_plane(in, k);
+		dst = image_plane(out, k);
+		box_rows(src.data, src.stride, dst.data, dst.stride, src.height,
+			src.width, src.channels, width, height, edge);
+	}
+}
+
+/***************************************************************************
+ * Func: grey_morphology_desc                                              *
+ *                                                                         *
+ * Desc: grey_morphology for image descriptors; see convolve_desc          *
+ *                                                                         *
+ * Params: in - source image, 8 bits per sample                            *
+ *         out - filtered image of the same size and layout; not in itself *
+ *         op - GREY_ERODE or GREY_DILATE                                  *
+ *         width, height - rectangle size                                  *
+ *         edge - EDGE_CLAMP, EDGE_MIRROR or EDGE_ZERO                     *
+ ***************************************************************************/
+
+void grey_morphology_desc(image_desc *in, image_desc *out, int op, int width,
+	int height, int edge)
+{
+	image_desc src, dst;        /* one plane of each */
+	int k;
+
+	match_images(in, out, 8, "grey_morphology_desc");
+	for (k = 0; k < image_planes(in); k++)
+	{
+		src = image_plane(in, k);
+		dst = image_plane(out, k);
+		grey_rows(src.data, src.stride, dst.data, dst.stride, src.height,
+			src.width, src.channels, op, width, height, edge);
+	}
+}
@@ -0,0 +1,819 @@
+/***************************************************************************
+ * File: ipfft.c                                                           *
+ *                                                                         *
+ * Desc: fast Fourier transforms of any length, 2-D transforms of real     *
+ *       images and the frequency domain filters built on them. lengths    *
+ *       are split into radix 4, 2, 3 and 5 stages, with other primes      *
+ *       done as small DFTs, and each stage reads its twiddles from a      *
+ *       table built once per length                                       *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* rows or columns transformed by one thread pool task */
+#define FFT_BLOCK  8
+
+/***************************************************************************
+ * Func: fft_plan_new                                                      *
+ *                                                                         *
+ * Desc: splits a length into radix stages and builds its twiddle table.   *
+ *       a plan is only read by fft_run, so threads may share it           *
+ *                                                                         *
+ * Params: n - transform length, 1 or more                                 *
+ *                                                                         *
+ * Returns: the plan, to be freed with fft_plan_free                       *
+ ***************************************************************************/
+
+fft_plan *fft_plan_new(int n)
+{
+	fft_plan *plan;
+	int rest, p;                /* length left to split and its factor */
+	int k;
+
+	if (n < 1)
+	{
+		printf("fft_plan_new: bad length %d\n", n);
+		exit(1);
+	}
+
+	plan = (fft_plan *)malloc(sizeof(fft_plan));
+	if (plan == NULL || (plan->twiddle = (complex_ptr)malloc(sizeof(COMPLEX) * n)) == NULL)
+	{
+		printf("Error allocating FFT plan\n");
+		exit(1);
+	}
+	plan->n = n;
+	plan->stages = 0;
+	plan->max_radix = 1;
+
+	rest = n;
+	while (rest % 4 == 0)
+	{
+		plan->radix[plan->stages++] = 4;
+		rest /= 4;
+	}
+	for (p = 2; rest > 1; p++)
+		while (rest % p == 0)
+		{
+			plan->radix[plan->stages++] = p;
+			rest /= p;
+		}
+	for (k = 0; k < plan->stages; k++)
+		plan->max_radix = MAX(plan->max_radix, plan->radix[k]);
+
+	for (k = 0; k < n; k++)
+	{
+		plan->twiddle[k].re = cos(2.0 * PI * k / n);
+		plan->twiddle[k].im = -sin(2.0 * PI * k / n);
+	}
+	return plan;
+}
+
+/***************************************************************************
+ * Func: fft_plan_free                                                     *
+ *                                                                         *
+ * Desc: frees a plan from fft_plan_new                                    *
+ ***************************************************************************/
+
+void fft_plan_free(fft_plan *plan)
+{
+	free(plan->twiddle);
+	free(plan);
+}
+
+/* d = x * w, x times a twiddle */
+#define CMUL(d, x, w) \
+	{ (d).re = (x).re * (w).re - (x).im * (w).im; \
+	  (d).im = (x).re * (w).im + (x).im * (w).re; }
+
+/***************************************************************************
+ * Func: radix2, radix3, radix4, radix5, radix_any                         *
+ *                                                                         *
+ * Desc: one radix r pass of a Stockham FFT. the current sub-transforms    *
+ *       have length len and are interleaved with stride s; each group of  *
+ *       r inputs len / r apart goes through an r-point DFT and comes out  *
+ *       next to each other, output j multiplied by twiddle p * j * s. no  *
+ *       bit reversal is needed afterwards. radix_any does any other       *
+ *       prime as a plain DFT off the twiddle table                        *
+ *                                                                         *
+ * Params: plan - twiddles of the whole length                             *
+ *         len - length of the sub-transforms                              *
+ *         s - their stride                                                *
+ *         x - input                                                       *
+ *         y - output                                                      *
+ *         r, a - radix and r scratch values, radix_any only               *
+ ***************************************************************************/
+
+static void radix2(fft_plan *plan, int len, int s, complex_ptr x, complex_ptr y)
+{
+	COMPLEX w1, a0, a1, d;
+	int m = len / 2;            /* distance between butterfly inputs */
+	int p, q;                   /* butterfly group and interleave */
+
+	for (p = 0; p < m; p++)
+	{
+		w1 = plan->twiddle[p * s];
+		for (q = 0; q < s; q++)
+		{
+			a0 = x[q + s * p];
+			a1 = x[q + s * (p + m)];
+			y[q + s * 2 * p].re = a0.re + a1.re;
+			y[q + s * 2 * p].im = a0.im + a1.im;
+			d.re = a0.re - a1.re;
+			d.im = a0.im - a1.im;
+			CMUL(y[q + s * (2 * p + 1)], d, w1);
+		}
+	}
+}
+
+static void radix3(fft_plan *plan, int len, int s, complex_ptr x, complex_ptr y)
+{
+	COMPLEX w1, w2, a0, a1, a2, t0, t1, t2, d;
+	int m = len / 3;            /* distance between butterfly inputs */
+	int p, q;                   /* butterfly group and interleave */
+
+	for (p = 0; p < m; p++)
+	{
+		w1 = plan->twiddle[p * s];
+		w2 = plan->twiddle[2 * p * s];
+		for (q = 0; q < s; q++)
+		{
+			a0 = x[q + s * p];
+			a1 = x[q + s * (p + m)];
+			a2 = x[q + s * (p + 2 * m)];
+
+			/* cos(2 pi / 3) = -1/2, sin(2 pi / 3) = sqrt(3) / 2 */
+			t0.re = a1.re + a2.re;
+			t0.im = a1.im + a2.im;
+			t1.re = a0.re - 0.5 * t0.re;
+			t1.im = a0.im - 0.5 * t0.im;
+			t2.re = 0.86602540378443865 * (a1.im - a2.im);
+			t2.im = 0.86602540378443865 * (a2.re - a1.re);
+
+			y[q + s * 3 * p].re = a0.re + t0.re;
+			y[q + s * 3 * p].im = a0.im + t0.im;
+			d.re = t1.re + t2.re;
+			d.im = t1.im + t2.im;
+			CMUL(y[q + s * (3 * p + 1)], d, w1);
+			d.re = t1.re - t2.re;
+			d.im = t1.im - t2.im;
+			CMUL(y[q + s * (3 * p + 2)], d, w2);
+		}
+	}
+}
+
+static void radix4(fft_plan *plan, int len, int s, complex_ptr x, complex_ptr y)
+{
+	COMPLEX w1, w2, w3, a0, a1, a2, a3, t0, t1, t2, t3, d;
+	int m = len / 4;            /* distance between butterfly inputs */
+	int p, q;                   /* butterfly group and interleave */
+
+	for (p = 0; p < m; p++)
+	{
+		w1 = plan->twiddle[p * s];
+		w2 = plan->twiddle[2 * p * s];
+		w3 = plan->twiddle[3 * p * s];
+		for (q = 0; q < s; q++)
+		{
+			a0 = x[q + s * p];
+			a1 = x[q + s * (p + m)];
+			a2 = x[q + s * (p + 2 * m)];
+			a3 = x[q + s * (p + 3 * m)];
+
+			t0.re = a0.re + a2.re;
+			t0.im = a0.im + a2.im;
+			t1.re = a0.re - a2.re;
+			t1.im = a0.im - a2.im;
+			t2.re = a1.re + a3.re;
+			t2.im = a1.im + a3.im;
+			/* (a1 - a3) * -i */
+			t3.re = a1.im - a3.im;
+			t3.im = a3.re - a1.re;
+
+			y[q + s * 4 * p].re = t0.re + t2.re;
+			y[q + s * 4 * p].im = t0.im + t2.im;
+			d.re = t1.re + t3.re;
+			d.im = t1.im + t3.im;
+			CMUL(y[q + s * (4 * p + 1)], d, w1);
+			d.re = t0.re - t2.re;
+			d.im = t0.im - t2.im;
+			CMUL(y[q + s * (4 * p + 2)], d, w2);
+			d.re = t1.re - t3.re;
+			d.im = t1.im - t3.im;
+			CMUL(y[q + s * (4 * p + 3)], d, w3);
+		}
+	}
+}
+
+static void radix5(fft_plan *plan, int len, int s, complex_ptr x, complex_ptr y)
+{
+	/* cosines and sines of 2 pi / 5 and 4 pi / 5 */
+	const double c1 = 0.30901699437494742, c2 = -0.80901699437494742;
+	const double s1 = 0.95105651629515357, s2 = 0.58778525229247313;
+	COMPLEX w1, w2, w3, w4, a0, a1, a2, a3, a4;
+	COMPLEX t1, t2, t3, t4, m1, m2, n1, n2, d;
+	int m = len / 5;            /* distance between butterfly inputs */
+	int p, q;                   /* butterfly group and interleave */
+
+	for (p = 0; p < m; p++)
+	{
+		w1 = plan->twiddle[p * s];
+		w2 = plan->twiddle[2 * p * s];
+		w3 = plan->twiddle[3 * p * s];
+		w4 = plan->twiddle[4 * p * s];
+		for (q = 0; q < s; q++)
+		{
+			a0 = x[q + s * p];
+			a1 = x[q + s * (p + m)];
+			a2 = x[q + s * (p + 2 * m)];
+			a3 = x[q + s * (p + 3 * m)];
+			a4 = x[q + s * (p + 4 * m)];
+
+			t1.re = a1.re + a4.re;  t1.im = a1.im + a4.im;
+			t2.re = a2.re + a3.re;  t2.im = a2.im + a3.im;
+			t3.re = a1.re - a4.re;  t3.im = a1.im - a4.im;
+			t4.re = a2.re - a3.re;  t4.im = a2.im - a3.im;
+			m1.re = a0.re + c1 * t1.re + c2 * t2.re;
+			m1.im = a0.im + c1 * t1.im + c2 * t2.im;
+			m2.re = a0.re + c2 * t1.re + c1 * t2.re;
+			m2.im = a0.im + c2 * t1.im + c1 * t2.im;
+			/* -i (s1 t3 + s2 t4) and -i (s2 t3 - s1 t4) */
+			n1.re = s1 * t3.im + s2 * t4.im;
+			n1.im = -(s1 * t3.re + s2 * t4.re);
+			n2.re = s2 * t3.im - s1 * t4.im;
+			n2.im = s1 * t4.re - s2 * t3.re;
+
+			y[q + s * 5 * p].re = a0.re + t1.re + t2.re;
+			y[q + s * 5 * p].im = a0.im + t1.im + t2.im;
+			d.re = m1.re + n1.re;
+			d.im = m1.im + n1.im;
+			CMUL(y[q + s * (5 * p + 1)], d, w1);
+			d.re = m2.re + n2.re;
+			d.im = m2.im + n2.im;
+			CMUL(y[q + s * (5 * p + 2)], d, w2);
+			d.re = m2.re - n2.re;
+			d.im = m2.im - n2.im;
+			CMUL(y[q + s * (5 * p + 3)], d, w3);
+			d.re = m1.re - n1.re;
+			d.im = m1.im - n1.im;
+			CMUL(y[q + s * (5 * p + 4)], d, w4);
+		}
+	}
+}
+
+static void radix_any(fft_plan *plan, int r, int len, int s, complex_ptr x,
+	complex_ptr y, complex_ptr a)
+{
+	complex_ptr tw = plan->twiddle;
+	COMPLEX d, w;
+	int m = len / r;            /* distance between butterfly inputs */
+	int step = plan->n / r;     /* table step of the r-th roots of unity */
+	int p, q, j, k;             /* group, interleave, output and input */
+	int idx;                    /* j * k mod r */
+
+	for (p = 0; p < m; p++)
+		for (q = 0; q < s; q++)
+		{
+			for (k = 0; k < r; k++)
+				a[k] = x[q + s * (p + k * m)];
+			for (j = 0; j < r; j++)
+			{
+				d.re = d.im = 0.0;
+				for (k = 0, idx = 0; k < r; k++, idx += j)
+				{
+					if (idx >= r)
+						idx -= r;
+					w = tw[idx * step];
+					d.re += a[k].re * w.re - a[k].im * w.im;
+					d.im += a[k].re * w.im + a[k].im * w.re;
+				}
+				CMUL(y[q + s * (r * p + j)], d, tw[p * j * s]);
+			}
+		}
+}
+
+/***************************************************************************
+ * Func: fft_run                                                           *
+ *                                                                         *
+ * Desc: transforms data in place. the forward transform is X[k] = sum     *
+ *       x[j] exp(-2 pi i jk / n); the inverse uses the opposite sign and  *
+ *       divides by n, so it undoes the forward transform                  *
+ *                                                                         *
+ * Params: plan - plan of the length                                       *
+ *         data - n values                                                 *
+ *         work - n + plan->max_radix scratch values                       *
+ *         inverse - 0 for the forward transform, 1 for the inverse        *
+ ***************************************************************************/
+
+void fft_run(fft_plan *plan, complex_ptr data, complex_ptr work, int inverse)
+{
+	complex_ptr src, dst, tmp;  /* stage input and output */
+	int n = plan->n;
+	int len, s;                 /* sub-transform length and stride */
+	int i;
+
+	/* the inverse is the conjugate of the forward transform of the
+	   conjugate */
+	if (inverse)
+		for (i = 0; i < n; i++)
+			data[i].im = -data[i].im;
+
+	src = data;
+	dst = work;
+	len = n;
+	s = 1;
+	for (i = 0; i < plan->stages; i++)
+	{
+		switch (plan->radix[i])
+		{
+		case 2:
+			radix2(plan, len, s, src, dst);
+			break;
+		case 3:
+			radix3(plan, len, s, src, dst);
+			break;
+		case 4:
+			radix4(plan, len, s, src, dst);
+			break;
+		case 5:
+			radix5(plan, len, s, src, dst);
+			break;
+		default:
+			radix_any(plan, plan->radix[i], len, s, src, dst, work + n);
+		}
+		len /= plan->radix[i];
+		s *= plan->radix[i];
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	if (src != data)
+		memcpy(data, src, sizeof(COMPLEX) * n);
+
+	if (inverse)
+		for (i = 0; i < n; i++)
+		{
+			data[i].re /= n;
+			data[i].im = -data[i].im / n;
+		}
+}
+
+/***************************************************************************
+ * Func: fft_good_size                                                     *
+ *                                                                         *
+ * Desc: smallest length of at least n with no prime factor above 5, the   *
+ *       lengths the radix 2, 3, 4 and 5 stages handle fastest             *
+ ***************************************************************************/
+
+int fft_good_size(int n)
+{
+	int m;                      /* candidate with its small factors removed */
+
+	for (;; n++)
+	{
+		m = n;
+		while (m % 2 == 0)
+			m /= 2;
+		while (m % 3 == 0)
+			m /= 3;
+		while (m % 5 == 0)
+			m /= 5;
+		if (m == 1)
+			return n;
+	}
+}
+
+/* state shared by the tasks of the 2-D transforms */
+
+typedef struct
+    {
+    int rows;
+    int cols;
+    int half;               /* cols / 2 + 1 columns of the spectrum */
+    double_ptr image;       /* rows * cols real samples */
+    complex_ptr spec;       /* rows * half spectrum values */
+    fft_plan *row_plan;     /* length cols */
+    fft_plan *col_plan;     /* length rows */
+    } fft2d_job;
+
+/***************************************************************************
+ * Func: fft_scratch                                                       *
+ *                                                                         *
+ * Desc: allocates count transforms' worth of values plus the scratch      *
+ *       fft_run needs                                                     *
+ ***************************************************************************/
+
+static complex_ptr fft_scratch(fft_plan *plan, int count)
+{
+	complex_ptr buf;
+
+	buf = (complex_ptr)malloc(sizeof(COMPLEX) * (plan->n * (count + 1) + plan->max_radix));
+	if (buf == NULL)
+	{
+		printf("Error allocating FFT buffers\n");
+		exit(1);
+	}
+	return buf;
+}
+
+/***************************************************************************
+ * Func: row_forward_task                                                  *
+ *                                                                         *
+ * Desc: thread pool task: transforms rows 2 * FFT_BLOCK * index on. two   *
+ *       real rows go through one complex transform as its real and        *
+ *       imaginary parts and are told apart by their symmetry:             *
+ *       A[k] = (Z[k] + conj Z[n - k]) / 2, B[k] = (Z[k] - conj Z[n - k])  *
+ *       / 2i. only the half + 1 columns up to n / 2 are kept              *
+ ***************************************************************************/
+
+static void row_forward_task(void *arg, int index)
+{
+	fft2d_job *job = (fft2d_job *)arg;
+	complex_ptr z, work;        /* packed pair of rows and fft scratch */
+	complex_ptr a, b;           /* spectrum rows of the pair */
+	double_ptr ra, rb;          /* the real rows */
+	COMPLEX zk, zn;             /* Z[k] and conj Z[n - k] */
+	int n = job->cols;
+	int y, y1, k;
+
+	z = fft_scratch(job->row_plan, 1);
+	work = z + n;
+
+	y = index * 2 * FFT_BLOCK;
+	y1 = MIN(y + 2 * FFT_BLOCK, job->rows);
+	for (; y < y1; y += 2)
+	{
+		ra = job->image + (unsigned long)y * n;
+		rb = (y + 1 < y1) ? ra + n : NULL;
+		for (k = 0; k < n; k++)
+		{
+			z[k].re = ra[k];
+			z[k].im = (rb != NULL) ? rb[k] : 0.0;
+		}
+		fft_run(job->row_plan, z, work, 0);
+
+		a = job->spec + (unsigned long)y * job->half;
+		b = a + job->half;
+		for (k = 0; k < job->half; k++)
+		{
+			zk = z[k];
+			zn.re = z[k ? n - k : 0].re;
+			zn.im = -z[k ? n - k : 0].im;
+			a[k].re = 0.5 * (zk.re + zn.re);
+			a[k].im = 0.5 * (zk.im + zn.im);
+			if (rb != NULL)
+			{
+				b[k].re = 0.5 * (zk.im - zn.im);
+				b[k].im = 0.5 * (zn.re - zk.re);
+			}
+		}
+	}
+	free(z);
+}
+
+/***************************************************************************
+ * Func: row_inverse_task                                                  *
+ *                                                                         *
+ * Desc: thread pool task: the inverse of row_forward_task. the two half   *
+ *       spectra are completed by symmetry and packed as Z = A + iB, so    *
+ *       one inverse transform gives both real rows                        *
+ ***************************************************************************/
+
+static void row_inverse_task(void *arg, int index)
+{
+	fft2d_job *job = (fft2d_job *)arg;
+	complex_ptr z, work;        /* packed pair of rows and fft scratch */
+	complex_ptr a, b;           /* spectrum rows of the pair */
+	COMPLEX ak, bk;             /* A[k] and B[k] over the whole row */
+	double_ptr ra;              /* first real row */
+	int n = job->cols;
+	int y, y1, k, pair;
+
+	z = fft_scratch(job->row_plan, 1);
+	work = z + n;
+
+	y = index * 2 * FFT_BLOCK;
+	y1 = MIN(y + 2 * FFT_BLOCK, job->rows);
+	for (; y < y1; y += 2)
+	{
+		pair = (y + 1 < y1);
+		a = job->spec + (unsigned long)y * job->half;
+		b = a + job->half;
+		bk.re = bk.im = 0.0;
+		for (k = 0; k < n; k++)
+		{
+			if (k < job->half)
+			{
+				ak = a[k];
+				if (pair)
+					bk = b[k];
+			}
+			else
+			{
+				ak.re = a[n - k].re;
+				ak.im = -a[n - k].im;
+				if (pair)
+				{
+					bk.re = b[n - k].re;
+					bk.im = -b[n - k].im;
+				}
+			}
+			z[k].re = ak.re - bk.im;
+			z[k].im = ak.im + bk.re;
+		}
+		fft_run(job->row_plan, z, work, 1);
+
+		ra = job->image + (unsigned long)y * n;
+		for (k = 0; k < n; k++)
+		{
+			ra[k] = z[k].re;
+			if (pair)
+				ra[n + k] = z[k].im;
+		}
+	}
+	free(z);
+}
+
+/***************************************************************************
+ * Func: column_task                                                       *
+ *                                                                         *
+ * Desc: thread pool task: transforms spectrum columns FFT_BLOCK * index   *
+ *       on. the block is gathered a row at a time, so every spectrum row  *
+ *       is read and written in one contiguous piece                       *
+ *                                                                         *
+ * Params: job - spectrum and plans                                        *
+ *         index - block of columns                                        *
+ *         inverse - 0 for the forward transform, 1 for the inverse        *
+ ***************************************************************************/
+
+static void column_task(fft2d_job *job, int index, int inverse)
+{
+	complex_ptr buf, work;      /* FFT_BLOCK columns and fft scratch */
+	complex_ptr row;            /* spectrum row */
+	int n = job->rows;
+	int x0, width;              /* first column and columns in the block */
+	int x, y;
+
+	buf = fft_scratch(job->col_plan, FFT_BLOCK);
+	work = buf + FFT_BLOCK * n;
+	x0 = index * FFT_BLOCK;
+	width = MIN(FFT_BLOCK, job->half - x0);
+
+	for (y = 0; y < n; y++)
+	{
+		row = job->spec + (unsigned long)y * job->half + x0;
+		for (x = 0; x < width; x++)
+			buf[x * n + y] = row[x];
+	}
+	for (x = 0; x < width; x++)
+		fft_run(job->col_plan, buf + x * n, work, inverse);
+	for (y = 0; y < n; y++)
+	{
+		row = job->spec + (unsigned long)y * job->half + x0;
+		for (x = 0; x < width; x++)
+			row[x] = buf[x * n + y];
+	}
+	free(buf);
+}
+
+/***************************************************************************
+ * Func: column_forward_task, column_inverse_task                          *
+ *                                                                         *
+ * Desc: thread pool tasks for column_task                                 *
+ ***************************************************************************/
+
+static void column_forward_task(void *arg, int index)
+{
+	column_task((fft2d_job *)arg, index, 0);
+}
+
+static void column_inverse_task(void *arg, int index)
+{
+	column_task((fft2d_job *)arg, index, 1);
+}
+
+/***************************************************************************
+ * Func: fft2d_real                                                        *
+ *                                                                         *
+ * Desc: 2-D transform of a real image. the spectrum of a real image is    *
+ *       conjugate symmetric, so only columns 0 .. cols / 2 are returned;  *
+ *       row u holds vertical frequency u (u - rows above rows / 2)        *
+ *                                                                         *
+ * Params: image - rows * cols samples                                     *
+ *         rows, cols - size of the image                                  *
+ *                                                                         *
+ * Returns: rows * (cols / 2 + 1) spectrum values, row by row              *
+ ***************************************************************************/
+
+complex_ptr fft2d_real(double_ptr image, int rows, int cols)
+{
+	fft2d_job job;              /* plans shared by the tasks */
+
+	job.rows = rows;
+	job.cols = cols;
+	job.half = cols / 2 + 1;
+	job.image = image;
+	job.spec = (complex_ptr)malloc(sizeof(COMPLEX) * rows * job.half);
+	if (job.spec == NULL)
+	{
+		printf("Error allocating spectrum\n");
+		exit(1);
+	}
+	job.row_plan = fft_plan_new(cols);
+	job.col_plan = fft_plan_new(rows);
+
+	ip_parallel_for((rows + 2 * FFT_BLOCK - 1) / (2 * FFT_BLOCK), row_forward_task, &job);
+	ip_parallel_for((job.half + FFT_BLOCK - 1) / FFT_BLOCK, column_forward_task, &job);
+
+	fft_plan_free(job.row_plan);
+	fft_plan_free(job.col_plan);
+	return job.spec;
+}
+
+/***************************************************************************
+ * Func: ifft2d_real                                                       *
+ *                                                                         *
+ * Desc: inverse of fft2d_real                                             *
+ *                                                                         *
+ * Params: spec - rows * (cols / 2 + 1) spectrum values, overwritten       *
+ *         rows, cols - size of the image                                  *
+ *         image - rows * cols samples to fill                             *
+ ***************************************************************************/
+
+void ifft2d_real(complex_ptr spec, int rows, int cols, double_ptr image)
+{
+	fft2d_job job;              /* plans shared by the tasks */
+
+	job.rows = rows;
+	job.cols = cols;
+	job.half = cols / 2 + 1;
+	job.image = image;
+	job.spec = spec;
+	job.row_plan = fft_plan_new(cols);
+	job.col_plan = fft_plan_new(rows);
+
+	ip_parallel_for((job.half + FFT_BLOCK - 1) / FFT_BLOCK, column_inverse_task, &job);
+	ip_parallel_for((rows + 2 * FFT_BLOCK - 1) / (2 * FFT_BLOCK), row_inverse_task, &job);
+
+	fft_plan_free(job.row_plan);
+	fft_plan_free(job.col_plan);
+}
+
+/***************************************************************************
+ * Func: filter_gain                                                       *
+ *                                                                         *
+ * Desc: gain of a low pass filter                                         *
+ *                                                                         *
+ * Params: shape - FILTER_IDEAL, FILTER_BUTTERWORTH or FILTER_GAUSSIAN     *
+ *         q - (frequency / cutoff) squared                                *
+ *         order - order of the Butterworth filter                         *
+ ***************************************************************************/
+
+static double filter_gain(int shape, double q, int order)
+{
+	double power;               /* q ^ order */
+	int k;
+
+	switch (shape)
+	{
+	case FILTER_IDEAL:
+		return (q <= 1.0) ? 1.0 : 0.0;
+	case FILTER_BUTTERWORTH:
+		for (power = 1.0, k = 0; k < order; k++)
+			power *= q;
+		return 1.0 / (1.0 + power);
+	default:
+		return exp(-0.5 * q);
+	}
+}
+
+/***************************************************************************
+ * Func: extend_index                                                      *
+ *                                                                         *
+ * Desc: source row or column of position i of an extended image. the      *
+ *       first half of the extension mirrors the far edge and the second   *
+ *       half the near one, which the transform wraps onto                 *
+ *                                                                         *
+ * Params: i - position in the extended image                              *
+ *         n - rows or columns of the image                                *
+ *         padded - rows or columns of the extended image                  *
+ ***************************************************************************/
+
+static int extend_index(int i, int n, int padded)
+{
+	if (i >= n)
+		i = (i - n < (padded - n) / 2) ? 2 * n - 1 - i : padded - 1 - i;
+	CLIP(i, 0, n - 1);
+	return i;
+}
+
+/***************************************************************************
+ * Func: fft_filter                                                        *
+ *                                                                         *
+ * Desc: low or high pass filters a grey image in the frequency domain.    *
+ *       the image is extended by mirroring to a size the FFT handles      *
+ *       fast, with room for the wrap-around to fall in the extension, and *
+ *       its spectrum multiplied by the filter's gain. the high pass gain  *
+ *       is 1 - the low pass gain and its result is clipped like the low   *
+ *       pass one. the cost does not depend on the cutoff, unlike a        *
+ *       spatial kernel of the same response                               *
+ *                                                                         *
+ * Params: buffer - pointer to image in memory, filtered in place          *
+ *         rows, cols - size of the image                                  *
+ *         shape - FILTER_IDEAL, FILTER_BUTTERWORTH or FILTER_GAUSSIAN     *
+ *         pass - FILTER_LOWPASS or FILTER_HIGHPASS                        *
+ *         cutoff - cutoff frequency in cycles per pixel, 0 .. 0.5         *
+ *         order - order of a Butterworth filter, usually 1 to 4           *
+ ***************************************************************************/
+
+void fft_filter(image_ptr buffer, int rows, int cols, int shape, int pass,
+	double cutoff, int order)
+{
+	double_ptr image;           /* extended image */
+	complex_ptr spec;           /* its spectrum */
+	double *qv, *gv;            /* per spectrum column: q and Gaussian gain */
+	double qu, gu;              /* the same for the current row */
+	double f, gain, v;          /* frequency, gain and filtered sample */
+	image_ptr src;              /* source row of an extended row */
+	double_ptr dst;             /* extended row */
+	int *sx;                    /* source column per extended column */
+	int prows, pcols;           /* extended size */
+	int half;                   /* columns of the spectrum */
+	int x, y;
+
+	if (cutoff <= 0.0)
+	{
+		printf("fft_filter: cutoff %g must be above 0\n", cutoff);
+		exit(1);
+	}
+
+	prows = fft_good_size(rows + rows / 8 + 8);
+	pcols = fft_good_size(cols + cols / 8 + 8);
+	half = pcols / 2 + 1;
+	image = (double_ptr)malloc(sizeof(double) * prows * pcols);
+	qv = (double *)malloc(sizeof(double) * 2 * half);
+	sx = (int *)malloc(sizeof(int) * pcols);
+	if (image == NULL || qv == NULL || sx == NULL)
+	{
+		printf("Error allocating FFT image\n");
+		exit(1);
+	}
+	gv = qv + half;
+
+	for (x = 0; x < pcols; x++)
+		sx[x] = extend_index(x, cols, pcols);
+	for (y = 0; y < prows; y++)
+	{
+		src = buffer + (unsigned long)extend_index(y, rows, prows) * cols;
+		dst = image + (unsigned long)y * pcols;
+		for (x = 0; x < pcols; x++)
+			dst[x] = src[sx[x]];
+	}
+
+	spec = fft2d_real(image, prows, pcols);
+
+	/* the Gaussian is a product of a row and a column gain */
+	for (x = 0; x < half; x++)
+	{
+		f = (double)x / pcols / cutoff;
+		qv[x] = f * f;
+		gv[x] = exp(-0.5 * qv[x]);
+	}
+	for (y = 0; y < prows; y++)
+	{
+		f = (double)((y <= prows / 2) ? y : y - prows) / prows / cutoff;
+		qu = f * f;
+		gu = exp(-0.5 * qu);
+		for (x = 0; x < half; x++)
+		{
+			if (shape == FILTER_GAUSSIAN)
+				gain = gu * gv[x];
+			else
+				gain = filter_gain(shape, qu + qv[x], order);
+			if (pass == FILTER_HIGHPASS)
+				gain = 1.0 - gain;
+			spec[(unsigned long)y * half + x].re *= gain;
+			spec[(unsigned long)y * half + x].im *= gain;
+		}
+	}
+	ifft2d_real(spec, prows, pcols, image);
+
+	for (y = 0; y < rows; y++)
+		for (x = 0; x < cols; x++)
+		{
+			v = floor(image[(unsigned long)y * pcols + x] + 0.5);
+			CLIP(v, 0, 255);
+			buffer[(unsigned long)y * cols + x] = (unsigned char)v;
+		}
+
+	free(spec);
+	free(image);
+	free(qv);
+	free(sx);
+}
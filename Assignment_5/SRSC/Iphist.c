@@ -0,0 +1,793 @@
+/***************************************************************************
+ * File: iphist.c                                                          *
+ *                                                                         *
+ * Desc: grey level histograms of 8-bit, RGB and 16-bit images, and the    *
+ *       point operations built on them: statistics, Otsu thresholding     *
+ *       and histogram equalization                                        *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* sub-histograms per task. neighbouring samples go to different copies,
+   so a run of equal samples does not wait on its own increments */
+#define HIST_WAYS  4
+
+/* samples per bin a task should count before another task is worth
+   clearing and merging its sub-histograms */
+#define HIST_RUN   16
+
+/***************************************************************************
+ * Func: count_gray                                                        *
+ *                                                                         *
+ * Desc: counts 8-bit samples into HIST_WAYS sub-histograms of 256 bins,   *
+ *       sample i going to copy i % HIST_WAYS                              *
+ *                                                                         *
+ * Params: src - samples                                                   *
+ *         n - number of samples                                           *
+ *         sub - HIST_WAYS * 256 counters, cleared                         *
+ ***************************************************************************/
+
+static void count_gray(void *src, unsigned long n, unsigned int *sub)
+{
+	unsigned char *p = (unsigned char *)src;
+	unsigned int w0, w1;        /* four samples each */
+	unsigned long i;            /* sample index */
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		memcpy(&w0, p + i, 4);
+		memcpy(&w1, p + i + 4, 4);
+		sub[w0 & 255]++;
+		sub[256 + ((w0 >> 8) & 255)]++;
+		sub[512 + ((w0 >> 16) & 255)]++;
+		sub[768 + (w0 >> 24)]++;
+		sub[w1 & 255]++;
+		sub[256 + ((w1 >> 8) & 255)]++;
+		sub[512 + ((w1 >> 16) & 255)]++;
+		sub[768 + (w1 >> 24)]++;
+	}
+
+	for (; i < n; i++)
+		sub[p[i]]++;
+}
+
+/***************************************************************************
+ * Func: count_rgb                                                         *
+ *                                                                         *
+ * Desc: counts RGB pixels into HIST_WAYS sub-histograms of 768 bins (red, *
+ *       green, blue), pixel i going to copy i % HIST_WAYS                 *
+ *                                                                         *
+ * Params: src - pixels, 3 bytes each                                      *
+ *         n - number of pixels                                            *
+ *         sub - HIST_WAYS * 768 counters, cleared                         *
+ ***************************************************************************/
+
+static void count_rgb(void *src, unsigned long n, unsigned int *sub)
+{
+	unsigned char *p = (unsigned char *)src;
+	unsigned long i;            /* pixel index */
+
+	for (i = 0; i + 4 <= n; i += 4, p += 12)
+	{
+		sub[p[0]]++;
+		sub[256 + p[1]]++;
+		sub[512 + p[2]]++;
+		sub[768 + p[3]]++;
+		sub[1024 + p[4]]++;
+		sub[1280 + p[5]]++;
+		sub[1536 + p[6]]++;
+		sub[1792 + p[7]]++;
+		sub[2048 + p[8]]++;
+		sub[2304 + p[9]]++;
+		sub[2560 + p[10]]++;
+		sub[2816 + p[11]]++;
+	}
+
+	for (; i < n; i++, p += 3)
+	{
+		sub[p[0]]++;
+		sub[256 + p[1]]++;
+		sub[512 + p[2]]++;
+	}
+}
+
+/***************************************************************************
+ * Func: count16                                                           *
+ *                                                                         *
+ * Desc: counts 16-bit samples into HIST_WAYS sub-histograms of 65536      *
+ *       bins, sample i going to copy i % HIST_WAYS                        *
+ *                                                                         *
+ * Params: src - samples                                                   *
+ *         n - number of samples                                           *
+ *         sub - HIST_WAYS * 65536 counters, cleared                       *
+ ***************************************************************************/
+
+static void count16(void *src, unsigned long n, unsigned int *sub)
+{
+	unsigned short *p = (unsigned short *)src;
+	unsigned long i;            /* sample index */
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		sub[p[i]]++;
+		sub[65536 + p[i + 1]]++;
+		sub[131072 + p[i + 2]]++;
+		sub[196608 + p[i + 3]]++;
+	}
+
+	for (; i < n; i++)
+		sub[p[i]]++;
+}
+
+/* state shared by the tasks of a histogram */
+
+typedef struct
+    {
+    unsigned char *in;      /* first element */
+    int size;               /* bytes in one element */
+    unsigned long n;        /* number of elements */
+    unsigned long cols;     /* elements in one row */
+    long stride;            /* bytes from one row to the next */
+    int bins;               /* bins in one sub-histogram */
+    int tasks;              /* slices of the elements */
+    unsigned int *counts;   /* tasks * HIST_WAYS * bins counters */
+    void (*count)(void *src, unsigned long n, unsigned int *sub);
+    } hist_job;
+
+/***************************************************************************
+ * Func: hist_task                                                         *
+ *                                                                         *
+ * Desc: thread pool task: counts slice index of the elements, a row       *
+ *       piece at a time, and folds its sub-histograms into the first one  *
+ ***************************************************************************/
+
+static void hist_task(void *arg, int index)
+{
+	hist_job *job = (hist_job *)arg;
+	unsigned long start, end;   /* slice of the elements */
+	unsigned long y, x, len;    /* row, column and length of a piece */
+	unsigned int *sub;          /* this task's counters */
+	int k, b;                   /* sub-histogram and bin */
+
+	start = job->n / job->tasks * index + MIN((unsigned long)index, job->n % job->tasks);
+	end = job->n / job->tasks * (index + 1) + MIN((unsigned long)index + 1, job->n % job->tasks);
+	sub = job->counts + (unsigned long)index * HIST_WAYS * job->bins;
+
+	memset(sub, 0, sizeof(unsigned int) * HIST_WAYS * job->bins);
+	for (; start < end; start += len)
+	{
+		y = start / job->cols;
+		x = start % job->cols;
+		len = MIN(job->cols - x, end - start);
+		job->count(job->in + y * job->stride + x * job->size, len, sub);
+	}
+
+	for (k = 1; k < HIST_WAYS; k++)
+		for (b = 0; b < job->bins; b++)
+			sub[b] += sub[k * job->bins + b];
+}
+
+/***************************************************************************
+ * Func: run_histogram                                                     *
+ *                                                                         *
+ * Desc: counts the elements on the thread pool and adds the tasks'        *
+ *       histograms together. images too small to repay clearing a         *
+ *       histogram per thread get fewer tasks                              *
+ *                                                                         *
+ * Params: in - first element                                              *
+ *         size - bytes in one element                                     *
+ *         n - number of elements                                          *
+ *         cols - elements in one row, n when they are all in one run      *
+ *         stride - bytes from one row to the next                         *
+ *         bins - bins of the histogram                                    *
+ *         count - kernel filling HIST_WAYS sub-histograms                 *
+ *         hist - bins counters to fill                                    *
+ ***************************************************************************/
+
+static void run_histogram(void *in, int size, unsigned long n,
+	unsigned long cols, long stride, int bins,
+	void (*count)(void *src, unsigned long n, unsigned int *sub),
+	unsigned long *hist)
+{
+	hist_job job;               /* slices shared by the tasks */
+	int t, b;                   /* task and bin */
+
+	job.in = (unsigned char *)in;
+	job.size = size;
+	job.n = n;
+	job.cols = cols;
+	job.stride = stride;
+	job.bins = bins;
+	job.count = count;
+	job.tasks = (int)MIN((unsigned long)ip_get_threads(),
+		n / ((unsigned long)bins * HIST_RUN) + 1);
+
+	job.counts = (unsigned int *)malloc(sizeof(unsigned int) * HIST_WAYS * bins * job.tasks);
+	if (job.counts == NULL)
+	{
+		printf("Error allocating histogram\n");
+		exit(1);
+	}
+
+	ip_parallel_for(job.tasks, hist_task, &job);
+
+	for (b = 0; b < bins; b++)
+		hist[b] = 0;
+	for (t = 0; t < job.tasks; t++)
+		for (b = 0; b < bins; b++)
+			hist[b] += job.counts[(unsigned long)t * HIST_WAYS * bins + b];
+
+	free(job.counts);
+}
+
+/***************************************************************************
+ * Func: hist_gray                                                         *
+ *                                                                         *
+ * Desc: histogram of 8-bit samples                                        *
+ *                                                                         *
+ * Params: in - samples                                                    *
+ *         n - number of samples (rows * cols)                             *
+ *         hist - 256 counters to fill                                     *
+ ***************************************************************************/
+
+void hist_gray(image_ptr in, unsigned long n, unsigned long *hist)
+{
+	run_histogram(in, 1, n, n, 0, 256, count_gray, hist);
+}
+
+/***************************************************************************
+ * Func: hist_rgb                                                          *
+ *                                                                         *
+ * Desc: histograms of the three channels of an RGB image                  *
+ *                                                                         *
+ * Params: in - pixels in r, g, b order                                    *
+ *         pixels - number of pixels (rows * cols)                         *
+ *         hist - 768 counters to fill: red, then green, then blue         *
+ ***************************************************************************/
+
+void hist_rgb(image_ptr in, unsigned long pixels, unsigned long *hist)
+{
+	run_histogram(in, 3, pixels, pixels, 0, 768, count_rgb, hist);
+}
+
+/***************************************************************************
+ * Func: hist16                                                            *
+ *                                                                         *
+ * Desc: histogram of 16-bit samples, as read by read_pnm16                *
+ *                                                                         *
+ * Params: in - samples                                                    *
+ *         n - number of samples (rows * cols, times 3 for PPM)            *
+ *         hist - 65536 counters to fill                                   *
+ ***************************************************************************/
+
+void hist16(image16_ptr in, unsigned long n, unsigned long *hist)
+{
+	run_histogram(in, 2, n, n, 0, 65536, count16, hist);
+}
+
+/***************************************************************************
+ * Func: hist_desc                                                         *
+ *                                                                         *
+ * Desc: histogram of an image descriptor, counting only the samples       *
+ *       inside it however far apart its rows are. 8-bit grey images fill  *
+ *       256 counters, 8-bit RGB images 768 as hist_rgb, in either layout, *
+ *       and 16-bit grey images 65536                                      *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ *         hist - counters to fill                                         *
+ ***************************************************************************/
+
+void hist_desc(image_desc *img, unsigned long *hist)
+{
+	image_desc plane;           /* one plane of a planar image */
+	unsigned long n;            /* samples or pixels in a plane */
+	int k;
+
+	n = (unsigned long)img->width * img->height;
+	if (img->depth > 8 && img->channels == 1)
+		run_histogram(img->data, 2, n, img->width, img->stride, 65536, count16,
+			hist);
+	else if (img->depth == 8 && img->channels == 3 && img->plane_stride == 0)
+		run_histogram(img->data, 3, n, img->width, img->stride, 768, count_rgb,
+			hist);
+	else if (img->depth == 8 && (img->channels == 1 || img->channels == 3))
+		for (k = 0; k < image_planes(img); k++)
+		{
+			plane = image_plane(img, k);
+			run_histogram(plane.data, 1, n, plane.width, plane.stride, 256,
+				count_gray, hist + 256 * k);
+		}
+	else
+	{
+		printf("hist_desc: no histogram of %d channels of %d bits\n",
+			img->channels, img->depth);
+		exit(1);
+	}
+}
+
+/***************************************************************************
+ * Func: hist_stats                                                        *
+ *                                                                         *
+ * Desc: minimum, maximum, median, mean and standard deviation of the      *
+ *       levels counted in a histogram                                     *
+ *                                                                         *
+ * Params: hist - the histogram                                            *
+ *         bins - number of bins (256, or 65536 for hist16)                *
+ *         s - summary to fill; all zero for an empty histogram            *
+ ***************************************************************************/
+
+void hist_stats(unsigned long *hist, int bins, hist_summary *s)
+{
+	double sum, square;         /* sums of the levels and their squares */
+	unsigned long seen;         /* samples at or below the current level */
+	int v;                      /* level */
+
+	memset(s, 0, sizeof(hist_summary));
+	sum = square = 0.0;
+	for (v = 0; v < bins; v++)
+	{
+		s->count += hist[v];
+		sum += (double)hist[v] * v;
+		square += (double)hist[v] * v * v;
+	}
+	if (s->count == 0)
+		return;
+
+	for (v = 0; hist[v] == 0; v++)
+		;
+	s->min = v;
+	for (v = bins - 1; hist[v] == 0; v--)
+		;
+	s->max = v;
+
+	seen = 0;
+	for (v = 0; v < bins; v++)
+	{
+		seen += hist[v];
+		if (seen >= (s->count + 1) / 2)
+			break;
+	}
+	s->median = v;
+
+	s->mean = sum / s->count;
+	s->stddev = sqrt(MAX(square / s->count - s->mean * s->mean, 0.0));
+}
+
+/***************************************************************************
+ * Func: otsu_threshold                                                    *
+ *                                                                         *
+ * Desc: picks the threshold that best splits a histogram in two, the one  *
+ *       with the greatest variance between the two classes (Otsu)         *
+ *                                                                         *
+ * Params: hist - the histogram                                            *
+ *         bins - number of bins                                           *
+ *                                                                         *
+ * Returns: the first level of the upper class, as taken by lut_threshold  *
+ ***************************************************************************/
+
+int otsu_threshold(unsigned long *hist, int bins)
+{
+	double total, sum;          /* samples and sum of their levels */
+	double w0, sum0;            /* the same for levels up to v */
+	double mean0, mean1;        /* class means */
+	double between, best;       /* between-class variance */
+	int v, threshold;           /* level and best threshold */
+
+	total = sum = 0.0;
+	for (v = 0; v < bins; v++)
+	{
+		total += hist[v];
+		sum += (double)hist[v] * v;
+	}
+
+	w0 = sum0 = 0.0;
+	best = -1.0;
+	threshold = 1;
+	for (v = 0; v < bins - 1; v++)
+	{
+		w0 += hist[v];
+		sum0 += (double)hist[v] * v;
+		if (w0 == 0.0 || w0 == total)
+			continue;
+
+		mean0 = sum0 / w0;
+		mean1 = (sum - sum0) / (total - w0);
+		between = w0 * (total - w0) * (mean0 - mean1) * (mean0 - mean1);
+		if (between > best)
+		{
+			best = between;
+			threshold = v + 1;
+		}
+	}
+	return threshold;
+}
+
+/***************************************************************************
+ * Func: equalize_lut                                                      *
+ *                                                                         *
+ * Desc: builds the table that equalizes a histogram: the normalized sum   *
+ *       of the histogram up to each level                                 *
+ *                                                                         *
+ * Params: histogram - 256 counters                                        *
+ *         number_of_pixels - samples counted                              *
+ *         sum_hist - 256 entries to fill                                  *
+ ***************************************************************************/
+
+static void equalize_lut(unsigned long *histogram, unsigned long number_of_pixels,
+	unsigned char *sum_hist)
+{
+	float scale_factor;         /* normalized scale factor */
+	unsigned long sum;          /* running sum of histogram */
+	int i;                      /* grey level */
+
+	sum = 0;
+	scale_factor = 255.0f / number_of_pixels;
+	for (i = 0; i < 256; i++)
+	{
+		sum += histogram[i];
+		sum_hist[i] = (unsigned char)((sum * scale_factor) + 0.5);
+	}
+}
+
+/***************************************************************************
+ * Func: histogram_equalize                                                *
+ *                                                                         *
+ * Desc: histogram equalize an image in place                              *
+ *                                                                         *
+ * Params: buffer - pointer to image in memory                             *
+ *         number_of_pixels - total number of pixels in image              *
+ ***************************************************************************/
+
+void histogram_equalize(image_ptr buffer, unsigned long number_of_pixels)
+{
+	unsigned long histogram[256];   /* image histogram */
+	unsigned char sum_hist[256];    /* normalized sum of histogram, as a LUT */
+
+	hist_gray(buffer, number_of_pixels, histogram);
+	equalize_lut(histogram, number_of_pixels, sum_hist);
+	apply_lut(buffer, buffer, number_of_pixels, sum_hist);
+}
+
+/***************************************************************************
+ * Func: histogram_equalize_desc                                           *
+ *                                                                         *
+ * Desc: histogram_equalize for an 8-bit grey image descriptor, e.g. to    *
+ *       equalize one window of a larger image by its own histogram        *
+ *                                                                         *
+ * Params: img - the image, changed in place                               *
+ ***************************************************************************/
+
+void histogram_equalize_desc(image_desc *img)
+{
+	unsigned long histogram[256];   /* image histogram */
+	unsigned char sum_hist[256];    /* normalized sum of histogram, as a LUT */
+
+	if (img->channels != 1 || img->depth != 8)
+	{
+		printf("histogram_equalize_desc: image is not 8-bit grey\n");
+		exit(1);
+	}
+	hist_desc(img, histogram);
+	equalize_lut(histogram, (unsigned long)img->width * img->height, sum_hist);
+	apply_lut_desc(img, img, sum_hist);
+}
+
+/***************************************************************************
+ * Func: threshold_image                                                   *
+ *                                                                         *
+ * Desc: turns an image black and white in place at the Otsu threshold     *
+ *                                                                         *
+ * Params: buffer - pointer to image in memory                             *
+ *         number_of_pixels - total number of pixels in image              *
+ ***************************************************************************/
+
+void threshold_image(image_ptr buffer, unsigned long number_of_pixels)
+{
+	unsigned long histogram[256];   /* image histogram */
+	unsigned char lut[256];     /* black below the threshold */
+
+	hist_gray(buffer, number_of_pixels, histogram);
+	lut_threshold(lut, otsu_threshold(histogram, 256));
+	apply_lut(buffer, buffer, number_of_pixels, lut);
+}
+
+/* state shared by the tasks of clahe */
+
+typedef struct
+    {
+    image_ptr buffer;       /* image, equalized in place */
+    int rows;
+    int cols;
+    int tiles_x;            /* tiles across */
+    int tiles_y;            /* tiles down */
+    double clip_limit;      /* multiple of the mean bin count */
+    unsigned int *counts;   /* tiles_x * HIST_WAYS * 256 counters per tile row */
+    unsigned char *luts;    /* 256 entries per tile, row by row */
+    int *tx0, *tx1;         /* tiles left and right of each column */
+    int *wx;                /* weight of tx1, 0 .. 256 */
+    int *ty0, *ty1;         /* tiles above and below each row */
+    int *wy;                /* weight of ty1, 0 .. 256 */
+    } clahe_job;
+
+/* image rows blended by one task of clahe */
+#define CLAHE_ROWS  64
+
+/* first position of tile t when size positions are cut into tiles, and
+   the centre of the tile */
+#define TILE_START(t, size, tiles)  ((int)((long)(t) * (size) / (tiles)))
+#define TILE_CENTRE(t, size, tiles) \
+	((TILE_START(t, size, tiles) + TILE_START((t) + 1, size, tiles) - 1) / 2.0)
+
+/***************************************************************************
+ * Func: clahe_lut                                                         *
+ *                                                                         *
+ * Desc: clips a tile histogram, spreads the clipped samples evenly over   *
+ *       all bins and turns the result into an equalization table          *
+ *                                                                         *
+ * Params: hist - 256 counters of the tile, clipped in place               *
+ *         pixels - samples in the tile                                    *
+ *         clip_limit - most samples a bin keeps, times the mean bin       *
+ *         lut - 256 entries to fill                                       *
+ ***************************************************************************/
+
+static void clahe_lut(unsigned int *hist, unsigned long pixels, double clip_limit,
+	unsigned char *lut)
+{
+	unsigned long limit;        /* most samples a bin keeps */
+	unsigned long excess;       /* samples clipped off */
+	unsigned long step;         /* bins between extra samples */
+	unsigned long sum;          /* running sum of histogram */
+	float scale_factor;         /* normalized scale factor */
+	int i;                      /* grey level */
+
+	limit = (unsigned long)(clip_limit * pixels / 256);
+	if (limit < 1)
+		limit = 1;
+
+	excess = 0;
+	for (i = 0; i < 256; i++)
+		if (hist[i] > limit)
+		{
+			excess += hist[i] - limit;
+			hist[i] = limit;
+		}
+
+	for (i = 0; i < 256; i++)
+		hist[i] += excess / 256;
+	excess %= 256;
+	if (excess > 0)
+	{
+		step = 256 / excess;
+		for (i = 0; i < 256 && excess > 0; i += step, excess--)
+			hist[i]++;
+	}
+
+	sum = 0;
+	scale_factor = 255.0f / pixels;
+	for (i = 0; i < 256; i++)
+	{
+		sum += hist[i];
+		lut[i] = (unsigned char)((sum * scale_factor) + 0.5);
+	}
+}
+
+/***************************************************************************
+ * Func: clahe_tile_task                                                   *
+ *                                                                         *
+ * Desc: thread pool task: builds the tables of tile row index. the rows   *
+ *       of the band are read once, top to bottom, each row adding its     *
+ *       pieces to the histograms of all the tiles across                  *
+ ***************************************************************************/
+
+static void clahe_tile_task(void *arg, int index)
+{
+	clahe_job *job = (clahe_job *)arg;
+	unsigned int *sub;          /* HIST_WAYS sub-histograms of a tile */
+	int y0, y1;                 /* rows of the band */
+	int x0, x1;                 /* columns of a tile */
+	int y, tx, k, b;            /* row, tile, sub-histogram and bin */
+
+	y0 = TILE_START(index, job->rows, job->tiles_y);
+	y1 = TILE_START(index + 1, job->rows, job->tiles_y);
+	sub = job->counts + (unsigned long)index * job->tiles_x * HIST_WAYS * 256;
+	memset(sub, 0, sizeof(unsigned int) * job->tiles_x * HIST_WAYS * 256);
+
+	for (y = y0; y < y1; y++)
+		for (tx = 0; tx < job->tiles_x; tx++)
+		{
+			x0 = TILE_START(tx, job->cols, job->tiles_x);
+			x1 = TILE_START(tx + 1, job->cols, job->tiles_x);
+			count_gray(job->buffer + (unsigned long)y * job->cols + x0, x1 - x0,
+				sub + tx * HIST_WAYS * 256);
+		}
+
+	for (tx = 0; tx < job->tiles_x; tx++, sub += HIST_WAYS * 256)
+	{
+		for (k = 1; k < HIST_WAYS; k++)
+			for (b = 0; b < 256; b++)
+				sub[b] += sub[k * 256 + b];
+
+		x0 = TILE_START(tx, job->cols, job->tiles_x);
+		x1 = TILE_START(tx + 1, job->cols, job->tiles_x);
+		clahe_lut(sub, (unsigned long)(y1 - y0) * (x1 - x0), job->clip_limit,
+			job->luts + ((unsigned long)index * job->tiles_x + tx) * 256);
+	}
+}
+
+/***************************************************************************
+ * Func: tile_neighbours                                                   *
+ *                                                                         *
+ * Desc: finds, for each position along an axis, the two tiles whose       *
+ *       centres lie either side of it and the weight of the second.       *
+ *       positions outside the outer centres use the outer tile alone      *
+ *                                                                         *
+ * Params: size - rows or columns of the image                             *
+ *         tiles - tiles along the axis                                    *
+ *         t0 - first tile per position                                    *
+ *         t1 - second tile per position                                   *
+ *         w - weight of t1 per position, 0 .. 256                         *
+ ***************************************************************************/
+
+static void tile_neighbours(int size, int tiles, int *t0, int *t1, int *w)
+{
+	double c0, c1;              /* centres of tiles t and t + 1 */
+	int i, t;                   /* position and tile */
+
+	t = 0;
+	c0 = TILE_CENTRE(0, size, tiles);
+	c1 = TILE_CENTRE(1, size, tiles);
+	for (i = 0; i < size; i++)
+	{
+		while (t + 1 < tiles && i >= c1)
+		{
+			t++;
+			c0 = c1;
+			c1 = TILE_CENTRE(t + 1, size, tiles);
+		}
+
+		if (i <= c0 || t + 1 >= tiles)
+		{
+			t0[i] = t1[i] = t;
+			w[i] = 0;
+		}
+		else
+		{
+			t0[i] = t;
+			t1[i] = t + 1;
+			w[i] = (int)((i - c0) / (c1 - c0) * 256 + 0.5);
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: clahe_blend_task                                                  *
+ *                                                                         *
+ * Desc: thread pool task: maps rows index * CLAHE_ROWS on through the     *
+ *       tables of the four nearest tiles, blended bilinearly              *
+ ***************************************************************************/
+
+static void clahe_blend_task(void *arg, int index)
+{
+	clahe_job *job = (clahe_job *)arg;
+	int cols = job->cols;
+	int *tx0 = job->tx0, *tx1 = job->tx1, *wx = job->wx;
+	unsigned char *top, *bot;   /* tables of the tile rows above and below */
+	unsigned short *vlut;       /* the two blended for the current row */
+	unsigned short *left, *right;   /* blended tables either side of a span */
+	image_ptr p;                /* current row */
+	int y0, y1;                 /* rows of the task */
+	int x, x1, y, k, v;         /* column, end of span, row, entry, level */
+	int wy;                     /* weight of the lower tile row */
+
+	y0 = index * CLAHE_ROWS;
+	y1 = MIN(y0 + CLAHE_ROWS, job->rows);
+
+	vlut = (unsigned short *)malloc(sizeof(unsigned short) * 256 * job->tiles_x);
+	if (vlut == NULL)
+	{
+		printf("Error allocating CLAHE tables\n");
+		exit(1);
+	}
+
+	for (y = y0; y < y1; y++)
+	{
+		p = job->buffer + (unsigned long)y * cols;
+
+		/* blend the tables down once per row, so a pixel needs two */
+		top = job->luts + (unsigned long)job->ty0[y] * job->tiles_x * 256;
+		bot = job->luts + (unsigned long)job->ty1[y] * job->tiles_x * 256;
+		wy = job->wy[y];
+		for (k = 0; k < 256 * job->tiles_x; k++)
+			vlut[k] = (unsigned short)((top[k] << 8) + wy * (bot[k] - top[k]));
+
+		/* columns between the same two tile centres share their tables */
+		for (x = 0; x < cols; x = x1)
+		{
+			for (x1 = x + 1; x1 < cols && tx0[x1] == tx0[x] && tx1[x1] == tx1[x]; x1++)
+				;
+			left = vlut + tx0[x] * 256;
+			right = vlut + tx1[x] * 256;
+			for (; x < x1; x++)
+			{
+				v = p[x];
+				p[x] = (unsigned char)(((left[v] << 8) + wx[x] * (right[v] - left[v]) +
+					32768) >> 16);
+			}
+		}
+	}
+
+	free(vlut);
+}
+
+/***************************************************************************
+ * Func: clahe                                                             *
+ *                                                                         *
+ * Desc: contrast-limited adaptive histogram equalization of a grey image  *
+ *       in place. the image is cut into tiles, each tile is equalized     *
+ *       with its histogram clipped at clip_limit times the mean bin, and  *
+ *       every pixel is mapped through the tables of its four nearest      *
+ *       tiles, blended bilinearly so the tile edges do not show. a low    *
+ *       clip limit keeps flat backgrounds from being stretched into noise *
+ *                                                                         *
+ * Params: buffer - pointer to image in memory                             *
+ *         rows, cols - size of the image                                  *
+ *         tiles_x - tiles across, 1 .. cols                               *
+ *         tiles_y - tiles down, 1 .. rows                                 *
+ *         clip_limit - 1 gives the least contrast change, large values    *
+ *                      approach plain equalization of each tile; 2 to 4   *
+ *                      is usual                                           *
+ ***************************************************************************/
+
+void clahe(image_ptr buffer, int rows, int cols, int tiles_x, int tiles_y,
+	double clip_limit)
+{
+	clahe_job job;              /* tables shared by the tasks */
+
+	if (tiles_x < 1 || tiles_x > cols || tiles_y < 1 || tiles_y > rows)
+	{
+		printf("clahe: %d x %d tiles do not fit a %d x %d image\n",
+			tiles_x, tiles_y, cols, rows);
+		exit(1);
+	}
+	if (clip_limit < 1.0)
+	{
+		printf("clahe: clip limit %g must be at least 1\n", clip_limit);
+		exit(1);
+	}
+
+	job.buffer = buffer;
+	job.rows = rows;
+	job.cols = cols;
+	job.tiles_x = tiles_x;
+	job.tiles_y = tiles_y;
+	job.clip_limit = clip_limit;
+	job.counts = (unsigned int *)malloc(sizeof(unsigned int) * HIST_WAYS * 256 *
+		tiles_x * tiles_y);
+	job.luts = (unsigned char *)malloc(256 * tiles_x * tiles_y);
+	job.tx0 = (int *)malloc(sizeof(int) * 3 * (cols + rows));
+	if (job.counts == NULL || job.luts == NULL || job.tx0 == NULL)
+	{
+		printf("Error allocating CLAHE tiles\n");
+		exit(1);
+	}
+	job.tx1 = job.tx0 + cols;
+	job.wx = job.tx1 + cols;
+	job.ty0 = job.wx + cols;
+	job.ty1 = job.ty0 + rows;
+	job.wy = job.ty1 + rows;
+	tile_neighbours(cols, tiles_x, job.tx0, job.tx1, job.wx);
+	tile_neighbours(rows, tiles_y, job.ty0, job.ty1, job.wy);
+
+	ip_parallel_for(tiles_y, clahe_tile_task, &job);
+	ip_parallel_for((rows + CLAHE_ROWS - 1) / CLAHE_ROWS, clahe_blend_task, &job);
+
+	free(job.counts);
+	free(job.luts);
+	free(job.tx0);
+}
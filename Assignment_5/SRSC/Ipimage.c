@@ -0,0 +1,589 @@
+/***************************************************************************
+ * File: ipimage.c                                                         *
+ *                                                                         *
+ * Desc: image descriptors. an image_desc carries the size, channels,      *
+ *       bit depth, row and plane strides and ownership of a raster, so a  *
+ *       window of an image, rows padded for alignment or a planar colour  *
+ *       image can be handed to the _desc functions without a copy         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* bytes in one sample */
+#define SAMPLE_BYTES(img)  (((img)->depth > 8) ? 2 : 1)
+
+/***************************************************************************
+ * Func: new_image                                                         *
+ *                                                                         *
+ * Desc: allocates an image. rows start IP_ALIGN bytes apart, so each row  *
+ *       of a plane is as aligned as the first                             *
+ *                                                                         *
+ * Params: width, height - size in pixels                                  *
+ *         channels - samples per pixel                                    *
+ *         depth - bits per sample, 8 or up to 16                          *
+ *         layout - IP_INTERLEAVED or IP_PLANAR                            *
+ *                                                                         *
+ * Returns: the image, owning its samples                                  *
+ ***************************************************************************/
+
+image_desc new_image(int width, int height, int channels, int depth,
+	int layout)
+{
+	image_desc img;
+	long line;                  /* bytes of samples in one row */
+	int planes;                 /* planes in memory */
+
+	if (width < 1 || height < 1 || channels < 1 || depth < 1 || depth > 16)
+	{
+		printf("new_image: bad %d x %d image of %d channels of %d bits\n",
+			width, height, channels, depth);
+		exit(1);
+	}
+
+	img.width = width;
+	img.height = height;
+	img.channels = channels;
+	img.depth = depth;
+	planes = (layout == IP_PLANAR && channels > 1) ? channels : 1;
+	line = (long)width * (channels / planes) * SAMPLE_BYTES(&img);
+	img.stride = (line + IP_ALIGN - 1) / IP_ALIGN * IP_ALIGN;
+	img.plane_stride = (planes > 1) ? img.stride * height : 0;
+	img.owned = 1;
+	img.data = (image_ptr)IP_MALLOC((unsigned long)img.stride * height * planes);
+	if (img.data == NULL)
+	{
+		printf("Unable to malloc %d x %d image\n", width, height);
+		exit(1);
+	}
+	return img;
+}
+
+/***************************************************************************
+ * Func: wrap_image                                                        *
+ *                                                                         *
+ * Desc: describes an image of the kind read_pnm returns, without taking   *
+ *       it over                                                           *
+ *                                                                         *
+ * Params: buffer - the samples, rows back to back                         *
+ *         rows, cols - size of the image                                  *
+ *         type - 5 = PGM   6 = PPM                                        *
+ *                                                                         *
+ * Returns: an interleaved 8-bit image borrowing buffer                    *
+ ***************************************************************************/
+
+image_desc wrap_image(image_ptr buffer, int rows, int cols, int type)
+{
+	image_desc img;
+
+	img.width = cols;
+	img.height = rows;
+	img.channels = (type == PPM) ? 3 : 1;
+	img.depth = 8;
+	img.stride = (long)cols * img.channels;
+	img.plane_stride = 0;
+	img.owned = 0;
+	img.data = buffer;
+	return img;
+}
+
+/***************************************************************************
+ * Func: free_image                                                        *
+ *                                                                         *
+ * Desc: releases the samples of an image that owns them; a borrowed       *
+ *       image is only forgotten                                           *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ ***************************************************************************/
+
+void free_image(image_desc *img)
+{
+	if (img->owned)
+		IP_FREE(img->data);
+	img->data = NULL;
+	img->owned = 0;
+}
+
+/***************************************************************************
+ * Func: image_roi                                                         *
+ *                                                                         *
+ * Desc: a view of a rectangle of an image. it shares the samples and      *
+ *       strides of img, so writes through it land in img, and it must     *
+ *       not outlive img                                                   *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ *         x, y - top left pixel of the rectangle                          *
+ *         width, height - size of the rectangle                           *
+ *                                                                         *
+ * Returns: the view, borrowing the samples of img                         *
+ ***************************************************************************/
+
+image_desc image_roi(image_desc *img, int x, int y, int width, int height)
+{
+	image_desc view = *img;
+
+	if (x < 0 || y < 0 || width < 1 || height < 1
+		|| x + width > img->width || y + height > img->height)
+	{
+		printf("image_roi: %d x %d at (%d, %d) is not inside %d x %d\n",
+			width, height, x, y, img->width, img->height);
+		exit(1);
+	}
+
+	view.width = width;
+	view.height = height;
+	view.owned = 0;
+	view.data = IMAGE_ROW(img, y) + (long)x * SAMPLE_BYTES(img)
+		* ((img->plane_stride == 0) ? img->channels : 1);
+	return view;
+}
+
+/***************************************************************************
+ * Func: image_planes                                                      *
+ *                                                                         *
+ * Desc: counts the planes image_plane splits an image into                *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ *                                                                         *
+ * Returns: channels for a planar image, 1 for an interleaved one          *
+ ***************************************************************************/
+
+int image_planes(image_desc *img)
+{
+	return (img->plane_stride != 0) ? img->channels : 1;
+}
+
+/***************************************************************************
+ * Func: image_plane                                                       *
+ *                                                                         *
+ * Desc: a view of plane k of an image. a plane of a planar image is a     *
+ *       grey image; an interleaved image is its own only plane. filters   *
+ *       that treat channels alike loop over the planes, and so take       *
+ *       either layout                                                     *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ *         k - plane, 0 .. image_planes(img) - 1                           *
+ *                                                                         *
+ * Returns: the view, borrowing the samples of img                         *
+ ***************************************************************************/
+
+image_desc image_plane(image_desc *img, int k)
+{
+	image_desc view = *img;
+
+	if (k < 0 || k >= image_planes(img))
+	{
+		printf("image_plane: no plane %d in an image of %d\n", k,
+			image_planes(img));
+		exit(1);
+	}
+
+	view.owned = 0;
+	if (img->plane_stride != 0)
+	{
+		view.channels = 1;
+		view.plane_stride = 0;
+		view.data = img->data + k * img->plane_stride;
+	}
+	return view;
+}
+
+/***************************************************************************
+ * Func: image_layout                                                      *
+ *                                                                         *
+ * Desc: tells how the channels of an image are stored                     *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ *                                                                         *
+ * Returns: IP_PLANAR or IP_INTERLEAVED                                    *
+ ***************************************************************************/
+
+int image_layout(image_desc *img)
+{
+	return (img->plane_stride != 0) ? IP_PLANAR : IP_INTERLEAVED;
+}
+
+/***************************************************************************
+ * Func: pick_layout                                                       *
+ *                                                                         *
+ * Desc: chooses one layout for a chain of filters, so the image is        *
+ *       converted once before the chain rather than inside each filter.   *
+ *       the layout most filters ask for wins, interleaved on a tie        *
+ *                                                                         *
+ * Params: wants - the _LAYOUT of each filter, e.g. RESIZE_LAYOUT(method)  *
+ *         count - number of filters                                       *
+ *                                                                         *
+ * Returns: IP_PLANAR, IP_INTERLEAVED, or IP_ANY_LAYOUT if no filter cares *
+ ***************************************************************************/
+
+int pick_layout(int *wants, int count)
+{
+	int planar, interleaved;    /* votes for each layout */
+	int i;
+
+	planar = interleaved = 0;
+	for (i = 0; i < count; i++)
+		if (wants[i] == IP_PLANAR)
+			planar++;
+		else if (wants[i] == IP_INTERLEAVED)
+			interleaved++;
+
+	if (planar == 0 && interleaved == 0)
+		return IP_ANY_LAYOUT;
+	return (planar > interleaved) ? IP_PLANAR : IP_INTERLEAVED;
+}
+
+/***************************************************************************
+ * Func: use_layout                                                        *
+ *                                                                         *
+ * Desc: gives an image in the layout a filter chain wants. an image       *
+ *       already in it, or asked for in IP_ANY_LAYOUT, comes back as a     *
+ *       view of itself; otherwise it is converted into a new image. the   *
+ *       result goes to free_image either way                              *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ *         layout - IP_INTERLEAVED, IP_PLANAR or IP_ANY_LAYOUT             *
+ *                                                                         *
+ * Returns: the image in that layout                                       *
+ ***************************************************************************/
+
+image_desc use_layout(image_desc *img, int layout)
+{
+	image_desc out;
+
+	if (layout == IP_ANY_LAYOUT || img->channels == 1
+		|| layout == image_layout(img))
+	{
+		out = *img;
+		out.owned = 0;
+		return out;
+	}
+
+	out = new_image(img->width, img->height, img->channels, img->depth, layout);
+	copy_image(img, &out);
+	return out;
+}
+
+/***************************************************************************
+ * Func: match_images                                                      *
+ *                                                                         *
+ * Desc: checks that two images have the same size, channels, depth and    *
+ *       layout, as a filter from one into the other needs; stops the      *
+ *       program if not                                                    *
+ *                                                                         *
+ * Params: a, b - the images                                               *
+ *         depth - bits per sample the caller handles, 0 for any           *
+ *         who - name of the caller, for the message                       *
+ ***************************************************************************/
+
+void match_images(image_desc *a, image_desc *b, int depth, char *who)
+{
+	if (a->width != b->width || a->height != b->height
+		|| a->channels != b->channels || a->depth != b->depth
+		|| (a->plane_stride == 0) != (b->plane_stride == 0))
+	{
+		printf("%s: images differ in size, channels, depth or layout\n", who);
+		exit(1);
+	}
+	if (depth != 0 && a->depth != depth)
+	{
+		printf("%s: needs %d-bit samples, not %d-bit\n", who, depth, a->depth);
+		exit(1);
+	}
+}
+
+/***************************************************************************
+ * Func: split_row                                                         *
+ *                                                                         *
+ * Desc: copies a row of interleaved pixels into one row of each plane     *
+ *                                                                         *
+ * Params: src - n pixels of channels samples                              *
+ *         dst - channels rows of n samples                                *
+ *         n - pixels in the row                                           *
+ *         channels - samples per pixel                                    *
+ *         bytes - bytes per sample                                        *
+ ***************************************************************************/
+
+static void split_row(unsigned char *src, unsigned char **dst, int n,
+	int channels, int bytes)
+{
+	unsigned short *wide;       /* src as 16-bit samples */
+	int x, c;
+
+	if (bytes == 2)
+	{
+		wide = (unsigned short *)src;
+		for (c = 0; c < channels; c++)
+			for (x = 0; x < n; x++)
+				((unsigned short *)dst[c])[x] = wide[x * channels + c];
+	}
+	else
+		for (c = 0; c < channels; c++)
+			for (x = 0; x < n; x++)
+				dst[c][x] = src[x * channels + c];
+}
+
+/***************************************************************************
+ * Func: merge_row                                                         *
+ *                                                                         *
+ * Desc: interleaves one row of each plane into a row of pixels            *
+ *                                                                         *
+ * Params: src - channels rows of n samples                                *
+ *         dst - n pixels of channels samples                              *
+ *         n - pixels in the row                                           *
+ *         channels - samples per pixel                                    *
+ *         bytes - bytes per sample                                        *
+ ***************************************************************************/
+
+static void merge_row(unsigned char **src, unsigned char *dst, int n,
+	int channels, int bytes)
+{
+	unsigned short *wide;       /* dst as 16-bit samples */
+	int x, c;
+
+	if (bytes == 2)
+	{
+		wide = (unsigned short *)dst;
+		for (c = 0; c < channels; c++)
+			for (x = 0; x < n; x++)
+				wide[x * channels + c] = ((unsigned short *)src[c])[x];
+	}
+	else
+		for (c = 0; c < channels; c++)
+			for (x = 0; x < n; x++)
+				dst[x * channels + c] = src[c][x];
+}
+
+/***************************************************************************
+ * Func: split_rgb_scalar, merge_rgb_scalar                                *
+ *                                                                         *
+ * Desc: convert n pixels between r,g,b triples and three planes           *
+ ***************************************************************************/
+
+static void split_rgb_scalar(image_ptr rgb, unsigned char *r, unsigned char *g,
+	unsigned char *b, int n)
+{
+	int i;                      /* pixel index */
+
+	for (i = 0; i < n; i++)
+	{
+		r[i] = rgb[3 * i];
+		g[i] = rgb[3 * i + 1];
+		b[i] = rgb[3 * i + 2];
+	}
+}
+
+static void merge_rgb_scalar(unsigned char *r, unsigned char *g,
+	unsigned char *b, image_ptr rgb, int n)
+{
+	int i;                      /* pixel index */
+
+	for (i = 0; i < n; i++)
+	{
+		rgb[3 * i] = r[i];
+		rgb[3 * i + 1] = g[i];
+		rgb[3 * i + 2] = b[i];
+	}
+}
+
+/***************************************************************************
+ * Func: split_rgb                                                         *
+ *                                                                         *
+ * Desc: splits a row of 8-bit r,g,b triples into three planes. the        *
+ *       vector kernels move 16 or 32 pixels with byte shuffles            *
+ *                                                                         *
+ * Params: rgb - source pixels                                             *
+ *         r, g, b - planes of n samples, must not overlap rgb             *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+void split_rgb(image_ptr rgb, unsigned char *r, unsigned char *g,
+	unsigned char *b, int n)
+{
+	int cpu = ip_cpu_features();
+
+#ifdef IP_X86
+	if (cpu & IP_CPU_AVX2)
+	{
+		split_rgb_avx2(rgb, r, g, b, n);
+		return;
+	}
+	if (cpu & IP_CPU_SSE41)
+	{
+		split_rgb_sse41(rgb, r, g, b, n);
+		return;
+	}
+#endif
+	split_rgb_scalar(rgb, r, g, b, n);
+}
+
+/***************************************************************************
+ * Func: merge_rgb                                                         *
+ *                                                                         *
+ * Desc: interleaves three planes into a row of 8-bit r,g,b triples; the   *
+ *       inverse of split_rgb                                              *
+ *                                                                         *
+ * Params: r, g, b - planes of n samples                                   *
+ *         rgb - output pixels, must not overlap the planes                *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+void merge_rgb(unsigned char *r, unsigned char *g, unsigned char *b,
+	image_ptr rgb, int n)
+{
+	int cpu = ip_cpu_features();
+
+#ifdef IP_X86
+	if (cpu & IP_CPU_AVX2)
+	{
+		merge_rgb_avx2(r, g, b, rgb, n);
+		return;
+	}
+	if (cpu & IP_CPU_SSE41)
+	{
+		merge_rgb_sse41(r, g, b, rgb, n);
+		return;
+	}
+#endif
+	merge_rgb_scalar(r, g, b, rgb, n);
+}
+
+/***************************************************************************
+ * Func: copy_image                                                        *
+ *                                                                         *
+ * Desc: copies the samples of one image into another of the same size,    *
+ *       channels and depth. the layouts may differ, so this also turns    *
+ *       an interleaved image planar and back, and packs a view into rows  *
+ *       back to back                                                      *
+ *                                                                         *
+ * Params: src - the image to copy                                         *
+ *         dst - the image to fill; must not overlap src                   *
+ ***************************************************************************/
+
+void copy_image(image_desc *src, image_desc *dst)
+{
+	unsigned char *rows[16];    /* one row of each plane */
+	image_desc a, b;            /* one plane of each image */
+	long line;                  /* bytes of samples in one row of a plane */
+	int bytes;                  /* bytes per sample */
+	int y, k;                   /* row and plane */
+
+	if (src->width != dst->width || src->height != dst->height
+		|| src->channels != dst->channels || src->depth != dst->depth)
+	{
+		printf("copy_image: images differ in size, channels or depth\n");
+		exit(1);
+	}
+	bytes = SAMPLE_BYTES(src);
+
+	if ((src->plane_stride == 0) == (dst->plane_stride == 0))
+	{
+		for (k = 0; k < image_planes(src); k++)
+		{
+			a = image_plane(src, k);
+			b = image_plane(dst, k);
+			line = (long)a.width * a.channels * bytes;
+			for (y = 0; y < a.height; y++)
+				memcpy(IMAGE_ROW(&b, y), IMAGE_ROW(&a, y), line);
+		}
+		return;
+	}
+
+	if (src->channels > 16)
+	{
+		printf("copy_image: cannot change the layout of %d channels\n",
+			src->channels);
+		exit(1);
+	}
+
+	for (y = 0; y < src->height; y++)
+		if (src->plane_stride == 0)
+		{
+			for (k = 0; k < dst->channels; k++)
+				rows[k] = IMAGE_ROW(dst, y) + k * dst->plane_stride;
+			if (src->channels == 3 && bytes == 1)
+				split_rgb(IMAGE_ROW(src, y), rows[0], rows[1], rows[2], src->width);
+			else
+				split_row(IMAGE_ROW(src, y), rows, src->width, src->channels,
+					bytes);
+		}
+		else
+		{
+			for (k = 0; k < src->channels; k++)
+				rows[k] = IMAGE_ROW(src, y) + k * src->plane_stride;
+			if (src->channels == 3 && bytes == 1)
+				merge_rgb(rows[0], rows[1], rows[2], IMAGE_ROW(dst, y), dst->width);
+			else
+				merge_row(rows, IMAGE_ROW(dst, y), dst->width, dst->channels,
+					bytes);
+		}
+}
+
+/***************************************************************************
+ * Func: read_image_desc                                                   *
+ *                                                                         *
+ * Desc: reads a PGM, PPM or BMP file as read_image does                   *
+ *                                                                         *
+ * Params: filename - name of the file                                     *
+ *                                                                         *
+ * Returns: an interleaved 8-bit image owning its samples                  *
+ ***************************************************************************/
+
+image_desc read_image_desc(char *filename)
+{
+	image_desc img;
+	image_ptr buffer;           /* samples as read */
+	int rows, cols, type;
+
+	buffer = read_image(filename, &rows, &cols, &type);
+	img = wrap_image(buffer, rows, cols, type);
+	img.owned = 1;
+	return img;
+}
+
+/***************************************************************************
+ * Func: write_image_desc                                                  *
+ *                                                                         *
+ * Desc: writes an 8-bit grey or RGB image as a PGM or PPM file. an image  *
+ *       whose rows are not back to back, or a planar one, is packed       *
+ *       into a scratch copy first                                         *
+ *                                                                         *
+ * Params: img - the image                                                 *
+ *         filename - name of the file                                     *
+ ***************************************************************************/
+
+void write_image_desc(image_desc *img, char *filename)
+{
+	image_desc packed;          /* img with rows back to back */
+	int type;                   /* 5 = PGM   6 = PPM */
+
+	if (img->depth != 8 || (img->channels != 1 && img->channels != 3))
+	{
+		printf("write_image_desc: cannot write %d channels of %d bits\n",
+			img->channels, img->depth);
+		exit(1);
+	}
+	type = (img->channels == 3) ? PPM : PGM;
+
+	if (img->plane_stride == 0 && img->stride == (long)img->width * img->channels)
+	{
+		write_pnm(img->data, filename, img->height, img->width, type);
+		return;
+	}
+
+	packed = wrap_image((image_ptr)IP_MALLOC((unsigned long)img->width
+		* img->height * img->channels), img->height, img->width, type);
+	if (packed.data == NULL)
+	{
+		printf("Unable to malloc %d x %d image\n", img->width, img->height);
+		exit(1);
+	}
+	packed.owned = 1;
+	copy_image(img, &packed);
+	write_pnm(packed.data, filename, img->height, img->width, type);
+	free_image(&packed);
+}
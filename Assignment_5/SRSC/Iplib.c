@@ -8,7 +8,9 @@
 #include <malloc.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ip.h"
+#include "ipsys.h"
 #include "math.h"
 #include <fcntl.h>
 
@@ -16,30 +18,344 @@
 image_ptr read_pnm(char *filename, int *rows, int *cols, int *type);
 int getnum(FILE *fp);
 
+/* bytes read along with the header; a longer header is read from the
+   file a number at a time */
+#define PNM_HEAD_BYTES  4096
+
 /***************************************************************************
- * Func: read_pnm                                                          *
+ * Func: pnm_header                                                        *
+ *                                                                         *
+ * Desc: parses a portable bitmap header held in memory                    *
+ *                                                                         *
+ * Params: p - first byte of the file                                      *
+ *         end - first byte past the bytes held                            *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         maxval - maximum value of pixel, 1 for PBM                      *
+ *         type - 1 .. 6 from the magic number                             *
+ *                                                                         *
+ * Returns: pointer to the first raster byte                               *
+ ***************************************************************************/
+
+static unsigned char *pnm_header(unsigned char *p, unsigned char *end,
+	int *rows, int *cols, int *maxval, int *type)
+{
+	if (end - p < 2 || p[0] != 'P' || p[1] < '1' || p[1] > '6')
+	{
+		printf("You silly goof... This is not a PPM file!\n");
+		exit(1);
+	}
+	*type = p[1] - '0';
+	p += 2;
+
+	*cols = getnum_mem(&p, end);
+	*rows = getnum_mem(&p, end);
+	*maxval = (*type == 1 || *type == PBM) ? 1 : getnum_mem(&p, end);
+	return p;
+}
+
+/***************************************************************************
+ * Func: pnm_header_held                                                   *
+ *                                                                         *
+ * Desc: tells whether a header ends inside the bytes held. comments may   *
+ *       make a header any length, so one that reaches the end of the      *
+ *       bytes might have a number or a comment cut in two                 *
+ *                                                                         *
+ * Params: p - first byte of the file                                      *
+ *         end - first byte past the bytes held                            *
+ *                                                                         *
+ * Returns: 1 if the header and the character ending it are held, else 0   *
+ ***************************************************************************/
+
+static int pnm_header_held(unsigned char *p, unsigned char *end)
+{
+	int count;                  /* numbers left in the header */
+
+	if (end - p < 2)
+		return 0;
+	count = (p[1] == '1' || p[1] == '4') ? 2 : 3;
+	for (p += 2; count > 0; count--)
+	{
+		/* the same steps as getnum_mem */
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '#'))
+		{
+			if (*p == '#')
+				while (p < end && *p != '\n')
+					p++;
+			else
+				p++;
+		}
+		while (p < end && *p >= '0' && *p <= '9')
+			p++;
+		if (p < end && *p == '#')
+			while (p < end && *p != '\n')
+				p++;
+		if (p >= end)
+			return 0;
+		p++;
+	}
+	return 1;
+}
+
+/***************************************************************************
+ * Func: pnm_header_file                                                   *
+ *                                                                         *
+ * Desc: pnm_header for a header too long to hold, read with getnum        *
+ *                                                                         *
+ * Params: fp - file positioned at its first byte; left at the first       *
+ *              raster byte                                                *
+ *         others as pnm_header                                            *
+ ***************************************************************************/
+
+static void pnm_header_file(FILE *fp, int *rows, int *cols, int *maxval,
+	int *type)
+{
+	int firstchar, secchar;
+
+	firstchar = getc(fp);
+	secchar = getc(fp);
+	if (firstchar != 'P' || secchar < '1' || secchar > '6')
+	{
+		printf("You silly goof... This is not a PPM file!\n");
+		exit(1);
+	}
+	*type = secchar - '0';
+
+	*cols = getnum(fp);
+	*rows = getnum(fp);
+	*maxval = (*type == 1 || *type == PBM) ? 1 : getnum(fp);
+}
+
+/***************************************************************************
+ * Func: ascii_samples_scalar                                              *
+ *                                                                         *
+ * Desc: decodes the ASCII samples of a P2 or P3 raster. white space and   *
+ *       comments may come between any two samples                         *
+ *                                                                         *
+ * Params: pos - read position, advanced past the samples decoded          *
+ *         end - first byte past the raster                                *
+ *         out - decoded samples                                           *
+ *         count - number of samples wanted                                *
+ *         depth - bytes per decoded sample, 2 for maxval above 255        *
+ *                                                                         *
+ * Returns: number of samples decoded, less than count at the end of the   *
+ *          raster                                                         *
+ ***************************************************************************/
+
+static unsigned long ascii_samples_scalar(unsigned char **pos, unsigned char *end,
+	unsigned char *out, unsigned long count, int depth)
+{
+	unsigned char *p = *pos;    /* current read position */
+	unsigned long n;            /* samples decoded */
+	int value;                  /* sample being decoded */
+
+	for (n = 0; n < count; n++)
+	{
+		while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r') || *p == '#'))
+		{
+			if (*p == '#')
+				while (p < end && *p != '\n')
+					p++;
+			else
+				p++;
+		}
+		if (p >= end)
+			break;
+		if (*p < '0' || *p > '9')
+		{
+			printf("Garbage in ASCII raster\n");
+			exit(1);
+		}
+
+		value = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+			value = MIN(value * 10 + (*p - '0'), 65535);
+		if (depth == 2)
+			((unsigned short *)out)[n] = (unsigned short)value;
+		else
+			out[n] = (unsigned char)value;
+	}
+
+	*pos = p;
+	return n;
+}
+
+/***************************************************************************
+ * Func: ascii_bits                                                        *
+ *                                                                         *
+ * Desc: decodes a P1 raster into packed PBM rows. every '0' or '1' is a   *
+ *       pixel of its own, with or without white space in between          *
+ *                                                                         *
+ * Params: pos - read position                                             *
+ *         end - first byte past the raster                                *
+ *         out - packed rows, 1 = black, first pixel in the top bit        *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         row_size - bytes in one packed row                              *
+ *                                                                         *
+ * Returns: number of pixels decoded                                       *
+ ***************************************************************************/
+
+static unsigned long ascii_bits(unsigned char **pos, unsigned char *end,
+	image_ptr out, int rows, int cols, unsigned long row_size)
+{
+	unsigned char *p = *pos;    /* current read position */
+	unsigned long n;            /* pixels decoded */
+	int x, y;                   /* pixel being decoded */
+
+	memset(out, 0, row_size * rows);
+	n = 0;
+	for (y = 0; y < rows; y++)
+		for (x = 0; x < cols; x++)
+		{
+			while (p < end && *p != '0' && *p != '1')
+			{
+				if (*p == '#')
+					while (p < end && *p != '\n')
+						p++;
+				else if (*p == ' ' || (*p >= '\t' && *p <= '\r'))
+					p++;
+				else
+				{
+					printf("Garbage in ASCII raster\n");
+					exit(1);
+				}
+			}
+			if (p >= end)
+				goto done;
+
+			if (*p++ == '1')
+				out[y * row_size + x / 8] |= 0x80 >> (x % 8);
+			n++;
+		}
+
+done:
+	*pos = p;
+	return n;
+}
+
+/***************************************************************************
+ * Func: decode_ascii                                                      *
+ *                                                                         *
+ * Desc: decodes a P2 or P3 raster. the vector decoders take the runs of   *
+ *       plain numbers and white space; anything else, such as a comment,  *
+ *       is stepped over one sample at a time by the scalar decoder.       *
+ *       16-bit samples are left to the scalar decoder                     *
+ *                                                                         *
+ * Params: pos - read position                                             *
+ *         end - first byte past the raster                                *
+ *         out - decoded samples                                           *
+ *         count - number of samples wanted                                *
+ *         depth - bytes per decoded sample, 2 for maxval above 255        *
+ *                                                                         *
+ * Returns: number of samples decoded                                      *
+ ***************************************************************************/
+
+static unsigned long decode_ascii(unsigned char **pos, unsigned char *end,
+	unsigned char *out, unsigned long count, int depth)
+{
+	unsigned long (*vector)(unsigned char **pos, unsigned char *end,
+		unsigned char *out, unsigned long count) = NULL;
+	unsigned long n, got;       /* samples decoded in all and by one call */
+	int cpu = ip_cpu_features();
+
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+		vector = ascii_samples_sse41;
+	if (cpu & IP_CPU_AVX2)
+		vector = ascii_samples_avx2;
+#endif
+
+	if (vector == NULL || depth == 2)
+		return ascii_samples_scalar(pos, end, out, count, depth);
+
+	n = 0;
+	while (n < count)
+	{
+		n += vector(pos, end, out + n, count - n);
+		if (n == count)
+			break;
+		got = ascii_samples_scalar(pos, end, out + n, 1, 1);
+		if (got == 0)
+			break;
+		n += got;
+	}
+	return n;
+}
+
+/***************************************************************************
+ * Func: swap_samples                                                      *
+ *                                                                         *
+ * Desc: converts 16-bit samples between the big-endian order of a file    *
+ *       and the order of this host; on a big-endian host it is a copy     *
+ *                                                                         *
+ * Params: src - source samples                                            *
+ *         dst - converted samples, may be src itself                      *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+static void swap_samples(unsigned short *src, unsigned short *dst, unsigned long n)
+{
+	void (*swap)(unsigned short *src, unsigned short *dst, int n) = NULL;
+	unsigned short one = 1;     /* first byte is 0 on a big-endian host */
+	unsigned long i;            /* sample index */
+	int cpu = ip_cpu_features();
+
+	if (*(unsigned char *)&one == 0)
+	{
+		if (src != dst)
+			memcpy(dst, src, n * sizeof(unsigned short));
+		return;
+	}
+
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+		swap = swap16_sse41;
+	if (cpu & IP_CPU_AVX2)
+		swap = swap16_avx2;
+#endif
+
+	if (swap != NULL)
+		swap(src, dst, (int)n);
+	else
+		for (i = 0; i < n; i++)
+			dst[i] = (unsigned short)((src[i] >> 8) | (src[i] << 8));
+}
+
+/***************************************************************************
+ * Func: load_pnm                                                          *
  *                                                                         *
- * Desc: reads a portable bitmap file                                      *
+ * Desc: reads a portable bitmap file. the header and the start of the     *
+ *       raster come in with one fread; a header with comments too long    *
+ *       for it is read again from the file. ASCII files (P1, P2, P3) are  *
+ *       decoded into the same layout as their RAWBITS twins, and type is  *
+ *       set to the RAWBITS type (4, 5 or 6). when maxval is above 255     *
+ *       every sample is an unsigned short in host order                   *
  *                                                                         *
  * Params: filename - name of image file to read                           *
  *         rows - number of rows in the image                              *
  *         cols - number of columns in the image                           *
  *         type - file type                                                *
+ *         maxval - maximum value of pixel                                 *
  *                                                                         *
  * Returns: pointer to the image just read into memory                     *
  ***************************************************************************/
 
-image_ptr read_pnm(char *filename, int *rows, int *cols, int *type)
+static image_ptr load_pnm(char *filename, int *rows, int *cols, int *type,
+	int *maxval)
     {
-    int i;                     /* index variable */
-    int row_size;              /* size of image row in bytes */
-    int maxval;                /* maximum value of pixel */
+    int depth;                 /* bytes per sample */
     FILE *fp;                  /* input file pointer */
-    int firstchar, secchar;    /* first 2 characters in the input file */
     image_ptr ptr;             /* pointer to image buffer */
-    unsigned long offset;      /* offset into image buffer */
+    unsigned char head[PNM_HEAD_BYTES]; /* header and start of the raster */
+    unsigned char *pos;        /* first raster byte in head */
+    unsigned long head_size;   /* bytes held in head */
+    unsigned long held;        /* raster bytes held in head */
+    unsigned long file_size;   /* size of the whole file */
     unsigned long total_size;  /* size of image in bytes */
-    unsigned long total_bytes; /* number of total bytes written to file */
+    unsigned long total_bytes; /* number of bytes (or samples) read */
+    unsigned char *text;       /* whole ASCII raster */
+    unsigned long row_size;    /* size of image row in bytes */
     float scale;               /* number of bytes per pixel */
 
     /* open input file */
@@ -49,40 +365,49 @@ image_ptr read_pnm(char *filename, int *rows, int *cols, int *type)
 	exit(1);
 	}
 
-    firstchar = getc(fp);
-    secchar = getc(fp);
+    fseek(fp, 0, SEEK_END);
+    file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
 
-    if(firstchar != 'P')
+    head_size = fread(head, 1, PNM_HEAD_BYTES, fp);
+    if(head_size < PNM_HEAD_BYTES || pnm_header_held(head, head + head_size))
 	{
-	printf("You silly goof... This is not a PPM file!\n");
-	exit(1);
+	pos = pnm_header(head, head + head_size, rows, cols, maxval, type);
+	held = head_size - (pos - head);
+	}
+    else
+	{
+	/* the header runs past head: none of the raster is held */
+	fseek(fp, 0, SEEK_SET);
+	pnm_header_file(fp, rows, cols, maxval, type);
+	head_size = ftell(fp);
+	pos = head;
+	held = 0;
 	}
 
-    *cols = getnum(fp);
-    *rows = getnum(fp);
-    *type = secchar - '0';
-
-    switch(secchar)
+    switch(*type)
 	{
-	case '4':            /* PBM */
+	case 1:            /* PBM */
+	case 4:
 	    scale = 0.125;
-	    maxval = 1;
 	    break;
-	case '5':            /* PGM */
+	case 2:            /* PGM */
+	case 5:
 	    scale = 1.0;
-	    maxval = getnum(fp);
 	    break;
-	case '6':             /* PPM */
+	default:            /* PPM */
 	    scale = 3.0;
-	    maxval = getnum(fp);
-	    break;
-	default :             /* Error */
-	    printf("read_pnm: This is not a Portable bitmap RAWBITS file\n");
-	    exit(1);
 	    break;
 	}
 
-    row_size = (*cols) * scale;
+    /* samples take two bytes, most significant first, above maxval 255 */
+    depth = (*maxval > 255) ? 2 : 1;
+
+    /* PBM rows are padded to whole bytes */
+    if(scale < 1.0)
+	row_size = (*cols + 7) / 8;
+    else
+	row_size = (*cols) * scale * depth;
     total_size = (unsigned long) (*rows) * row_size;
 
     ptr = (image_ptr) IP_MALLOC(total_size);
@@ -93,25 +418,142 @@ image_ptr read_pnm(char *filename, int *rows, int *cols, int *type)
 	exit(1);
 	}
 
-    total_bytes=0;
-    offset = 0;
-    for(i=0; i<(*rows); i++)
+    if(*type >= PBM)
 	{
-	total_bytes+=fread(ptr+offset, 1, row_size, fp);
-	offset += row_size;
-	}
+	/* the start of the raster came in with the header */
+	total_bytes = MIN(held, total_size);
+	memcpy(ptr, pos, total_bytes);
+	total_bytes += fread(ptr + total_bytes, 1, total_size - total_bytes, fp);
+
+	if(total_size != total_bytes)
+	    {
+	    printf("Failed miserably trying to read %ld bytes\nRead %ld bytes\n",
+		    total_size, total_bytes);
+	    exit(1);
+	    }
 
-    if(total_size != total_bytes)
+	if(depth == 2)
+	    swap_samples((unsigned short *) ptr, (unsigned short *) ptr, total_size / 2);
+	}
+    else
 	{
-	printf("Failed miserably trying to read %ld bytes\nRead %ld bytes\n",
-		total_size, total_bytes);
-	exit(1);
+	/* the whole ASCII raster is read at once, then decoded */
+	text = (unsigned char *) IP_MALLOC(held + file_size - head_size);
+	if(text == NULL)
+	    {
+	    printf("Unable to malloc %lu bytes\n", held + file_size - head_size);
+	    exit(1);
+	    }
+	memcpy(text, pos, held);
+	held += fread(text + held, 1, file_size - head_size, fp);
+	pos = text;
+
+	if(*type == 1)
+	    {
+	    total_bytes = ascii_bits(&pos, text + held, ptr, *rows, *cols, row_size);
+	    total_size = (unsigned long) (*rows) * (*cols);
+	    }
+	else
+	    {
+	    total_size /= depth;
+	    total_bytes = decode_ascii(&pos, text + held, ptr, total_size, depth);
+	    }
+
+	if(total_size != total_bytes)
+	    {
+	    printf("Failed miserably trying to read %ld samples\nRead %ld samples\n",
+		    total_size, total_bytes);
+	    exit(1);
+	    }
+
+	IP_FREE(text);
+	*type += 3;
 	}
 
     fclose(fp);
     return ptr;
     }
 
+/***************************************************************************
+ * Func: read_pnm                                                          *
+ *                                                                         *
+ * Desc: reads a portable bitmap file. ASCII files (P1, P2, P3) come back  *
+ *       in the layout of their RAWBITS twins with type set to 4, 5 or 6.  *
+ *       16-bit files are scaled down to 8 bits; read_pnm16 keeps them     *
+ *                                                                         *
+ * Params: filename - name of image file to read                           *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         type - file type                                                *
+ *                                                                         *
+ * Returns: pointer to the image just read into memory                     *
+ ***************************************************************************/
+
+image_ptr read_pnm(char *filename, int *rows, int *cols, int *type)
+    {
+    int maxval;                /* maximum value of pixel */
+    image_ptr ptr;             /* pointer to image buffer */
+    image_ptr wide;            /* 16-bit samples as read */
+    unsigned long samples;     /* number of samples in the image */
+
+    ptr = load_pnm(filename, rows, cols, type, &maxval);
+    if(maxval <= 255)
+	return ptr;
+
+    samples = (unsigned long) (*rows) * (*cols) * ((*type == PPM) ? 3 : 1);
+    wide = ptr;
+    ptr = pnm16_to_8((image16_ptr) wide, NULL, samples, maxval);
+    IP_FREE(wide);
+    return ptr;
+    }
+
+/***************************************************************************
+ * Func: read_pnm16                                                        *
+ *                                                                         *
+ * Desc: reads a PGM or PPM file with up to 16 bits per sample. samples    *
+ *       come back as unsigned shorts in host order whatever the maxval,   *
+ *       so 8-bit files are widened without scaling                        *
+ *                                                                         *
+ * Params: filename - name of image file to read                           *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         type - file type (5 = PGM   6 = PPM)                            *
+ *         maxval - maximum value of pixel                                 *
+ *                                                                         *
+ * Returns: pointer to the image just read into memory                     *
+ ***************************************************************************/
+
+image16_ptr read_pnm16(char *filename, int *rows, int *cols, int *type,
+	int *maxval)
+{
+	image_ptr ptr;              /* image as read */
+	image16_ptr wide;           /* widened image */
+	unsigned long samples;      /* number of samples in the image */
+	unsigned long i;            /* sample index */
+
+	ptr = load_pnm(filename, rows, cols, type, maxval);
+	if (*type == PBM)
+	{
+		printf("read_pnm16: %s is a PBM file\n", filename);
+		exit(1);
+	}
+	if (*maxval > 255)
+		return (image16_ptr)ptr;
+
+	samples = (unsigned long)(*rows) * (*cols) * ((*type == PPM) ? 3 : 1);
+	wide = (image16_ptr)IP_MALLOC(samples * sizeof(unsigned short));
+	if (wide == NULL)
+	{
+		printf("Unable to malloc %lu bytes\n", samples * sizeof(unsigned short));
+		exit(1);
+	}
+	for (i = 0; i < samples; i++)
+		wide[i] = ptr[i];
+
+	IP_FREE(ptr);
+	return wide;
+}
+
 /***************************************************************************
  * Func: getnum                                                            *
  *                                                                         *
@@ -124,30 +566,24 @@ image_ptr read_pnm(char *filename, int *rows, int *cols, int *type)
 
 int getnum(FILE *fp)
     {
-    char c;               /* character read in from file */
+    int c;                /* character read in from file */
     int i;                /* number accumulated and returned */
 
+    /* white space and comments may come in any order before the number */
     do
 	{
 	c = getc(fp);
+	if(c == '#')                   /* chew off comments */
+	    while((c != '\n') && (c != EOF))
+		c = getc(fp);
 	}
     while((c==' ') || (c=='\t') || (c=='\n') || (c=='\r'));
 
     if((c<'0') || (c>'9'))
-	if(c == '#')                   /* chew off comments */
-	    {
-	    while(c == '#')
-		{
-		while(c != '\n')
-		    c = getc(fp);
-		c = getc(fp);
-		}
-	    }
-	else
-	    {
-	    printf("Garbage in ASCII fields\n");
-	    exit(1);
-	    }
+	{
+	printf("Garbage in ASCII fields\n");
+	exit(1);
+	}
 
     i=0;
     do
@@ -157,6 +593,11 @@ int getnum(FILE *fp)
 	}
     while((c>='0') && (c<='9'));
 
+    /* a comment may start right after the number; its newline ends it */
+    if(c == '#')
+	while((c != '\n') && (c != EOF))
+	    c = getc(fp);
+
     return i;
     }
 
@@ -214,7 +655,11 @@ void write_pnm(image_ptr ptr, char *filename, int rows,
     if(magic_number != 4)
 	fprintf(fp, "255\n");
 
-    row_size = cols * scale;
+    /* PBM rows are padded to whole bytes */
+    if(scale < 1.0)
+	row_size = (cols + 7) / 8;
+    else
+	row_size = cols * scale;
     total_size = (long) row_size *rows;
     offset = 0;
     total_bytes = 0;
@@ -231,473 +676,2419 @@ void write_pnm(image_ptr ptr, char *filename, int rows,
     fclose(fp);
     }
 
-/****************************************************************************
- * Func: pnm_open                                                           *
- *                                                                          *
- * Desc: opens a pnm file and determines rows, cols, and maxval             *
- *                                                                          *
- * Params: rows- pointer to number of rows in the image                     *
- *         cols - pointer number of columns in the image                    *
- *         maxval - pointer to max value                                    *
- *         filename - name of image file                                    *
- ****************************************************************************/
+/***************************************************************************
+ * Func: write_pnm16                                                       *
+ *                                                                         *
+ * Desc: writes out a PGM or PPM file from 16-bit samples. above maxval    *
+ *       255 each sample takes two bytes, most significant first; up to    *
+ *       255 the file is an ordinary 8-bit one                             *
+ *                                                                         *
+ * Params: ptr - pointer to image in memory                                *
+ *         filename - name of file to write image to                       *
+ *         rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *         magic_number - 5 = PGM   6 = PPM                                *
+ *         maxval - maximum value of pixel, 1 .. 65535                     *
+ ***************************************************************************/
 
-FILE *pnm_open(int *rows, int *cols, int *maxval, char *filename)
-    {
-    int firstchar, secchar;
-    float scale;
-    unsigned long row_size;
-    FILE *fp;
+void write_pnm16(image16_ptr ptr, char *filename, int rows, int cols,
+	int magic_number, int maxval)
+{
+	FILE *fp;                   /* file pointer for output file */
+	unsigned long line;         /* samples in one row */
+	unsigned long row_size;     /* bytes in one row of the file */
+	unsigned long total_bytes;  /* number of bytes written to output file */
+	unsigned short *row;        /* one row in file order */
+	unsigned long i;            /* sample index */
+	int y;                      /* row index */
+
+	if (magic_number != PGM && magic_number != PPM)
+	{
+		printf("write_pnm16: only PGM and PPM files have 16-bit samples\n");
+		exit(1);
+	}
+	if (maxval < 1 || maxval > 65535)
+	{
+		printf("write_pnm16: maxval %d is out of range\n", maxval);
+		exit(1);
+	}
 
-    if((fp = fopen(filename, "rb")) == NULL)
+	if ((fp = fopen(filename, "wb")) == NULL)
 	{
-	printf("Unable to open %s for reading\n",filename);
-	exit(1);
+		printf("Unable to open %s for output\n", filename);
+		exit(1);
 	}
 
-    firstchar = getc(fp);
-    secchar = getc(fp);
+	fprintf(fp, "P%d\n%d %d\n%d\n", magic_number, cols, rows, maxval);
 
-    if(firstchar != 'P')
+	line = (unsigned long)cols * ((magic_number == PPM) ? 3 : 1);
+	row_size = (maxval > 255) ? line * 2 : line;
+	row = (unsigned short *)malloc(line * sizeof(unsigned short));
+	if (row == NULL)
 	{
-	printf("You silly goof... This is not a PPM file!\n");
-	exit(1);
+		printf("Unable to malloc %lu bytes\n", line * sizeof(unsigned short));
+		exit(1);
 	}
 
-    *cols = getnum(fp);
-    *rows = getnum(fp);
-
-    switch(secchar)
+	total_bytes = 0;
+	for (y = 0; y < rows; y++, ptr += line)
 	{
-	case '4':            /* PBM */
-	    scale = 0.125;
-	    *maxval = 1;
-	    break;
-	case '5':            /* PGM */
-	    scale = 1.0;
-	    *maxval = getnum(fp);
-	    break;
-	case '6':             /* PPM */
-	    scale = 3.0;
-	    *maxval = getnum(fp);
-	    break;
-	default :             /* Error */
-	    printf("read_pnm: This is not a Portable bitmap RAWBITS file\n");
-	    exit(1);
-	    break;
+		if (maxval > 255)
+			swap_samples(ptr, row, line);
+		else
+			for (i = 0; i < line; i++)
+				((unsigned char *)row)[i] = (unsigned char)ptr[i];
+		total_bytes += fwrite(row, 1, row_size, fp);
 	}
 
-    row_size = (*cols) * scale;
-    return fp;
-    }
+	if (total_bytes != row_size * rows)
+		printf("Tried to write %lu bytes...Only wrote %lu\n",
+			row_size * rows, total_bytes);
+
+	free(row);
+	fclose(fp);
+}
 
+/* samples handed to one thread pool task by the 16-bit LUT functions */
+#define LUT16_CHUNK  65536
 
-/****************************************************************************
- * Func: read_mesh                                                          *
- *                                                                          *
- * Desc: reads mesh data into a mesh structure				    *
- *                                                                          *
- * Params: filename - name of input mesh file                               *
- *                                                                          *
- * Returns: mesh structure storing width, height, x data  and y data        *
- ****************************************************************************/
-mesh *read_mesh(char *filename)
+/* state shared by the tasks of apply_lut16 and pnm16_to_8 */
+
+typedef struct
     {
-    FILE *fp;
-    mesh *mesh_data;
-    int width, height, mesh_size;
+    image16_ptr in;         /* source samples */
+    void *out;              /* 16-bit or 8-bit output samples */
+    unsigned long n;        /* number of samples */
+    unsigned short *lut16;  /* 65536 entries for apply_lut16, else NULL */
+    unsigned char *lut8;    /* 65536 entries for pnm16_to_8 */
+    } lut16_job;
 
-    /* open mesh file for input */
-    if((fp = fopen(filename, "rb")) == NULL)
+/***************************************************************************
+ * Func: lut16_task                                                        *
+ *                                                                         *
+ * Desc: thread pool task: looks up chunk index of the samples             *
+ ***************************************************************************/
+
+static void lut16_task(void *arg, int index)
+{
+	lut16_job *job = (lut16_job *)arg;
+	unsigned long i, start, stop;   /* samples of the chunk */
+	unsigned short *out16;
+	unsigned char *out8;
+
+	start = (unsigned long)index * LUT16_CHUNK;
+	stop = MIN(start + LUT16_CHUNK, job->n);
+	if (job->lut16 != NULL)
 	{
-	printf("Unable to open mesh file %s for reading\n", filename);
-	exit(1);
+		out16 = (unsigned short *)job->out;
+		for (i = start; i < stop; i++)
+			out16[i] = job->lut16[job->in[i]];
 	}
+	else
+	{
+		out8 = (unsigned char *)job->out;
+		for (i = start; i < stop; i++)
+			out8[i] = job->lut8[job->in[i]];
+	}
+}
 
-    mesh_data = malloc(sizeof(mesh));
-    /* read dimensions of mesh */
-    fread(&width, sizeof(int), 1, fp);
-    fread(&height, sizeof(int), 1, fp);
-    mesh_data->width = width;
-    mesh_data->height = height;
-    mesh_size = width * height;
-
-    /* allocate memory for mesh data */
-    mesh_data->x_data = malloc(sizeof(float) * mesh_size);
-    mesh_data->y_data = malloc(sizeof(float) * mesh_size);
-
-    fread(mesh_data->x_data, sizeof(float), mesh_size, fp);
-    fread(mesh_data->y_data, sizeof(float), mesh_size, fp);
+/***************************************************************************
+ * Func: apply_lut16                                                       *
+ *                                                                         *
+ * Desc: maps every 16-bit sample through a look-up table, out[i] =        *
+ *       lut[in[i]], spread over the thread pool                           *
+ *                                                                         *
+ * Params: in - source samples                                             *
+ *         out - mapped samples, may be in itself                          *
+ *         n - number of samples                                           *
+ *         lut - 65536 entries, one for every sample value                 *
+ ***************************************************************************/
 
-    return(mesh_data);
-    }
+void apply_lut16(image16_ptr in, image16_ptr out, unsigned long n,
+	unsigned short *lut)
+{
+	lut16_job job;              /* chunks shared by the tasks */
+
+	job.in = in;
+	job.out = out;
+	job.n = n;
+	job.lut16 = lut;
+	job.lut8 = NULL;
+	ip_parallel_for((int)((n + LUT16_CHUNK - 1) / LUT16_CHUNK), lut16_task, &job);
+}
 
+/***************************************************************************
+ * Func: pnm16_to_8                                                        *
+ *                                                                         *
+ * Desc: scales 16-bit samples down to 0 .. 255, rounding to the nearest   *
+ *       level, through a look-up table. samples above maxval become 255   *
+ *                                                                         *
+ * Params: in - source samples                                             *
+ *         out - 8-bit samples, NULL to allocate them                      *
+ *         n - number of samples                                           *
+ *         maxval - maximum value of pixel of the source                   *
+ *                                                                         *
+ * Returns: the 8-bit samples                                              *
+ ***************************************************************************/
 
-/****************************************************************************
- * Func: scale_pnm                                                          *
- *                                                                          *
- * Desc: scale an image using nearest neighbor interpolation                *
- *                                                                          *
- * Params: buffer - pointer to image in memory                              *
- *         fileout - name of output file                                    *
- *         rows - number of rows in image                                   *
- *         cols - number of columns in image                                *
- *         x_scale - scale factor in X direction                            *
- *         y_scale - scale factor in Y direction                            *
- *         type - graphics file type (5 = PGM    6 = PPM)                   *
- ****************************************************************************/
-void NNinterpolation(image_ptr buffer, char *fileout,
-	int rows, int cols, int x_scale, int y_scale, int type)
+image_ptr pnm16_to_8(image16_ptr in, image_ptr out, unsigned long n, int maxval)
 {
-	unsigned long x, y;          /* loop indices for columns and rows */
-	unsigned long index;        /* index into line buffer */
-	unsigned long source_index; /* address of source pixel in image buffer */
-	unsigned char *line_buff;   /* output line buffer */
-	int new_rows, new_cols;     /* values of rows and columns for new image */
-	unsigned line;              /* number of pixels in one scan line */
-	FILE *fp;                   /* output file pointer */
-	unsigned long X_Source, Y_Source;  /* x and y address of source pixel */
-	pixel_ptr color_buff;       /* pointer to a color image in memory */
-
-	/* open new output file */
-	if ((fp = fopen(fileout, "wb")) == NULL)
+	unsigned char *lut;         /* 8-bit level of every sample value */
+	lut16_job job;              /* chunks shared by the tasks */
+	long v;                     /* sample value */
+
+	lut = (unsigned char *)malloc(65536);
+	if (out == NULL)
+		out = (image_ptr)IP_MALLOC(n);
+	if (lut == NULL || out == NULL)
 	{
-		printf("Unable to open %s for output\n", fileout);
+		printf("Unable to malloc %lu bytes\n", n);
 		exit(1);
 	}
 
-	new_cols = cols * x_scale;  //  κ
+	for (v = 0; v < 65536; v++)
+		lut[v] = (v >= maxval) ? 255 : (unsigned char)((v * 255 + maxval / 2) / maxval);
 
-	new_rows = rows * y_scale;  //  κ
+	job.in = in;
+	job.out = out;
+	job.n = n;
+	job.lut16 = NULL;
+	job.lut8 = lut;
+	ip_parallel_for((int)((n + LUT16_CHUNK - 1) / LUT16_CHUNK), lut16_task, &job);
 
-	/* print out the portable bitmap header */
-	fprintf(fp, "P%d\n%d %d\n255\n", type, new_cols, new_rows);
+	free(lut);
+	return out;
+}
 
-	if (type == 5)        /* PGM file */
-		line = new_cols;
-	else                 /* PPM file */
-	{
-		line = new_cols * 3;
-		color_buff = (pixel_ptr)buffer;
-	}
+/****************************************************************************
+ * Func: pnm_open_type                                                      *
+ *                                                                          *
+ * Desc: opens a pnm file and determines rows, cols, maxval and file type   *
+ *                                                                          *
+ * Params: rows- pointer to number of rows in the image                     *
+ *         cols - pointer number of columns in the image                    *
+ *         maxval - pointer to max value                                    *
+ *         type - pointer to file type (4 = PBM  5 = PGM  6 = PPM)          *
+ *         filename - name of image file                                    *
+ *                                                                          *
+ * Returns: file pointer positioned at the first raster byte                *
+ ****************************************************************************/
 
-	line_buff = (unsigned char *)malloc(line);
+FILE *pnm_open_type(int *rows, int *cols, int *maxval, int *type,
+		    char *filename)
+    {
+    int firstchar, secchar;
+    FILE *fp;
 
-	for (y = 0; y < new_rows; y++)
+    if((fp = fopen(filename, "rb")) == NULL)
 	{
-		index = 0;
-		for (x = 0; x < new_cols; x++)
-		{
-			X_Source = (unsigned long)((x / x_scale) + 0.5);
-			Y_Source = (unsigned long)((y / y_scale) + 0.5);
-			source_index = Y_Source * cols + X_Source;
-			if (type == 5)      /* PGM */
-				line_buff[index++] = buffer[source_index];
-			else               /* PPM */
-			{
-				line_buff[index++] = color_buff[source_index].r;
-				line_buff[index++] = color_buff[source_index].g;
-				line_buff[index++] = color_buff[source_index].b;
-			}
-		}
-		fwrite(line_buff, 1, line, fp);
+	printf("Unable to open %s for reading\n",filename);
+	exit(1);
 	}
-	fclose(fp);
-}
 
-/* BiLinear Interpolation Լ */
-void biInterpolation(image_ptr buffer, char* fileout, int rows, int cols, int x_scale, int y_scale, int type)
-{
-	unsigned long x, y;          /* ࿭  ε */
-	unsigned long index;        /* buffer  ε */
-	unsigned long source_index; /* ̹  ҽ ȼ ε */
-	unsigned char* line_buff;   /*   output */
-	unsigned line;              /* ϳ ٿ ϴ ȼ */
-	int scale_rows, scale_cols;     /* scale  rows, cols */
-	FILE* fp;                   /*  */
-	unsigned long X_Source, Y_Source; /*  ȼ ǥ */
-	pixel_ptr color_buff;
+    firstchar = getc(fp);
+    secchar = getc(fp);
 
-	//   
-	if ((fp = fopen(fileout, "wb")) == NULL)
+    if(firstchar != 'P')
 	{
-		printf("Unable to open %s for output\n", fileout);
-		exit(1);
+	printf("You silly goof... This is not a PPM file!\n");
+	exit(1);
 	}
-	// main Լ  scaleŭ ũ 
-	scale_cols = cols * x_scale;
-	scale_rows = rows * y_scale;
 
-	// Ʈ  ۼ
-	fprintf(fp, "P%d\n%d %d\n255\n", type, scale_cols, scale_rows);
+    *cols = getnum(fp);
+    *rows = getnum(fp);
+    *type = secchar - '0';
 
-	if (type == 5) /* PGM file */
-		line = scale_cols;
-	else /* PPM file */
+    switch(secchar)
 	{
-		line = scale_cols * 3;
-		color_buff = (pixel_ptr)buffer;
+	case '4':            /* PBM */
+	    *maxval = 1;
+	    break;
+	case '5':            /* PGM */
+	    *maxval = getnum(fp);
+	    break;
+	case '6':             /* PPM */
+	    *maxval = getnum(fp);
+	    break;
+	default :             /* Error */
+	    printf("read_pnm: This is not a Portable bitmap RAWBITS file\n");
+	    exit(1);
+	    break;
 	}
 
-	line_buff = (unsigned char*)malloc(line);
-
-	for (y = 0; y < scale_rows; y++)
-	{
-		index = 0; //row cols  üũ 
-		for (x = 0; x < scale_cols; x++)
-		{
-			// ֺ 4 ȼ
-			float NW, NE, SW, SE;
-			float EWweight, NSweight;
-			float EWtop, EWbottom;
-
-			int X_Source = (int)x / x_scale;
-			int Y_Source = (int)y / y_scale;
+    return fp;
+    }
 
-			// 4 ȼ 
-			NW = buffer[Y_Source * cols + X_Source];
-			NE = buffer[Y_Source * cols + X_Source + 1];
-			SW = buffer[(Y_Source + 1) * cols + X_Source];
-			SE = buffer[(Y_Source + 1) * cols + X_Source + 1];
+/****************************************************************************
+ * Func: pnm_open                                                           *
+ *                                                                          *
+ * Desc: opens a pnm file and determines rows, cols, and maxval             *
+ *                                                                          *
+ * Params: rows- pointer to number of rows in the image                     *
+ *         cols - pointer number of columns in the image                    *
+ *         maxval - pointer to max value                                    *
+ *         filename - name of image file                                    *
+ ****************************************************************************/
 
-			// ġ 
-			EWweight = ((float)x / x_scale) - (float)X_Source;
-			NSweight = ((float)y / y_scale) - (float)Y_Source;
+FILE *pnm_open(int *rows, int *cols, int *maxval, char *filename)
+    {
+    int type;                  /* file type, not needed by the caller */
 
-			EWtop = NW + EWweight * (NE - NW);
-			EWbottom = SW + EWweight * (SE - SW);
+    return pnm_open_type(rows, cols, maxval, &type, filename);
+    }
 
 
-			// ȼ  (Ի ) Ҵ
-			float pixel = EWtop + NSweight * (EWbottom - EWtop);
+/***************************************************************************
+ * Func: getnum_mem                                                        *
+ *                                                                         *
+ * Desc: reads an ASCII number from a portable bitmap header held in       *
+ *       memory, the counterpart of getnum for mapped files                *
+ *                                                                         *
+ * Params: pos - pointer to the current read position, advanced past the   *
+ *               number and the single character that ends it              *
+ *         end - first byte past the end of the memory block               *
+ *                                                                         *
+ * Returns: the number read                                                *
+ ***************************************************************************/
 
-			source_index = Y_Source * cols + X_Source;
+int getnum_mem(unsigned char **pos, unsigned char *end)
+{
+	unsigned char *p = *pos;    /* current read position */
+	int i;                      /* number accumulated and returned */
 
-			if (type == 5) /* PGM */
-				line_buff[index++] = (unsigned char)pixel;
-			else /* PPM */
-			{
-				line_buff[index++] = color_buff[source_index].r;
-				line_buff[index++] = color_buff[source_index].g;
-				line_buff[index++] = color_buff[source_index].b;
-			}
-		}
-		//  ۼ
-		fwrite(line_buff, 1, line, fp);
+	/* skip white space and comments up to the start of the number */
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '#'))
+	{
+		if (*p == '#')
+			while (p < end && *p != '\n')
+				p++;
+		else
+			p++;
 	}
-	fclose(fp);
-}
 
-/* Cubic Convolution Interpolation  Kernel Լ */
-float cubicConvKernel(float x) {
-	float absX = abs(x);
-	float absX2 = absX * absX;
-	float absX3 = absX2 * absX;
+	if (p >= end || *p < '0' || *p > '9')
+	{
+		printf("Garbage in ASCII fields\n");
+		exit(1);
+	}
 
-	float a = -1; //  -1 
-	/*
-	a = -2 :   , ̹  ϰ ǥ
-	a = -1 :  ε巴 
-	a = -0.5 : ߰  ε巯 
-	-> ̹  ε巴 ° ߿Ұ  -1  
-	*/
+	i = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		i = i * 10 + (*p++ - '0');     /* convert ASCII to int */
 
-	if (0 <= absX && absX < 1) {
-		return (float)(((a + 2) * absX3) - ((a + 3) * absX2) + 1);
-	}
-	else if (1 <= absX && absX < 2) {
-		return (float)((a * absX3) - ((5 * a) * absX2) + ((8 * a) * absX) - (4 * a));
-	}
-	else if(2 <= absX ) {
-		return (float)0;
-	}
+	/* the character ending the number belongs to the header, as in getnum;
+	   a comment right after the number is skipped up to its newline */
+	if (p < end && *p == '#')
+		while (p < end && *p != '\n')
+			p++;
+	if (p < end)
+		p++;
 
-	return 0;
+	*pos = p;
+	return i;
 }
 
-/* Cubic Convolution Interpolation Լ */
-void cubicConvInterpolation(image_ptr buffer, char* fileout, int rows, int cols, int x_scale, int y_scale, int type) {
-	unsigned long x, y;			/* ࿭  ε */
-	unsigned long index;		/* buffer  ε */
-	unsigned long source_index; /* ̹  ҽ ȼ ε */
-	unsigned char* line_buff;   /*   output */
-	unsigned long line;			/* ϳ ٿ ϴ ȼ */
-	int scale_rows, scale_cols;	/*  ȼ ǥ */
-	FILE* fp;					/*  */
-	pixel_ptr color_buff;
+/***************************************************************************
+ * Func: map_pnm                                                           *
+ *                                                                         *
+ * Desc: maps a portable bitmap file into memory without copying it. the   *
+ *       returned pointer addresses the raster bytes inside the mapping,   *
+ *       so it can be handed to any routine that takes an image_ptr        *
+ *                                                                         *
+ * Params: filename - name of image file to map                            *
+ *         map - filled with the image size, type and mapping details      *
+ *         mode - PNM_READONLY or PNM_COPYONWRITE. with PNM_COPYONWRITE    *
+ *                routines may write into the image; only the pages they   *
+ *                touch are copied and the file itself never changes       *
+ *                                                                         *
+ * Returns: pointer to the raster, which stays valid until unmap_pnm       *
+ ***************************************************************************/
 
-	//   
-	if ((fp = fopen(fileout, "wb")) == NULL) {
-		printf("Unable to open %s for output\n", fileout);
+image_ptr map_pnm(char *filename, pnm_map *map, int mode)
+{
+	unsigned char *pos;         /* header parse position */
+	unsigned char *end;         /* first byte past the mapping */
+	unsigned long row_size;     /* size of image row in bytes */
+	unsigned long total_size;   /* size of image in bytes */
+	float scale;                /* number of bytes per pixel */
+
+	map->base = ip_map_file(filename, mode == PNM_COPYONWRITE, &map->size);
+	end = (unsigned char *)map->base + map->size;
+	pos = pnm_header((unsigned char *)map->base, end,
+		&map->rows, &map->cols, &map->maxval, &map->type);
+
+	switch (map->type)
+	{
+	case PBM:
+		scale = 0.125;
+		break;
+	case PGM:
+		scale = 1.0;
+		break;
+	case PPM:
+		scale = 3.0;
+		break;
+	default:
+		printf("map_pnm: This is not a Portable bitmap RAWBITS file\n");
 		exit(1);
+		break;
 	}
 
-	// main Լ  scaleŭ ũ 
-	scale_cols = cols * x_scale;
-	scale_rows = rows * y_scale;
-
-	// Ʈ  ۼ
-	fprintf(fp, "P%d\n%d %d\n255\n", type, scale_cols, scale_rows);
-
-
-	// ̹ type ° line  (pgm or ppm)
-	if (type == 5) // PGM
-		line = scale_cols;
-	else { // PPM
-		line = scale_cols * 3;
-		color_buff = (pixel_ptr)buffer;
-	}
-
-	line_buff = (unsigned char*)malloc(line);
-
-	for (y = 0; y < scale_rows; y++) {
-		index = 0; // row  
-		for (x = 0; x < scale_cols; x++) {
-			// col   
-			float pixel = 0.0; //  col ȼ 
-			float weightSum = 0.0; // ġ 
-
-			float X_Source = x / (float)x_scale; //  ̹ x ǥ
-			float Y_Source = y / (float)y_scale; //  ̹ y ǥ
-
-			// Ҽκ ó (int)
-			int X_Source_int = (int)floor(X_Source);
-			int Y_Source_int = (int)floor(Y_Source);
-
-			// 16 ֺ ȼ ̿ϱ  -2~1  ι (4x4)
-			for (int i = -1; i <= 2; i++) {
-				for (int j = -1; j <= 2; j++) {
-					// current X, Y  ǥ
-					int currX = X_Source_int + j;
-					int currY = Y_Source_int + i;
-
-					//  ǥ ̹   ִ Ȯ
-					if (currX >= 0 && currX < cols && currY >= 0 && currY < rows) {
-						// cubicConvKernel  ġ 
-						float weight = cubicConvKernel(X_Source - currX) * cubicConvKernel(Y_Source - currY);
-						pixel += buffer[currY * cols + currX] * weight;
-						weightSum += weight;
-					}
-				}
-			}
-
-			//ġ ոŭ   pixel  Ҵ
-			pixel = pixel / weightSum;
+	row_size = (scale < 1.0) ? (map->cols + 7) / 8 : map->cols * scale;
+	if (map->maxval > 255)
+		row_size *= 2;
+	total_size = (unsigned long)map->rows * row_size;
 
-			source_index = Y_Source_int * cols + X_Source_int;
-
-			if (type == 5) // PGM
-				line_buff[index++] = (unsigned char)pixel;
-			else { // PPM
-				line_buff[index++] = color_buff[source_index].r;
-				line_buff[index++] = color_buff[source_index].g;
-				line_buff[index++] = color_buff[source_index].b;
-			}
-		}
-		//  
-		fwrite(line_buff, 1, line, fp);
+	if ((unsigned long)(end - pos) < total_size)
+	{
+		printf("Failed miserably trying to map %lu bytes\nFound %lu bytes\n",
+			total_size, (unsigned long)(end - pos));
+		exit(1);
 	}
-	fclose(fp);
+
+	map->data = pos;
+	return map->data;
 }
 
+/***************************************************************************
+ * Func: unmap_pnm                                                         *
+ *                                                                         *
+ * Desc: releases an image mapped by map_pnm. the raster pointer must not  *
+ *       be used afterwards                                                *
+ *                                                                         *
+ * Params: map - image mapping to release                                  *
+ ***************************************************************************/
 
-typedef unsigned short int USHORT;
-typedef unsigned long int  ULONG;
+void unmap_pnm(pnm_map *map)
+{
+	ip_unmap_file(map->base, map->size);
+	map->base = NULL;
+	map->data = NULL;
+	map->size = 0;
+}
 
-struct BITMAPHEADER {
-	USHORT bmpType;                       // BMP   Ÿ ĺ
-	ULONG  bmpSize;                       // BMP  ũ(Ʈ )
-	USHORT bmpReserved1;                  // 
-	USHORT bmpReserved2;                  // 
-	ULONG  bmpOffset;                     // ̹  ۵Ǵ ġ(Offset)
-	ULONG  bmpHeaderSize;                 // Header ũ(Ʈ )
-	ULONG  bmpWidth;                      //  ũ(ȼ )
-	ULONG  bmpHeight;                     //  ũ(ȼ )
-	USHORT bmpPlanes;                     // Color Plane (1 )
-	USHORT bmpBitCount;                   //  ȼ Ҵ Ʈ
-	ULONG  bmpCompression;                //   뿩
-	ULONG  bmpBitmapSize;                 // Ʈ ̹ ũ
-	ULONG  bmpXPelsPerMeter;              //  ػ
-	ULONG  bmpYPelsPerMeter;              //  ػ
-	ULONG  bmpColors;                     //  
-	ULONG  bmpClrImportant;
-};
 
-struct BITMAPHEADER bmp_header;                // Bitmap  Header ü
+/***************************************************************************
+ * Func: open_row_band                                                     *
+ *                                                                         *
+ * Desc: opens a PGM or PPM file for streaming. rows are read on demand    *
+ *       into a ring of band rows, so an image of any height can be        *
+ *       processed in O(cols * band) memory                                *
+ *                                                                         *
+ * Params: filename - name of image file                                   *
+ *         band - number of consecutive source rows to keep                *
+ *                                                                         *
+ * Returns: the row band, positioned before the first row                  *
+ ***************************************************************************/
 
+row_band *open_row_band(char *filename, int band)
+{
+	row_band *rb;               /* band being built */
+	int maxval;                 /* maximum value of pixel */
 
-void ConvertBMP(char* filein, char* fileout) {
-	int read_fd;
-	unsigned char pixel;
-	int row, col;
-
-	/*  Ͽ offset, width, height  д κ */
-	read_fd = open(filein, O_RDONLY);
-	if (read_fd == -1) {
-		printf(" ϴ : %s\n", filein);
+	rb = (row_band *)malloc(sizeof(row_band));
+	if (rb == NULL)
+	{
+		printf("Unable to malloc %lu bytes\n", (unsigned long)sizeof(row_band));
 		exit(1);
 	}
 
-	read(read_fd, &bmp_header.bmpType, sizeof(bmp_header.bmpType));
-	read(read_fd, &bmp_header.bmpSize, sizeof(bmp_header.bmpSize));
-	read(read_fd, &bmp_header.bmpReserved1, sizeof(bmp_header.bmpReserved1));
-	read(read_fd, &bmp_header.bmpReserved2, sizeof(bmp_header.bmpReserved2));
-	read(read_fd, &bmp_header.bmpOffset, sizeof(bmp_header.bmpOffset));
-	read(read_fd, &bmp_header.bmpHeaderSize, sizeof(bmp_header.bmpHeaderSize));
-	read(read_fd, &bmp_header.bmpWidth, sizeof(bmp_header.bmpWidth));
-	read(read_fd, &bmp_header.bmpHeight, sizeof(bmp_header.bmpHeight));
-	read(read_fd, &bmp_header.bmpPlanes, sizeof(bmp_header.bmpPlanes));
-	read(read_fd, &bmp_header.bmpBitCount, sizeof(bmp_header.bmpBitCount));
-	read(read_fd, &bmp_header.bmpCompression, sizeof(bmp_header.bmpCompression));
-	read(read_fd, &bmp_header.bmpBitmapSize, sizeof(bmp_header.bmpBitmapSize));
-	read(read_fd, &bmp_header.bmpXPelsPerMeter, sizeof(bmp_header.bmpXPelsPerMeter));
-	read(read_fd, &bmp_header.bmpYPelsPerMeter, sizeof(bmp_header.bmpYPelsPerMeter));
-	read(read_fd, &bmp_header.bmpColors, sizeof(bmp_header.bmpColors));
-	read(read_fd, &bmp_header.bmpClrImportant, sizeof(bmp_header.bmpClrImportant));
-
-	close(read_fd);
-
-	// bmpOffset, bmpWidth, bmpHeight 
-	printf("bmpOffset: %lu\n", bmp_header.bmpOffset);
-	printf("bmpWidth: %lu\n", bmp_header.bmpWidth);
-	printf("bmpHeight: %lu\n", bmp_header.bmpHeight);
-
-	/*  bmp covert  κ */
-	// bmp  б
-	FILE* bmpfile = fopen(filein, "rb");
-	if (bmpfile == NULL) {
-		printf("BMP    ϴ : %s\n", filein);
+	rb->fp = pnm_open_type(&rb->rows, &rb->cols, &maxval, &rb->type, filename);
+	if (rb->type != PGM && rb->type != PPM)
+	{
+		printf("open_row_band: only PGM and PPM files can be streamed\n");
 		exit(1);
 	}
-	//  pgm   
-	FILE* pgmfile = fopen(fileout, "wb");
-	if (pgmfile == NULL) {
-		printf("PGM    ϴ : %s\n", fileout);
+	if (maxval > 255)
+	{
+		printf("open_row_band: 16-bit files cannot be streamed\n");
 		exit(1);
 	}
 
+	rb->row_size = (rb->type == PPM) ? rb->cols * 3 : rb->cols;
+	rb->band = band;
+	rb->next_row = 0;
+	rb->ring = (image_ptr)IP_MALLOC((unsigned long)band * rb->row_size);
+	if (rb->ring == NULL)
+	{
+		printf("Unable to malloc %lu bytes\n", (unsigned long)band * rb->row_size);
+		exit(1);
+	}
 
-	// bmp    ġ ̵
-	fseek(bmpfile, bmp_header.bmpOffset, SEEK_SET);
-
-	// pgm  ۼ
-	fprintf(pgmfile, "P2\n"); // pgm P2
-	//ּ κ 
-	fprintf(pgmfile, "%lu %lu\n", bmp_header.bmpWidth, bmp_header.bmpHeight);
-	fprintf(pgmfile, "255\n");
+	return rb;
+}
 
-	/* bmp͸ pgm ͷ ȯ */
-	for (row = bmp_header.bmpHeight - 1; row >= 0; row--) {
-		for (col = 0; col < bmp_header.bmpWidth; col++) {
-			fseek(bmpfile, bmp_header.bmpOffset + (row * bmp_header.bmpWidth + col), SEEK_SET);
-			// (row * bmp_header.bmpWidth + col)   ȼ ġ 
-			fread(&pixel, sizeof(pixel), 1, bmpfile);
-			fprintf(pgmfile, "%u ", pixel);
-		}
-		//    ó
-		fprintf(pgmfile, "\n");
+/***************************************************************************
+ * Func: band_row                                                          *
+ *                                                                         *
+ * Desc: returns source row y, reading forward through the file as far as  *
+ *       needed. rows must be asked for in non-decreasing order, give or   *
+ *       take the band height                                              *
+ *                                                                         *
+ * Params: rb - row band from open_row_band                                *
+ *         y - source row wanted                                           *
+ *                                                                         *
+ * Returns: pointer to the row, or NULL if y lies outside the image        *
+ ***************************************************************************/
+
+image_ptr band_row(row_band *rb, int y)
+{
+	image_ptr slot;             /* ring slot the next row is read into */
+
+	if (y < 0 || y >= rb->rows)
+		return NULL;
+
+	if (y < rb->next_row - rb->band)
+	{
+		printf("band_row: row %d has already left the band\n", y);
+		exit(1);
+	}
+
+	while (rb->next_row <= y)
+	{
+		slot = rb->ring + (unsigned long)(rb->next_row % rb->band) * rb->row_size;
+		if (fread(slot, 1, rb->row_size, rb->fp) != (size_t)rb->row_size)
+		{
+			printf("Failed miserably trying to read row %d\n", rb->next_row);
+			exit(1);
+		}
+		rb->next_row++;
+	}
+
+	return rb->ring + (unsigned long)(y % rb->band) * rb->row_size;
+}
+
+/***************************************************************************
+ * Func: close_row_band                                                    *
+ *                                                                         *
+ * Desc: closes the file and frees a row band                              *
+ *                                                                         *
+ * Params: rb - row band from open_row_band                                *
+ ***************************************************************************/
+
+void close_row_band(row_band *rb)
+{
+	fclose(rb->fp);
+	IP_FREE(rb->ring);
+	free(rb);
+}
+
+
+/****************************************************************************
+ * Func: read_mesh                                                          *
+ *                                                                          *
+ * Desc: reads mesh data into a mesh structure				    *
+ *                                                                          *
+ * Params: filename - name of input mesh file                               *
+ *                                                                          *
+ * Returns: mesh structure storing width, height, x data  and y data        *
+ ****************************************************************************/
+mesh *read_mesh(char *filename)
+    {
+    FILE *fp;
+    mesh *mesh_data;
+    int width, height, mesh_size;
+
+    /* open mesh file for input */
+    if((fp = fopen(filename, "rb")) == NULL)
+	{
+	printf("Unable to open mesh file %s for reading\n", filename);
+	exit(1);
+	}
+
+    /* read dimensions of mesh */
+    if(fread(&width, sizeof(int), 1, fp) != 1 ||
+       fread(&height, sizeof(int), 1, fp) != 1 ||
+       width < 1 || height < 1)
+	{
+	printf("Bad mesh file %s\n", filename);
+	exit(1);
+	}
+    mesh_size = width * height;
+
+    /* allocate memory for mesh data */
+    mesh_data = malloc(sizeof(mesh));
+    if(mesh_data == NULL ||
+       (mesh_data->x_data = malloc(sizeof(float) * mesh_size)) == NULL ||
+       (mesh_data->y_data = malloc(sizeof(float) * mesh_size)) == NULL)
+	{
+	printf("Error allocating mesh %s\n", filename);
+	exit(1);
+	}
+    mesh_data->width = width;
+    mesh_data->height = height;
+
+    if(fread(mesh_data->x_data, sizeof(float), mesh_size, fp) != (size_t)mesh_size ||
+       fread(mesh_data->y_data, sizeof(float), mesh_size, fp) != (size_t)mesh_size)
+	{
+	printf("Mesh file %s is short\n", filename);
+	exit(1);
+	}
+
+    fclose(fp);
+    return(mesh_data);
+    }
+
+
+/****************************************************************************
+ * Func: free_mesh                                                          *
+ *                                                                          *
+ * Desc: frees a mesh from read_mesh                                        *
+ *                                                                          *
+ * Params: m - the mesh                                                     *
+ ****************************************************************************/
+void free_mesh(mesh *m)
+    {
+    if(m == NULL)
+	return;
+    free(m->x_data);
+    free(m->y_data);
+    free(m);
+    }
+
+
+/***************************************************************************
+ * Func: map_coord                                                         *
+ *                                                                         *
+ * Desc: maps output sample o of a row (or column) stretched from src to   *
+ *       dst samples back to the source: o * src / dst, kept as a whole    *
+ *       part and a remainder so no rounding creeps in. for dst = src * k  *
+ *       this is the o / k the integer scaling functions always used       *
+ *                                                                         *
+ * Params: o - output sample                                               *
+ *         src, dst - source and output lengths                            *
+ *         rem - returns the remainder, in units of 1/dst                  *
+ *                                                                         *
+ * Returns: the source sample at or left of the mapped position            *
+ ***************************************************************************/
+
+static int map_coord(int o, int src, int dst, int *rem)
+{
+	long long pos = (long long)o * src;     /* position in units of 1/dst */
+
+	*rem = (int)(pos % dst);
+	return (int)(pos / dst);
+}
+
+/***************************************************************************
+ * Func: build_nn_table                                                    *
+ *                                                                         *
+ * Desc: works out which source sample every output sample of a nearest    *
+ *       neighbor row copies. the row is also cut into 16-sample blocks;   *
+ *       a block whose sources fit in 16 bytes gets a shuffle mask so the  *
+ *       vector kernels can build it with one load and one byte shuffle    *
+ *                                                                         *
+ * Params: t - table to fill                                               *
+ *         cols - number of columns in the source row                      *
+ *         new_cols - number of columns in the output row                  *
+ *         channels - 1 for PGM, 3 for PPM                                 *
+ ***************************************************************************/
+
+static void build_nn_table(nn_table *t, int cols, int new_cols, int channels)
+{
+	int x, c, b, i;             /* column, channel, block and sample indices */
+	int base, top;              /* lowest and highest source sample of a block */
+	int X_Source, rem;          /* source column and unused remainder */
+
+	t->line = new_cols * channels;
+	t->blocks = t->line / 16;
+	t->src = (int *)malloc(sizeof(int) * t->line);
+	t->block_base = (int *)malloc(sizeof(int) * (t->blocks + 1));
+	t->block_mask = (unsigned char *)malloc(16 * (t->blocks + 1));
+	if (t->src == NULL || t->block_base == NULL || t->block_mask == NULL)
+	{
+		printf("Unable to malloc resampling tables\n");
+		exit(1);
+	}
+
+	for (x = 0; x < new_cols; x++)
+	{
+		X_Source = map_coord(x, cols, new_cols, &rem);
+		for (c = 0; c < channels; c++)
+			t->src[x * channels + c] = X_Source * channels + c;
+	}
+
+	for (b = 0; b < t->blocks; b++)
+	{
+		/* PPM blocks may start on a g or b sample, so the lowest source
+		   sample is not always the first one */
+		base = top = t->src[b * 16];
+		for (i = 1; i < 16; i++)
+		{
+			base = MIN(base, t->src[b * 16 + i]);
+			top = MAX(top, t->src[b * 16 + i]);
+		}
+
+		/* the 16-byte load must stay inside the source row */
+		if (top - base >= 16 || base + 16 > cols * channels)
+			base = -1;
+
+		t->block_base[b] = base;
+		for (i = 0; i < 16; i++)
+			t->block_mask[b * 16 + i] = (base < 0) ? 0 : t->src[b * 16 + i] - base;
+	}
+}
+
+/***************************************************************************
+ * Func: build_bilinear_table                                              *
+ *                                                                         *
+ * Desc: works out the left-hand source sample and the fixed point weight  *
+ *       pair (BI_ONE - w, w) of every output sample of a bilinear row.    *
+ *       w is the fractional part of x / x_scale in units of 1/BI_ONE.     *
+ *       the neighbours of an RGB sample are 3 apart, so for PPM src       *
+ *       indexes the pair row built by bilinear_row, where they sit side   *
+ *       by side as for PGM                                                *
+ *                                                                         *
+ * Params: t - table to fill                                               *
+ *         cols - number of columns in the source row                      *
+ *         new_cols - number of columns in the output row                  *
+ *         channels - 1 for PGM, 3 for PPM                                 *
+ ***************************************************************************/
+
+static void build_bilinear_table(bilinear_table *t, int cols, int new_cols,
+	int channels)
+{
+	int x, c, e;                /* column, channel and output sample */
+	int w;                      /* weight of the right-hand neighbour */
+	int X_Source, rem;          /* source column and fraction of a column */
+
+	t->line = new_cols * channels;
+	t->channels = channels;
+	t->src = (int *)malloc(sizeof(int) * t->line);
+	t->weight = (short *)malloc(sizeof(short) * 2 * t->line);
+	if (t->src == NULL || t->weight == NULL)
+	{
+		printf("Unable to malloc resampling tables\n");
+		exit(1);
+	}
+
+	for (x = 0; x < new_cols; x++)
+	{
+		X_Source = map_coord(x, cols, new_cols, &rem);
+		w = (int)(((long long)rem * BI_ONE + new_cols / 2) / new_cols);
+		for (c = 0; c < channels; c++)
+		{
+			e = x * channels + c;
+			t->src[e] = X_Source * channels + c;
+			if (channels > 1)
+				t->src[e] *= 2;
+			t->weight[2 * e] = (short)(BI_ONE - w);
+			t->weight[2 * e + 1] = (short)w;
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: bilinear_y                                                        *
+ *                                                                         *
+ * Desc: finds the source rows and fixed point weight of output row y      *
+ *                                                                         *
+ * Params: y - output row                                                  *
+ *         rows, new_rows - number of source and output rows               *
+ *         wy - returns the weight of the lower row, in units of 1/BI_ONE  *
+ *                                                                         *
+ * Returns: the upper source row                                           *
+ ***************************************************************************/
+
+static int bilinear_y(int y, int rows, int new_rows, int *wy)
+{
+	int Y_Source, rem;          /* upper row and fraction of a row */
+
+	Y_Source = map_coord(y, rows, new_rows, &rem);
+	*wy = (int)(((long long)rem * BI_ONE + new_rows / 2) / new_rows);
+	return Y_Source;
+}
+
+/***************************************************************************
+ * Func: nn_row_scalar                                                     *
+ *                                                                         *
+ * Desc: builds one output row for nearest neighbor scaling. the vector    *
+ *       kernels in ipsimd.c produce exactly the same bytes                *
+ *                                                                         *
+ * Params: src_row - source row the output row is taken from               *
+ *         line_buff - output line buffer                                  *
+ *         t - table from build_nn_table                                   *
+ ***************************************************************************/
+
+static void nn_row_scalar(image_ptr src_row, unsigned char *line_buff, nn_table *t)
+{
+	int e;                      /* output sample */
+
+	for (e = 0; e < t->line; e++)
+		line_buff[e] = src_row[t->src[e]];
+}
+
+/***************************************************************************
+ * Func: bilinear_vpass_scalar                                             *
+ *                                                                         *
+ * Desc: blends two source rows with fixed point weights. the result is    *
+ *       row0 * (BI_ONE - wy) + row1 * wy, at most 255 * BI_ONE            *
+ *                                                                         *
+ * Params: row0, row1 - source rows above and below                        *
+ *         wy - weight of row1                                             *
+ *         vrow - blended row                                              *
+ *         n - number of samples in a row                                  *
+ ***************************************************************************/
+
+static void bilinear_vpass_scalar(image_ptr row0, image_ptr row1, int wy,
+	short *vrow, int n)
+{
+	int i;                      /* sample index */
+
+	for (i = 0; i < n; i++)
+		vrow[i] = (short)(row0[i] * (BI_ONE - wy) + row1[i] * wy);
+}
+
+/***************************************************************************
+ * Func: bilinear_hpass_scalar                                             *
+ *                                                                         *
+ * Desc: blends each output sample from its two neighbours in a row made   *
+ *       by a vertical pass, rounding to the nearest grey level            *
+ *                                                                         *
+ * Params: vrow - row from a vertical pass, padded past the last column,   *
+ *                or its pair row for PPM                                  *
+ *         line_buff - output line buffer                                  *
+ *         t - table from build_bilinear_table                             *
+ ***************************************************************************/
+
+static void bilinear_hpass_scalar(short *vrow, unsigned char *line_buff,
+	bilinear_table *t)
+{
+	int e;                      /* output sample */
+	int s;                      /* left-hand source sample */
+
+	for (e = 0; e < t->line; e++)
+	{
+		s = t->src[e];
+		line_buff[e] = (unsigned char)((vrow[s] * t->weight[2 * e]
+			+ vrow[s + 1] * t->weight[2 * e + 1]
+			+ (1 << (2 * BI_SHIFT - 1))) >> (2 * BI_SHIFT));
+	}
+}
+
+/***************************************************************************
+ * Func: bilinear_pair_scalar                                              *
+ *                                                                         *
+ * Desc: builds the pair row of an interleaved row: sample i and sample    *
+ *       i + step side by side, so the horizontal pass finds both          *
+ *       neighbours of a colour sample next to each other                  *
+ *                                                                         *
+ * Params: vrow - row from a vertical pass, padded by step samples         *
+ *         pairs - 2 * n shorts                                            *
+ *         n - number of samples in vrow                                   *
+ *         step - distance between neighbours in vrow                      *
+ ***************************************************************************/
+
+static void bilinear_pair_scalar(short *vrow, short *pairs, int n, int step)
+{
+	int i;                      /* sample index */
+
+	for (i = 0; i < n; i++)
+	{
+		pairs[2 * i] = vrow[i];
+		pairs[2 * i + 1] = vrow[i + step];
+	}
+}
+
+/***************************************************************************
+ * Func: cubic_vpass_scalar                                                *
+ *                                                                         *
+ * Desc: 4-tap vertical blend of the separable cubic resampler             *
+ *                                                                         *
+ * Params: hrow - the four x-filtered rows                                 *
+ *         weight - their four weights                                     *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+static void cubic_vpass_scalar(float *hrow[4], float *weight, float bias,
+	unsigned char *out, int n)
+{
+	int i;                      /* sample index */
+	float pixel;                /* filtered value */
+
+	for (i = 0; i < n; i++)
+	{
+		pixel = weight[0] * hrow[0][i] + weight[1] * hrow[1][i]
+			+ weight[2] * hrow[2][i] + weight[3] * hrow[3][i] + bias;
+		CLIP(pixel, 0, 255);
+		out[i] = (unsigned char)pixel;
+	}
+}
+
+/***************************************************************************
+ * Func: cubic_vpass16_scalar                                              *
+ *                                                                         *
+ * Desc: cubic_vpass_scalar for 16-bit samples                             *
+ *                                                                         *
+ * Params: hrow - the four x-filtered rows                                 *
+ *         weight - their four weights                                     *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         top - largest sample value, the maxval of the image             *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+static void cubic_vpass16_scalar(float *hrow[4], float *weight, float bias,
+	float top, unsigned short *out, int n)
+{
+	int i;                      /* sample index */
+	float pixel;                /* filtered value */
+
+	for (i = 0; i < n; i++)
+	{
+		pixel = weight[0] * hrow[0][i] + weight[1] * hrow[1][i]
+			+ weight[2] * hrow[2][i] + weight[3] * hrow[3][i] + bias;
+		CLIP(pixel, 0, top);
+		out[i] = (unsigned short)pixel;
+	}
+}
+
+/* scratch bilinear_row needs for a row of n samples: the padded vertical
+   pass, then the pair row of an RGB row */
+#define VROW_SHORTS(n)  (3 * (n) + 32)
+
+/* row kernels picked by select_kernels */
+static void (*nn_row)(image_ptr src_row, unsigned char *line_buff, nn_table *t);
+static void (*bilinear_vpass)(image_ptr row0, image_ptr row1, int wy,
+	short *vrow, int n);
+static void (*bilinear_hpass)(short *vrow, unsigned char *line_buff,
+	bilinear_table *t);
+static void (*bilinear_pair)(short *vrow, short *pairs, int n, int step);
+static void (*cubic_vpass)(float *hrow[4], float *weight, float bias,
+	unsigned char *out, int n);
+static void (*cubic_vpass16)(float *hrow[4], float *weight, float bias,
+	float top, unsigned short *out, int n);
+
+/***************************************************************************
+ * Func: select_kernels                                                    *
+ *                                                                         *
+ * Desc: points the row kernels at the widest vector versions this cpu     *
+ *       runs, falling back to the scalar ones                             *
+ ***************************************************************************/
+
+static void select_kernels(void)
+{
+	int cpu = ip_cpu_features();
+
+	nn_row = nn_row_scalar;
+	bilinear_vpass = bilinear_vpass_scalar;
+	bilinear_hpass = bilinear_hpass_scalar;
+	bilinear_pair = bilinear_pair_scalar;
+	cubic_vpass = cubic_vpass_scalar;
+	cubic_vpass16 = cubic_vpass16_scalar;
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+	{
+		nn_row = nn_row_sse41;
+		bilinear_vpass = bilinear_vpass_sse41;
+		bilinear_hpass = bilinear_hpass_sse41;
+		bilinear_pair = bilinear_pair_sse41;
+		cubic_vpass = cubic_vpass_sse41;
+		cubic_vpass16 = cubic_vpass16_sse41;
+	}
+	if (cpu & IP_CPU_AVX2)
+	{
+		nn_row = nn_row_avx2;
+		bilinear_vpass = bilinear_vpass_avx2;
+		bilinear_hpass = bilinear_hpass_avx2;
+		bilinear_pair = bilinear_pair_avx2;
+		cubic_vpass = cubic_vpass_avx2;
+		cubic_vpass16 = cubic_vpass16_avx2;
+	}
+#endif
+}
+
+/***************************************************************************
+ * Func: bilinear_row                                                      *
+ *                                                                         *
+ * Desc: builds one output row for bilinear scaling: a vertical blend of   *
+ *       the two source rows, then a horizontal blend. the right-most      *
+ *       column reuses the last source pixel instead of reading past       *
+ *       the end of the row                                                *
+ *                                                                         *
+ * Params: row0 - source row above the output row                          *
+ *         row1 - source row below the output row (row0 on the last row)   *
+ *         wy - fixed point weight of row1                                 *
+ *         vrow - scratch of VROW_SHORTS(n) shorts                         *
+ *         n - number of samples in a source row                           *
+ *         line_buff - output line buffer                                  *
+ *         t - table from build_bilinear_table                             *
+ ***************************************************************************/
+
+static void bilinear_row(image_ptr row0, image_ptr row1, int wy, short *vrow,
+	int n, unsigned char *line_buff, bilinear_table *t)
+{
+	int i;                      /* padding sample */
+	short *pairs;               /* pair row, after the padded vrow */
+
+	bilinear_vpass(row0, row1, wy, vrow, n);
+	for (i = 0; i < t->channels; i++)
+		vrow[n + i] = vrow[n - t->channels + i];
+
+	if (t->channels == 1)
+		bilinear_hpass(vrow, line_buff, t);
+	else
+	{
+		pairs = vrow + n + 16;
+		bilinear_pair(vrow, pairs, n, t->channels);
+		bilinear_hpass(pairs, line_buff, t);
+	}
+}
+
+/* layout colour rows are filtered in, see set_color_layout */
+static int color_layout = IP_INTERLEAVED;
+
+/***************************************************************************
+ * Func: set_color_layout                                                  *
+ *                                                                         *
+ * Desc: chooses how the bilinear kernels filter PPM rows. IP_INTERLEAVED  *
+ *       works on the r,g,b triples in place; IP_PLANAR splits each row    *
+ *       into r, g and b planes and filters them as three grey rows,       *
+ *       which lets the vector kernels read neighbours that are adjacent.  *
+ *       both give the same image                                          *
+ *                                                                         *
+ * Params: layout - IP_INTERLEAVED or IP_PLANAR                            *
+ ***************************************************************************/
+
+void set_color_layout(int layout)
+{
+	color_layout = layout;
+}
+
+/***************************************************************************
+ * Func: bilinear_planar_row                                               *
+ *                                                                         *
+ * Desc: builds one output row of a PPM image for bilinear scaling as      *
+ *       three grey rows, for the IP_PLANAR layout                         *
+ *                                                                         *
+ * Params: row0, row1 - source rows above and below                        *
+ *         wy - fixed point weight of row1                                 *
+ *         vrow - scratch of VROW_SHORTS(cols) shorts                      *
+ *         cols - number of pixels in a source row                         *
+ *         planes - scratch of 3 * (2 * cols + t->line) bytes              *
+ *         line_buff - output line buffer                                  *
+ *         t - one-channel table from build_bilinear_table                 *
+ ***************************************************************************/
+
+static void bilinear_planar_row(image_ptr row0, image_ptr row1, int wy,
+	short *vrow, int cols, unsigned char *planes, unsigned char *line_buff,
+	bilinear_table *t)
+{
+	unsigned char *p0, *p1;     /* planes of the two source rows */
+	unsigned char *out;         /* planes of the output row */
+	int c;                      /* plane */
+
+	p0 = planes;
+	p1 = planes + 3 * cols;
+	out = planes + 6 * cols;
+
+	split_rgb(row0, p0, p0 + cols, p0 + 2 * cols, cols);
+	split_rgb(row1, p1, p1 + cols, p1 + 2 * cols, cols);
+	for (c = 0; c < 3; c++)
+		bilinear_row(p0 + c * cols, p1 + c * cols, wy, vrow, cols,
+			out + c * t->line, t);
+	merge_rgb(out, out + t->line, out + 2 * t->line, line_buff, t->line);
+}
+
+/***************************************************************************
+ * Func: free_nn_table, free_bilinear_table                                *
+ *                                                                         *
+ * Desc: free the tables built for a row kernel                            *
+ ***************************************************************************/
+
+static void free_nn_table(nn_table *t)
+{
+	free(t->src);
+	free(t->block_base);
+	free(t->block_mask);
+}
+
+static void free_bilinear_table(bilinear_table *t)
+{
+	free(t->src);
+	free(t->weight);
+}
+
+/***************************************************************************
+ * Func: cubic_row                                                         *
+ *                                                                         *
+ * Desc: builds one output row for cubic convolution scaling. the 16       *
+ *       weights of an output pixel are shared by its r, g and b samples   *
+ *                                                                         *
+ * Params: src - the four source rows Y_Source_int-1 .. Y_Source_int+2,    *
+ *               NULL for rows outside the image                           *
+ *         Y_Source - y coordinate of the output row in the source image   *
+ *         Y_Source_int - integer part of Y_Source                         *
+ *         line_buff - output line buffer                                  *
+ *         cols - number of columns in the source rows                     *
+ *         new_cols - number of columns in the output row                  *
+ *         x_scale - scale factor in X direction                           *
+ *         type - graphics file type (5 = PGM    6 = PPM)                  *
+ ***************************************************************************/
+
+static void cubic_row(image_ptr src[4], float Y_Source, int Y_Source_int,
+	unsigned char *line_buff, int cols, int new_cols, int x_scale, int type)
+{
+	int x;                      /* loop index for columns */
+	unsigned long index;        /* index into line buffer */
+	int channels;               /* samples per pixel */
+	int c;                      /* channel */
+
+	channels = (type == 5) ? 1 : 3;
+	index = 0; // row  
+	for (x = 0; x < new_cols; x++) {
+		// col   
+		float pixel[3] = { 0.0, 0.0, 0.0 }; //  col äκ ȼ 
+		float weightSum = 0.0; // ġ 
+
+		float X_Source = x / (float)x_scale; //  ̹ x ǥ
+
+		// Ҽκ ó (int)
+		int X_Source_int = (int)floor(X_Source);
+
+		// 16 ֺ ȼ ̿ϱ  -2~1  ι (4x4)
+		for (int i = -1; i <= 2; i++) {
+			//  row ̹  ̸ ǳʶ
+			if (src[i + 1] == NULL)
+				continue;
+			for (int j = -1; j <= 2; j++) {
+				// current X, Y  ǥ
+				int currX = X_Source_int + j;
+				int currY = Y_Source_int + i;
+
+				//  ǥ ̹   ִ Ȯ
+				if (currX >= 0 && currX < cols) {
+					// cubicConvKernel  ġ 
+					float weight = cubicConvKernel(X_Source - currX) * cubicConvKernel(Y_Source - currY);
+					// PPM  ġ r, g, b 
+					for (c = 0; c < channels; c++)
+						pixel[c] += src[i + 1][currX * channels + c] * weight;
+					weightSum += weight;
+				}
+			}
+		}
+
+		//ġ ոŭ   pixel  Ҵ
+		for (c = 0; c < channels; c++) {
+			pixel[c] = pixel[c] / weightSum;
+
+			// cubic kernel overshoot 0~255 
+			CLIP(pixel[c], 0, 255);
+			line_buff[index++] = (unsigned char)pixel[c];
+		}
+	}
+}
+
+
+/* output rows of one tile; see ip_run_tiles */
+
+#define TILE_ROWS  32
+
+/* state shared by the tiles of one scaling call */
+
+typedef struct scale_job
+    {
+    image_ptr buffer;       /* source image */
+    int rows, cols;         /* size of the source image */
+    int new_rows, new_cols; /* size of the output image */
+    int x_scale, y_scale;   /* whole scale factors, for cubic_tile only */
+    int type;               /* 5 = PGM   6 = PPM */
+    int depth;              /* bytes per sample, 2 for maxval above 255 */
+    unsigned long line;     /* bytes in one output row */
+    unsigned long row_size; /* bytes in one source row */
+    unsigned long in_stride; /* bytes from one source row to the next */
+    nn_table nt;            /* tables of the row kernel in use */
+    bilinear_table bt;
+    int planar;             /* PPM rows are filtered as three planes */
+    resample_axis xa, ya;
+    float bias;             /* added before truncating to a grey level */
+    float top;              /* largest grey level, 255 or the maxval */
+    int tile_cols;          /* output columns of a tile */
+    void (*tile)(struct scale_job *job, ip_tile *t, unsigned char *out);
+    image_ptr out;          /* output image */
+    unsigned long stride;   /* bytes from one output row to the next */
+    } scale_job;
+
+/***************************************************************************
+ * Func: scale_task                                                        *
+ *                                                                         *
+ * Desc: tile task: fills tile t of the output image                       *
+ ***************************************************************************/
+
+static void scale_task(void *arg, ip_tile *t)
+{
+	scale_job *job = (scale_job *)arg;
+	unsigned long pixel = job->line / job->new_cols;    /* bytes per pixel */
+
+	job->tile(job, t, job->out + (unsigned long)t->y0 * job->stride
+		+ t->x0 * pixel);
+}
+
+/***************************************************************************
+ * Func: init_scale_job                                                    *
+ *                                                                         *
+ * Desc: fills in the sizes of a scaling call; the caller adds the tables  *
+ *       and tile function of its method. a 16-bit call follows it with    *
+ *       set_depth                                                         *
+ ***************************************************************************/
+
+static void init_scale_job(scale_job *job, image_ptr buffer, int rows, int cols,
+	int new_rows, int new_cols, int type)
+{
+	int channels = (type == 5) ? 1 : 3;
+
+	job->buffer = buffer;
+	job->rows = rows;
+	job->cols = cols;
+	job->new_rows = new_rows;
+	job->new_cols = new_cols;
+	job->x_scale = new_cols / cols;
+	job->y_scale = new_rows / rows;
+	job->type = type;
+	job->depth = 1;
+	job->bias = 0.0;
+	job->top = 255.0;
+	job->line = (unsigned long)new_cols * channels;
+	job->row_size = (unsigned long)cols * channels;
+	job->in_stride = job->row_size;
+	job->tile_cols = new_cols;
+}
+
+/***************************************************************************
+ * Func: set_depth                                                         *
+ *                                                                         *
+ * Desc: switches a scaling call to 16-bit samples: rows get twice the     *
+ *       bytes and the separable passes clip to maxval                     *
+ ***************************************************************************/
+
+static void set_depth(scale_job *job, int maxval)
+{
+	job->depth = 2;
+	job->top = (float)maxval;
+	job->line *= 2;
+	job->row_size *= 2;
+	job->in_stride *= 2;
+}
+
+/***************************************************************************
+ * Func: run_scale_job                                                     *
+ *                                                                         *
+ * Desc: produces the output image in tiles of TILE_ROWS rows by           *
+ *       tile_cols columns that the thread pool fills in any order. every  *
+ *       tile writes only its own pixels, so the image is the same         *
+ *       whatever the thread count or tile size                            *
+ *                                                                         *
+ * Params: job - tables and tile function of the scaling method            *
+ *         out - output image, NULL to allocate one                        *
+ *         out_stride - bytes between output rows, 0 for packed rows       *
+ *                                                                         *
+ * Returns: the output image                                               *
+ ***************************************************************************/
+
+static image_ptr run_scale_job(scale_job *job, image_ptr out, int out_stride)
+{
+	job->stride = (out_stride > 0) ? (unsigned long)out_stride : job->line;
+	if (job->stride < job->line)
+	{
+		printf("Output stride %lu is shorter than a row of %lu bytes\n",
+			job->stride, job->line);
+		exit(1);
+	}
+
+	if (out == NULL)
+	{
+		out = (image_ptr)IP_MALLOC(job->stride * job->new_rows);
+		if (out == NULL)
+		{
+			printf("Unable to malloc output image\n");
+			exit(1);
+		}
+	}
+
+	job->out = out;
+	ip_run_tiles(job->new_rows, job->new_cols, TILE_ROWS, job->tile_cols,
+		scale_task, job);
+	return out;
+}
+
+/***************************************************************************
+ * Func: nn_tile, bilinear_tile, cubic_tile                                *
+ *                                                                         *
+ * Desc: fill output rows t->y0 .. t->y1 - 1 of the matching scaling       *
+ *       method. their tiles are always whole rows                         *
+ *                                                                         *
+ * Params: job - shared state of the scaling call                          *
+ *         t - the tile                                                    *
+ *         out - where row t->y0 goes; the others follow it                *
+ ***************************************************************************/
+
+static void nn_tile(scale_job *job, ip_tile *t, unsigned char *out)
+{
+	int y;                      /* output row */
+	int Y_Source, rem;          /* source row and unused remainder */
+	int prev;                   /* source row of the output row above */
+
+	prev = -1;
+	for (y = t->y0; y < t->y1; y++, out += job->stride)
+	{
+		Y_Source = map_coord(y, job->rows, job->new_rows, &rem);
+
+		/* output rows taken from the same source row are copies */
+		if (Y_Source == prev)
+			memcpy(out, out - job->stride, job->line);
+		else
+			nn_row(job->buffer + Y_Source * job->in_stride, out, &job->nt);
+		prev = Y_Source;
+	}
+}
+
+static void bilinear_tile(scale_job *job, ip_tile *t, unsigned char *out)
+{
+	int y;                      /* output row */
+	int Y_Source, Y_Next;       /* source rows above and below */
+	int wy;                     /* weight of the row below */
+	image_ptr row0, row1;
+	short *vrow;                /* vertical blend of the two rows */
+	unsigned char *planes;      /* planes of the rows for IP_PLANAR */
+
+	vrow = (short *)IP_MALLOC(sizeof(short) * VROW_SHORTS(job->row_size));
+	planes = (unsigned char *)IP_MALLOC(2 * job->row_size + job->line);
+	if (vrow == NULL || planes == NULL)
+	{
+		printf("Unable to malloc line buffers\n");
+		exit(1);
+	}
+
+	for (y = t->y0; y < t->y1; y++, out += job->stride)
+	{
+		Y_Source = bilinear_y(y, job->rows, job->new_rows, &wy);
+		Y_Next = MIN(Y_Source + 1, job->rows - 1);
+		row0 = job->buffer + Y_Source * job->in_stride;
+		row1 = job->buffer + Y_Next * job->in_stride;
+
+		if (job->planar)
+			bilinear_planar_row(row0, row1, wy, vrow, job->cols, planes, out, &job->bt);
+		else
+			bilinear_row(row0, row1, wy, vrow, job->row_size, out, &job->bt);
+	}
+
+	IP_FREE(planes);
+	IP_FREE(vrow);
+}
+
+static void cubic_tile(scale_job *job, ip_tile *t, unsigned char *out)
+{
+	int y, i;                   /* output row and index into src */
+	int currY;                  /* source row of src[i] */
+	float Y_Source;             /* y coordinate of the row in the source */
+	int Y_Source_int;           /* integer part of Y_Source */
+	image_ptr src[4];           /* source rows Y_Source_int-1 .. +2 */
+
+	for (y = t->y0; y < t->y1; y++, out += job->stride)
+	{
+		Y_Source = y / (float)job->y_scale;
+		Y_Source_int = (int)floor(Y_Source);
+
+		/* rows outside the image are NULL */
+		for (i = 0; i < 4; i++)
+		{
+			currY = Y_Source_int - 1 + i;
+			src[i] = (currY >= 0 && currY < job->rows) ?
+				job->buffer + currY * job->in_stride : NULL;
+		}
+
+		cubic_row(src, Y_Source, Y_Source_int, out, job->cols, job->new_cols,
+			job->x_scale, job->type);
+	}
+}
+
+/****************************************************************************
+ * Func: NNinterpolation_mem                                                *
+ *                                                                          *
+ * Desc: scale an image using nearest neighbor interpolation                *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ *         out - output image, NULL to allocate one                         *
+ *         out_stride - bytes between output rows, 0 for packed rows        *
+ *                                                                          *
+ * Returns: the scaled image, cols * x_scale by rows * y_scale              *
+ ****************************************************************************/
+image_ptr NNinterpolation_mem(image_ptr buffer, int rows, int cols,
+	int x_scale, int y_scale, int type, image_ptr out, int out_stride)
+{
+	int new_rows, new_cols;     /* values of rows and columns for new image */
+	scale_job job;              /* tables shared by the row tiles */
+
+	new_cols = cols * x_scale;  //  κ
+
+	new_rows = rows * y_scale;  //  κ
+
+	select_kernels();
+	init_scale_job(&job, buffer, rows, cols, new_rows, new_cols, type);
+	build_nn_table(&job.nt, cols, new_cols, (type == 5) ? 1 : 3);
+	job.tile = nn_tile;
+
+	out = run_scale_job(&job, out, out_stride);
+
+	free_nn_table(&job.nt);
+	return out;
+}
+
+/****************************************************************************
+ * Func: NNinterpolation                                                    *
+ *                                                                          *
+ * Desc: nearest neighbor scaling to a file                                 *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         fileout - name of output file                                    *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ ****************************************************************************/
+void NNinterpolation(image_ptr buffer, char *fileout,
+	int rows, int cols, int x_scale, int y_scale, int type)
+{
+	image_ptr out;              /* scaled image */
+
+	out = NNinterpolation_mem(buffer, rows, cols, x_scale, y_scale, type, NULL, 0);
+	write_pnm(out, fileout, rows * y_scale, cols * x_scale, type);
+	IP_FREE(out);
+}
+
+/* BiLinear Interpolation Լ,  ޸(out) ۼ */
+image_ptr biInterpolation_mem(image_ptr buffer, int rows, int cols, int x_scale, int y_scale, int type, image_ptr out, int out_stride)
+{
+	int scale_rows, scale_cols;     /* scale  rows, cols */
+	scale_job job;              /* row tile Բ  ̺ */
+
+	// main Լ  scaleŭ ũ 
+	scale_cols = cols * x_scale;
+	scale_rows = rows * y_scale;
+
+	// CPU ´ Ŀ ,  ٲ ʴ  ̸ 
+	select_kernels();
+	init_scale_job(&job, buffer, rows, cols, scale_rows, scale_cols, type);
+
+	// PPM äκ  (planar r, g, b   )
+	job.planar = (type == 6 && color_layout == IP_PLANAR);
+	build_bilinear_table(&job.bt, cols, scale_cols,
+		(type == 5 || job.planar) ? 1 : 3);
+	job.tile = bilinear_tile;
+
+	// row tile   out  (out NULL̸  Ҵ)
+	out = run_scale_job(&job, out, out_stride);
+
+	free_bilinear_table(&job.bt);
+	return out;
+}
+
+/* BiLinear Interpolation Լ */
+void biInterpolation(image_ptr buffer, char* fileout, int rows, int cols, int x_scale, int y_scale, int type)
+{
+	image_ptr out;              /* scale ̹ */
+
+	// ޸𸮿   Ϸ ۼ
+	out = biInterpolation_mem(buffer, rows, cols, x_scale, y_scale, type, NULL, 0);
+	write_pnm(out, fileout, rows * y_scale, cols * x_scale, type);
+	IP_FREE(out);
+}
+
+/* Cubic Convolution Interpolation  Kernel Լ */
+float cubicConvKernel(float x) {
+	float absX = (float)fabs(x);
+	float absX2 = absX * absX;
+	float absX3 = absX2 * absX;
+
+	float a = -1; //  -1 
+	/*
+	a = -2 :   , ̹  ϰ ǥ
+	a = -1 :  ε巴 
+	a = -0.5 : ߰  ε巯 
+	-> ̹  ε巴 ° ߿Ұ  -1  
+	*/
+
+	if (0 <= absX && absX < 1) {
+		return (float)(((a + 2) * absX3) - ((a + 3) * absX2) + 1);
+	}
+	else if (1 <= absX && absX < 2) {
+		return (float)((a * absX3) - ((5 * a) * absX2) + ((8 * a) * absX) - (4 * a));
+	}
+	else if(2 <= absX ) {
+		return (float)0;
+	}
+
+	return 0;
+}
+
+/* Cubic Convolution Interpolation Լ,  ޸(out) ۼ */
+image_ptr cubicConvInterpolation_mem(image_ptr buffer, int rows, int cols, int x_scale, int y_scale, int type, image_ptr out, int out_stride) {
+	int scale_rows, scale_cols;	/*  ȼ ǥ */
+	scale_job job;				/* row tile Բ   */
+
+	// main Լ  scaleŭ ũ 
+	scale_cols = cols * x_scale;
+	scale_rows = rows * y_scale;
+
+	// ̹ type ° line  (pgm or ppm)
+	init_scale_job(&job, buffer, rows, cols, scale_rows, scale_cols, type);
+	job.tile = cubic_tile;
+
+	// row tile   out  (out NULL̸  Ҵ)
+	return run_scale_job(&job, out, out_stride);
+}
+
+/* Cubic Convolution Interpolation Լ */
+void cubicConvInterpolation(image_ptr buffer, char* fileout, int rows, int cols, int x_scale, int y_scale, int type) {
+	image_ptr out;				/* scale ̹ */
+
+	// ޸𸮿   Ϸ ۼ
+	out = cubicConvInterpolation_mem(buffer, rows, cols, x_scale, y_scale, type, NULL, 0);
+	write_pnm(out, fileout, rows * y_scale, cols * x_scale, type);
+	IP_FREE(out);
+}
+
+/****************************************************************************
+ * Func: NNinterpolation_stream                                             *
+ *                                                                          *
+ * Desc: nearest neighbor scaling from file to file. only the source row    *
+ *       the current output row is taken from is held in memory             *
+ *                                                                          *
+ * Params: filein - name of input file                                      *
+ *         fileout - name of output file                                    *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ ****************************************************************************/
+void NNinterpolation_stream(char *filein, char *fileout, int x_scale, int y_scale)
+{
+	int y;                      /* loop index for rows */
+	unsigned char *line_buff;   /* output line buffer */
+	int new_rows, new_cols;     /* values of rows and columns for new image */
+	unsigned line;              /* number of bytes in one output scan line */
+	FILE *fp;                   /* output file pointer */
+	row_band *band;             /* ring holding the source row */
+	long held;                  /* source row now in line_buff, -1 = none */
+	nn_table nt;                /* source sample of each output sample */
+
+	band = open_row_band(filein, 1);
+
+	if ((fp = fopen(fileout, "wb")) == NULL)
+	{
+		printf("Unable to open %s for output\n", fileout);
+		exit(1);
+	}
+
+	new_cols = band->cols * x_scale;
+	new_rows = band->rows * y_scale;
+	fprintf(fp, "P%d\n%d %d\n255\n", band->type, new_cols, new_rows);
+
+	line = (band->type == 5) ? new_cols : new_cols * 3;
+	select_kernels();
+	build_nn_table(&nt, band->cols, new_cols, (band->type == 5) ? 1 : 3);
+	line_buff = (unsigned char *)IP_MALLOC(line);
+	held = -1;
+
+	for (y = 0; y < new_rows; y++)
+	{
+		if ((long)(y / y_scale) != held)
+		{
+			nn_row(band_row(band, y / y_scale), line_buff, &nt);
+			held = (long)(y / y_scale);
+		}
+		fwrite(line_buff, 1, line, fp);
+	}
+	free_nn_table(&nt);
+	IP_FREE(line_buff);
+	fclose(fp);
+	close_row_band(band);
+}
+
+/****************************************************************************
+ * Func: biInterpolation_stream                                             *
+ *                                                                          *
+ * Desc: bilinear scaling from file to file, holding two source rows        *
+ *                                                                          *
+ * Params: filein - name of input file                                      *
+ *         fileout - name of output file                                    *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ ****************************************************************************/
+void biInterpolation_stream(char *filein, char *fileout, int x_scale, int y_scale)
+{
+	int y;                      /* loop index for rows */
+	unsigned char *line_buff;   /* output line buffer */
+	int new_rows, new_cols;     /* values of rows and columns for new image */
+	unsigned line;              /* number of bytes in one output scan line */
+	FILE *fp;                   /* output file pointer */
+	row_band *band;             /* ring holding the two source rows */
+	image_ptr row0, row1;       /* source rows above and below */
+	short *vrow;                /* vertical blend of row0 and row1 */
+	unsigned char *planes;      /* planes of the rows for IP_PLANAR */
+	int planar;                 /* PPM rows are filtered as three planes */
+	bilinear_table bt;          /* neighbours and weights along x */
+
+	band = open_row_band(filein, 2);
+
+	if ((fp = fopen(fileout, "wb")) == NULL)
+	{
+		printf("Unable to open %s for output\n", fileout);
+		exit(1);
+	}
+
+	new_cols = band->cols * x_scale;
+	new_rows = band->rows * y_scale;
+	fprintf(fp, "P%d\n%d %d\n255\n", band->type, new_cols, new_rows);
+
+	line = (band->type == 5) ? new_cols : new_cols * 3;
+	select_kernels();
+	planar = (band->type == 6 && color_layout == IP_PLANAR);
+	build_bilinear_table(&bt, band->cols, new_cols, (band->type == 5 || planar) ? 1 : 3);
+	line_buff = (unsigned char *)IP_MALLOC(line);
+	vrow = (short *)IP_MALLOC(sizeof(short) * VROW_SHORTS(band->row_size));
+	planes = (unsigned char *)IP_MALLOC(2 * band->row_size + line);
+
+	for (y = 0; y < new_rows; y++)
+	{
+		int wy;
+		int Y_Source = bilinear_y(y, band->rows, new_rows, &wy);
+
+		row0 = band_row(band, Y_Source);
+		row1 = band_row(band, MIN(Y_Source + 1, band->rows - 1));
+		if (planar)
+			bilinear_planar_row(row0, row1, wy, vrow, band->cols, planes,
+				line_buff, &bt);
+		else
+			bilinear_row(row0, row1, wy, vrow, band->row_size, line_buff, &bt);
+		fwrite(line_buff, 1, line, fp);
+	}
+	free_bilinear_table(&bt);
+	IP_FREE(planes);
+	IP_FREE(vrow);
+	IP_FREE(line_buff);
+	fclose(fp);
+	close_row_band(band);
+}
+
+/****************************************************************************
+ * Func: cubicConvInterpolation_stream                                      *
+ *                                                                          *
+ * Desc: cubic convolution scaling from file to file, holding four source   *
+ *       rows                                                               *
+ *                                                                          *
+ * Params: filein - name of input file                                      *
+ *         fileout - name of output file                                    *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ ****************************************************************************/
+void cubicConvInterpolation_stream(char *filein, char *fileout, int x_scale, int y_scale)
+{
+	int y;                      /* loop index for rows */
+	unsigned char *line_buff;   /* output line buffer */
+	int new_rows, new_cols;     /* values of rows and columns for new image */
+	unsigned line;              /* number of bytes in one output scan line */
+	FILE *fp;                   /* output file pointer */
+	row_band *band;             /* ring holding the four source rows */
+	image_ptr src[4];           /* source rows Y_Source_int-1 .. +2 */
+	int i;                      /* index into src */
+
+	band = open_row_band(filein, 4);
+
+	if ((fp = fopen(fileout, "wb")) == NULL)
+	{
+		printf("Unable to open %s for output\n", fileout);
+		exit(1);
+	}
+
+	new_cols = band->cols * x_scale;
+	new_rows = band->rows * y_scale;
+	fprintf(fp, "P%d\n%d %d\n255\n", band->type, new_cols, new_rows);
+
+	line = (band->type == 5) ? new_cols : new_cols * 3;
+	line_buff = (unsigned char *)IP_MALLOC(line);
+
+	for (y = 0; y < new_rows; y++)
+	{
+		float Y_Source = y / (float)y_scale;
+		int Y_Source_int = (int)floor(Y_Source);
+
+		/* rows are fetched top to bottom so none is dropped too early */
+		for (i = 0; i < 4; i++)
+			src[i] = band_row(band, Y_Source_int - 1 + i);
+		cubic_row(src, Y_Source, Y_Source_int, line_buff, band->cols, new_cols,
+			x_scale, band->type);
+		fwrite(line_buff, 1, line, fp);
+	}
+	IP_FREE(line_buff);
+	fclose(fp);
+	close_row_band(band);
+}
+
+
+/***************************************************************************
+ * Func: alloc_axis                                                        *
+ *                                                                         *
+ * Desc: allocates the tables of a resample_axis                           *
+ *                                                                         *
+ * Params: axis - table to fill                                            *
+ *         taps - source samples read per output sample                    *
+ *         dst_len - number of output samples along the axis               *
+ ***************************************************************************/
+
+static void alloc_axis(resample_axis *axis, int taps, int dst_len)
+{
+	axis->taps = taps;
+	axis->index = (int *)malloc(sizeof(int) * taps * dst_len);
+	axis->weight = (float *)malloc(sizeof(float) * taps * dst_len);
+	if (axis->index == NULL || axis->weight == NULL)
+	{
+		printf("Unable to malloc resampling tables\n");
+		exit(1);
+	}
+}
+
+/***************************************************************************
+ * Func: cubic_axis                                                        *
+ *                                                                         *
+ * Desc: precomputes the cubic convolution taps along one axis. output     *
+ *       sample o reads the four source samples around o * src_len /       *
+ *       dst_len; taps that fall outside the image get weight 0 and the    *
+ *       rest are normalized, exactly as cubicConvInterpolation does in 2D *
+ *                                                                         *
+ * Params: axis - table to fill                                            *
+ *         src_len - number of source samples along the axis               *
+ *         dst_len - number of output samples along the axis               *
+ ***************************************************************************/
+
+static void cubic_axis(resample_axis *axis, int src_len, int dst_len)
+{
+	int o, k;                   /* output sample and tap indices */
+	float pos;                  /* source coordinate of the output sample */
+	int pos_int;                /* integer part of pos */
+	int src;                    /* source sample read by a tap */
+	float sum;                  /* sum of the in-range weights */
+	int *index;                 /* taps of the current output sample */
+	float *weight;
+
+	alloc_axis(axis, 4, dst_len);
+
+	for (o = 0; o < dst_len; o++)
+	{
+		/* for dst_len = src_len * k this is the o / (float)k of the 2D code */
+		pos = (float)((double)o * src_len / dst_len);
+		pos_int = (int)floor(pos);
+		index = axis->index + o * 4;
+		weight = axis->weight + o * 4;
+		sum = 0.0;
+
+		for (k = 0; k < 4; k++)
+		{
+			src = pos_int - 1 + k;
+			if (src >= 0 && src < src_len)
+				weight[k] = cubicConvKernel(pos - src);
+			else
+				weight[k] = 0.0;
+			sum += weight[k];
+			index[k] = CLAMP(src, 0, src_len - 1);
+		}
+
+		for (k = 0; k < 4; k++)
+			weight[k] /= sum;
+	}
+}
+
+/***************************************************************************
+ * Func: linear_axis                                                       *
+ *                                                                         *
+ * Desc: precomputes the two linear interpolation taps of every output     *
+ *       sample along one axis. the last source sample is reused past the  *
+ *       end of the axis                                                   *
+ *                                                                         *
+ * Params: axis - table to fill                                            *
+ *         src_len - number of source samples along the axis               *
+ *         dst_len - number of output samples along the axis               *
+ ***************************************************************************/
+
+static void linear_axis(resample_axis *axis, int src_len, int dst_len)
+{
+	int o;                      /* output sample */
+	int src, rem;               /* left-hand source sample and fraction */
+	float w;                    /* weight of the right-hand sample */
+
+	alloc_axis(axis, 2, dst_len);
+
+	for (o = 0; o < dst_len; o++)
+	{
+		src = map_coord(o, src_len, dst_len, &rem);
+		w = rem / (float)dst_len;
+		axis->index[2 * o] = src;
+		axis->index[2 * o + 1] = MIN(src + 1, src_len - 1);
+		axis->weight[2 * o] = 1.0f - w;
+		axis->weight[2 * o + 1] = w;
+	}
+}
+
+/***************************************************************************
+ * Func: area_axis                                                         *
+ *                                                                         *
+ * Desc: precomputes area-averaging taps for shrinking along one axis.     *
+ *       output sample o covers source positions o * src_len / dst_len     *
+ *       up to (o + 1) * src_len / dst_len, and each source sample is      *
+ *       weighted by how much of it lies in that span. the overlaps are    *
+ *       worked out in whole units of 1/dst_len so the weights of every    *
+ *       output sample add up to 1                                         *
+ *                                                                         *
+ * Params: axis - table to fill                                            *
+ *         src_len - number of source samples along the axis               *
+ *         dst_len - number of output samples along the axis, < src_len    *
+ ***************************************************************************/
+
+static void area_axis(resample_axis *axis, int src_len, int dst_len)
+{
+	int o, k;                   /* output sample and tap */
+	int taps;                   /* most source samples one span touches */
+	long long start, end;       /* span of o, in units of 1/dst_len */
+	long long lo, hi;           /* part of source sample s inside the span */
+	int first, s;               /* first source sample of the span, tap's */
+
+	taps = (src_len + dst_len - 1) / dst_len + 1;
+	alloc_axis(axis, taps, dst_len);
+
+	for (o = 0; o < dst_len; o++)
+	{
+		start = (long long)o * src_len;
+		end = start + src_len;
+		first = (int)(start / dst_len);
+
+		for (k = 0; k < taps; k++)
+		{
+			s = first + k;
+			lo = MAX(start, (long long)s * dst_len);
+			hi = MIN(end, (long long)(s + 1) * dst_len);
+			axis->index[o * taps + k] = MIN(s, src_len - 1);
+			axis->weight[o * taps + k] = (hi > lo) ? (float)(hi - lo) / src_len : 0.0f;
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: free_axis                                                         *
+ *                                                                         *
+ * Desc: frees the tables of a resample_axis                               *
+ *                                                                         *
+ * Params: axis - table to free                                            *
+ ***************************************************************************/
+
+static void free_axis(resample_axis *axis)
+{
+	free(axis->index);
+	free(axis->weight);
+}
+
+/***************************************************************************
+ * Func: horizontal_pass                                                   *
+ *                                                                         *
+ * Desc: resamples one source row along x into a row of floats. PPM rows   *
+ *       are filtered one channel after another for every output pixel,    *
+ *       so all three channels are done in the same sweep                  *
+ *                                                                         *
+ * Params: src_row - source row                                            *
+ *         axis - x taps                                                   *
+ *         out - new_cols * channels floats                                *
+ *         new_cols - number of output columns                             *
+ *         channels - 1 for PGM, 3 for PPM                                 *
+ ***************************************************************************/
+
+static void horizontal_pass(image_ptr src_row, resample_axis *axis,
+	float *out, int new_cols, int channels)
+{
+	int x, c, k;                /* output column, channel and tap */
+	int *index;                 /* taps of the current output column */
+	float *weight;
+	float sum;                  /* filtered value */
+
+	for (x = 0; x < new_cols; x++)
+	{
+		index = axis->index + x * axis->taps;
+		weight = axis->weight + x * axis->taps;
+		for (c = 0; c < channels; c++)
+		{
+			sum = 0.0;
+			for (k = 0; k < axis->taps; k++)
+				sum += weight[k] * src_row[index[k] * channels + c];
+			*out++ = sum;
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: horizontal_pass16                                                 *
+ *                                                                         *
+ * Desc: horizontal_pass for 16-bit source rows                            *
+ *                                                                         *
+ * Params: src_row - source row                                            *
+ *         axis - x taps                                                   *
+ *         out - new_cols * channels floats                                *
+ *         new_cols - number of output columns                             *
+ *         channels - 1 for PGM, 3 for PPM                                 *
+ ***************************************************************************/
+
+static void horizontal_pass16(unsigned short *src_row, resample_axis *axis,
+	float *out, int new_cols, int channels)
+{
+	int x, c, k;                /* output column, channel and tap */
+	int *index;                 /* taps of the current output column */
+	float *weight;
+	float sum;                  /* filtered value */
+
+	for (x = 0; x < new_cols; x++)
+	{
+		index = axis->index + x * axis->taps;
+		weight = axis->weight + x * axis->taps;
+		for (c = 0; c < channels; c++)
+		{
+			sum = 0.0;
+			for (k = 0; k < axis->taps; k++)
+				sum += weight[k] * src_row[index[k] * channels + c];
+			*out++ = sum;
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: vertical_pass                                                     *
+ *                                                                         *
+ * Desc: blends x-filtered rows into one output row. four taps go to the   *
+ *       vector kernels; the sums are formed in the same order either way  *
+ *                                                                         *
+ * Params: hrow - the taps x-filtered rows                                 *
+ *         weight - their weights                                          *
+ *         taps - number of rows                                           *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+static void vertical_pass(float **hrow, float *weight, int taps, float bias,
+	unsigned char *out, int n)
+{
+	int i, k;                   /* sample and tap */
+	float pixel;                /* filtered value */
+
+	if (taps == 4)
+	{
+		cubic_vpass(hrow, weight, bias, out, n);
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		pixel = 0.0;
+		for (k = 0; k < taps; k++)
+			pixel += weight[k] * hrow[k][i];
+		pixel += bias;
+		CLIP(pixel, 0, 255);
+		out[i] = (unsigned char)pixel;
+	}
+}
+
+/***************************************************************************
+ * Func: vertical_pass16                                                   *
+ *                                                                         *
+ * Desc: vertical_pass for 16-bit output rows                              *
+ *                                                                         *
+ * Params: hrow - the taps x-filtered rows                                 *
+ *         weight - their weights                                          *
+ *         taps - number of rows                                           *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         top - largest sample value, the maxval of the image             *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+static void vertical_pass16(float **hrow, float *weight, int taps, float bias,
+	float top, unsigned short *out, int n)
+{
+	int i, k;                   /* sample and tap */
+	float pixel;                /* filtered value */
+
+	if (taps == 4)
+	{
+		cubic_vpass16(hrow, weight, bias, top, out, n);
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		pixel = 0.0;
+		for (k = 0; k < taps; k++)
+			pixel += weight[k] * hrow[k][i];
+		pixel += bias;
+		CLIP(pixel, 0, top);
+		out[i] = (unsigned short)pixel;
+	}
+}
+
+/***************************************************************************
+ * Func: separable_tile                                                    *
+ *                                                                         *
+ * Desc: fills tile t of a separable resampler. every tile keeps its own   *
+ *       ring of x-filtered rows, so the source rows shared with the tile  *
+ *       above are filtered twice. the ring only spans the tile's columns, *
+ *       so on a wide image it stays in the cache down the whole band.     *
+ *       16-bit images go through the same ring with the 16-bit passes     *
+ *                                                                         *
+ * Params: job - shared state of the scaling call                          *
+ *         t - the tile                                                    *
+ *         out - where pixel (t->x0, t->y0) goes; the rows below follow at *
+ *               the output stride                                         *
+ ***************************************************************************/
+
+static void separable_tile(scale_job *job, ip_tile *t, unsigned char *out)
+{
+	int y, k;                   /* output row and tap */
+	int taps;                   /* source rows per output row */
+	int channels;               /* samples per pixel */
+	int w;                      /* output columns of the tile */
+	unsigned long n;            /* samples in one row of the tile */
+	resample_axis xa;           /* x taps from column t->x0 on */
+	unsigned char *src_row;     /* source row of a tap */
+	float *ring;                /* x-filtered source rows */
+	int *held;                  /* source row held by each ring slot */
+	float **hrow;               /* x-filtered rows used by this output row */
+	int *index;                 /* y taps of the current output row */
+	float *weight;
+
+	taps = job->ya.taps;
+	channels = (job->type == 5) ? 1 : 3;
+	w = t->x1 - t->x0;
+	n = (unsigned long)w * channels;
+	xa = job->xa;
+	xa.index += t->x0 * xa.taps;
+	xa.weight += t->x0 * xa.taps;
+	ring = (float *)malloc(sizeof(float) * taps * n);
+	held = (int *)malloc(sizeof(int) * taps);
+	hrow = (float **)malloc(sizeof(float *) * taps);
+	if (ring == NULL || held == NULL || hrow == NULL)
+	{
+		printf("Unable to malloc line buffers\n");
+		exit(1);
+	}
+	for (k = 0; k < taps; k++)
+		held[k] = -1;
+
+	for (y = t->y0; y < t->y1; y++, out += job->stride)
+	{
+		index = job->ya.index + y * taps;
+		weight = job->ya.weight + y * taps;
+
+		/* filter any source row this output row needs that is not held yet.
+		   the taps span at most taps consecutive rows, so two different
+		   rows never share a slot */
+		for (k = 0; k < taps; k++)
+		{
+			int slot = index[k] % taps;
+
+			hrow[k] = ring + slot * n;
+			if (held[slot] != index[k])
+			{
+				src_row = job->buffer + (unsigned long)index[k] * job->in_stride;
+				if (job->depth == 2)
+					horizontal_pass16((unsigned short *)src_row, &xa, hrow[k],
+						w, channels);
+				else
+					horizontal_pass(src_row, &xa, hrow[k], w, channels);
+				held[slot] = index[k];
+			}
+		}
+
+		if (job->depth == 2)
+			vertical_pass16(hrow, weight, taps, job->bias, job->top,
+				(unsigned short *)out, n);
+		else
+			vertical_pass(hrow, weight, taps, job->bias, out, n);
+	}
+
+	free(hrow);
+	free(held);
+	free(ring);
+}
+
+/****************************************************************************
+ * Func: cubicSeparableInterpolation_mem                                    *
+ *                                                                          *
+ * Desc: cubic convolution scaling done as two 1D passes. the tap indices   *
+ *       and weights depend only on the output column (or row) and the      *
+ *       scale, so they are computed once per axis. every source row is     *
+ *       filtered along x once and kept in a ring of four rows, and each    *
+ *       output row is a 4-tap blend of those, which is 8 multiply-adds     *
+ *       per output sample instead of 16 kernel evaluations. results are    *
+ *       rounded to the nearest grey level, so a flat image stays flat;     *
+ *       they can differ from cubicConvInterpolation, which truncates, by   *
+ *       one level                                                          *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ *         out - output image, NULL to allocate one                         *
+ *         out_stride - bytes between output rows, 0 for packed rows        *
+ *                                                                          *
+ * Returns: the scaled image, cols * x_scale by rows * y_scale              *
+ ****************************************************************************/
+image_ptr cubicSeparableInterpolation_mem(image_ptr buffer, int rows, int cols,
+	int x_scale, int y_scale, int type, image_ptr out, int out_stride)
+{
+	int new_rows, new_cols;     /* values of rows and columns for new image */
+	int channels;               /* samples per pixel */
+	scale_job job;              /* tap tables shared by the tiles */
+
+	new_cols = cols * x_scale;
+	new_rows = rows * y_scale;
+	channels = (type == 5) ? 1 : 3;
+
+	select_kernels();
+	init_scale_job(&job, buffer, rows, cols, new_rows, new_cols, type);
+	cubic_axis(&job.xa, cols, new_cols);
+	cubic_axis(&job.ya, rows, new_rows);
+	job.bias = 0.5;
+	job.tile = separable_tile;
+	job.tile_cols = ip_tile_cols(new_cols, sizeof(float) * job.ya.taps * channels, 0);
+
+	out = run_scale_job(&job, out, out_stride);
+
+	free_axis(&job.xa);
+	free_axis(&job.ya);
+	return out;
+}
+
+/****************************************************************************
+ * Func: cubicSeparableInterpolation                                        *
+ *                                                                          *
+ * Desc: separable cubic convolution scaling to a file                      *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         fileout - name of output file                                    *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ ****************************************************************************/
+void cubicSeparableInterpolation(image_ptr buffer, char *fileout,
+	int rows, int cols, int x_scale, int y_scale, int type)
+{
+	image_ptr out;              /* scaled image */
+
+	out = cubicSeparableInterpolation_mem(buffer, rows, cols, x_scale, y_scale,
+		type, NULL, 0);
+	write_pnm(out, fileout, rows * y_scale, cols * x_scale, type);
+	IP_FREE(out);
+}
+
+/****************************************************************************
+ * Func: resize_axis                                                        *
+ *                                                                          *
+ * Desc: picks the taps of one axis of resize_pnm: area averaging when the  *
+ *       axis shrinks, otherwise the interpolation kernel of the method     *
+ ****************************************************************************/
+
+static void resize_axis(resample_axis *axis, int src_len, int dst_len, int method)
+{
+	if (dst_len < src_len)
+		area_axis(axis, src_len, dst_len);
+	else if (method == RESIZE_BILINEAR)
+		linear_axis(axis, src_len, dst_len);
+	else
+		cubic_axis(axis, src_len, dst_len);
+}
+
+/****************************************************************************
+ * Func: resize_image                                                       *
+ *                                                                          *
+ * Desc: the engine behind resize_pnm_mem and resize_pnm16_mem. a 16-bit    *
+ *       nearest neighbor row is an 8-bit one with two byte samples per     *
+ *       channel; 16-bit bilinear goes through the separable passes         *
+ *                                                                          *
+ * Params: as resize_pnm_mem, plus                                          *
+ *         in_stride - bytes between input rows, 0 for packed rows          *
+ *         depth - bytes per sample, 2 for a 16-bit image                   *
+ *         maxval - maximum value of pixel, the clipping level              *
+ ****************************************************************************/
+
+static image_ptr resize_image(image_ptr buffer, int in_stride, int rows, int cols,
+	int *new_rows, int *new_cols, int type, int depth, int maxval, int method,
+	image_ptr out, int out_stride)
+{
+	scale_job job;              /* tables shared by the row tiles */
+	int channels;               /* samples per pixel */
+
+	if (*new_rows <= 0 && *new_cols > 0)
+		*new_rows = MAX(1, (int)((double)rows * *new_cols / cols + 0.5));
+	if (*new_cols <= 0 && *new_rows > 0)
+		*new_cols = MAX(1, (int)((double)cols * *new_rows / rows + 0.5));
+	if (*new_rows <= 0 || *new_cols <= 0)
+	{
+		printf("resize_pnm: bad output size %d x %d\n", *new_cols, *new_rows);
+		exit(1);
+	}
+
+	select_kernels();
+	init_scale_job(&job, buffer, rows, cols, *new_rows, *new_cols, type);
+	if (depth == 2)
+		set_depth(&job, maxval);
+	if (in_stride > 0)
+	{
+		if ((unsigned long)in_stride < job.row_size)
+		{
+			printf("Input stride %d is shorter than a row of %lu bytes\n",
+				in_stride, job.row_size);
+			exit(1);
+		}
+		job.in_stride = in_stride;
+	}
+	channels = (type == 5) ? 1 : 3;
+
+	if (method == RESIZE_NN)
+	{
+		build_nn_table(&job.nt, cols, *new_cols, channels * job.depth);
+		job.tile = nn_tile;
+		out = run_scale_job(&job, out, out_stride);
+		free_nn_table(&job.nt);
+	}
+	else if (method == RESIZE_BILINEAR && job.depth == 1
+		&& *new_rows >= rows && *new_cols >= cols)
+	{
+		job.planar = (type == 6 && color_layout == IP_PLANAR);
+		build_bilinear_table(&job.bt, cols, *new_cols, job.planar ? 1 : channels);
+		job.tile = bilinear_tile;
+		out = run_scale_job(&job, out, out_stride);
+		free_bilinear_table(&job.bt);
+	}
+	else
+	{
+		resize_axis(&job.xa, cols, *new_cols, method);
+		resize_axis(&job.ya, rows, *new_rows, method);
+		job.bias = 0.5;
+		job.tile = separable_tile;
+		job.tile_cols = ip_tile_cols(*new_cols,
+			sizeof(float) * job.ya.taps * channels, 0);
+		out = run_scale_job(&job, out, out_stride);
+		free_axis(&job.xa);
+		free_axis(&job.ya);
+	}
+
+	return out;
+}
+
+/****************************************************************************
+ * Func: resize_pnm_mem                                                     *
+ *                                                                          *
+ * Desc: resizes an image to any size. RESIZE_NN copies the nearest pixel.  *
+ *       RESIZE_BILINEAR and RESIZE_CUBIC interpolate when an axis grows    *
+ *       and average the covered area when it shrinks, so a large image     *
+ *       can be reduced straight to a thumbnail without aliasing. the       *
+ *       source position of output pixel x is x * cols / new_cols, and      *
+ *       filtered results are rounded to the nearest grey level, so a flat  *
+ *       image stays flat and whole-number factors give the same bytes as   *
+ *       NNinterpolation, biInterpolation and cubicSeparableInterpolation   *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         new_rows - rows of the new image, 0 keeps the aspect ratio;      *
+ *                    set to the rows actually used                         *
+ *         new_cols - columns of the new image, 0 keeps the aspect ratio;   *
+ *                    set to the columns actually used                      *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC              *
+ *         out - output image, NULL to allocate one                         *
+ *         out_stride - bytes between output rows, 0 for packed rows        *
+ *                                                                          *
+ * Returns: the resized image                                               *
+ ****************************************************************************/
+image_ptr resize_pnm_mem(image_ptr buffer, int rows, int cols,
+	int *new_rows, int *new_cols, int type, int method,
+	image_ptr out, int out_stride)
+{
+	return resize_image(buffer, 0, rows, cols, new_rows, new_cols, type, 1, 255,
+		method, out, out_stride);
+}
+
+/****************************************************************************
+ * Func: resize_pnm                                                         *
+ *                                                                          *
+ * Desc: resizes an image to any size and writes it to a file; see          *
+ *       resize_pnm_mem                                                     *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         fileout - name of output file                                    *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         new_rows - rows of the new image, 0 keeps the aspect ratio       *
+ *         new_cols - columns of the new image, 0 keeps the aspect ratio    *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC              *
+ ****************************************************************************/
+void resize_pnm(image_ptr buffer, char *fileout, int rows, int cols,
+	int new_rows, int new_cols, int type, int method)
+{
+	image_ptr out;              /* resized image */
+
+	out = resize_pnm_mem(buffer, rows, cols, &new_rows, &new_cols, type, method,
+		NULL, 0);
+	write_pnm(out, fileout, new_rows, new_cols, type);
+	IP_FREE(out);
+}
+
+/****************************************************************************
+ * Func: resize_pnm_scale                                                   *
+ *                                                                          *
+ * Desc: resizes an image by any scale factors, e.g. 0.25 or 1.5; the new   *
+ *       size is rounded to whole pixels                                    *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         fileout - name of output file                                    *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         x_scale - scale factor in X direction                            *
+ *         y_scale - scale factor in Y direction                            *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC              *
+ ****************************************************************************/
+void resize_pnm_scale(image_ptr buffer, char *fileout, int rows, int cols,
+	float x_scale, float y_scale, int type, int method)
+{
+	resize_pnm(buffer, fileout, rows, cols,
+		MAX(1, (int)(rows * y_scale + 0.5)), MAX(1, (int)(cols * x_scale + 0.5)),
+		type, method);
+}
+
+/****************************************************************************
+ * Func: resize_pnm16_mem                                                   *
+ *                                                                          *
+ * Desc: resize_pnm_mem for images from read_pnm16. the filters work on     *
+ *       the full 16-bit samples and clip to maxval, so no precision is     *
+ *       lost before the output is written                                  *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         new_rows - rows of the new image, 0 keeps the aspect ratio;      *
+ *                    set to the rows actually used                         *
+ *         new_cols - columns of the new image, 0 keeps the aspect ratio;   *
+ *                    set to the columns actually used                      *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ *         maxval - maximum value of pixel                                  *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC              *
+ *         out - output image, NULL to allocate one                         *
+ *         out_stride - bytes between output rows, 0 for packed rows        *
+ *                                                                          *
+ * Returns: the resized image                                               *
+ ****************************************************************************/
+image16_ptr resize_pnm16_mem(image16_ptr buffer, int rows, int cols,
+	int *new_rows, int *new_cols, int type, int maxval, int method,
+	image16_ptr out, int out_stride)
+{
+	return (image16_ptr)resize_image((image_ptr)buffer, 0, rows, cols,
+		new_rows, new_cols, type, 2, maxval, method, (image_ptr)out, out_stride);
+}
+
+/****************************************************************************
+ * Func: resize_pnm16                                                       *
+ *                                                                          *
+ * Desc: resizes a 16-bit image to any size and writes it to a file with    *
+ *       the same maxval; see resize_pnm_mem                                *
+ *                                                                          *
+ * Params: buffer - pointer to image in memory                              *
+ *         fileout - name of output file                                    *
+ *         rows - number of rows in image                                   *
+ *         cols - number of columns in image                                *
+ *         new_rows - rows of the new image, 0 keeps the aspect ratio       *
+ *         new_cols - columns of the new image, 0 keeps the aspect ratio    *
+ *         type - graphics file type (5 = PGM    6 = PPM)                   *
+ *         maxval - maximum value of pixel                                  *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC              *
+ ****************************************************************************/
+void resize_pnm16(image16_ptr buffer, char *fileout, int rows, int cols,
+	int new_rows, int new_cols, int type, int maxval, int method)
+{
+	image16_ptr out;            /* resized image */
+
+	out = resize_pnm16_mem(buffer, rows, cols, &new_rows, &new_cols, type,
+		maxval, method, NULL, 0);
+	write_pnm16(out, fileout, new_rows, new_cols, type, maxval);
+	IP_FREE(out);
+}
+
+/****************************************************************************
+ * Func: resize_desc                                                        *
+ *                                                                          *
+ * Desc: resize_pnm_mem and resize_pnm16_mem for image descriptors: in is   *
+ *       resized to the size of out, reading and writing rows any number    *
+ *       of bytes apart, so a window of one image can be scaled straight    *
+ *       into a window of another. a planar image is resized plane by       *
+ *       plane. samples deeper than 8 bits clip to 2^depth - 1              *
+ *                                                                          *
+ * Params: in - source image, 1 or 3 channels                               *
+ *         out - resized image, same channels, depth and layout             *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC              *
+ ****************************************************************************/
+void resize_desc(image_desc *in, image_desc *out, int method)
+{
+	image_desc src, dst;        /* one plane of each */
+	int new_rows, new_cols;     /* size of out, as resize_image wants it */
+	int k;
+
+	if (in->channels != out->channels || in->depth != out->depth
+		|| (in->plane_stride == 0) != (out->plane_stride == 0))
+	{
+		printf("resize_desc: images differ in channels, depth or layout\n");
+		exit(1);
+	}
+
+	for (k = 0; k < image_planes(in); k++)
+	{
+		src = image_plane(in, k);
+		dst = image_plane(out, k);
+		if (src.channels != 1 && src.channels != 3)
+		{
+			printf("resize_desc: cannot resize %d channels\n", src.channels);
+			exit(1);
+		}
+		new_rows = dst.height;
+		new_cols = dst.width;
+		resize_image(src.data, (int)src.stride, src.height, src.width,
+			&new_rows, &new_cols, (src.channels == 3) ? PPM : PGM,
+			(src.depth > 8) ? 2 : 1, (1 << src.depth) - 1, method, dst.data,
+			(int)dst.stride);
 	}
+}
+
+/* BMP  binary pnm Ϸ ȯϴ Լ */
+void ConvertBMP(char* filein, char* fileout) {
+	int rows, cols, type;
+	bmp_info info;                  // BMP  header 
+	image_ptr image;
+
+	/* palette, 24/32bit, RLE8, top-down BMP  pgm/ppm 迭  */
+	image = read_bmp(filein, &rows, &cols, &type, &info);
+
+	// bmpOffset, bmpWidth, bmpHeight 
+	printf("bmpOffset: %lu\n", info.offset);
+	printf("bmpWidth: %ld\n", info.width);
+	printf("bmpHeight: %ld\n", info.height);
 
-	fclose(bmpfile);
-	fclose(pgmfile);
+	// ȸ palette -> P5,   -> P6
+	write_pnm(image, fileout, rows, cols, type);
+	IP_FREE(image);
 }
@@ -0,0 +1,377 @@
+/***************************************************************************
+ * File: iplut.c                                                           *
+ *                                                                         *
+ * Desc: point operations on 8-bit samples through 256-entry look-up       *
+ *       tables. tables are built from a function or one of the usual      *
+ *       operations, composed, and applied to an image in one pass over    *
+ *       memory, however many operations were folded into them             *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* samples handed to one thread pool task */
+#define LUT_CHUNK  65536
+
+/***************************************************************************
+ * Func: lut_level                                                         *
+ *                                                                         *
+ * Desc: rounds a computed grey level and clips it to 0 .. 255             *
+ ***************************************************************************/
+
+static unsigned char lut_level(double value)
+{
+	value = floor(value + 0.5);
+	CLIP(value, 0, 255);
+	return (unsigned char)value;
+}
+
+/***************************************************************************
+ * Func: lut_from_function                                                 *
+ *                                                                         *
+ * Desc: fills a table with f(0) .. f(255), rounded and clipped            *
+ *                                                                         *
+ * Params: lut - 256 entries to fill                                       *
+ *         f - the point operation                                         *
+ *         arg - passed on to f                                            *
+ ***************************************************************************/
+
+void lut_from_function(unsigned char *lut, double (*f)(double value, void *arg),
+	void *arg)
+{
+	int v;                      /* grey level */
+
+	for (v = 0; v < 256; v++)
+		lut[v] = lut_level(f(v, arg));
+}
+
+/***************************************************************************
+ * Func: lut_identity                                                      *
+ *                                                                         *
+ * Desc: fills a table that leaves every grey level alone                  *
+ *                                                                         *
+ * Params: lut - 256 entries to fill                                       *
+ ***************************************************************************/
+
+void lut_identity(unsigned char *lut)
+{
+	int v;                      /* grey level */
+
+	for (v = 0; v < 256; v++)
+		lut[v] = (unsigned char)v;
+}
+
+/***************************************************************************
+ * Func: lut_linear                                                        *
+ *                                                                         *
+ * Desc: fills a table for v * scale + offset, the arithmetic point        *
+ *       operations of arithlut.c                                          *
+ *                                                                         *
+ * Params: lut - 256 entries to fill                                       *
+ *         scale - gain                                                    *
+ *         offset - added after the gain                                   *
+ ***************************************************************************/
+
+void lut_linear(unsigned char *lut, double scale, double offset)
+{
+	int v;                      /* grey level */
+
+	for (v = 0; v < 256; v++)
+		lut[v] = lut_level(v * scale + offset);
+}
+
+/***************************************************************************
+ * Func: lut_gamma                                                         *
+ *                                                                         *
+ * Desc: fills a table for 255 * (v / 255) ^ gamma. gamma below 1          *
+ *       brightens the dark tones, above 1 darkens them                    *
+ *                                                                         *
+ * Params: lut - 256 entries to fill                                       *
+ *         gamma - exponent, greater than 0                                *
+ ***************************************************************************/
+
+void lut_gamma(unsigned char *lut, double gamma)
+{
+	int v;                      /* grey level */
+
+	if (gamma <= 0.0)
+	{
+		printf("lut_gamma: gamma must be greater than 0\n");
+		exit(1);
+	}
+
+	for (v = 0; v < 256; v++)
+		lut[v] = lut_level(255.0 * pow(v / 255.0, gamma));
+}
+
+/***************************************************************************
+ * Func: lut_contrast                                                      *
+ *                                                                         *
+ * Desc: fills a contrast stretch table: low maps to 0, high to 255 and    *
+ *       the levels in between are spread linearly                         *
+ *                                                                         *
+ * Params: lut - 256 entries to fill                                       *
+ *         low - level that becomes black                                  *
+ *         high - level that becomes white, greater than low               *
+ ***************************************************************************/
+
+void lut_contrast(unsigned char *lut, int low, int high)
+{
+	if (high <= low)
+	{
+		printf("lut_contrast: high %d must be above low %d\n", high, low);
+		exit(1);
+	}
+
+	lut_linear(lut, 255.0 / (high - low), -255.0 * low / (high - low));
+}
+
+/***************************************************************************
+ * Func: lut_threshold                                                     *
+ *                                                                         *
+ * Desc: fills a table that makes levels below threshold black and the     *
+ *       rest white                                                        *
+ *                                                                         *
+ * Params: lut - 256 entries to fill                                       *
+ *         threshold - first level that becomes white                      *
+ ***************************************************************************/
+
+void lut_threshold(unsigned char *lut, int threshold)
+{
+	int v;                      /* grey level */
+
+	for (v = 0; v < 256; v++)
+		lut[v] = (v < threshold) ? 0 : 255;
+}
+
+/***************************************************************************
+ * Func: lut_compose                                                       *
+ *                                                                         *
+ * Desc: folds two tables into one that does first, then second            *
+ *                                                                         *
+ * Params: first - table applied first                                     *
+ *         second - table applied to its result                            *
+ *         out - 256 entries, may be first or second                       *
+ ***************************************************************************/
+
+void lut_compose(unsigned char *first, unsigned char *second, unsigned char *out)
+{
+	unsigned char tmp[256];     /* result, in case out is an operand */
+	int v;                      /* grey level */
+
+	for (v = 0; v < 256; v++)
+		tmp[v] = second[first[v]];
+	memcpy(out, tmp, 256);
+}
+
+/***************************************************************************
+ * Func: apply_lut_scalar                                                  *
+ *                                                                         *
+ * Desc: maps samples through a 256-entry table                            *
+ *                                                                         *
+ * Params: src - source samples                                            *
+ *         dst - mapped samples, may be src itself                         *
+ *         n - number of samples                                           *
+ *         lut - 256 entries                                               *
+ ***************************************************************************/
+
+static void apply_lut_scalar(unsigned char *src, unsigned char *dst, int n,
+	unsigned char *lut)
+{
+	int i;                      /* sample index */
+
+	for (i = 0; i < n; i++)
+		dst[i] = lut[src[i]];
+}
+
+/* a table kernel: apply_lut_scalar, _sse41 or _avx2 */
+typedef void (*lut_fn)(unsigned char *src, unsigned char *dst, int n,
+	unsigned char *lut);
+
+/* state shared by the tasks of apply_lut */
+
+typedef struct
+    {
+    image_ptr in;           /* source samples */
+    image_ptr out;          /* mapped samples */
+    unsigned long n;        /* number of samples */
+    unsigned char *lut;     /* 256 entries */
+    lut_fn kernel;          /* from lut_kernel */
+    } lut_job;
+
+/***************************************************************************
+ * Func: lut_task                                                          *
+ *                                                                         *
+ * Desc: thread pool task: maps chunk index of the samples                 *
+ ***************************************************************************/
+
+static void lut_task(void *arg, int index)
+{
+	lut_job *job = (lut_job *)arg;
+	unsigned long start;        /* first sample of the chunk */
+
+	start = (unsigned long)index * LUT_CHUNK;
+	job->kernel(job->in + start, job->out + start,
+		(int)MIN(LUT_CHUNK, job->n - start), job->lut);
+}
+
+/***************************************************************************
+ * Func: lut_kernel                                                        *
+ *                                                                         *
+ * Desc: picks the fastest table kernel the cpu has                        *
+ ***************************************************************************/
+
+static lut_fn lut_kernel(void)
+{
+	int cpu = ip_cpu_features();
+
+#ifdef IP_X86
+	if (cpu & IP_CPU_AVX2)
+		return apply_lut_avx2;
+	if (cpu & IP_CPU_SSE41)
+		return apply_lut_sse41;
+#endif
+	return apply_lut_scalar;
+}
+
+/***************************************************************************
+ * Func: apply_lut                                                         *
+ *                                                                         *
+ * Desc: maps every sample of an image through a table, out[i] =           *
+ *       lut[in[i]]. the vector kernels look up 16 or 32 samples with 16   *
+ *       byte shuffles, and the image is spread over the thread pool       *
+ *                                                                         *
+ * Params: in - source samples                                             *
+ *         out - mapped samples, may be in itself                          *
+ *         n - number of samples (rows * cols, times 3 for PPM)            *
+ *         lut - 256 entries                                               *
+ ***************************************************************************/
+
+void apply_lut(image_ptr in, image_ptr out, unsigned long n, unsigned char *lut)
+{
+	lut_job job;                /* chunks shared by the tasks */
+
+	job.kernel = lut_kernel();
+	job.in = in;
+	job.out = out;
+	job.n = n;
+	job.lut = lut;
+	ip_parallel_for((int)((n + LUT_CHUNK - 1) / LUT_CHUNK), lut_task, &job);
+}
+
+/***************************************************************************
+ * Func: apply_lut_row                                                     *
+ *                                                                         *
+ * Desc: apply_lut for a short run of samples, on the calling thread. for  *
+ *       callers that are already a thread pool task                       *
+ *                                                                         *
+ * Params: in - source samples                                             *
+ *         out - mapped samples, may be in itself                          *
+ *         n - number of samples                                           *
+ *         lut - 256 entries                                               *
+ ***************************************************************************/
+
+void apply_lut_row(unsigned char *in, unsigned char *out, int n,
+	unsigned char *lut)
+{
+	lut_kernel()(in, out, n, lut);
+}
+
+/* state shared by the tasks of apply_lut_desc on rows apart */
+
+typedef struct
+    {
+    image_desc *src;        /* plane being mapped */
+    image_desc *dst;
+    int line;               /* samples in one row */
+    int band;               /* rows of one task */
+    unsigned char *lut;     /* 256 entries */
+    } lut_rows_job;
+
+/***************************************************************************
+ * Func: lut_rows_task                                                     *
+ *                                                                         *
+ * Desc: thread pool task: maps band index of the rows                     *
+ ***************************************************************************/
+
+static void lut_rows_task(void *arg, int index)
+{
+	lut_rows_job *job = (lut_rows_job *)arg;
+	int y, y1;                  /* row and the end of the band */
+
+	y = index * job->band;
+	y1 = MIN(y + job->band, job->src->height);
+	for (; y < y1; y++)
+		apply_lut_row(IMAGE_ROW(job->src, y), IMAGE_ROW(job->dst, y), job->line,
+			job->lut);
+}
+
+/***************************************************************************
+ * Func: apply_lut_desc                                                    *
+ *                                                                         *
+ * Desc: apply_lut for image descriptors. rows back to back go through in  *
+ *       one call, otherwise the image is mapped in bands of rows of about *
+ *       LUT_CHUNK samples, so the bytes between rows are left alone       *
+ *                                                                         *
+ * Params: in - source image, 8 bits per sample                            *
+ *         out - mapped image of the same size and layout, may be in       *
+ *         lut - 256 entries                                               *
+ ***************************************************************************/
+
+void apply_lut_desc(image_desc *in, image_desc *out, unsigned char *lut)
+{
+	image_desc src, dst;        /* one plane of each */
+	unsigned long line;         /* samples in one row of a plane */
+	lut_rows_job job;           /* bands shared by the tasks */
+	int k;                      /* plane */
+
+	match_images(in, out, 8, "apply_lut_desc");
+	for (k = 0; k < image_planes(in); k++)
+	{
+		src = image_plane(in, k);
+		dst = image_plane(out, k);
+		line = (unsigned long)src.width * src.channels;
+		if (src.stride == (long)line && dst.stride == (long)line)
+			apply_lut(src.data, dst.data, line * src.height, lut);
+		else
+		{
+			job.src = &src;
+			job.dst = &dst;
+			job.line = (int)line;
+			job.band = (int)MAX(1, LUT_CHUNK / line);
+			job.lut = lut;
+			ip_parallel_for((src.height + job.band - 1) / job.band, lut_rows_task,
+				&job);
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: apply_lut_chain                                                   *
+ *                                                                         *
+ * Desc: applies several point operations in a row with a single pass      *
+ *       over the image, by composing their tables first                   *
+ *                                                                         *
+ * Params: in - source samples                                             *
+ *         out - mapped samples, may be in itself                          *
+ *         n - number of samples                                           *
+ *         luts - the tables, in the order the operations are done         *
+ *         count - number of tables                                        *
+ ***************************************************************************/
+
+void apply_lut_chain(image_ptr in, image_ptr out, unsigned long n,
+	unsigned char **luts, int count)
+{
+	unsigned char lut[256];     /* all the operations in one table */
+	int k;                      /* table index */
+
+	lut_identity(lut);
+	for (k = 0; k < count; k++)
+		lut_compose(lut, luts[k], lut);
+	apply_lut(in, out, n, lut);
+}
@@ -0,0 +1,843 @@
+/***************************************************************************
+ * File: ipmorph.c                                                         *
+ *                                                                         *
+ * Desc: feature based morphing (Beier and Neely). each pixel of a frame   *
+ *       is placed relative to every destination line, the same place      *
+ *       relative to the matching source line gives one source position,   *
+ *       and the positions are averaged with weights that fall off with    *
+ *       distance from the line. the field is built into a remap table     *
+ *       and sampled with remap_image. lines far from a tile of the table  *
+ *       are only evaluated at its corners, which bounds the work per      *
+ *       pixel however many lines the morph has                            *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* pixels on a side of the square tiles lines are culled for */
+#define FIELD_TILE  32
+
+/* lines the SIMD kernels take at once; field_lines are padded to it */
+#define FIELD_LANES  8
+
+/* parameters used when morph_params is NULL */
+static morph_params default_params = { 1.0f, 2.0f, 0.5f, 0.5f };
+
+/* evaluates the field at one pixel: sum[0..2] = sum w x', sum w y', sum w */
+typedef void (*field_kernel)(field_lines *f, float x, float y, float a,
+	float b, float *sum);
+
+/* work shared by the tasks of field_remap */
+typedef struct
+{
+	field_lines *lines;         /* all lines */
+	morph_params *mp;
+	field_kernel point;
+	remap_table *t;
+	int tiles_x;                /* tiles across a row */
+} field_job;
+
+/* bounds on what one line adds at the pixels of a tile */
+typedef struct
+{
+	double floor;               /* least weight it can have */
+	double x, y;                /* source position it gives the tile centre */
+	double m[4];                /* d(x, y) / d(pixel), row major */
+	double shift;               /* furthest its position is from the heaviest */
+	double error;               /* most it moves a sample if interpolated */
+	int line;
+} line_bound;
+
+/***************************************************************************
+ * Func: new_line_set                                                      *
+ *                                                                         *
+ * Desc: makes an empty set of line segments that grows as lines are added *
+ *                                                                         *
+ * Params: size - lines to make room for at first                          *
+ *                                                                         *
+ * Returns: the set, to be freed with free_line_set                        *
+ ***************************************************************************/
+
+line_set *new_line_set(int size)
+{
+	line_set *s;
+
+	if (size < 1)
+		size = 16;
+	s = (line_set *)malloc(sizeof(line_set));
+	if (s == NULL || (s->px = (float *)malloc(sizeof(float) * 4 * size)) == NULL)
+	{
+		printf("Error allocating line set\n");
+		exit(1);
+	}
+	s->count = 0;
+	s->size = size;
+	s->py = s->px + size;
+	s->qx = s->py + size;
+	s->qy = s->qx + size;
+	return s;
+}
+
+/***************************************************************************
+ * Func: free_line_set                                                     *
+ *                                                                         *
+ * Desc: frees a set from new_line_set                                     *
+ *                                                                         *
+ * Params: s - the set                                                     *
+ ***************************************************************************/
+
+void free_line_set(line_set *s)
+{
+	if (s == NULL)
+		return;
+	free(s->px);
+	free(s);
+}
+
+/***************************************************************************
+ * Func: grow_line_set                                                     *
+ *                                                                         *
+ * Desc: makes room for at least size lines, keeping those in the set      *
+ *                                                                         *
+ * Params: s - the set                                                     *
+ *         size - lines needed                                             *
+ ***************************************************************************/
+
+static void grow_line_set(line_set *s, int size)
+{
+	float *block;
+
+	if (size <= s->size)
+		return;
+	size = MAX(size, 2 * s->size);
+	block = (float *)malloc(sizeof(float) * 4 * size);
+	if (block == NULL)
+	{
+		printf("Error allocating line set\n");
+		exit(1);
+	}
+	memcpy(block, s->px, sizeof(float) * s->count);
+	memcpy(block + size, s->py, sizeof(float) * s->count);
+	memcpy(block + 2 * size, s->qx, sizeof(float) * s->count);
+	memcpy(block + 3 * size, s->qy, sizeof(float) * s->count);
+	free(s->px);
+
+	s->size = size;
+	s->px = block;
+	s->py = block + size;
+	s->qx = block + 2 * size;
+	s->qy = block + 3 * size;
+}
+
+/***************************************************************************
+ * Func: add_line                                                          *
+ *                                                                         *
+ * Desc: adds the segment from P to Q to a set                             *
+ *                                                                         *
+ * Params: s - the set                                                     *
+ *         px, py - start point, column and row                            *
+ *         qx, qy - end point                                              *
+ ***************************************************************************/
+
+void add_line(line_set *s, float px, float py, float qx, float qy)
+{
+	grow_line_set(s, s->count + 1);
+	s->px[s->count] = px;
+	s->py[s->count] = py;
+	s->qx[s->count] = qx;
+	s->qy[s->count] = qy;
+	s->count++;
+}
+
+/***************************************************************************
+ * Func: line_set_from_list                                                *
+ *                                                                         *
+ * Desc: copies the segments of a LINE_LIST into a new set                 *
+ *                                                                         *
+ * Params: list - the list                                                 *
+ *                                                                         *
+ * Returns: the set, to be freed with free_line_set                        *
+ ***************************************************************************/
+
+line_set *line_set_from_list(LINE_LIST *list)
+{
+	line_set *s;
+	int i;
+
+	s = new_line_set(list->number);
+	for (i = 0; i < list->number; i++)
+		add_line(s, (float)list->line[i].P.x, (float)list->line[i].P.y,
+			(float)list->line[i].Q.x, (float)list->line[i].Q.y);
+	return s;
+}
+
+/***************************************************************************
+ * Func: blend_line_sets                                                   *
+ *                                                                         *
+ * Desc: moves every line of a set part of the way to the matching line    *
+ *       of another, giving the lines of an in-between frame               *
+ *                                                                         *
+ * Params: a - lines at t = 0                                              *
+ *         b - lines at t = 1, as many as in a                             *
+ *         t - how far to go                                               *
+ *         out - set to hold the result, may be a or b                     *
+ ***************************************************************************/
+
+void blend_line_sets(line_set *a, line_set *b, double t, line_set *out)
+{
+	float s = (float)t;
+	int i;
+
+	if (a->count != b->count)
+	{
+		printf("blend_line_sets: %d lines against %d\n", a->count, b->count);
+		exit(1);
+	}
+
+	grow_line_set(out, a->count);
+	for (i = 0; i < a->count; i++)
+	{
+		out->px[i] = a->px[i] + s * (b->px[i] - a->px[i]);
+		out->py[i] = a->py[i] + s * (b->py[i] - a->py[i]);
+		out->qx[i] = a->qx[i] + s * (b->qx[i] - a->qx[i]);
+		out->qy[i] = a->qy[i] + s * (b->qy[i] - a->qy[i]);
+	}
+	out->count = a->count;
+}
+
+/***************************************************************************
+ * Func: new_field_lines                                                   *
+ *                                                                         *
+ * Desc: allocates field_lines for count lines, rounded up to FIELD_LANES  *
+ *                                                                         *
+ * Params: count - number of lines                                         *
+ *                                                                         *
+ * Returns: the lines, all parameters 0                                    *
+ ***************************************************************************/
+
+static field_lines *new_field_lines(int count)
+{
+	field_lines *f;
+	float *block;
+	int size = (count + FIELD_LANES - 1) / FIELD_LANES * FIELD_LANES;
+
+	f = (field_lines *)malloc(sizeof(field_lines));
+	block = (float *)calloc((size_t)13 * MAX(size, 1), sizeof(float));
+	if (f == NULL || block == NULL)
+	{
+		printf("Error allocating field lines\n");
+		exit(1);
+	}
+	f->count = size;
+	f->px = block;
+	f->py = block + size;
+	f->dx = block + 2 * size;
+	f->dy = block + 3 * size;
+	f->inv_len2 = block + 4 * size;
+	f->inv_len = block + 5 * size;
+	f->strength = block + 6 * size;
+	f->sx = block + 7 * size;
+	f->sy = block + 8 * size;
+	f->sdx = block + 9 * size;
+	f->sdy = block + 10 * size;
+	f->snx = block + 11 * size;
+	f->sny = block + 12 * size;
+	return f;
+}
+
+static void free_field_lines(field_lines *f)
+{
+	free(f->px);
+	free(f);
+}
+
+/***************************************************************************
+ * Func: copy_field_line                                                   *
+ *                                                                         *
+ * Desc: copies line i of one field_lines to line j of another             *
+ ***************************************************************************/
+
+static void copy_field_line(field_lines *from, int i, field_lines *to, int j)
+{
+	to->px[j] = from->px[i];
+	to->py[j] = from->py[i];
+	to->dx[j] = from->dx[i];
+	to->dy[j] = from->dy[i];
+	to->inv_len2[j] = from->inv_len2[i];
+	to->inv_len[j] = from->inv_len[i];
+	to->strength[j] = from->strength[i];
+	to->sx[j] = from->sx[i];
+	to->sy[j] = from->sy[i];
+	to->sdx[j] = from->sdx[i];
+	to->sdy[j] = from->sdy[i];
+	to->snx[j] = from->snx[i];
+	to->sny[j] = from->sny[i];
+}
+
+/***************************************************************************
+ * Func: field_prepare                                                     *
+ *                                                                         *
+ * Desc: works out the per-line constants of a field warp. a line with     *
+ *       no length gets no weight                                          *
+ *                                                                         *
+ * Params: dst - lines in the image being made                             *
+ *         src - matching lines in the image sampled                       *
+ *         p - length exponent of the weights                              *
+ *                                                                         *
+ * Returns: the lines, padded with weightless ones                         *
+ ***************************************************************************/
+
+static field_lines *field_prepare(line_set *dst, line_set *src, float p)
+{
+	field_lines *f;
+	double len, slen;
+	int i;
+
+	if (dst->count != src->count)
+	{
+		printf("field warp: %d lines against %d\n", dst->count, src->count);
+		exit(1);
+	}
+
+	f = new_field_lines(dst->count);
+	for (i = 0; i < dst->count; i++)
+	{
+		f->px[i] = dst->px[i];
+		f->py[i] = dst->py[i];
+		f->dx[i] = dst->qx[i] - dst->px[i];
+		f->dy[i] = dst->qy[i] - dst->py[i];
+		f->sx[i] = src->px[i];
+		f->sy[i] = src->py[i];
+		f->sdx[i] = src->qx[i] - src->px[i];
+		f->sdy[i] = src->qy[i] - src->py[i];
+
+		len = sqrt((double)f->dx[i] * f->dx[i] + (double)f->dy[i] * f->dy[i]);
+		slen = sqrt((double)f->sdx[i] * f->sdx[i] + (double)f->sdy[i] * f->sdy[i]);
+		if (len > 0)
+		{
+			f->inv_len2[i] = (float)(1.0 / (len * len));
+			f->inv_len[i] = (float)(1.0 / len);
+			f->strength[i] = (float)pow(len, p);
+		}
+		if (slen > 0)
+		{
+			f->snx[i] = (float)(-f->sdy[i] / slen);
+			f->sny[i] = (float)(f->sdx[i] / slen);
+		}
+	}
+	return f;
+}
+
+/***************************************************************************
+ * Func: field_point_scalar                                                *
+ *                                                                         *
+ * Desc: sums the source positions that every line gives one pixel, each   *
+ *       times its weight (strength / (a + distance)) ^ b. lanes of        *
+ *       FIELD_LANES lines are summed apart and folded in the order the    *
+ *       SIMD kernels use, so they give the same floats                    *
+ *                                                                         *
+ * Params: f - the lines                                                   *
+ *         x, y - the pixel                                                *
+ *         a, b - weight constants                                         *
+ *         sum - set to the sums of w * x', w * y' and w                   *
+ ***************************************************************************/
+
+static void field_point_scalar(field_lines *f, float x, float y, float a,
+	float b, float *sum)
+{
+	float acc[3][FIELD_LANES];  /* x', y' and weight sums per lane */
+	float ex, ey, u, v, uc, fx, fy, r, w;
+	int half_b = (int)(2 * b);
+	int i, k, c, n;
+
+	if (half_b != 2 * b || half_b < 1 || half_b > 4)
+		half_b = 0;
+	memset(acc, 0, sizeof(acc));
+
+	for (i = 0; i < f->count; i += FIELD_LANES)
+		for (k = 0; k < FIELD_LANES; k++)
+		{
+			ex = x - f->px[i + k];
+			ey = y - f->py[i + k];
+			u = (ex * f->dx[i + k] + ey * f->dy[i + k]) * f->inv_len2[i + k];
+			v = (ey * f->dx[i + k] - ex * f->dy[i + k]) * f->inv_len[i + k];
+			uc = (u < 0) ? 0 : u;
+			uc = (uc > 1) ? 1 : uc;
+			fx = ex - uc * f->dx[i + k];
+			fy = ey - uc * f->dy[i + k];
+			r = f->strength[i + k] / (a + sqrtf(fx * fx + fy * fy));
+			switch (half_b)
+			{
+			case 1: w = sqrtf(r); break;
+			case 2: w = r; break;
+			case 3: w = r * sqrtf(r); break;
+			case 4: w = r * r; break;
+			default: w = powf(r, b); break;
+			}
+			acc[0][k] += w * (f->sx[i + k] + u * f->sdx[i + k] + v * f->snx[i + k]);
+			acc[1][k] += w * (f->sy[i + k] + u * f->sdy[i + k] + v * f->sny[i + k]);
+			acc[2][k] += w;
+		}
+
+	/* fold the lanes in halves, as the horizontal adds do */
+	for (c = 0; c < 3; c++)
+	{
+		for (n = FIELD_LANES / 2; n >= 1; n /= 2)
+			for (k = 0; k < n; k++)
+				acc[c][k] = acc[c][k] + acc[c][k + n];
+		sum[c] = acc[c][0];
+	}
+}
+
+/***************************************************************************
+ * Func: segment_distance                                                  *
+ *                                                                         *
+ * Desc: distance from a point to line i of a field_lines                  *
+ ***************************************************************************/
+
+static float segment_distance(field_lines *f, int i, float x, float y)
+{
+	float ex = x - f->px[i], ey = y - f->py[i];
+	float u = (ex * f->dx[i] + ey * f->dy[i]) * f->inv_len2[i];
+
+	u = CLAMP(u, 0.0f, 1.0f);
+	ex -= u * f->dx[i];
+	ey -= u * f->dy[i];
+	return sqrtf(ex * ex + ey * ey);
+}
+
+static int compare_bound(const void *a, const void *b)
+{
+	double wa = ((line_bound *)a)->error, wb = ((line_bound *)b)->error;
+
+	return (wa < wb) ? -1 : (wa > wb);
+}
+
+/***************************************************************************
+ * Func: split_lines                                                       *
+ *                                                                         *
+ * Desc: sorts the lines of a tile into near ones, evaluated at every      *
+ *       pixel, and far ones, evaluated at the tile corners only and       *
+ *       interpolated. every pixel lies within r of the tile centre, which *
+ *       bounds each line's weight and its derivatives, and the source     *
+ *       position a line gives is affine in the pixel. together these      *
+ *       bound how far interpolating a line can move a sample, and lines   *
+ *       are made far, least harm first, while the total stays within      *
+ *       mp->cull pixels                                                   *
+ *                                                                         *
+ * Params: all - every line                                                *
+ *         mp - weight constants and error allowed                         *
+ *         cx, cy - tile centre                                            *
+ *         r - half the tile diagonal                                      *
+ *         bound - scratch, one per line                                   *
+ *         near, far - the two sets, padded with weightless lines          *
+ *         ref - set to the source position the heaviest line gives the    *
+ *               centre and its derivatives, as line_bound x, y and m      *
+ ***************************************************************************/
+
+static void split_lines(field_lines *all, morph_params *mp, float cx, float cy,
+	float r, line_bound *bound, field_lines *near, field_lines *far, double *ref)
+{
+	double floor_sum = 0;       /* least sum of weights at any pixel */
+	double spent = 0;           /* error of the far lines so far */
+	double reach = 0;           /* largest shift */
+	double ex, ey, u, v, dx, dy, m, near_d, sb, c1, c2;
+	double b_exp = mp->b;
+	line_bound *b, *h;          /* a line and the heaviest */
+	float d;
+	int n = 0, i, k, lines, far_lines = 0;
+
+	for (i = 0; i < all->count; i++)
+		if (all->strength[i] > 0)
+		{
+			b = &bound[n++];
+			ex = cx - all->px[i];
+			ey = cy - all->py[i];
+			u = (ex * all->dx[i] + ey * all->dy[i]) * all->inv_len2[i];
+			v = (ey * all->dx[i] - ex * all->dy[i]) * all->inv_len[i];
+			b->x = all->sx[i] + u * all->sdx[i] + v * all->snx[i];
+			b->y = all->sy[i] + u * all->sdy[i] + v * all->sny[i];
+
+			/* x' = s + sd * u + sn * v, u and v linear in the pixel */
+			b->m[0] = all->sdx[i] * all->dx[i] * all->inv_len2[i] -
+				all->snx[i] * all->dy[i] * all->inv_len[i];
+			b->m[1] = all->sdx[i] * all->dy[i] * all->inv_len2[i] +
+				all->snx[i] * all->dx[i] * all->inv_len[i];
+			b->m[2] = all->sdy[i] * all->dx[i] * all->inv_len2[i] -
+				all->sny[i] * all->dy[i] * all->inv_len[i];
+			b->m[3] = all->sdy[i] * all->dy[i] * all->inv_len2[i] +
+				all->sny[i] * all->dx[i] * all->inv_len[i];
+
+			d = segment_distance(all, i, cx, cy);
+			b->floor = pow(all->strength[i] / (mp->a + d + r), b_exp);
+			b->error = d - r;   /* nearest the tile comes, for now */
+			b->line = i;
+			floor_sum += b->floor;
+		}
+
+	near->count = far->count = 0;
+	if (n == 0)
+		return;
+
+	h = &bound[0];
+	for (i = 1; i < n; i++)
+		if (bound[i].floor > h->floor)
+			h = &bound[i];
+	ref[0] = h->x;
+	ref[1] = h->y;
+	for (k = 0; k < 4; k++)
+		ref[2 + k] = h->m[k];
+	for (i = 0; i < n; i++)
+	{
+		b = &bound[i];
+		dx = b->x - h->x;
+		dy = b->y - h->y;
+		m = 0;
+		for (k = 0; k < 4; k++)
+			m += (b->m[k] - h->m[k]) * (b->m[k] - h->m[k]);
+		b->m[0] = sqrt(m);
+		b->shift = sqrt(dx * dx + dy * dy) + r * b->m[0];
+		reach = MAX(reach, b->shift);
+	}
+
+	/*
+	 * the error of bilinear interpolation over the tile is at most r^2 / 2
+	 * times the second derivative. the line adds w * (x' - x'h) to the
+	 * numerator and w * (x'h - average) to both, x' - x'h being affine,
+	 * so the second derivative is at most w'' (shift + reach) + 2 w' |m|,
+	 * with w' and w'' taken at the nearest the line comes to the tile
+	 */
+	for (i = 0; i < n; i++)
+	{
+		b = &bound[i];
+		near_d = b->error;
+		if (near_d <= 0)
+		{
+			b->error = HUGE_VAL;
+			continue;
+		}
+		sb = pow(all->strength[b->line], b_exp);
+		c1 = b_exp * sb * pow(mp->a + near_d, -b_exp - 1);
+		c2 = (b_exp + 1) * c1 / (mp->a + near_d) + c1 / near_d;
+		b->error = 0.5 * r * r * (c2 * (b->shift + reach) + 2 * c1 * b->m[0]);
+	}
+
+	qsort(bound, n, sizeof(line_bound), compare_bound);
+	for (i = 0; i < n; i++)
+	{
+		spent += bound[i].error;
+		if (spent > mp->cull * floor_sum)
+			break;
+		copy_field_line(all, bound[i].line, far, far_lines++);
+	}
+
+	for (lines = 0; i < n; i++)
+		copy_field_line(all, bound[i].line, near, lines++);
+
+	near->count = (lines + FIELD_LANES - 1) / FIELD_LANES * FIELD_LANES;
+	for (k = lines; k < near->count; k++)
+		near->strength[k] = 0;
+	far->count = (far_lines + FIELD_LANES - 1) / FIELD_LANES * FIELD_LANES;
+	for (k = far_lines; k < far->count; k++)
+		far->strength[k] = 0;
+}
+
+/***************************************************************************
+ * Func: far_corner                                                        *
+ *                                                                         *
+ * Desc: sums the far lines at one tile corner, less the weight times the  *
+ *       position the heaviest line gives there, which is added back       *
+ *       exactly at each pixel                                             *
+ *                                                                         *
+ * Params: job - the field_job                                             *
+ *         far - the far lines                                             *
+ *         ref - heaviest line from split_lines                            *
+ *         x, y - the corner, relative to the tile centre in dx, dy        *
+ *         out - sums w (x' - x'h), w (y' - y'h) and w                     *
+ ***************************************************************************/
+
+static void far_corner(field_job *job, field_lines *far, double *ref, float x,
+	float y, float dx, float dy, float *out)
+{
+	job->point(far, x, y, job->mp->a, job->mp->b, out);
+	out[0] -= out[2] * (float)(ref[0] + ref[2] * dx + ref[3] * dy);
+	out[1] -= out[2] * (float)(ref[1] + ref[4] * dx + ref[5] * dy);
+}
+
+/***************************************************************************
+ * Func: field_task                                                        *
+ *                                                                         *
+ * Desc: fills one row of FIELD_TILE tiles of the remap table. the far     *
+ *       lines of a tile are summed at its corners and blended across it,  *
+ *       and the near ones added at each pixel                             *
+ *                                                                         *
+ * Params: arg - the field_job                                             *
+ *         index - row of tiles                                            *
+ ***************************************************************************/
+
+static void field_task(void *arg, int index)
+{
+	field_job *job = (field_job *)arg;
+	remap_table *t = job->t;
+	morph_params *mp = job->mp;
+	field_lines *near, *far;
+	line_bound *bound;
+	double ref[6];              /* heaviest line, from split_lines */
+	float corner[4][3];         /* far sums at the four corners */
+	float left[3], right[3];    /* far sums down the tile edges */
+	float sum[3], w;
+	float *px, *py;
+	float cx, cy, fx, fy;
+	int y0, y1, x0, x1, x, y, c, tile;
+
+	near = new_field_lines(job->lines->count);
+	far = new_field_lines(job->lines->count);
+	bound = (line_bound *)malloc(sizeof(line_bound) * MAX(job->lines->count, 1));
+	if (bound == NULL)
+	{
+		printf("Error allocating line bounds\n");
+		exit(1);
+	}
+	memset(ref, 0, sizeof(ref));
+	memset(corner, 0, sizeof(corner));
+	memset(left, 0, sizeof(left));
+	memset(right, 0, sizeof(right));
+
+	y0 = index * FIELD_TILE;
+	y1 = MIN(y0 + FIELD_TILE, t->rows);
+	cy = 0.5f * (y0 + y1 - 1);
+	for (tile = 0; tile < job->tiles_x; tile++)
+	{
+		x0 = tile * FIELD_TILE;
+		x1 = MIN(x0 + FIELD_TILE, t->cols);
+		cx = 0.5f * (x0 + x1 - 1);
+		if (mp->cull > 0)
+		{
+			split_lines(job->lines, mp, cx, cy, 0.5f * (float)sqrt(
+				(double)(x1 - 1 - x0) * (x1 - 1 - x0) +
+				(double)(y1 - 1 - y0) * (y1 - 1 - y0)), bound, near, far, ref);
+			far_corner(job, far, ref, (float)x0, (float)y0, x0 - cx, y0 - cy,
+				corner[0]);
+			far_corner(job, far, ref, (float)(x1 - 1), (float)y0, x1 - 1 - cx,
+				y0 - cy, corner[1]);
+			far_corner(job, far, ref, (float)x0, (float)(y1 - 1), x0 - cx,
+				y1 - 1 - cy, corner[2]);
+			far_corner(job, far, ref, (float)(x1 - 1), (float)(y1 - 1),
+				x1 - 1 - cx, y1 - 1 - cy, corner[3]);
+		}
+
+		for (y = y0; y < y1; y++)
+		{
+			fy = (y1 - 1 > y0) ? (float)(y - y0) / (y1 - 1 - y0) : 0.0f;
+			for (c = 0; c < 3; c++)
+			{
+				left[c] = corner[0][c] + fy * (corner[2][c] - corner[0][c]);
+				right[c] = corner[1][c] + fy * (corner[3][c] - corner[1][c]);
+			}
+
+			px = t->x + (long)y * t->cols;
+			py = t->y + (long)y * t->cols;
+			for (x = x0; x < x1; x++)
+			{
+				job->point(mp->cull > 0 ? near : job->lines, (float)x, (float)y,
+					mp->a, mp->b, sum);
+				if (far->count > 0)
+				{
+					fx = (x1 - 1 > x0) ? (float)(x - x0) / (x1 - 1 - x0) : 0.0f;
+					w = left[2] + fx * (right[2] - left[2]);
+					sum[0] += left[0] + fx * (right[0] - left[0]) + w *
+						(float)(ref[0] + ref[2] * (x - cx) + ref[3] * (y - cy));
+					sum[1] += left[1] + fx * (right[1] - left[1]) + w *
+						(float)(ref[1] + ref[4] * (x - cx) + ref[5] * (y - cy));
+					sum[2] += w;
+				}
+
+				if (sum[2] > 0)
+				{
+					px[x] = sum[0] / sum[2];
+					py[x] = sum[1] / sum[2];
+				}
+				else
+				{
+					px[x] = (float)x;
+					py[x] = (float)y;
+				}
+			}
+		}
+	}
+
+	free(bound);
+	free_field_lines(near);
+	free_field_lines(far);
+}
+
+/***************************************************************************
+ * Func: field_remap                                                       *
+ *                                                                         *
+ * Desc: builds the remap table of a field warp: each pixel of the output  *
+ *       samples the source where the source lines put it                  *
+ *                                                                         *
+ * Params: dst - lines in the output image                                 *
+ *         src - matching lines in the source image                        *
+ *         rows - number of output rows                                    *
+ *         cols - number of output columns                                 *
+ *         mp - weight constants, or NULL for the defaults                 *
+ *                                                                         *
+ * Returns: the table, to be freed with free_remap                         *
+ ***************************************************************************/
+
+remap_table *field_remap(line_set *dst, line_set *src, int rows, int cols,
+	morph_params *mp)
+{
+	field_job job;
+	remap_table *t;
+	float b2;
+	int cpu = ip_cpu_features();
+
+	if (mp == NULL)
+		mp = &default_params;
+	if (mp->a <= 0 || mp->b <= 0 || rows < 1 || cols < 1)
+	{
+		printf("field_remap: bad weight constants a %g b %g\n", mp->a, mp->b);
+		exit(1);
+	}
+
+	t = (remap_table *)malloc(sizeof(remap_table));
+	if (t == NULL || (t->x = (float *)malloc(sizeof(float) * 2 * rows * cols)) == NULL)
+	{
+		printf("Error allocating remap table\n");
+		exit(1);
+	}
+	t->rows = rows;
+	t->cols = cols;
+	t->y = t->x + (long)rows * cols;
+
+	/* the SIMD kernels take b of 0.5, 1, 1.5 or 2 */
+	job.point = field_point_scalar;
+	b2 = 2 * mp->b;
+#ifdef IP_X86
+	if (b2 == (int)b2 && b2 >= 1 && b2 <= 4)
+	{
+		if (cpu & IP_CPU_SSE41)
+			job.point = field_point_sse41;
+		if (cpu & IP_CPU_AVX2)
+			job.point = field_point_avx2;
+	}
+#endif
+
+	job.lines = field_prepare(dst, src, mp->p);
+	job.mp = mp;
+	job.t = t;
+	job.tiles_x = (cols + FIELD_TILE - 1) / FIELD_TILE;
+	ip_parallel_for((rows + FIELD_TILE - 1) / FIELD_TILE, field_task, &job);
+
+	free_field_lines(job.lines);
+	return t;
+}
+
+/***************************************************************************
+ * Func: morph_frame                                                       *
+ *                                                                         *
+ * Desc: makes the frame t of the way from one image to another. both are  *
+ *       warped onto lines t of the way between their line sets, bilinear, *
+ *       and cross-dissolved                                               *
+ *                                                                         *
+ * Params: a - image at t = 0                                              *
+ *         b - image at t = 1, the same size and type                      *
+ *         rows - number of rows                                           *
+ *         cols - number of columns                                        *
+ *         type - PGM or PPM                                               *
+ *         la - lines of a                                                 *
+ *         lb - matching lines of b                                        *
+ *         t - place of the frame, 0 to 1                                  *
+ *         mp - weight constants, or NULL for the defaults                 *
+ *         out - rows * cols pixels, or NULL to allocate                   *
+ *                                                                         *
+ * Returns: the frame                                                      *
+ ***************************************************************************/
+
+image_ptr morph_frame(image_ptr a, image_ptr b, int rows, int cols, int type,
+	line_set *la, line_set *lb, double t, morph_params *mp, image_ptr out)
+{
+	line_set *lt;
+	remap_table *ta, *tb;
+	image_ptr wb;
+	unsigned long i, n;
+	int w;                      /* weight of b in 256ths */
+
+	n = (unsigned long)rows * cols * ((type == PPM) ? 3 : 1);
+	lt = new_line_set(la->count);
+	blend_line_sets(la, lb, t, lt);
+
+	ta = field_remap(lt, la, rows, cols, mp);
+	out = remap_image(a, rows, cols, type, ta, RESIZE_BILINEAR, out);
+	free_remap(ta);
+
+	tb = field_remap(lt, lb, rows, cols, mp);
+	wb = remap_image(b, rows, cols, type, tb, RESIZE_BILINEAR, NULL);
+	free_remap(tb);
+
+	w = (int)(t * 256 + 0.5);
+	w = CLAMP(w, 0, 256);
+	for (i = 0; i < n; i++)
+		out[i] = (unsigned char)((out[i] * (256 - w) + wb[i] * w + 128) >> 8);
+
+	IP_FREE(wb);
+	free_line_set(lt);
+	return out;
+}
+
+/***************************************************************************
+ * Func: morph_sequence                                                    *
+ *                                                                         *
+ * Desc: writes the frames of a morph from one image to another, the first *
+ *       being a and the last b, to files <basename>000.pgm and on         *
+ *       (.ppm for colour)                                                 *
+ *                                                                         *
+ * Params: a - first image                                                 *
+ *         b - last image, the same size and type                          *
+ *         rows - number of rows                                           *
+ *         cols - number of columns                                        *
+ *         type - PGM or PPM                                               *
+ *         la - lines of a                                                 *
+ *         lb - matching lines of b                                        *
+ *         frames - number of frames, 2 or more                            *
+ *         mp - weight constants, or NULL for the defaults                 *
+ *         basename - start of the file names                              *
+ ***************************************************************************/
+
+void morph_sequence(image_ptr a, image_ptr b, int rows, int cols, int type,
+	line_set *la, line_set *lb, int frames, morph_params *mp, char *basename)
+{
+	image_ptr frame;
+	char filename[1024];
+	int k;
+
+	if (frames < 2)
+	{
+		printf("morph_sequence: %d frames, need 2 or more\n", frames);
+		exit(1);
+	}
+
+	frame = (image_ptr)IP_MALLOC((unsigned long)rows * cols * ((type == PPM) ? 3 : 1));
+	if (frame == NULL)
+	{
+		printf("Error allocating morph frame\n");
+		exit(1);
+	}
+
+	for (k = 0; k < frames; k++)
+	{
+		morph_frame(a, b, rows, cols, type, la, lb, (double)k / (frames - 1),
+			mp, frame);
+		sprintf(filename, "%.1000s%03d.%s", basename, k, (type == PPM) ? "ppm" : "pgm");
+		write_pnm(frame, filename, rows, cols, type);
+	}
+
+	IP_FREE(frame);
+}
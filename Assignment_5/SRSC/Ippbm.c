@@ -0,0 +1,758 @@
+/***************************************************************************
+ * File: ippbm.c                                                           *
+ *                                                                         *
+ * Desc: binary images kept as packed bits. a 64-bit word holds 64         *
+ *       pixels, so the logic operations, erosion and dilation work on     *
+ *       64 pixels per instruction. pack_threshold and unpack_bits join    *
+ *       them to the grey level routines in iplib.c                        *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* output rows handed to one thread pool task */
+#define BIT_TILE_ROWS  64
+
+/* operations of bit_logic */
+#define BIT_NOT  0
+#define BIT_AND  1
+#define BIT_OR   2
+#define BIT_XOR  3
+
+/***************************************************************************
+ * Func: new_bit_image                                                     *
+ *                                                                         *
+ * Desc: allocates a binary image with every pixel white (0)               *
+ *                                                                         *
+ * Params: rows - number of rows in the image                              *
+ *         cols - number of columns in the image                           *
+ *                                                                         *
+ * Returns: the new image                                                  *
+ ***************************************************************************/
+
+bit_image *new_bit_image(int rows, int cols)
+{
+	bit_image *b;               /* image being built */
+
+	b = (bit_image *)malloc(sizeof(bit_image));
+	if (b == NULL)
+	{
+		printf("Unable to malloc %lu bytes\n", (unsigned long)sizeof(bit_image));
+		exit(1);
+	}
+
+	b->rows = rows;
+	b->cols = cols;
+	b->words = (cols + 63) / 64;
+	b->bits = (bit_word *)IP_MALLOC(sizeof(bit_word) * rows * b->words);
+	if (b->bits == NULL)
+	{
+		printf("Unable to malloc %lu bytes\n",
+			(unsigned long)rows * b->words * (unsigned long)sizeof(bit_word));
+		exit(1);
+	}
+	memset(b->bits, 0, sizeof(bit_word) * rows * b->words);
+
+	return b;
+}
+
+/***************************************************************************
+ * Func: free_bit_image                                                    *
+ *                                                                         *
+ * Desc: frees a binary image                                              *
+ *                                                                         *
+ * Params: b - image from new_bit_image or any routine returning one       *
+ ***************************************************************************/
+
+void free_bit_image(bit_image *b)
+{
+	IP_FREE(b->bits);
+	free(b);
+}
+
+/***************************************************************************
+ * Func: last_mask                                                         *
+ *                                                                         *
+ * Desc: mask of the pixels the last word of a row holds                   *
+ *                                                                         *
+ * Params: cols - number of columns in the image                           *
+ ***************************************************************************/
+
+static bit_word last_mask(int cols)
+{
+	return (cols % 64 == 0) ? ~(bit_word)0 : ((bit_word)1 << (cols % 64)) - 1;
+}
+
+/***************************************************************************
+ * Func: reverse_byte                                                      *
+ *                                                                         *
+ * Desc: mirrors the bits of a byte. a PBM file keeps its first pixel in   *
+ *       the top bit of a byte, a bit_image in the bottom one              *
+ ***************************************************************************/
+
+static unsigned char reverse_byte(unsigned char b)
+{
+	b = (unsigned char)((b >> 4) | (b << 4));
+	b = (unsigned char)(((b & 0xcc) >> 2) | ((b & 0x33) << 2));
+	return (unsigned char)(((b & 0xaa) >> 1) | ((b & 0x55) << 1));
+}
+
+/***************************************************************************
+ * Func: read_pbm                                                          *
+ *                                                                         *
+ * Desc: reads a PBM file, RAWBITS or ASCII, into a binary image           *
+ *                                                                         *
+ * Params: filename - name of image file to read                           *
+ *                                                                         *
+ * Returns: the image                                                      *
+ ***************************************************************************/
+
+bit_image *read_pbm(char *filename)
+{
+	int rows, cols, type;       /* size and type of the file */
+	image_ptr ptr;              /* rows as read_pnm packs them */
+	unsigned long row_size;     /* bytes in one of those rows */
+	bit_image *b;               /* image being built */
+	bit_word *row;              /* current row of b */
+	unsigned long i;            /* byte index in the row */
+	int y;                      /* row index */
+
+	ptr = read_pnm(filename, &rows, &cols, &type);
+	if (type != PBM)
+	{
+		printf("read_pbm: %s is not a PBM file\n", filename);
+		exit(1);
+	}
+
+	b = new_bit_image(rows, cols);
+	row_size = (cols + 7) / 8;
+	for (y = 0; y < rows; y++)
+	{
+		row = b->bits + (unsigned long)y * b->words;
+		for (i = 0; i < row_size; i++)
+			row[i / 8] |= (bit_word)reverse_byte(ptr[y * row_size + i]) << (8 * (i % 8));
+
+		/* the padding bits of the file may hold anything */
+		row[b->words - 1] &= last_mask(cols);
+	}
+
+	IP_FREE(ptr);
+	return b;
+}
+
+/***************************************************************************
+ * Func: write_pbm                                                         *
+ *                                                                         *
+ * Desc: writes a binary image as a RAWBITS PBM file                       *
+ *                                                                         *
+ * Params: b - image to write                                              *
+ *         filename - name of file to write image to                       *
+ ***************************************************************************/
+
+void write_pbm(bit_image *b, char *filename)
+{
+	image_ptr ptr;              /* rows packed as in the file */
+	unsigned long row_size;     /* bytes in one of those rows */
+	bit_word *row;              /* current row of b */
+	unsigned long i;            /* byte index in the row */
+	int y;                      /* row index */
+
+	row_size = (b->cols + 7) / 8;
+	ptr = (image_ptr)IP_MALLOC(row_size * b->rows);
+	if (ptr == NULL)
+	{
+		printf("Unable to malloc %lu bytes\n", row_size * b->rows);
+		exit(1);
+	}
+
+	for (y = 0; y < b->rows; y++)
+	{
+		row = b->bits + (unsigned long)y * b->words;
+		for (i = 0; i < row_size; i++)
+			ptr[y * row_size + i] = reverse_byte((unsigned char)(row[i / 8] >> (8 * (i % 8))));
+	}
+
+	write_pnm(ptr, filename, b->rows, b->cols, PBM);
+	IP_FREE(ptr);
+}
+
+/* state shared by the tiles of one binary image operation */
+
+typedef struct bit_job
+    {
+    bit_image *a, *b;       /* sources; b is NULL for single image ones */
+    bit_image *dst;         /* result */
+    int op;                 /* BIT_NOT .. BIT_XOR, or 1 to erode */
+    int *src_x;             /* bit_scale_nn: source column per column */
+    int factor;             /* bit_scale_nn: whole power of two, else 0 */
+    void (*tile)(struct bit_job *job, int y0, int y1);
+    } bit_job;
+
+/***************************************************************************
+ * Func: bit_task                                                          *
+ *                                                                         *
+ * Desc: thread pool task: fills tile index of the result                  *
+ ***************************************************************************/
+
+static void bit_task(void *arg, int index)
+{
+	bit_job *job = (bit_job *)arg;
+	int y0;                     /* first row of the tile */
+
+	y0 = index * BIT_TILE_ROWS;
+	job->tile(job, y0, MIN(y0 + BIT_TILE_ROWS, job->dst->rows));
+}
+
+/***************************************************************************
+ * Func: run_bit_job                                                       *
+ *                                                                         *
+ * Desc: runs the tile function of a job over the rows of its result       *
+ ***************************************************************************/
+
+static void run_bit_job(bit_job *job)
+{
+	ip_parallel_for((job->dst->rows + BIT_TILE_ROWS - 1) / BIT_TILE_ROWS, bit_task, job);
+}
+
+/***************************************************************************
+ * Func: check_size                                                        *
+ *                                                                         *
+ * Desc: stops with a message unless two images are the same size          *
+ ***************************************************************************/
+
+static void check_size(bit_image *a, bit_image *b, char *caller)
+{
+	if (a->rows != b->rows || a->cols != b->cols)
+	{
+		printf("%s: images are %d x %d and %d x %d\n", caller,
+			a->cols, a->rows, b->cols, b->rows);
+		exit(1);
+	}
+}
+
+/***************************************************************************
+ * Func: logic_tile                                                        *
+ *                                                                         *
+ * Desc: one tile of bit_not, bit_and, bit_or or bit_xor, a word at a      *
+ *       time. complemented words are masked so the padding stays 0        *
+ ***************************************************************************/
+
+static void logic_tile(bit_job *job, int y0, int y1)
+{
+	unsigned long i, start, stop;   /* words of the tile */
+	bit_word *a, *b, *dst;
+	bit_word mask;              /* pixels of the last word of a row */
+	int words = job->dst->words;
+
+	start = (unsigned long)y0 * words;
+	stop = (unsigned long)y1 * words;
+	a = job->a->bits;
+	b = (job->b != NULL) ? job->b->bits : NULL;
+	dst = job->dst->bits;
+
+	switch (job->op)
+	{
+	case BIT_NOT:
+		mask = last_mask(job->dst->cols);
+		for (i = start; i < stop; i++)
+			dst[i] = ~a[i];
+		for (i = start + words - 1; i < stop; i += words)
+			dst[i] &= mask;
+		break;
+	case BIT_AND:
+		for (i = start; i < stop; i++)
+			dst[i] = a[i] & b[i];
+		break;
+	case BIT_OR:
+		for (i = start; i < stop; i++)
+			dst[i] = a[i] | b[i];
+		break;
+	default:
+		for (i = start; i < stop; i++)
+			dst[i] = a[i] ^ b[i];
+		break;
+	}
+}
+
+/***************************************************************************
+ * Func: bit_logic                                                         *
+ *                                                                         *
+ * Desc: runs one of the logic operations over whole images                *
+ ***************************************************************************/
+
+static void bit_logic(bit_image *a, bit_image *b, bit_image *dst, int op,
+	char *caller)
+{
+	bit_job job;                /* operands shared by the tiles */
+
+	check_size(a, dst, caller);
+	if (b != NULL)
+		check_size(b, dst, caller);
+
+	job.a = a;
+	job.b = b;
+	job.dst = dst;
+	job.op = op;
+	job.tile = logic_tile;
+	run_bit_job(&job);
+}
+
+/***************************************************************************
+ * Func: bit_not, bit_and, bit_or, bit_xor                                 *
+ *                                                                         *
+ * Desc: pixel by pixel logic operations, 64 pixels per word operation.    *
+ *       dst must be the same size as the sources and may be one of them   *
+ *                                                                         *
+ * Params: src, a, b - source images                                       *
+ *         dst - result                                                    *
+ ***************************************************************************/
+
+void bit_not(bit_image *src, bit_image *dst)
+{
+	bit_logic(src, NULL, dst, BIT_NOT, "bit_not");
+}
+
+void bit_and(bit_image *a, bit_image *b, bit_image *dst)
+{
+	bit_logic(a, b, dst, BIT_AND, "bit_and");
+}
+
+void bit_or(bit_image *a, bit_image *b, bit_image *dst)
+{
+	bit_logic(a, b, dst, BIT_OR, "bit_or");
+}
+
+void bit_xor(bit_image *a, bit_image *b, bit_image *dst)
+{
+	bit_logic(a, b, dst, BIT_XOR, "bit_xor");
+}
+
+/***************************************************************************
+ * Func: popcount_scalar                                                   *
+ *                                                                         *
+ * Desc: counts the set bits of n words                                    *
+ *                                                                         *
+ * Params: src - words to count                                            *
+ *         n - number of words                                             *
+ *                                                                         *
+ * Returns: number of set bits                                             *
+ ***************************************************************************/
+
+static unsigned long popcount_scalar(bit_word *src, unsigned long n)
+{
+	unsigned long i;            /* word index */
+	unsigned long total = 0;    /* bits counted */
+
+	for (i = 0; i < n; i++)
+		total += ip_popcount64(src[i]);
+	return total;
+}
+
+/***************************************************************************
+ * Func: bit_count                                                         *
+ *                                                                         *
+ * Desc: counts the black pixels of a binary image                         *
+ *                                                                         *
+ * Params: b - image to count                                              *
+ *                                                                         *
+ * Returns: number of pixels set to 1                                      *
+ ***************************************************************************/
+
+unsigned long bit_count(bit_image *b)
+{
+	unsigned long (*count)(bit_word *src, unsigned long n) = popcount_scalar;
+	int cpu = ip_cpu_features();
+
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+		count = popcount_sse41;
+	if (cpu & IP_CPU_AVX2)
+		count = popcount_avx2;
+#endif
+
+	/* the padding bits are 0, so whole rows can be counted */
+	return count(b->bits, (unsigned long)b->rows * b->words);
+}
+
+/***************************************************************************
+ * Func: spread_row                                                        *
+ *                                                                         *
+ * Desc: ORs every pixel of a row with its left and right neighbours.      *
+ *       the words are complemented first when flip is all ones, which     *
+ *       turns the dilation into an erosion of the original pixels         *
+ *                                                                         *
+ * Params: row - source row                                                *
+ *         out - spread row                                                *
+ *         words - words in a row                                          *
+ *         flip - 0, or all ones to work on the complement                 *
+ *         mask - pixels of the last word                                  *
+ ***************************************************************************/
+
+static void spread_row(bit_word *row, bit_word *out, int words, bit_word flip,
+	bit_word mask)
+{
+	int k;                      /* word index */
+	bit_word prev, cur, next;   /* words k - 1, k and k + 1 */
+
+	prev = 0;
+	cur = (row[0] ^ flip) & ((words == 1) ? mask : ~(bit_word)0);
+	for (k = 0; k < words; k++)
+	{
+		if (k + 1 < words)
+			next = (row[k + 1] ^ flip) & ((k + 2 == words) ? mask : ~(bit_word)0);
+		else
+			next = 0;
+
+		/* pixel x - 1 moves up to bit x, pixel x + 1 down to it */
+		out[k] = cur | (cur << 1) | (prev >> 63) | (cur >> 1) | (next << 63);
+		prev = cur;
+		cur = next;
+	}
+}
+
+/***************************************************************************
+ * Func: morph_tile                                                        *
+ *                                                                         *
+ * Desc: one tile of bit_erode or bit_dilate with a 3 x 3 square. every    *
+ *       source row is spread sideways once into a ring of three rows;     *
+ *       an output row is the OR of the three spread rows around it        *
+ ***************************************************************************/
+
+static void morph_tile(bit_job *job, int y0, int y1)
+{
+	bit_image *src = job->a;
+	int words = src->words;
+	bit_word flip;              /* all ones for an erosion */
+	bit_word mask;              /* pixels of the last word of a row */
+	bit_word *ring;             /* spread rows y - 1, y and y + 1 */
+	bit_word *above, *here, *below, *out;
+	int y, k, sy;               /* output row, word and source row */
+
+	flip = job->op ? ~(bit_word)0 : 0;
+	mask = last_mask(src->cols);
+	ring = (bit_word *)malloc(sizeof(bit_word) * 3 * words);
+	if (ring == NULL)
+	{
+		printf("Unable to malloc line buffers\n");
+		exit(1);
+	}
+
+	for (y = y0; y < y1; y++)
+	{
+		/* source rows outside the image are white before any flip, so
+		   dilation adds nothing at the border and erosion takes nothing */
+		if (y == y0)
+			for (sy = y - 1; sy <= y; sy++)
+			{
+				here = ring + ((sy + 3) % 3) * words;
+				if (sy >= 0)
+					spread_row(src->bits + (unsigned long)sy * words, here, words, flip, mask);
+				else
+					memset(here, 0, sizeof(bit_word) * words);
+			}
+
+		sy = y + 1;
+		below = ring + (sy % 3) * words;
+		if (sy < src->rows)
+			spread_row(src->bits + (unsigned long)sy * words, below, words, flip, mask);
+		else
+			memset(below, 0, sizeof(bit_word) * words);
+
+		above = ring + ((y + 2) % 3) * words;
+		here = ring + (y % 3) * words;
+		out = job->dst->bits + (unsigned long)y * words;
+		for (k = 0; k < words; k++)
+			out[k] = (above[k] | here[k] | below[k]) ^ flip;
+		out[words - 1] &= mask;
+	}
+
+	free(ring);
+}
+
+/***************************************************************************
+ * Func: bit_erode, bit_dilate                                             *
+ *                                                                         *
+ * Desc: erosion and dilation of the black pixels with a 3 x 3 square,     *
+ *       64 pixels per word operation. pixels outside the image are        *
+ *       ignored, so the border neither grows nor wears away by itself     *
+ *                                                                         *
+ * Params: src - source image                                              *
+ *         dst - result, the same size as src but not src itself           *
+ ***************************************************************************/
+
+static void bit_morph(bit_image *src, bit_image *dst, int erode, char *caller)
+{
+	bit_job job;                /* operands shared by the tiles */
+
+	check_size(src, dst, caller);
+	if (src->bits == dst->bits)
+	{
+		printf("%s: dst must not be src\n", caller);
+		exit(1);
+	}
+
+	job.a = src;
+	job.b = NULL;
+	job.dst = dst;
+	job.op = erode;
+	job.tile = morph_tile;
+	run_bit_job(&job);
+}
+
+void bit_erode(bit_image *src, bit_image *dst)
+{
+	bit_morph(src, dst, 1, "bit_erode");
+}
+
+void bit_dilate(bit_image *src, bit_image *dst)
+{
+	bit_morph(src, dst, 0, "bit_dilate");
+}
+
+/***************************************************************************
+ * Func: spread_word                                                       *
+ *                                                                         *
+ * Desc: repeats each of the low 64 / factor bits of a word factor times,  *
+ *       by doubling the bits log2(factor) times                           *
+ *                                                                         *
+ * Params: w - source bits in the low end                                  *
+ *         factor - 1, 2, 4 or 8                                           *
+ ***************************************************************************/
+
+static bit_word spread_word(bit_word w, int factor)
+{
+	int f;                      /* spread so far */
+
+	for (f = 1; f < factor; f *= 2)
+	{
+		/* move every bit i to 2i, then copy it into 2i + 1 */
+		w &= 0xffffffffULL;
+		w = (w | (w << 16)) & 0x0000ffff0000ffffULL;
+		w = (w | (w << 8)) & 0x00ff00ff00ff00ffULL;
+		w = (w | (w << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		w = (w | (w << 2)) & 0x3333333333333333ULL;
+		w = (w | (w << 1)) & 0x5555555555555555ULL;
+		w |= w << 1;
+	}
+	return w;
+}
+
+/***************************************************************************
+ * Func: scale_tile                                                        *
+ *                                                                         *
+ * Desc: one tile of bit_scale_nn. for a whole power of two enlargement    *
+ *       each output word is a spread piece of a source word; otherwise    *
+ *       the output bits are gathered one by one. an output row taken      *
+ *       from the same source row as the one above is a copy of it         *
+ ***************************************************************************/
+
+static void scale_tile(bit_job *job, int y0, int y1)
+{
+	bit_image *src = job->a, *dst = job->dst;
+	bit_word *row, *out;        /* source and output rows */
+	bit_word w;                 /* output word being built */
+	int y, k, x, sy;            /* output row, word, column, source row */
+	int prev = -1;              /* source row of the output row above */
+	int per;                    /* source bits per output word */
+
+	for (y = y0; y < y1; y++)
+	{
+		sy = (int)((long long)y * src->rows / dst->rows);
+		row = src->bits + (unsigned long)sy * src->words;
+		out = dst->bits + (unsigned long)y * dst->words;
+
+		if (sy == prev)
+		{
+			memcpy(out, out - dst->words, sizeof(bit_word) * dst->words);
+			continue;
+		}
+		prev = sy;
+
+		if (job->factor)
+		{
+			per = 64 / job->factor;
+			for (k = 0; k < dst->words; k++)
+				out[k] = spread_word(row[k * per / 64] >> (k * per % 64), job->factor);
+		}
+		else
+			for (k = 0; k < dst->words; k++)
+			{
+				w = 0;
+				for (x = MIN(64 * k + 63, dst->cols - 1); x >= 64 * k; x--)
+					w = (w << 1) | ((row[job->src_x[x] / 64] >> (job->src_x[x] % 64)) & 1);
+				out[k] = w;
+			}
+		out[dst->words - 1] &= last_mask(dst->cols);
+	}
+}
+
+/***************************************************************************
+ * Func: bit_scale_nn                                                      *
+ *                                                                         *
+ * Desc: scales a binary image to any size by nearest neighbor. output     *
+ *       pixel x copies source pixel x * cols / new_cols, as in            *
+ *       resize_pnm                                                        *
+ *                                                                         *
+ * Params: src - source image                                              *
+ *         new_rows - rows of the new image                                *
+ *         new_cols - columns of the new image                             *
+ *                                                                         *
+ * Returns: the scaled image                                               *
+ ***************************************************************************/
+
+bit_image *bit_scale_nn(bit_image *src, int new_rows, int new_cols)
+{
+	bit_job job;                /* tables shared by the tiles */
+	int x;                      /* output column */
+
+	if (new_rows <= 0 || new_cols <= 0)
+	{
+		printf("bit_scale_nn: bad output size %d x %d\n", new_cols, new_rows);
+		exit(1);
+	}
+
+	job.a = src;
+	job.b = NULL;
+	job.dst = new_bit_image(new_rows, new_cols);
+	job.tile = scale_tile;
+
+	job.factor = 0;
+	for (x = 1; x <= 8; x *= 2)
+		if (new_cols == src->cols * x)
+			job.factor = x;
+
+	job.src_x = (int *)malloc(sizeof(int) * new_cols);
+	if (job.src_x == NULL)
+	{
+		printf("Unable to malloc resampling tables\n");
+		exit(1);
+	}
+	for (x = 0; x < new_cols; x++)
+		job.src_x[x] = (int)((long long)x * src->cols / new_cols);
+
+	run_bit_job(&job);
+
+	free(job.src_x);
+	return job.dst;
+}
+
+/***************************************************************************
+ * Func: pack_threshold_scalar                                             *
+ *                                                                         *
+ * Desc: thresholds a row of grey levels into packed bits                  *
+ *                                                                         *
+ * Params: src - grey levels                                               *
+ *         dst - (n + 63) / 64 words, 1 where src is below threshold       *
+ *         n - number of pixels                                            *
+ *         threshold - first grey level that stays white, 0 .. 255         *
+ ***************************************************************************/
+
+static void pack_threshold_scalar(unsigned char *src, bit_word *dst, int n,
+	int threshold)
+{
+	int i;                      /* pixel index */
+
+	memset(dst, 0, sizeof(bit_word) * ((n + 63) / 64));
+	for (i = 0; i < n; i++)
+		if (src[i] < threshold)
+			dst[i / 64] |= (bit_word)1 << (i % 64);
+}
+
+/***************************************************************************
+ * Func: unpack_bits_scalar                                                *
+ *                                                                         *
+ * Desc: turns a row of packed bits into grey levels, 0 for black and 255  *
+ *       for white                                                         *
+ *                                                                         *
+ * Params: src - packed row                                                *
+ *         dst - grey levels                                               *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+static void unpack_bits_scalar(bit_word *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+
+	for (i = 0; i < n; i++)
+		dst[i] = ((src[i / 64] >> (i % 64)) & 1) ? 0 : 255;
+}
+
+/***************************************************************************
+ * Func: pack_threshold                                                    *
+ *                                                                         *
+ * Desc: makes a binary image from a PGM image: grey levels below the      *
+ *       threshold become black                                            *
+ *                                                                         *
+ * Params: buffer - pointer to PGM image in memory                         *
+ *         rows - number of rows in image                                  *
+ *         cols - number of columns in image                               *
+ *         threshold - first grey level that stays white, 0 .. 255         *
+ *                                                                         *
+ * Returns: the binary image                                               *
+ ***************************************************************************/
+
+bit_image *pack_threshold(image_ptr buffer, int rows, int cols, int threshold)
+{
+	void (*pack)(unsigned char *src, bit_word *dst, int n, int threshold);
+	bit_image *b;               /* image being built */
+	int y;                      /* row index */
+	int cpu = ip_cpu_features();
+
+	pack = pack_threshold_scalar;
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+		pack = pack_threshold_sse41;
+	if (cpu & IP_CPU_AVX2)
+		pack = pack_threshold_avx2;
+#endif
+
+	threshold = CLAMP(threshold, 0, 255);
+	b = new_bit_image(rows, cols);
+	for (y = 0; y < rows; y++)
+		pack(buffer + (unsigned long)y * cols, b->bits + (unsigned long)y * b->words,
+			cols, threshold);
+	return b;
+}
+
+/***************************************************************************
+ * Func: unpack_bits                                                       *
+ *                                                                         *
+ * Desc: makes a PGM image from a binary image, 0 for black pixels and     *
+ *       255 for white ones                                                *
+ *                                                                         *
+ * Params: b - binary image                                                *
+ *                                                                         *
+ * Returns: the PGM image, b->rows by b->cols                              *
+ ***************************************************************************/
+
+image_ptr unpack_bits(bit_image *b)
+{
+	void (*unpack)(bit_word *src, unsigned char *dst, int n);
+	image_ptr ptr;              /* image being built */
+	int y;                      /* row index */
+	int cpu = ip_cpu_features();
+
+	unpack = unpack_bits_scalar;
+#ifdef IP_X86
+	if (cpu & IP_CPU_SSE41)
+		unpack = unpack_bits_sse41;
+	if (cpu & IP_CPU_AVX2)
+		unpack = unpack_bits_avx2;
+#endif
+
+	ptr = (image_ptr)IP_MALLOC((unsigned long)b->rows * b->cols);
+	if (ptr == NULL)
+	{
+		printf("Unable to malloc %lu bytes\n", (unsigned long)b->rows * b->cols);
+		exit(1);
+	}
+
+	for (y = 0; y < b->rows; y++)
+		unpack(b->bits + (unsigned long)y * b->words, ptr + (unsigned long)y * b->cols,
+			b->cols);
+	return ptr;
+}
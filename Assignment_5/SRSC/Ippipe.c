@@ -0,0 +1,549 @@
+/***************************************************************************
+ * File: ippipe.c                                                          *
+ *                                                                         *
+ * Desc: point operation pipelines. a chain of per-pixel operations,       *
+ *       built with calls or from a text spec such as                      *
+ *                                                                         *
+ *           gamma 0.8 | contrast 20 230 | threshold 128 | invert          *
+ *                                                                         *
+ *       is run in one pass over the image. neighbouring table stages are  *
+ *       composed into a single table as they are added, and what is left  *
+ *       (tables between colour matrices) runs stage after stage on a      *
+ *       chunk of pixels small enough to stay in the cache                 *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* pixels run through the stages at a time by one thread pool task */
+#define PIPE_CHUNK  4096
+
+/* fraction bits of the colour matrix weights */
+#define PIPE_SHIFT  14
+#define PIPE_ONE    (1 << PIPE_SHIFT)
+
+/* longest operation name in a spec */
+#define PIPE_WORD   16
+
+/* most numbers an operation takes */
+#define PIPE_ARGS   12
+
+/* weights of r, g and b in the luma of a pixel */
+static const double luma[3] = {0.299, 0.587, 0.114};
+
+/* work shared by the tasks of run_pipe_desc */
+typedef struct
+{
+	point_pipe *p;
+	image_desc *in;
+	image_desc *out;
+	unsigned long pixels;       /* pixels in the image */
+} pipe_job;
+
+/***************************************************************************
+ * Func: new_pipe                                                          *
+ *                                                                         *
+ * Desc: makes an empty pipeline, which copies its input                   *
+ *                                                                         *
+ * Returns: the pipeline                                                   *
+ ***************************************************************************/
+
+point_pipe *new_pipe(void)
+{
+	point_pipe *p;
+
+	p = (point_pipe *)malloc(sizeof(point_pipe));
+	if (p == NULL || (p->stages = (pipe_stage *)malloc(sizeof(pipe_stage) * 4)) == NULL)
+	{
+		printf("Error allocating pipeline\n");
+		exit(1);
+	}
+	p->count = 0;
+	p->size = 4;
+	p->color = 0;
+	return p;
+}
+
+/***************************************************************************
+ * Func: free_pipe                                                         *
+ *                                                                         *
+ * Desc: frees a pipeline from new_pipe or parse_pipe                      *
+ *                                                                         *
+ * Params: p - the pipeline                                                *
+ ***************************************************************************/
+
+void free_pipe(point_pipe *p)
+{
+	if (p == NULL)
+		return;
+	free(p->stages);
+	free(p);
+}
+
+/***************************************************************************
+ * Func: add_stage                                                         *
+ *                                                                         *
+ * Desc: appends an empty stage, growing the array as needed               *
+ *                                                                         *
+ * Returns: the new stage                                                  *
+ ***************************************************************************/
+
+static pipe_stage *add_stage(point_pipe *p, int kind)
+{
+	pipe_stage *grown;
+
+	if (p->count == p->size)
+	{
+		grown = (pipe_stage *)realloc(p->stages, sizeof(pipe_stage) * 2 * p->size);
+		if (grown == NULL)
+		{
+			printf("Error allocating pipeline\n");
+			exit(1);
+		}
+		p->stages = grown;
+		p->size *= 2;
+	}
+	p->stages[p->count].kind = kind;
+	return &p->stages[p->count++];
+}
+
+/***************************************************************************
+ * Func: pipe_lut                                                          *
+ *                                                                         *
+ * Desc: appends a table applied to every sample. right after another      *
+ *       table it is composed into that one, so a run of table stages      *
+ *       costs one lookup per sample however long it is                    *
+ *                                                                         *
+ * Params: p - the pipeline                                                *
+ *         lut - 256 entries, e.g. from lut_gamma; copied                  *
+ ***************************************************************************/
+
+void pipe_lut(point_pipe *p, unsigned char *lut)
+{
+	pipe_stage *s;
+
+	if (p->count > 0 && p->stages[p->count - 1].kind == PIPE_LUT)
+	{
+		s = &p->stages[p->count - 1];
+		lut_compose(s->lut, lut, s->lut);
+	}
+	else
+		memcpy(add_stage(p, PIPE_LUT)->lut, lut, 256);
+}
+
+/***************************************************************************
+ * Func: pipe_matrix                                                       *
+ *                                                                         *
+ * Desc: appends a colour matrix, out_c = m[4c] * r + m[4c + 1] * g +      *
+ *       m[4c + 2] * b + m[4c + 3], rounded and clipped to 0 .. 255.       *
+ *       a pipeline with a matrix only runs on RGB images                  *
+ *                                                                         *
+ * Params: p - the pipeline                                                *
+ *         m - 12 numbers: the r, g and b rows, each three weights and     *
+ *             an offset in grey levels                                    *
+ ***************************************************************************/
+
+void pipe_matrix(point_pipe *p, double *m)
+{
+	pipe_stage *s;
+	int i;
+
+	for (i = 0; i < 12; i++)
+		if ((i % 4 != 3 && (m[i] < -64.0 || m[i] > 64.0))
+			|| (i % 4 == 3 && (m[i] < -1024.0 || m[i] > 1024.0)))
+		{
+			printf("pipe_matrix: entry %d of %g is out of range\n", i, m[i]);
+			exit(1);
+		}
+
+	s = add_stage(p, PIPE_MATRIX);
+	for (i = 0; i < 12; i++)
+		s->weight[i] = (int)(m[i] * PIPE_ONE + ((m[i] < 0.0) ? -0.5 : 0.5));
+	for (i = 3; i < 12; i += 4)
+		s->weight[i] += PIPE_ONE / 2;
+	p->color = 1;
+}
+
+/***************************************************************************
+ * Func: saturation_matrix                                                 *
+ *                                                                         *
+ * Desc: fills the matrix that moves each pixel from its luma toward (or   *
+ *       past) its colour: 0 gives grey, 1 leaves the pixel alone          *
+ ***************************************************************************/
+
+static void saturation_matrix(double s, double *m)
+{
+	int c, k;
+
+	for (c = 0; c < 3; c++)
+	{
+		for (k = 0; k < 3; k++)
+			m[4 * c + k] = (1.0 - s) * luma[k] + ((c == k) ? s : 0.0);
+		m[4 * c + 3] = 0.0;
+	}
+}
+
+/***************************************************************************
+ * Func: add_operation                                                     *
+ *                                                                         *
+ * Desc: appends the stage of one operation of a spec                      *
+ *                                                                         *
+ * Params: p - the pipeline                                                *
+ *         word - name of the operation                                    *
+ *         arg, count - the numbers after it                               *
+ ***************************************************************************/
+
+static void add_operation(point_pipe *p, char *word, double *arg, int count)
+{
+	unsigned char lut[256];
+	double m[12];
+	int want;                   /* numbers the operation takes */
+
+	if (strcmp(word, "invert") == 0 || strcmp(word, "grey") == 0
+		|| strcmp(word, "gray") == 0)
+		want = 0;
+	else if (strcmp(word, "linear") == 0 || strcmp(word, "contrast") == 0)
+		want = 2;
+	else if (strcmp(word, "matrix") == 0)
+		want = 12;
+	else if (strcmp(word, "scale") == 0 || strcmp(word, "add") == 0
+		|| strcmp(word, "gamma") == 0 || strcmp(word, "threshold") == 0
+		|| strcmp(word, "saturation") == 0)
+		want = 1;
+	else
+	{
+		printf("pipe: unknown operation '%s'\n", word);
+		exit(1);
+	}
+	if (count != want)
+	{
+		printf("pipe: '%s' takes %d numbers, not %d\n", word, want, count);
+		exit(1);
+	}
+
+	if (strcmp(word, "invert") == 0)
+		lut_linear(lut, -1.0, 255.0);
+	else if (strcmp(word, "linear") == 0)
+		lut_linear(lut, arg[0], arg[1]);
+	else if (strcmp(word, "scale") == 0)
+		lut_linear(lut, arg[0], 0.0);
+	else if (strcmp(word, "add") == 0)
+		lut_linear(lut, 1.0, arg[0]);
+	else if (strcmp(word, "gamma") == 0)
+		lut_gamma(lut, arg[0]);
+	else if (strcmp(word, "contrast") == 0)
+		lut_contrast(lut, (int)arg[0], (int)arg[1]);
+	else if (strcmp(word, "threshold") == 0)
+		lut_threshold(lut, (int)arg[0]);
+	else
+	{
+		if (strcmp(word, "matrix") == 0)
+			memcpy(m, arg, sizeof(m));
+		else
+			saturation_matrix((want == 0) ? 0.0 : arg[0], m);
+		pipe_matrix(p, m);
+		return;
+	}
+	pipe_lut(p, lut);
+}
+
+/***************************************************************************
+ * Func: parse_pipe                                                        *
+ *                                                                         *
+ * Desc: builds a pipeline from a text spec. operations are separated by   *
+ *       '|', ';' or new lines and run left to right; '#' starts a comment *
+ *       to the end of the line. the operations are                        *
+ *                                                                         *
+ *         linear s o     v * s + o         scale s     v * s              *
+ *         add o          v + o             invert      255 - v            *
+ *         gamma g        255 (v / 255)^g   threshold t 0 below t, 255 on  *
+ *         contrast l h   stretch l .. h to 0 .. 255                       *
+ *         grey           r, g and b set to the luma (also gray)           *
+ *         saturation s   0 grey, 1 unchanged, above 1 more colourful      *
+ *         matrix ...     12 numbers, as pipe_matrix                       *
+ *                                                                         *
+ * Params: spec - the text                                                 *
+ *                                                                         *
+ * Returns: the pipeline                                                   *
+ ***************************************************************************/
+
+point_pipe *parse_pipe(char *spec)
+{
+	point_pipe *p = new_pipe();
+	char word[PIPE_WORD];       /* name of the operation */
+	double arg[PIPE_ARGS];      /* its numbers */
+	char *pos, *end;
+	double v;
+	int len, count;
+
+	pos = spec;
+	while (*pos != '\0')
+	{
+		if (isspace((unsigned char)*pos) || *pos == '|' || *pos == ';')
+		{
+			pos++;
+			continue;
+		}
+		if (*pos == '#')
+		{
+			while (*pos != '\0' && *pos != '\n')
+				pos++;
+			continue;
+		}
+
+		for (len = 0; isalpha((unsigned char)*pos); pos++)
+			if (len < PIPE_WORD - 1)
+				word[len++] = (char)tolower((unsigned char)*pos);
+		word[len] = '\0';
+		if (len == 0)
+		{
+			printf("pipe: expected an operation at '%.20s'\n", pos);
+			exit(1);
+		}
+
+		/* the numbers run to the end of the stage */
+		for (count = 0; ; count++)
+		{
+			while (*pos == ' ' || *pos == '\t' || *pos == ',' || *pos == '\r')
+				pos++;
+			if (*pos == '\0' || *pos == '\n' || *pos == '|' || *pos == ';'
+				|| *pos == '#')
+				break;
+			v = strtod(pos, &end);
+			if (end == pos)
+			{
+				printf("pipe: bad number after '%s' at '%.20s'\n", word, pos);
+				exit(1);
+			}
+			if (count < PIPE_ARGS)
+				arg[count] = v;
+			pos = end;
+		}
+		add_operation(p, word, arg, count);
+	}
+	return p;
+}
+
+/***************************************************************************
+ * Func: read_pipe                                                         *
+ *                                                                         *
+ * Desc: builds a pipeline from a spec file; see parse_pipe                *
+ *                                                                         *
+ * Params: filename - name of the file                                     *
+ *                                                                         *
+ * Returns: the pipeline                                                   *
+ ***************************************************************************/
+
+point_pipe *read_pipe(char *filename)
+{
+	point_pipe *p;
+	FILE *fp;
+	char *text;
+	long size;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+	{
+		printf("Unable to open %s for reading\n", filename);
+		exit(1);
+	}
+	fseek(fp, 0L, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0L, SEEK_SET);
+
+	text = (char *)malloc(size + 1);
+	if (text == NULL || (long)fread(text, 1, size, fp) != size)
+	{
+		printf("Unable to read %s\n", filename);
+		exit(1);
+	}
+	fclose(fp);
+	text[size] = '\0';
+
+	p = parse_pipe(text);
+	free(text);
+	return p;
+}
+
+/***************************************************************************
+ * Func: matrix_run                                                        *
+ *                                                                         *
+ * Desc: runs n RGB pixels through a colour matrix stage                   *
+ *                                                                         *
+ * Params: src - source pixels                                             *
+ *         dst - output pixels, may be src itself                          *
+ *         n - number of pixels                                            *
+ *         w - fixed point weights of the stage                            *
+ ***************************************************************************/
+
+static void matrix_run(unsigned char *src, unsigned char *dst, int n, int *w)
+{
+	int r, g, b, v;
+	int i, c;
+
+	for (i = 0; i < n; i++, src += 3, dst += 3)
+	{
+		r = src[0];
+		g = src[1];
+		b = src[2];
+		for (c = 0; c < 3; c++)
+		{
+			v = (w[4 * c] * r + w[4 * c + 1] * g + w[4 * c + 2] * b
+				+ w[4 * c + 3]) >> PIPE_SHIFT;
+			CLIP(v, 0, 255);
+			dst[c] = (unsigned char)v;
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: stages_run                                                        *
+ *                                                                         *
+ * Desc: runs a chunk of pixels through every stage. the first stage       *
+ *       reads src and the rest work on dst in place, so the chunk is      *
+ *       read from and written to memory once                              *
+ *                                                                         *
+ * Params: p - the pipeline                                                *
+ *         src - source pixels                                             *
+ *         dst - output pixels, may be src itself                          *
+ *         n - number of pixels                                            *
+ *         channels - samples per pixel                                    *
+ ***************************************************************************/
+
+static void stages_run(point_pipe *p, unsigned char *src, unsigned char *dst,
+	int n, int channels)
+{
+	pipe_stage *s;
+	int k;
+
+	for (k = 0; k < p->count; k++, src = dst)
+	{
+		s = &p->stages[k];
+		if (s->kind == PIPE_LUT)
+			apply_lut_row(src, dst, n * channels, s->lut);
+		else
+			matrix_run(src, dst, n, s->weight);
+	}
+}
+
+/***************************************************************************
+ * Func: pipe_task                                                         *
+ *                                                                         *
+ * Desc: thread pool task: runs PIPE_CHUNK pixels through the pipeline, a  *
+ *       row piece at a time. the pixels of a planar image are gathered    *
+ *       into r,g,b triples for the stages and split again after           *
+ ***************************************************************************/
+
+static void pipe_task(void *arg, int index)
+{
+	pipe_job *job = (pipe_job *)arg;
+	image_desc *in = job->in;
+	image_desc *out = job->out;
+	unsigned char buff[3 * PIPE_CHUNK]; /* one piece of a planar image */
+	unsigned char *src, *dst;   /* the piece */
+	unsigned long start, end;   /* pixels of the task */
+	long ps;                    /* plane stride */
+	int y, x, n;                /* row, column and length of a piece */
+
+	start = (unsigned long)index * PIPE_CHUNK;
+	end = MIN(start + PIPE_CHUNK, job->pixels);
+	for (; start < end; start += n)
+	{
+		y = (int)(start / in->width);
+		x = (int)(start % in->width);
+		n = (int)MIN((unsigned long)(in->width - x), end - start);
+
+		if (in->plane_stride == 0)
+		{
+			src = IMAGE_ROW(in, y) + (long)x * in->channels;
+			dst = IMAGE_ROW(out, y) + (long)x * out->channels;
+			stages_run(job->p, src, dst, n, in->channels);
+		}
+		else
+		{
+			src = IMAGE_ROW(in, y) + x;
+			dst = IMAGE_ROW(out, y) + x;
+			ps = in->plane_stride;
+			merge_rgb(src, src + ps, src + 2 * ps, buff, n);
+			stages_run(job->p, buff, buff, n, 3);
+			ps = out->plane_stride;
+			split_rgb(buff, dst, dst + ps, dst + 2 * ps, n);
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: run_pipe_desc                                                     *
+ *                                                                         *
+ * Desc: runs an image through a pipeline in one pass. a pipeline that     *
+ *       folded into a single table goes straight to apply_lut_desc;       *
+ *       otherwise chunks of PIPE_CHUNK pixels go through all the stages   *
+ *       on the thread pool                                                *
+ *                                                                         *
+ * Params: p - the pipeline                                                *
+ *         in - source image, 8-bit grey or RGB                            *
+ *         out - output image of the same size and layout, may be in       *
+ ***************************************************************************/
+
+void run_pipe_desc(point_pipe *p, image_desc *in, image_desc *out)
+{
+	pipe_job job;
+
+	match_images(in, out, 8, "run_pipe");
+	if (in->channels != 1 && in->channels != 3)
+	{
+		printf("run_pipe: cannot run %d channels\n", in->channels);
+		exit(1);
+	}
+	if (p->color && in->channels != 3)
+	{
+		printf("run_pipe: colour matrix on a grey image\n");
+		exit(1);
+	}
+
+	if (p->count == 0)
+	{
+		if (in->data != out->data)
+			copy_image(in, out);
+		return;
+	}
+	if (p->count == 1 && p->stages[0].kind == PIPE_LUT)
+	{
+		apply_lut_desc(in, out, p->stages[0].lut);
+		return;
+	}
+
+	job.p = p;
+	job.in = in;
+	job.out = out;
+	job.pixels = (unsigned long)in->width * in->height;
+	ip_parallel_for((int)((job.pixels + PIPE_CHUNK - 1) / PIPE_CHUNK),
+		pipe_task, &job);
+}
+
+/***************************************************************************
+ * Func: run_pipe                                                          *
+ *                                                                         *
+ * Desc: runs an image through a pipeline in one pass; see run_pipe_desc   *
+ *                                                                         *
+ * Params: p - the pipeline                                                *
+ *         in - source image                                               *
+ *         out - output image, may be in itself                            *
+ *         rows, cols - size of the image                                  *
+ *         type - 5 = PGM   6 = PPM                                        *
+ ***************************************************************************/
+
+void run_pipe(point_pipe *p, image_ptr in, image_ptr out, int rows, int cols,
+	int type)
+{
+	image_desc src, dst;
+
+	src = wrap_image(in, rows, cols, type);
+	dst = wrap_image(out, rows, cols, type);
+	run_pipe_desc(p, &src, &dst);
+}
@@ -0,0 +1,1887 @@
+/***************************************************************************
+ * File: ipsimd.c                                                          *
+ *                                                                         *
+ * Desc: SSE4.1 and AVX2 versions of the row kernels. each one gives       *
+ *       exactly the same bytes as its scalar twin in iplib.c, ipbmp.c,    *
+ *       ippbm.c, iplut.c, ipconv.c, ipmorph.c or ipimage.c and is only    *
+ *       called after ip_cpu_features has reported its instruction set     *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ip.h"
+#include "ipsys.h"
+
+#ifdef IP_X86
+#include <immintrin.h>
+
+/* rounding constant and shift of the bilinear horizontal pass */
+#define BI_ROUND  (1 << (2 * BI_SHIFT - 1))
+
+/***************************************************************************
+ * Func: vrow_pair                                                         *
+ *                                                                         *
+ * Desc: packs the two neighbours of one output sample into 32 bits, low   *
+ *       half left, to match a (BI_ONE - w, w) weight pair                 *
+ *                                                                         *
+ * Params: p - left-hand neighbour in a vertical pass row                  *
+ ***************************************************************************/
+
+static int vrow_pair(short *p)
+{
+	return (int)((unsigned short)p[0] | ((unsigned int)(unsigned short)p[1] << 16));
+}
+
+/***************************************************************************
+ * Func: nn_row_sse41                                                      *
+ *                                                                         *
+ * Desc: nearest neighbor row, one 16-sample block per pshufb              *
+ *                                                                         *
+ * Params: src_row - source row the output row is taken from               *
+ *         line_buff - output line buffer                                  *
+ *         t - table from build_nn_table                                   *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void nn_row_sse41(image_ptr src_row, unsigned char *line_buff,
+	nn_table *t)
+{
+	int b, e;                   /* block and output sample */
+	__m128i v, m;               /* source bytes and shuffle mask */
+
+	for (b = 0; b < t->blocks; b++)
+	{
+		if (t->block_base[b] >= 0)
+		{
+			v = _mm_loadu_si128((__m128i *)(src_row + t->block_base[b]));
+			m = _mm_loadu_si128((__m128i *)(t->block_mask + b * 16));
+			_mm_storeu_si128((__m128i *)(line_buff + b * 16), _mm_shuffle_epi8(v, m));
+		}
+		else
+			for (e = b * 16; e < b * 16 + 16; e++)
+				line_buff[e] = src_row[t->src[e]];
+	}
+
+	for (e = t->blocks * 16; e < t->line; e++)
+		line_buff[e] = src_row[t->src[e]];
+}
+
+/***************************************************************************
+ * Func: nn_row_avx2                                                       *
+ *                                                                         *
+ * Desc: nearest neighbor row, two 16-sample blocks per vpshufb            *
+ *                                                                         *
+ * Params: src_row - source row the output row is taken from               *
+ *         line_buff - output line buffer                                  *
+ *         t - table from build_nn_table                                   *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void nn_row_avx2(image_ptr src_row, unsigned char *line_buff,
+	nn_table *t)
+{
+	int b, e;                   /* block and output sample */
+	__m256i v, m;               /* source bytes and shuffle masks */
+
+	for (b = 0; b + 1 < t->blocks; b += 2)
+	{
+		if (t->block_base[b] < 0 || t->block_base[b + 1] < 0)
+		{
+			for (e = b * 16; e < b * 16 + 32; e++)
+				line_buff[e] = src_row[t->src[e]];
+			continue;
+		}
+
+		/* vpshufb works within each 128-bit lane, one block per lane */
+		v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((__m128i *)(src_row + t->block_base[b]))),
+			_mm_loadu_si128((__m128i *)(src_row + t->block_base[b + 1])), 1);
+		m = _mm256_loadu_si256((__m256i *)(t->block_mask + b * 16));
+		_mm256_storeu_si256((__m256i *)(line_buff + b * 16), _mm256_shuffle_epi8(v, m));
+	}
+
+	for (e = b * 16; e < t->line; e++)
+		line_buff[e] = src_row[t->src[e]];
+}
+
+/***************************************************************************
+ * Func: bilinear_vpass_sse41                                              *
+ *                                                                         *
+ * Desc: blends two source rows, 16 samples per iteration                  *
+ *                                                                         *
+ * Params: row0, row1 - source rows above and below                        *
+ *         wy - weight of row1                                             *
+ *         vrow - blended row                                              *
+ *         n - number of samples in a row                                  *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void bilinear_vpass_sse41(image_ptr row0, image_ptr row1, int wy,
+	short *vrow, int n)
+{
+	int i;                      /* sample index */
+	__m128i w0, w1;             /* weights of row0 and row1 */
+	__m128i zero;
+	__m128i a, b;               /* 16 bytes of each row */
+
+	w0 = _mm_set1_epi16((short)(BI_ONE - wy));
+	w1 = _mm_set1_epi16((short)wy);
+	zero = _mm_setzero_si128();
+
+	/* 255 * BI_ONE still fits a signed 16-bit lane */
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		a = _mm_loadu_si128((__m128i *)(row0 + i));
+		b = _mm_loadu_si128((__m128i *)(row1 + i));
+		_mm_storeu_si128((__m128i *)(vrow + i), _mm_add_epi16(
+			_mm_mullo_epi16(_mm_cvtepu8_epi16(a), w0),
+			_mm_mullo_epi16(_mm_cvtepu8_epi16(b), w1)));
+		_mm_storeu_si128((__m128i *)(vrow + i + 8), _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)));
+	}
+
+	for (; i < n; i++)
+		vrow[i] = (short)(row0[i] * (BI_ONE - wy) + row1[i] * wy);
+}
+
+/***************************************************************************
+ * Func: bilinear_vpass_avx2                                               *
+ *                                                                         *
+ * Desc: blends two source rows, 32 samples per iteration                  *
+ *                                                                         *
+ * Params: row0, row1 - source rows above and below                        *
+ *         wy - weight of row1                                             *
+ *         vrow - blended row                                              *
+ *         n - number of samples in a row                                  *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void bilinear_vpass_avx2(image_ptr row0, image_ptr row1, int wy,
+	short *vrow, int n)
+{
+	int i, k;                   /* sample index and half of the 32 */
+	__m256i w0, w1;             /* weights of row0 and row1 */
+	__m256i a, b;               /* 16 samples of each row */
+
+	w0 = _mm256_set1_epi16((short)(BI_ONE - wy));
+	w1 = _mm256_set1_epi16((short)wy);
+
+	for (i = 0; i + 32 <= n; i += 32)
+		for (k = i; k < i + 32; k += 16)
+		{
+			a = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)(row0 + k)));
+			b = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)(row1 + k)));
+			_mm256_storeu_si256((__m256i *)(vrow + k), _mm256_add_epi16(
+				_mm256_mullo_epi16(a, w0), _mm256_mullo_epi16(b, w1)));
+		}
+
+	for (; i < n; i++)
+		vrow[i] = (short)(row0[i] * (BI_ONE - wy) + row1[i] * wy);
+}
+
+/***************************************************************************
+ * Func: bilinear_pair_sse41                                               *
+ *                                                                         *
+ * Desc: builds the pair row of an interleaved row, 8 samples per          *
+ *       iteration: punpcklwd/punpckhwd of the row and the row shifted     *
+ *       by step                                                           *
+ *                                                                         *
+ * Params: vrow - row from a vertical pass, padded by step samples         *
+ *         pairs - 2 * n shorts                                            *
+ *         n - number of samples in vrow                                   *
+ *         step - distance between neighbours in vrow                      *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void bilinear_pair_sse41(short *vrow, short *pairs, int n, int step)
+{
+	int i;                      /* sample index */
+	__m128i a, b;               /* samples i.. and i+step.. */
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		a = _mm_loadu_si128((__m128i *)(vrow + i));
+		b = _mm_loadu_si128((__m128i *)(vrow + i + step));
+		_mm_storeu_si128((__m128i *)(pairs + 2 * i), _mm_unpacklo_epi16(a, b));
+		_mm_storeu_si128((__m128i *)(pairs + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+	}
+
+	for (; i < n; i++)
+	{
+		pairs[2 * i] = vrow[i];
+		pairs[2 * i + 1] = vrow[i + step];
+	}
+}
+
+/***************************************************************************
+ * Func: bilinear_pair_avx2                                                *
+ *                                                                         *
+ * Desc: builds the pair row of an interleaved row, 16 samples per         *
+ *       iteration                                                         *
+ *                                                                         *
+ * Params: vrow - row from a vertical pass, padded by step samples         *
+ *         pairs - 2 * n shorts                                            *
+ *         n - number of samples in vrow                                   *
+ *         step - distance between neighbours in vrow                      *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void bilinear_pair_avx2(short *vrow, short *pairs, int n, int step)
+{
+	int i;                      /* sample index */
+	__m256i a, b;               /* samples i.. and i+step.. */
+	__m256i lo, hi;             /* pairs 0-3, 8-11 and 4-7, 12-15 */
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		a = _mm256_loadu_si256((__m256i *)(vrow + i));
+		b = _mm256_loadu_si256((__m256i *)(vrow + i + step));
+		lo = _mm256_unpacklo_epi16(a, b);
+		hi = _mm256_unpackhi_epi16(a, b);
+		_mm256_storeu_si256((__m256i *)(pairs + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(pairs + 2 * i + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	for (; i < n; i++)
+	{
+		pairs[2 * i] = vrow[i];
+		pairs[2 * i + 1] = vrow[i + step];
+	}
+}
+
+/***************************************************************************
+ * Func: bilinear_hpass_sse41                                              *
+ *                                                                         *
+ * Desc: horizontal blend, 8 output samples per iteration. the neighbour   *
+ *       pairs are packed so one pmaddwd applies both weights              *
+ *                                                                         *
+ * Params: vrow - row from a vertical pass, padded past the last column    *
+ *         line_buff - output line buffer                                  *
+ *         t - table from build_bilinear_table                             *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void bilinear_hpass_sse41(short *vrow, unsigned char *line_buff,
+	bilinear_table *t)
+{
+	int e, s;                   /* output sample and left-hand neighbour */
+	int *src = t->src;
+	__m128i p0, p1;             /* neighbour pairs of samples e..e+7 */
+	__m128i r0, r1;             /* blended samples */
+	__m128i round;
+
+	round = _mm_set1_epi32(BI_ROUND);
+
+	for (e = 0; e + 8 <= t->line; e += 8)
+	{
+		p0 = _mm_set_epi32(vrow_pair(vrow + src[e + 3]),
+			vrow_pair(vrow + src[e + 2]),
+			vrow_pair(vrow + src[e + 1]),
+			vrow_pair(vrow + src[e]));
+		p1 = _mm_set_epi32(vrow_pair(vrow + src[e + 7]),
+			vrow_pair(vrow + src[e + 6]),
+			vrow_pair(vrow + src[e + 5]),
+			vrow_pair(vrow + src[e + 4]));
+
+		r0 = _mm_madd_epi16(p0, _mm_loadu_si128((__m128i *)(t->weight + 2 * e)));
+		r1 = _mm_madd_epi16(p1, _mm_loadu_si128((__m128i *)(t->weight + 2 * e + 8)));
+		r0 = _mm_srai_epi32(_mm_add_epi32(r0, round), 2 * BI_SHIFT);
+		r1 = _mm_srai_epi32(_mm_add_epi32(r1, round), 2 * BI_SHIFT);
+
+		r0 = _mm_packs_epi32(r0, r1);
+		_mm_storel_epi64((__m128i *)(line_buff + e), _mm_packus_epi16(r0, r0));
+	}
+
+	for (; e < t->line; e++)
+	{
+		s = src[e];
+		line_buff[e] = (unsigned char)((vrow[s] * t->weight[2 * e]
+			+ vrow[s + 1] * t->weight[2 * e + 1] + BI_ROUND) >> (2 * BI_SHIFT));
+	}
+}
+
+/***************************************************************************
+ * Func: bilinear_hpass_avx2                                               *
+ *                                                                         *
+ * Desc: horizontal blend, 16 output samples per iteration. each pair of   *
+ *       neighbours is fetched by one 32-bit lane of a vpgatherdd          *
+ *                                                                         *
+ * Params: vrow - row from a vertical pass, padded past the last column    *
+ *         line_buff - output line buffer                                  *
+ *         t - table from build_bilinear_table                             *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void bilinear_hpass_avx2(short *vrow, unsigned char *line_buff,
+	bilinear_table *t)
+{
+	int e, k, s;                /* output sample, half of the 16, neighbour */
+	__m256i idx;                /* left-hand neighbours of 8 samples */
+	__m256i p, r[2];            /* neighbour pairs and blended samples */
+	__m256i round;
+	__m128i out;
+
+	round = _mm256_set1_epi32(BI_ROUND);
+
+	for (e = 0; e + 16 <= t->line; e += 16)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			idx = _mm256_loadu_si256((__m256i *)(t->src + e + 8 * k));
+			p = _mm256_i32gather_epi32((int *)vrow, idx, 2);
+
+			r[k] = _mm256_madd_epi16(p,
+				_mm256_loadu_si256((__m256i *)(t->weight + 2 * (e + 8 * k))));
+			r[k] = _mm256_srai_epi32(_mm256_add_epi32(r[k], round), 2 * BI_SHIFT);
+		}
+
+		/* packs works per lane, so put the four quarters back in order */
+		p = _mm256_permute4x64_epi64(_mm256_packs_epi32(r[0], r[1]), 0xd8);
+		out = _mm_packus_epi16(_mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1));
+		_mm_storeu_si128((__m128i *)(line_buff + e), out);
+	}
+
+	for (; e < t->line; e++)
+	{
+		s = t->src[e];
+		line_buff[e] = (unsigned char)((vrow[s] * t->weight[2 * e]
+			+ vrow[s + 1] * t->weight[2 * e + 1] + BI_ROUND) >> (2 * BI_SHIFT));
+	}
+}
+
+
+/***************************************************************************
+ * Func: cubic_vpass_sse41                                                 *
+ *                                                                         *
+ * Desc: 4-tap vertical blend of the separable cubic resampler, 16 output  *
+ *       samples per iteration. the products are added in the same order   *
+ *       as the scalar loop, so the rounding is the same                   *
+ *                                                                         *
+ * Params: hrow - the four x-filtered rows                                 *
+ *         weight - their four weights                                     *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void cubic_vpass_sse41(float *hrow[4], float *weight,
+	float bias, unsigned char *out, int n)
+{
+	int i, k;                   /* sample index and group of four */
+	__m128 w0, w1, w2, w3;      /* tap weights */
+	__m128 b;                   /* bias */
+	__m128 lo, hi;              /* clipping range */
+	__m128i q[4];               /* truncated samples */
+	float pixel;
+
+	w0 = _mm_set1_ps(weight[0]);
+	w1 = _mm_set1_ps(weight[1]);
+	w2 = _mm_set1_ps(weight[2]);
+	w3 = _mm_set1_ps(weight[3]);
+	b = _mm_set1_ps(bias);
+	lo = _mm_setzero_ps();
+	hi = _mm_set1_ps(255.0f);
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		for (k = 0; k < 4; k++)
+		{
+			__m128 p = _mm_mul_ps(w0, _mm_loadu_ps(hrow[0] + i + 4 * k));
+
+			p = _mm_add_ps(p, _mm_mul_ps(w1, _mm_loadu_ps(hrow[1] + i + 4 * k)));
+			p = _mm_add_ps(p, _mm_mul_ps(w2, _mm_loadu_ps(hrow[2] + i + 4 * k)));
+			p = _mm_add_ps(p, _mm_mul_ps(w3, _mm_loadu_ps(hrow[3] + i + 4 * k)));
+			p = _mm_add_ps(p, b);
+			q[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(p, lo), hi));
+		}
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(
+			_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3])));
+	}
+
+	for (; i < n; i++)
+	{
+		pixel = weight[0] * hrow[0][i] + weight[1] * hrow[1][i]
+			+ weight[2] * hrow[2][i] + weight[3] * hrow[3][i] + bias;
+		CLIP(pixel, 0, 255);
+		out[i] = (unsigned char)pixel;
+	}
+}
+
+/***************************************************************************
+ * Func: cubic_vpass_avx2                                                  *
+ *                                                                         *
+ * Desc: 4-tap vertical blend of the separable cubic resampler, 32 output  *
+ *       samples per iteration                                             *
+ *                                                                         *
+ * Params: hrow - the four x-filtered rows                                 *
+ *         weight - their four weights                                     *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void cubic_vpass_avx2(float *hrow[4], float *weight,
+	float bias, unsigned char *out, int n)
+{
+	int i, k;                   /* sample index and group of eight */
+	__m256 w0, w1, w2, w3;      /* tap weights */
+	__m256 b;                   /* bias */
+	__m256 lo, hi;              /* clipping range */
+	__m256i q[4];               /* truncated samples */
+	__m256i order;              /* undoes the per-lane packing */
+	float pixel;
+
+	w0 = _mm256_set1_ps(weight[0]);
+	w1 = _mm256_set1_ps(weight[1]);
+	w2 = _mm256_set1_ps(weight[2]);
+	w3 = _mm256_set1_ps(weight[3]);
+	b = _mm256_set1_ps(bias);
+	lo = _mm256_setzero_ps();
+	hi = _mm256_set1_ps(255.0f);
+	order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	for (i = 0; i + 32 <= n; i += 32)
+	{
+		for (k = 0; k < 4; k++)
+		{
+			__m256 p = _mm256_mul_ps(w0, _mm256_loadu_ps(hrow[0] + i + 8 * k));
+
+			p = _mm256_add_ps(p, _mm256_mul_ps(w1, _mm256_loadu_ps(hrow[1] + i + 8 * k)));
+			p = _mm256_add_ps(p, _mm256_mul_ps(w2, _mm256_loadu_ps(hrow[2] + i + 8 * k)));
+			p = _mm256_add_ps(p, _mm256_mul_ps(w3, _mm256_loadu_ps(hrow[3] + i + 8 * k)));
+			p = _mm256_add_ps(p, b);
+			q[k] = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(p, lo), hi));
+		}
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_permutevar8x32_epi32(
+			_mm256_packus_epi16(_mm256_packs_epi32(q[0], q[1]),
+				_mm256_packs_epi32(q[2], q[3])), order));
+	}
+
+	for (; i < n; i++)
+	{
+		pixel = weight[0] * hrow[0][i] + weight[1] * hrow[1][i]
+			+ weight[2] * hrow[2][i] + weight[3] * hrow[3][i] + bias;
+		CLIP(pixel, 0, 255);
+		out[i] = (unsigned char)pixel;
+	}
+}
+
+/***************************************************************************
+ * Func: cubic_vpass16_sse41                                               *
+ *                                                                         *
+ * Desc: cubic_vpass_sse41 for 16-bit samples, 8 output samples per        *
+ *       iteration, clipped to 0 .. top                                    *
+ *                                                                         *
+ * Params: hrow - the four x-filtered rows                                 *
+ *         weight - their four weights                                     *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         top - largest sample value, the maxval of the image             *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void cubic_vpass16_sse41(float *hrow[4], float *weight,
+	float bias, float top, unsigned short *out, int n)
+{
+	int i, k;                   /* sample index and group of four */
+	__m128 w0, w1, w2, w3;      /* tap weights */
+	__m128 b;                   /* bias */
+	__m128 lo, hi;              /* clipping range */
+	__m128i q[2];               /* truncated samples */
+	float pixel;
+
+	w0 = _mm_set1_ps(weight[0]);
+	w1 = _mm_set1_ps(weight[1]);
+	w2 = _mm_set1_ps(weight[2]);
+	w3 = _mm_set1_ps(weight[3]);
+	b = _mm_set1_ps(bias);
+	lo = _mm_setzero_ps();
+	hi = _mm_set1_ps(top);
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			__m128 p = _mm_mul_ps(w0, _mm_loadu_ps(hrow[0] + i + 4 * k));
+
+			p = _mm_add_ps(p, _mm_mul_ps(w1, _mm_loadu_ps(hrow[1] + i + 4 * k)));
+			p = _mm_add_ps(p, _mm_mul_ps(w2, _mm_loadu_ps(hrow[2] + i + 4 * k)));
+			p = _mm_add_ps(p, _mm_mul_ps(w3, _mm_loadu_ps(hrow[3] + i + 4 * k)));
+			p = _mm_add_ps(p, b);
+			q[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(p, lo), hi));
+		}
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi32(q[0], q[1]));
+	}
+
+	for (; i < n; i++)
+	{
+		pixel = weight[0] * hrow[0][i] + weight[1] * hrow[1][i]
+			+ weight[2] * hrow[2][i] + weight[3] * hrow[3][i] + bias;
+		CLIP(pixel, 0, top);
+		out[i] = (unsigned short)pixel;
+	}
+}
+
+/***************************************************************************
+ * Func: cubic_vpass16_avx2                                                *
+ *                                                                         *
+ * Desc: cubic_vpass_avx2 for 16-bit samples, 16 output samples per        *
+ *       iteration                                                         *
+ *                                                                         *
+ * Params: hrow - the four x-filtered rows                                 *
+ *         weight - their four weights                                     *
+ *         bias - added before truncating, 0.5 rounds to nearest           *
+ *         top - largest sample value, the maxval of the image             *
+ *         out - output samples                                            *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void cubic_vpass16_avx2(float *hrow[4], float *weight,
+	float bias, float top, unsigned short *out, int n)
+{
+	int i, k;                   /* sample index and group of eight */
+	__m256 w0, w1, w2, w3;      /* tap weights */
+	__m256 b;                   /* bias */
+	__m256 lo, hi;              /* clipping range */
+	__m256i q[2];               /* truncated samples */
+	float pixel;
+
+	w0 = _mm256_set1_ps(weight[0]);
+	w1 = _mm256_set1_ps(weight[1]);
+	w2 = _mm256_set1_ps(weight[2]);
+	w3 = _mm256_set1_ps(weight[3]);
+	b = _mm256_set1_ps(bias);
+	lo = _mm256_setzero_ps();
+	hi = _mm256_set1_ps(top);
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			__m256 p = _mm256_mul_ps(w0, _mm256_loadu_ps(hrow[0] + i + 8 * k));
+
+			p = _mm256_add_ps(p, _mm256_mul_ps(w1, _mm256_loadu_ps(hrow[1] + i + 8 * k)));
+			p = _mm256_add_ps(p, _mm256_mul_ps(w2, _mm256_loadu_ps(hrow[2] + i + 8 * k)));
+			p = _mm256_add_ps(p, _mm256_mul_ps(w3, _mm256_loadu_ps(hrow[3] + i + 8 * k)));
+			p = _mm256_add_ps(p, b);
+			q[k] = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(p, lo), hi));
+		}
+		/* the pack works per lane; the qword permute puts the halves back */
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(
+			_mm256_packus_epi32(q[0], q[1]), 0xd8));
+	}
+
+	for (; i < n; i++)
+	{
+		pixel = weight[0] * hrow[0][i] + weight[1] * hrow[1][i]
+			+ weight[2] * hrow[2][i] + weight[3] * hrow[3][i] + bias;
+		CLIP(pixel, 0, top);
+		out[i] = (unsigned short)pixel;
+	}
+}
+
+/***************************************************************************
+ * Func: swap_rb_sse41                                                     *
+ *                                                                         *
+ * Desc: BGR to RGB (or back), five pixels per pshufb. each store writes   *
+ *       one byte past its five pixels, which the next store or the        *
+ *       scalar tail overwrites                                            *
+ *                                                                         *
+ * Params: src - source pixels                                             *
+ *         dst - swapped pixels, must not overlap src                      *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void swap_rb_sse41(unsigned char *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+	__m128i m;                  /* shuffle mask */
+
+	m = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+
+	/* the 16-byte load and store must stay inside the rows */
+	for (i = 0; i + 6 <= n; i += 5)
+		_mm_storeu_si128((__m128i *)(dst + 3 * i),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(src + 3 * i)), m));
+
+	for (; i < n; i++)
+	{
+		dst[3 * i] = src[3 * i + 2];
+		dst[3 * i + 1] = src[3 * i + 1];
+		dst[3 * i + 2] = src[3 * i];
+	}
+}
+
+/***************************************************************************
+ * Func: swap_rb_avx2                                                      *
+ *                                                                         *
+ * Desc: BGR to RGB (or back), ten pixels per iteration, five in each      *
+ *       128-bit lane                                                      *
+ *                                                                         *
+ * Params: src - source pixels                                             *
+ *         dst - swapped pixels, must not overlap src                      *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void swap_rb_avx2(unsigned char *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+	__m256i m, v;               /* shuffle mask and pixels */
+
+	m = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15,
+		2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+
+	for (i = 0; i + 11 <= n; i += 10)
+	{
+		v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((__m128i *)(src + 3 * i))),
+			_mm_loadu_si128((__m128i *)(src + 3 * i + 15)), 1);
+		v = _mm256_shuffle_epi8(v, m);
+		_mm_storeu_si128((__m128i *)(dst + 3 * i), _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)(dst + 3 * i + 15), _mm256_extracti128_si256(v, 1));
+	}
+
+	for (; i < n; i++)
+	{
+		dst[3 * i] = src[3 * i + 2];
+		dst[3 * i + 1] = src[3 * i + 1];
+		dst[3 * i + 2] = src[3 * i];
+	}
+}
+
+/***************************************************************************
+ * Func: bgra_to_rgb_sse41                                                 *
+ *                                                                         *
+ * Desc: BGRA to RGB, four pixels per pshufb; alpha is dropped             *
+ *                                                                         *
+ * Params: src - BGRA pixels                                               *
+ *         dst - RGB pixels, must not overlap src                          *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void bgra_to_rgb_sse41(unsigned char *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+	__m128i m;                  /* shuffle mask */
+
+	m = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	for (i = 0; i + 6 <= n; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + 3 * i),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(src + 4 * i)), m));
+
+	for (; i < n; i++)
+	{
+		dst[3 * i] = src[4 * i + 2];
+		dst[3 * i + 1] = src[4 * i + 1];
+		dst[3 * i + 2] = src[4 * i];
+	}
+}
+
+/***************************************************************************
+ * Func: bgra_to_rgb_avx2                                                  *
+ *                                                                         *
+ * Desc: BGRA to RGB, eight pixels per iteration. each lane packs its      *
+ *       four pixels into 12 bytes and a dword permute joins the lanes     *
+ *                                                                         *
+ * Params: src - BGRA pixels                                               *
+ *         dst - RGB pixels, must not overlap src                          *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void bgra_to_rgb_avx2(unsigned char *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+	__m256i m, order, v;        /* shuffle mask, lane join and pixels */
+
+	m = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	order = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	for (i = 0; i + 11 <= n; i += 8)
+	{
+		v = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i *)(src + 4 * i)), m);
+		_mm256_storeu_si256((__m256i *)(dst + 3 * i), _mm256_permutevar8x32_epi32(v, order));
+	}
+
+	for (; i < n; i++)
+	{
+		dst[3 * i] = src[4 * i + 2];
+		dst[3 * i + 1] = src[4 * i + 1];
+		dst[3 * i + 2] = src[4 * i];
+	}
+}
+
+/* pshufb masks of split_rgb: entry 3 * c + k gathers the samples of
+   channel c that lie in 16-byte chunk k of 16 pixels */
+static const signed char split_mask[9][16] = {
+	{ 0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13},
+	{ 1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14},
+	{ 2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15}};
+
+/* pshufb masks of merge_rgb: entry 3 * k + c places the samples of
+   channel c that belong in 16-byte chunk k of 16 pixels */
+static const signed char merge_mask[9][16] = {
+	{ 0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5},
+	{-1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1},
+	{-1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1},
+	{-1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1},
+	{ 5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10},
+	{-1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1},
+	{-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1},
+	{-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1},
+	{10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15}};
+
+/***************************************************************************
+ * Func: split_rgb_sse41                                                   *
+ *                                                                         *
+ * Desc: r,g,b triples to three planes, 16 pixels per iteration: each      *
+ *       plane is three pshufbs of the 48 source bytes, ored together      *
+ *                                                                         *
+ * Params: rgb - source pixels                                             *
+ *         r, g, b - planes of n samples, must not overlap rgb             *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void split_rgb_sse41(unsigned char *rgb, unsigned char *r,
+	unsigned char *g, unsigned char *b, int n)
+{
+	unsigned char *plane[3];    /* r, g and b */
+	__m128i m[9];               /* split_mask */
+	__m128i c0, c1, c2;         /* the three chunks of 16 pixels */
+	int i, c;                   /* pixel and channel */
+
+	plane[0] = r;
+	plane[1] = g;
+	plane[2] = b;
+	for (c = 0; c < 9; c++)
+		m[c] = _mm_loadu_si128((__m128i *)split_mask[c]);
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		c0 = _mm_loadu_si128((__m128i *)(rgb + 3 * i));
+		c1 = _mm_loadu_si128((__m128i *)(rgb + 3 * i + 16));
+		c2 = _mm_loadu_si128((__m128i *)(rgb + 3 * i + 32));
+		for (c = 0; c < 3; c++)
+			_mm_storeu_si128((__m128i *)(plane[c] + i), _mm_or_si128(
+				_mm_or_si128(_mm_shuffle_epi8(c0, m[3 * c]),
+				_mm_shuffle_epi8(c1, m[3 * c + 1])),
+				_mm_shuffle_epi8(c2, m[3 * c + 2])));
+	}
+
+	for (; i < n; i++)
+	{
+		r[i] = rgb[3 * i];
+		g[i] = rgb[3 * i + 1];
+		b[i] = rgb[3 * i + 2];
+	}
+}
+
+/***************************************************************************
+ * Func: split_rgb_avx2                                                    *
+ *                                                                         *
+ * Desc: r,g,b triples to three planes, 32 pixels per iteration. lane      *
+ *       permutes give each 128-bit lane the chunks of 16 pixels, so the   *
+ *       in-lane pshufbs of split_rgb_sse41 apply unchanged                *
+ *                                                                         *
+ * Params: rgb - source pixels                                             *
+ *         r, g, b - planes of n samples, must not overlap rgb             *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void split_rgb_avx2(unsigned char *rgb, unsigned char *r,
+	unsigned char *g, unsigned char *b, int n)
+{
+	unsigned char *plane[3];    /* r, g and b */
+	__m256i m[9];               /* split_mask in both lanes */
+	__m256i v0, v1, v2;         /* the 96 source bytes */
+	__m256i c0, c1, c2;         /* chunk k of pixels 0-15 and 16-31 */
+	int i, c;                   /* pixel and channel */
+
+	plane[0] = r;
+	plane[1] = g;
+	plane[2] = b;
+	for (c = 0; c < 9; c++)
+		m[c] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)split_mask[c]));
+
+	for (i = 0; i + 32 <= n; i += 32)
+	{
+		v0 = _mm256_loadu_si256((__m256i *)(rgb + 3 * i));
+		v1 = _mm256_loadu_si256((__m256i *)(rgb + 3 * i + 32));
+		v2 = _mm256_loadu_si256((__m256i *)(rgb + 3 * i + 64));
+		c0 = _mm256_permute2x128_si256(v0, v1, 0x30);
+		c1 = _mm256_permute2x128_si256(v0, v2, 0x21);
+		c2 = _mm256_permute2x128_si256(v1, v2, 0x30);
+		for (c = 0; c < 3; c++)
+			_mm256_storeu_si256((__m256i *)(plane[c] + i), _mm256_or_si256(
+				_mm256_or_si256(_mm256_shuffle_epi8(c0, m[3 * c]),
+				_mm256_shuffle_epi8(c1, m[3 * c + 1])),
+				_mm256_shuffle_epi8(c2, m[3 * c + 2])));
+	}
+
+	for (; i < n; i++)
+	{
+		r[i] = rgb[3 * i];
+		g[i] = rgb[3 * i + 1];
+		b[i] = rgb[3 * i + 2];
+	}
+}
+
+/***************************************************************************
+ * Func: merge_rgb_sse41                                                   *
+ *                                                                         *
+ * Desc: three planes to r,g,b triples, 16 pixels per iteration: each      *
+ *       16-byte chunk of output is three pshufbs of the planes, ored      *
+ *                                                                         *
+ * Params: r, g, b - planes of n samples                                   *
+ *         rgb - output pixels, must not overlap the planes                *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void merge_rgb_sse41(unsigned char *r, unsigned char *g,
+	unsigned char *b, unsigned char *rgb, int n)
+{
+	__m128i m[9];               /* merge_mask */
+	__m128i vr, vg, vb;         /* 16 samples of each plane */
+	int i, k;                   /* pixel and output chunk */
+
+	for (k = 0; k < 9; k++)
+		m[k] = _mm_loadu_si128((__m128i *)merge_mask[k]);
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		vr = _mm_loadu_si128((__m128i *)(r + i));
+		vg = _mm_loadu_si128((__m128i *)(g + i));
+		vb = _mm_loadu_si128((__m128i *)(b + i));
+		for (k = 0; k < 3; k++)
+			_mm_storeu_si128((__m128i *)(rgb + 3 * i + 16 * k), _mm_or_si128(
+				_mm_or_si128(_mm_shuffle_epi8(vr, m[3 * k]),
+				_mm_shuffle_epi8(vg, m[3 * k + 1])),
+				_mm_shuffle_epi8(vb, m[3 * k + 2])));
+	}
+
+	for (; i < n; i++)
+	{
+		rgb[3 * i] = r[i];
+		rgb[3 * i + 1] = g[i];
+		rgb[3 * i + 2] = b[i];
+	}
+}
+
+/***************************************************************************
+ * Func: merge_rgb_avx2                                                    *
+ *                                                                         *
+ * Desc: three planes to r,g,b triples, 32 pixels per iteration. each      *
+ *       lane builds the chunks of its 16 pixels as merge_rgb_sse41 does,  *
+ *       and lane permutes put the six chunks in memory order              *
+ *                                                                         *
+ * Params: r, g, b - planes of n samples                                   *
+ *         rgb - output pixels, must not overlap the planes                *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void merge_rgb_avx2(unsigned char *r, unsigned char *g,
+	unsigned char *b, unsigned char *rgb, int n)
+{
+	__m256i m[9];               /* merge_mask in both lanes */
+	__m256i vr, vg, vb;         /* 32 samples of each plane */
+	__m256i c[3];               /* chunk k of pixels 0-15 and 16-31 */
+	int i, k;                   /* pixel and output chunk */
+
+	for (k = 0; k < 9; k++)
+		m[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)merge_mask[k]));
+
+	for (i = 0; i + 32 <= n; i += 32)
+	{
+		vr = _mm256_loadu_si256((__m256i *)(r + i));
+		vg = _mm256_loadu_si256((__m256i *)(g + i));
+		vb = _mm256_loadu_si256((__m256i *)(b + i));
+		for (k = 0; k < 3; k++)
+			c[k] = _mm256_or_si256(
+				_mm256_or_si256(_mm256_shuffle_epi8(vr, m[3 * k]),
+				_mm256_shuffle_epi8(vg, m[3 * k + 1])),
+				_mm256_shuffle_epi8(vb, m[3 * k + 2]));
+		_mm256_storeu_si256((__m256i *)(rgb + 3 * i),
+			_mm256_permute2x128_si256(c[0], c[1], 0x20));
+		_mm256_storeu_si256((__m256i *)(rgb + 3 * i + 32),
+			_mm256_permute2x128_si256(c[2], c[0], 0x30));
+		_mm256_storeu_si256((__m256i *)(rgb + 3 * i + 64),
+			_mm256_permute2x128_si256(c[1], c[2], 0x31));
+	}
+
+	for (; i < n; i++)
+	{
+		rgb[3 * i] = r[i];
+		rgb[3 * i + 1] = g[i];
+		rgb[3 * i + 2] = b[i];
+	}
+}
+
+/***************************************************************************
+ * Func: swap16_sse41                                                      *
+ *                                                                         *
+ * Desc: swaps the two bytes of every 16-bit sample, eight per pshufb      *
+ *                                                                         *
+ * Params: src - source samples                                            *
+ *         dst - swapped samples, may be src itself                        *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void swap16_sse41(unsigned short *src, unsigned short *dst, int n)
+{
+	int i;                      /* sample index */
+	__m128i m;                  /* shuffle mask */
+
+	m = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *)(dst + i),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(src + i)), m));
+
+	for (; i < n; i++)
+		dst[i] = (unsigned short)((src[i] >> 8) | (src[i] << 8));
+}
+
+/***************************************************************************
+ * Func: swap16_avx2                                                       *
+ *                                                                         *
+ * Desc: swaps the two bytes of every 16-bit sample, 16 per iteration      *
+ *                                                                         *
+ * Params: src - source samples                                            *
+ *         dst - swapped samples, may be src itself                        *
+ *         n - number of samples                                           *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void swap16_avx2(unsigned short *src, unsigned short *dst, int n)
+{
+	int i;                      /* sample index */
+	__m256i m;                  /* shuffle mask */
+
+	m = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+	for (i = 0; i + 16 <= n; i += 16)
+		_mm256_storeu_si256((__m256i *)(dst + i),
+			_mm256_shuffle_epi8(_mm256_loadu_si256((__m256i *)(src + i)), m));
+
+	for (; i < n; i++)
+		dst[i] = (unsigned short)((src[i] >> 8) | (src[i] << 8));
+}
+
+/***************************************************************************
+ * Func: pack_threshold_sse41                                              *
+ *                                                                         *
+ * Desc: thresholds a row of grey levels into packed bits, 16 pixels per   *
+ *       compare and movemask                                              *
+ *                                                                         *
+ * Params: src - grey levels                                               *
+ *         dst - (n + 63) / 64 words, 1 where src is below threshold       *
+ *         n - number of pixels                                            *
+ *         threshold - first grey level that stays white, 0 .. 255         *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void pack_threshold_sse41(unsigned char *src, bit_word *dst, int n,
+	int threshold)
+{
+	int i, k;                   /* pixel index and group of 16 */
+	__m128i t, x;               /* threshold and grey levels */
+	bit_word white;             /* pixels at or above the threshold */
+
+	t = _mm_set1_epi8((char)threshold);
+
+	for (i = 0; i + 64 <= n; i += 64)
+	{
+		white = 0;
+		for (k = 0; k < 4; k++)
+		{
+			x = _mm_loadu_si128((__m128i *)(src + i + 16 * k));
+			white |= (bit_word)(unsigned int)_mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_max_epu8(x, t), x)) << (16 * k);
+		}
+		dst[i / 64] = ~white;
+	}
+
+	if (i < n)
+	{
+		dst[i / 64] = 0;
+		for (k = 0; i + k < n; k++)
+			if (src[i + k] < threshold)
+				dst[i / 64] |= (bit_word)1 << k;
+	}
+}
+
+/***************************************************************************
+ * Func: pack_threshold_avx2                                               *
+ *                                                                         *
+ * Desc: thresholds a row of grey levels into packed bits, 32 pixels per   *
+ *       compare and movemask                                              *
+ *                                                                         *
+ * Params: src - grey levels                                               *
+ *         dst - (n + 63) / 64 words, 1 where src is below threshold       *
+ *         n - number of pixels                                            *
+ *         threshold - first grey level that stays white, 0 .. 255         *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void pack_threshold_avx2(unsigned char *src, bit_word *dst, int n,
+	int threshold)
+{
+	int i, k;                   /* pixel index and group of 32 */
+	__m256i t, x;               /* threshold and grey levels */
+	bit_word white;             /* pixels at or above the threshold */
+
+	t = _mm256_set1_epi8((char)threshold);
+
+	for (i = 0; i + 64 <= n; i += 64)
+	{
+		white = 0;
+		for (k = 0; k < 2; k++)
+		{
+			x = _mm256_loadu_si256((__m256i *)(src + i + 32 * k));
+			white |= (bit_word)(unsigned int)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(_mm256_max_epu8(x, t), x)) << (32 * k);
+		}
+		dst[i / 64] = ~white;
+	}
+
+	if (i < n)
+	{
+		dst[i / 64] = 0;
+		for (k = 0; i + k < n; k++)
+			if (src[i + k] < threshold)
+				dst[i / 64] |= (bit_word)1 << k;
+	}
+}
+
+/***************************************************************************
+ * Func: unpack_bits_sse41                                                 *
+ *                                                                         *
+ * Desc: turns a row of packed bits into grey levels, 0 for black and 255  *
+ *       for white, 16 pixels per iteration: the two bytes holding them    *
+ *       are spread over 16 lanes and each lane tests its own bit          *
+ *                                                                         *
+ * Params: src - packed row                                                *
+ *         dst - grey levels                                               *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void unpack_bits_sse41(bit_word *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+	__m128i spread, bit, zero;  /* byte spread, lane bit and zero */
+	__m128i v;
+	unsigned int bits;          /* the 16 pixels */
+
+	spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+	bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	zero = _mm_setzero_si128();
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		bits = (unsigned int)(src[i / 64] >> (i % 64)) & 0xffff;
+		v = _mm_shuffle_epi8(_mm_cvtsi32_si128(bits), spread);
+		_mm_storeu_si128((__m128i *)(dst + i),
+			_mm_cmpeq_epi8(_mm_and_si128(v, bit), zero));
+	}
+
+	for (; i < n; i++)
+		dst[i] = ((src[i / 64] >> (i % 64)) & 1) ? 0 : 255;
+}
+
+/***************************************************************************
+ * Func: unpack_bits_avx2                                                  *
+ *                                                                         *
+ * Desc: turns a row of packed bits into grey levels, 32 pixels per        *
+ *       iteration                                                         *
+ *                                                                         *
+ * Params: src - packed row                                                *
+ *         dst - grey levels                                               *
+ *         n - number of pixels                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void unpack_bits_avx2(bit_word *src, unsigned char *dst, int n)
+{
+	int i;                      /* pixel index */
+	__m256i spread, bit, zero;  /* byte spread, lane bit and zero */
+	__m256i v;
+
+	/* every lane holds all four bytes; the low lane spreads two of them
+	   and the high lane the other two */
+	spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+		2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	bit = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+		1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	zero = _mm256_setzero_si256();
+
+	for (i = 0; i + 32 <= n; i += 32)
+	{
+		v = _mm256_set1_epi32((int)(unsigned int)(src[i / 64] >> (i % 64)));
+		v = _mm256_shuffle_epi8(v, spread);
+		_mm256_storeu_si256((__m256i *)(dst + i),
+			_mm256_cmpeq_epi8(_mm256_and_si256(v, bit), zero));
+	}
+
+	for (; i < n; i++)
+		dst[i] = ((src[i / 64] >> (i % 64)) & 1) ? 0 : 255;
+}
+
+/***************************************************************************
+ * Func: popcount_sse41                                                    *
+ *                                                                         *
+ * Desc: counts the set bits of n words. every nibble is counted with a    *
+ *       16-entry pshufb table and psadbw sums the byte counts             *
+ *                                                                         *
+ * Params: src - words to count                                            *
+ *         n - number of words                                             *
+ *                                                                         *
+ * Returns: number of set bits                                             *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 unsigned long popcount_sse41(bit_word *src, unsigned long n)
+{
+	unsigned long i;            /* word index */
+	unsigned long total;        /* bits counted */
+	__m128i table, low, zero;   /* nibble counts, nibble mask and zero */
+	__m128i v, c, acc;
+	bit_word part[2];           /* the two halves of acc */
+
+	table = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	low = _mm_set1_epi8(0x0f);
+	zero = _mm_setzero_si128();
+	acc = zero;
+
+	for (i = 0; i + 2 <= n; i += 2)
+	{
+		v = _mm_loadu_si128((__m128i *)(src + i));
+		c = _mm_add_epi8(_mm_shuffle_epi8(table, _mm_and_si128(v, low)),
+			_mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(v, 4), low)));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(c, zero));
+	}
+
+	_mm_storeu_si128((__m128i *)part, acc);
+	total = (unsigned long)(part[0] + part[1]);
+	for (; i < n; i++)
+		total += ip_popcount64(src[i]);
+	return total;
+}
+
+/***************************************************************************
+ * Func: popcount_avx2                                                     *
+ *                                                                         *
+ * Desc: counts the set bits of n words, four words per iteration          *
+ *                                                                         *
+ * Params: src - words to count                                            *
+ *         n - number of words                                             *
+ *                                                                         *
+ * Returns: number of set bits                                             *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 unsigned long popcount_avx2(bit_word *src, unsigned long n)
+{
+	unsigned long i;            /* word index */
+	unsigned long total;        /* bits counted */
+	__m256i table, low, zero;   /* nibble counts, nibble mask and zero */
+	__m256i v, c, acc;
+	bit_word part[4];           /* the four quarters of acc */
+
+	table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	low = _mm256_set1_epi8(0x0f);
+	zero = _mm256_setzero_si256();
+	acc = zero;
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		v = _mm256_loadu_si256((__m256i *)(src + i));
+		c = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+			_mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, zero));
+	}
+
+	_mm256_storeu_si256((__m256i *)part, acc);
+	total = (unsigned long)(part[0] + part[1] + part[2] + part[3]);
+	for (; i < n; i++)
+		total += ip_popcount64(src[i]);
+	return total;
+}
+
+/***************************************************************************
+ * Func: lut_nibble_tables                                                 *
+ *                                                                         *
+ * Desc: splits a 256-entry table into 16 pshufb tables for the LUT        *
+ *       kernels. each half of the table is looked up with indices x,      *
+ *       x - 16, x - 32, ... made by signed saturating subtraction, so     *
+ *       table h of the half counts for high nibbles h and up until the    *
+ *       index goes negative. table h holds entries h xor h - 1, and the   *
+ *       xor of the tables that count for x is entry x of the original     *
+ *                                                                         *
+ * Params: lut - 256 entries                                               *
+ *         d - 16 x 16 entries built from it                               *
+ ***************************************************************************/
+
+static void lut_nibble_tables(unsigned char *lut, unsigned char *d)
+{
+	int h, l;                   /* high and low nibble */
+
+	for (h = 0; h < 16; h++)
+		for (l = 0; l < 16; l++)
+		{
+			d[16 * h + l] = lut[16 * h + l];
+			if (h % 8 != 0)
+				d[16 * h + l] ^= lut[16 * (h - 1) + l];
+		}
+}
+
+/***************************************************************************
+ * Func: apply_lut_sse41                                                   *
+ *                                                                         *
+ * Desc: maps 16 samples through a 256-entry table with 16 pshufb. the     *
+ *       low half is indexed from x and the high half from x - 128; a      *
+ *       sample of the other half starts negative and never counts         *
+ *                                                                         *
+ * Params: src - source samples                                            *
+ *         dst - mapped samples, may be src itself                         *
+ *         n - number of samples                                           *
+ *         lut - 256 entries                                               *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void apply_lut_sse41(unsigned char *src, unsigned char *dst, int n,
+	unsigned char *lut)
+{
+	int i, h;                   /* sample index and table */
+	unsigned char d[256];       /* tables from lut_nibble_tables */
+	__m128i t[16];
+	__m128i sixteen, top;       /* index step and top bit */
+	__m128i lo, hi, r;          /* indices into the two halves, result */
+
+	lut_nibble_tables(lut, d);
+	for (h = 0; h < 16; h++)
+		t[h] = _mm_loadu_si128((__m128i *)(d + 16 * h));
+	sixteen = _mm_set1_epi8(16);
+	top = _mm_set1_epi8(-128);
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		lo = _mm_loadu_si128((__m128i *)(src + i));
+		hi = _mm_xor_si128(lo, top);
+		r = _mm_xor_si128(_mm_shuffle_epi8(t[0], lo), _mm_shuffle_epi8(t[8], hi));
+		for (h = 1; h < 8; h++)
+		{
+			lo = _mm_subs_epi8(lo, sixteen);
+			hi = _mm_subs_epi8(hi, sixteen);
+			r = _mm_xor_si128(r, _mm_xor_si128(_mm_shuffle_epi8(t[h], lo),
+				_mm_shuffle_epi8(t[h + 8], hi)));
+		}
+		_mm_storeu_si128((__m128i *)(dst + i), r);
+	}
+
+	for (; i < n; i++)
+		dst[i] = lut[src[i]];
+}
+
+/***************************************************************************
+ * Func: apply_lut_avx2                                                    *
+ *                                                                         *
+ * Desc: maps 32 samples through a 256-entry table with 16 pshufb          *
+ *                                                                         *
+ * Params: src - source samples                                            *
+ *         dst - mapped samples, may be src itself                         *
+ *         n - number of samples                                           *
+ *         lut - 256 entries                                               *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void apply_lut_avx2(unsigned char *src, unsigned char *dst, int n,
+	unsigned char *lut)
+{
+	int i, h;                   /* sample index and table */
+	unsigned char d[256];       /* tables from lut_nibble_tables */
+	__m256i t[16];
+	__m256i sixteen, top;       /* index step and top bit */
+	__m256i lo, hi, r;          /* indices into the two halves, result */
+
+	lut_nibble_tables(lut, d);
+	for (h = 0; h < 16; h++)
+		t[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)(d + 16 * h)));
+	sixteen = _mm256_set1_epi8(16);
+	top = _mm256_set1_epi8(-128);
+
+	for (i = 0; i + 32 <= n; i += 32)
+	{
+		lo = _mm256_loadu_si256((__m256i *)(src + i));
+		hi = _mm256_xor_si256(lo, top);
+		r = _mm256_xor_si256(_mm256_shuffle_epi8(t[0], lo), _mm256_shuffle_epi8(t[8], hi));
+		for (h = 1; h < 8; h++)
+		{
+			lo = _mm256_subs_epi8(lo, sixteen);
+			hi = _mm256_subs_epi8(hi, sixteen);
+			r = _mm256_xor_si256(r, _mm256_xor_si256(_mm256_shuffle_epi8(t[h], lo),
+				_mm256_shuffle_epi8(t[h + 8], hi)));
+		}
+		_mm256_storeu_si256((__m256i *)(dst + i), r);
+	}
+
+	for (; i < n; i++)
+		dst[i] = lut[src[i]];
+}
+
+/***************************************************************************
+ * Func: conv_vpass_sse41                                                  *
+ *                                                                         *
+ * Desc: weighted sum of source rows, 8 samples per iteration              *
+ *                                                                         *
+ * Params: src - taps rows of bytes                                        *
+ *         weight - taps fixed point weights                               *
+ *         taps - number of rows                                           *
+ *         dst - n sums                                                    *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void conv_vpass_sse41(unsigned char **src, int *weight, int taps,
+	int *dst, int n)
+{
+	int i, k;                   /* sample and tap */
+	int sum;
+	__m128i w, a;               /* weight and 8 bytes of a row */
+	__m128i lo, hi;             /* sums of samples i.. and i+4.. */
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		lo = hi = _mm_setzero_si128();
+		for (k = 0; k < taps; k++)
+		{
+			w = _mm_set1_epi32(weight[k]);
+			a = _mm_loadl_epi64((__m128i *)(src[k] + i));
+			lo = _mm_add_epi32(lo, _mm_mullo_epi32(_mm_cvtepu8_epi32(a), w));
+			hi = _mm_add_epi32(hi, _mm_mullo_epi32(_mm_cvtepu8_epi32(
+				_mm_srli_si128(a, 4)), w));
+		}
+		_mm_storeu_si128((__m128i *)(dst + i), lo);
+		_mm_storeu_si128((__m128i *)(dst + i + 4), hi);
+	}
+
+	for (; i < n; i++)
+	{
+		sum = 0;
+		for (k = 0; k < taps; k++)
+			sum += weight[k] * src[k][i];
+		dst[i] = sum;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_vpass_avx2                                                   *
+ *                                                                         *
+ * Desc: weighted sum of source rows, 16 samples per iteration             *
+ *                                                                         *
+ * Params: src - taps rows of bytes                                        *
+ *         weight - taps fixed point weights                               *
+ *         taps - number of rows                                           *
+ *         dst - n sums                                                    *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void conv_vpass_avx2(unsigned char **src, int *weight, int taps,
+	int *dst, int n)
+{
+	int i, k;                   /* sample and tap */
+	int sum;
+	__m256i w;                  /* weight */
+	__m256i lo, hi;             /* sums of samples i.. and i+8.. */
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		lo = hi = _mm256_setzero_si256();
+		for (k = 0; k < taps; k++)
+		{
+			w = _mm256_set1_epi32(weight[k]);
+			lo = _mm256_add_epi32(lo, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((__m128i *)(src[k] + i))), w));
+			hi = _mm256_add_epi32(hi, _mm256_mullo_epi32(_mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((__m128i *)(src[k] + i + 8))), w));
+		}
+		_mm256_storeu_si256((__m256i *)(dst + i), lo);
+		_mm256_storeu_si256((__m256i *)(dst + i + 8), hi);
+	}
+
+	for (; i < n; i++)
+	{
+		sum = 0;
+		for (k = 0; k < taps; k++)
+			sum += weight[k] * src[k][i];
+		dst[i] = sum;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_hpass_sse41                                                  *
+ *                                                                         *
+ * Desc: adds a weighted sum along a row to an accumulator, 8 samples per  *
+ *       iteration                                                         *
+ *                                                                         *
+ * Params: src - row from conv_vpass, padded by (taps - 1) * step          *
+ *         weight - taps fixed point weights                               *
+ *         taps - number of samples summed                                 *
+ *         step - distance between neighbours, channels of the image       *
+ *         acc - n sums to add to                                          *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void conv_hpass_sse41(int *src, int *weight, int taps, int step,
+	int *acc, int n)
+{
+	int i, k;                   /* sample and tap */
+	int sum;
+	int *p;                     /* samples under tap k */
+	__m128i w;                  /* weight */
+	__m128i lo, hi;             /* sums of samples i.. and i+4.. */
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		lo = _mm_loadu_si128((__m128i *)(acc + i));
+		hi = _mm_loadu_si128((__m128i *)(acc + i + 4));
+		for (k = 0, p = src + i; k < taps; k++, p += step)
+		{
+			w = _mm_set1_epi32(weight[k]);
+			lo = _mm_add_epi32(lo, _mm_mullo_epi32(_mm_loadu_si128((__m128i *)p), w));
+			hi = _mm_add_epi32(hi, _mm_mullo_epi32(_mm_loadu_si128((__m128i *)(p + 4)), w));
+		}
+		_mm_storeu_si128((__m128i *)(acc + i), lo);
+		_mm_storeu_si128((__m128i *)(acc + i + 4), hi);
+	}
+
+	for (; i < n; i++)
+	{
+		sum = acc[i];
+		for (k = 0; k < taps; k++)
+			sum += weight[k] * src[i + k * step];
+		acc[i] = sum;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_hpass_avx2                                                   *
+ *                                                                         *
+ * Desc: adds a weighted sum along a row to an accumulator, 16 samples     *
+ *       per iteration                                                     *
+ *                                                                         *
+ * Params: src - row from conv_vpass, padded by (taps - 1) * step          *
+ *         weight - taps fixed point weights                               *
+ *         taps - number of samples summed                                 *
+ *         step - distance between neighbours, channels of the image       *
+ *         acc - n sums to add to                                          *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void conv_hpass_avx2(int *src, int *weight, int taps, int step,
+	int *acc, int n)
+{
+	int i, k;                   /* sample and tap */
+	int sum;
+	int *p;                     /* samples under tap k */
+	__m256i w;                  /* weight */
+	__m256i lo, hi;             /* sums of samples i.. and i+8.. */
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		lo = _mm256_loadu_si256((__m256i *)(acc + i));
+		hi = _mm256_loadu_si256((__m256i *)(acc + i + 8));
+		for (k = 0, p = src + i; k < taps; k++, p += step)
+		{
+			w = _mm256_set1_epi32(weight[k]);
+			lo = _mm256_add_epi32(lo, _mm256_mullo_epi32(
+				_mm256_loadu_si256((__m256i *)p), w));
+			hi = _mm256_add_epi32(hi, _mm256_mullo_epi32(
+				_mm256_loadu_si256((__m256i *)(p + 8)), w));
+		}
+		_mm256_storeu_si256((__m256i *)(acc + i), lo);
+		_mm256_storeu_si256((__m256i *)(acc + i + 8), hi);
+	}
+
+	for (; i < n; i++)
+	{
+		sum = acc[i];
+		for (k = 0; k < taps; k++)
+			sum += weight[k] * src[i + k * step];
+		acc[i] = sum;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_store_sse41                                                  *
+ *                                                                         *
+ * Desc: turns fixed point sums into clipped bytes, 8 per iteration. the   *
+ *       saturating packs do the clipping                                  *
+ *                                                                         *
+ * Params: acc - n sums                                                    *
+ *         bias - added before the shift, rounding included                *
+ *         shift - fraction bits of the sums                               *
+ *         dst - n bytes                                                   *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void conv_store_sse41(int *acc, int bias, int shift,
+	unsigned char *dst, int n)
+{
+	int i;                      /* sample index */
+	int v;
+	__m128i b, s;               /* bias and shift count */
+	__m128i lo, hi;             /* samples i.. and i+4.. */
+
+	b = _mm_set1_epi32(bias);
+	s = _mm_cvtsi32_si128(shift);
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		lo = _mm_sra_epi32(_mm_add_epi32(_mm_loadu_si128((__m128i *)(acc + i)), b), s);
+		hi = _mm_sra_epi32(_mm_add_epi32(_mm_loadu_si128((__m128i *)(acc + i + 4)), b), s);
+		lo = _mm_packs_epi32(lo, hi);
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(lo, lo));
+	}
+
+	for (; i < n; i++)
+	{
+		v = (acc[i] + bias) >> shift;
+		CLIP(v, 0, 255);
+		dst[i] = (unsigned char)v;
+	}
+}
+
+/***************************************************************************
+ * Func: conv_store_avx2                                                   *
+ *                                                                         *
+ * Desc: turns fixed point sums into clipped bytes, 16 per iteration       *
+ *                                                                         *
+ * Params: acc - n sums                                                    *
+ *         bias - added before the shift, rounding included                *
+ *         shift - fraction bits of the sums                               *
+ *         dst - n bytes                                                   *
+ *         n - samples in a row                                            *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void conv_store_avx2(int *acc, int bias, int shift,
+	unsigned char *dst, int n)
+{
+	int i;                      /* sample index */
+	int v;
+	__m256i b;                  /* bias */
+	__m128i s;                  /* shift count */
+	__m256i lo, hi;             /* samples i.. and i+8.. */
+
+	b = _mm256_set1_epi32(bias);
+	s = _mm_cvtsi32_si128(shift);
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		lo = _mm256_sra_epi32(_mm256_add_epi32(
+			_mm256_loadu_si256((__m256i *)(acc + i)), b), s);
+		hi = _mm256_sra_epi32(_mm256_add_epi32(
+			_mm256_loadu_si256((__m256i *)(acc + i + 8)), b), s);
+
+		/* the packs work within 128-bit lanes; the permutes put the
+		   samples back in order */
+		lo = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+		lo = _mm256_packus_epi16(lo, lo);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm256_castsi256_si128(
+			_mm256_permute4x64_epi64(lo, 0x08)));
+	}
+
+	for (; i < n; i++)
+	{
+		v = (acc[i] + bias) >> shift;
+		CLIP(v, 0, 255);
+		dst[i] = (unsigned char)v;
+	}
+}
+
+/***************************************************************************
+ * Func: field_point_sse41                                                 *
+ *                                                                         *
+ * Desc: sums the weighted source positions that every line of a field     *
+ *       warp gives one pixel, four lines to a register and eight lines    *
+ *       per iteration, in the lanes and order of field_point_scalar in    *
+ *       ipmorph.c                                                         *
+ *                                                                         *
+ * Params: f - the lines, a multiple of 8                                  *
+ *         x, y - the pixel                                                *
+ *         a, b - weight constants, b one of 0.5, 1, 1.5 or 2              *
+ *         sum - set to the sums of w * x', w * y' and w                   *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 void field_point_sse41(field_lines *f, float x, float y,
+	float a, float b, float *sum)
+{
+	__m128 acc[3][2];           /* x', y' and weight sums, lanes 0-3, 4-7 */
+	__m128 vx, vy, va, zero, one;
+	__m128 ex, ey, dx, dy, u, v, uc, fx, fy, r, w;
+	int half_b = (int)(2 * b);
+	int i, h, c;
+
+	vx = _mm_set1_ps(x);
+	vy = _mm_set1_ps(y);
+	va = _mm_set1_ps(a);
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+	for (c = 0; c < 3; c++)
+		acc[c][0] = acc[c][1] = zero;
+
+	for (i = 0; i < f->count; i += 8)
+		for (h = 0; h < 2; h++)
+		{
+			int k = i + 4 * h;
+
+			dx = _mm_loadu_ps(f->dx + k);
+			dy = _mm_loadu_ps(f->dy + k);
+			ex = _mm_sub_ps(vx, _mm_loadu_ps(f->px + k));
+			ey = _mm_sub_ps(vy, _mm_loadu_ps(f->py + k));
+			u = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ex, dx), _mm_mul_ps(ey, dy)),
+				_mm_loadu_ps(f->inv_len2 + k));
+			v = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ey, dx), _mm_mul_ps(ex, dy)),
+				_mm_loadu_ps(f->inv_len + k));
+			uc = _mm_min_ps(_mm_max_ps(u, zero), one);
+			fx = _mm_sub_ps(ex, _mm_mul_ps(uc, dx));
+			fy = _mm_sub_ps(ey, _mm_mul_ps(uc, dy));
+			r = _mm_div_ps(_mm_loadu_ps(f->strength + k), _mm_add_ps(va,
+				_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy)))));
+			switch (half_b)
+			{
+			case 1: w = _mm_sqrt_ps(r); break;
+			case 2: w = r; break;
+			case 3: w = _mm_mul_ps(r, _mm_sqrt_ps(r)); break;
+			default: w = _mm_mul_ps(r, r); break;
+			}
+
+			acc[0][h] = _mm_add_ps(acc[0][h], _mm_mul_ps(w, _mm_add_ps(_mm_add_ps(
+				_mm_loadu_ps(f->sx + k), _mm_mul_ps(u, _mm_loadu_ps(f->sdx + k))),
+				_mm_mul_ps(v, _mm_loadu_ps(f->snx + k)))));
+			acc[1][h] = _mm_add_ps(acc[1][h], _mm_mul_ps(w, _mm_add_ps(_mm_add_ps(
+				_mm_loadu_ps(f->sy + k), _mm_mul_ps(u, _mm_loadu_ps(f->sdy + k))),
+				_mm_mul_ps(v, _mm_loadu_ps(f->sny + k)))));
+			acc[2][h] = _mm_add_ps(acc[2][h], w);
+		}
+
+	for (c = 0; c < 3; c++)
+	{
+		__m128 s = _mm_add_ps(acc[c][0], acc[c][1]);
+
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		sum[c] = _mm_cvtss_f32(s);
+	}
+}
+
+/***************************************************************************
+ * Func: field_point_avx2                                                  *
+ *                                                                         *
+ * Desc: sums the weighted source positions that every line of a field     *
+ *       warp gives one pixel, eight lines per iteration                   *
+ *                                                                         *
+ * Params: f - the lines, a multiple of 8                                  *
+ *         x, y - the pixel                                                *
+ *         a, b - weight constants, b one of 0.5, 1, 1.5 or 2              *
+ *         sum - set to the sums of w * x', w * y' and w                   *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 void field_point_avx2(field_lines *f, float x, float y,
+	float a, float b, float *sum)
+{
+	__m256 acc[3];              /* x', y' and weight sums per lane */
+	__m256 vx, vy, va, zero, one;
+	__m256 ex, ey, dx, dy, u, v, uc, fx, fy, r, w;
+	int half_b = (int)(2 * b);
+	int i, c;
+
+	vx = _mm256_set1_ps(x);
+	vy = _mm256_set1_ps(y);
+	va = _mm256_set1_ps(a);
+	zero = _mm256_setzero_ps();
+	one = _mm256_set1_ps(1.0f);
+	for (c = 0; c < 3; c++)
+		acc[c] = zero;
+
+	for (i = 0; i < f->count; i += 8)
+	{
+		dx = _mm256_loadu_ps(f->dx + i);
+		dy = _mm256_loadu_ps(f->dy + i);
+		ex = _mm256_sub_ps(vx, _mm256_loadu_ps(f->px + i));
+		ey = _mm256_sub_ps(vy, _mm256_loadu_ps(f->py + i));
+		u = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ex, dx), _mm256_mul_ps(ey, dy)),
+			_mm256_loadu_ps(f->inv_len2 + i));
+		v = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(ey, dx), _mm256_mul_ps(ex, dy)),
+			_mm256_loadu_ps(f->inv_len + i));
+		uc = _mm256_min_ps(_mm256_max_ps(u, zero), one);
+		fx = _mm256_sub_ps(ex, _mm256_mul_ps(uc, dx));
+		fy = _mm256_sub_ps(ey, _mm256_mul_ps(uc, dy));
+		r = _mm256_div_ps(_mm256_loadu_ps(f->strength + i), _mm256_add_ps(va,
+			_mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(fx, fx), _mm256_mul_ps(fy, fy)))));
+		switch (half_b)
+		{
+		case 1: w = _mm256_sqrt_ps(r); break;
+		case 2: w = r; break;
+		case 3: w = _mm256_mul_ps(r, _mm256_sqrt_ps(r)); break;
+		default: w = _mm256_mul_ps(r, r); break;
+		}
+
+		acc[0] = _mm256_add_ps(acc[0], _mm256_mul_ps(w, _mm256_add_ps(_mm256_add_ps(
+			_mm256_loadu_ps(f->sx + i), _mm256_mul_ps(u, _mm256_loadu_ps(f->sdx + i))),
+			_mm256_mul_ps(v, _mm256_loadu_ps(f->snx + i)))));
+		acc[1] = _mm256_add_ps(acc[1], _mm256_mul_ps(w, _mm256_add_ps(_mm256_add_ps(
+			_mm256_loadu_ps(f->sy + i), _mm256_mul_ps(u, _mm256_loadu_ps(f->sdy + i))),
+			_mm256_mul_ps(v, _mm256_loadu_ps(f->sny + i)))));
+		acc[2] = _mm256_add_ps(acc[2], w);
+	}
+
+	for (c = 0; c < 3; c++)
+	{
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(acc[c]),
+			_mm256_extractf128_ps(acc[c], 1));
+
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		sum[c] = _mm_cvtss_f32(s);
+	}
+}
+
+/***************************************************************************
+ * Func: ascii_window                                                      *
+ *                                                                         *
+ * Desc: decodes the numbers that lie wholly inside one window of an       *
+ *       ASCII raster, found from the window's digit bit mask. a number    *
+ *       that reaches the end of the window may go on past it, so it is    *
+ *       left for the next window                                          *
+ *                                                                         *
+ * Params: p - first byte of the window                                    *
+ *         digits - bit i set if p[i] is a digit                           *
+ *         limit - bytes of the window; only white space and digits come   *
+ *                 before it                                               *
+ *         out - decoded samples                                           *
+ *         n - samples decoded so far                                      *
+ *         count - number of samples wanted                                *
+ *                                                                         *
+ * Returns: bytes of the window used up                                    *
+ ***************************************************************************/
+
+static int ascii_window(unsigned char *p, unsigned int digits, int limit,
+	unsigned char *out, unsigned long *n, unsigned long count)
+{
+	int i;                      /* bytes used up */
+	int start, len, k;          /* digits of the current number */
+	unsigned int rest;          /* digit mask from i on */
+	int value;                  /* sample being decoded */
+
+	if (limit < 32)
+		digits &= (1u << limit) - 1;
+
+	i = 0;
+	while (*n < count)
+	{
+		rest = digits >> i;
+		if (rest == 0)
+			return limit;       /* nothing but white space left */
+
+		start = i + ip_ctz(rest);
+		rest = ~(digits >> start);
+		len = (rest == 0) ? 32 : ip_ctz(rest);
+		if (start + len >= limit)
+			return start;
+
+		value = 0;
+		for (k = 0; k < len; k++)
+			value = MIN(value * 10 + (p[start + k] - '0'), 65535);
+		out[(*n)++] = (unsigned char)value;
+		i = start + len;
+	}
+	return i;
+}
+
+/***************************************************************************
+ * Func: ascii_samples_sse41                                               *
+ *                                                                         *
+ * Desc: decodes the samples of a P2 or P3 raster, classifying 16 bytes    *
+ *       at a time into digits and white space. it stops at anything       *
+ *       else, such as a comment, and near the end of the raster; the      *
+ *       scalar decoder in iplib.c takes it from there                     *
+ *                                                                         *
+ * Params: pos - read position, advanced past the samples decoded          *
+ *         end - first byte past the raster                                *
+ *         out - decoded samples                                           *
+ *         count - number of samples wanted                                *
+ *                                                                         *
+ * Returns: number of samples decoded                                      *
+ ***************************************************************************/
+
+IP_TARGET_SSE41 unsigned long ascii_samples_sse41(unsigned char **pos,
+	unsigned char *end, unsigned char *out, unsigned long count)
+{
+	unsigned char *p = *pos;    /* current read position */
+	unsigned long n = 0;        /* samples decoded */
+	unsigned int digits, space; /* byte masks of the window */
+	unsigned int other;         /* bytes that are neither */
+	int used;                   /* bytes of the window used up */
+	__m128i v, d, w;
+
+	while (n < count && p + 16 <= end)
+	{
+		v = _mm_loadu_si128((__m128i *)p);
+
+		/* '0' .. '9', and ' ' or '\t' .. '\r' */
+		d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+		digits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d));
+		w = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+		space = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(_mm_min_epu8(w, _mm_set1_epi8(4)), w)));
+
+		other = ~(digits | space) & 0xffff;
+		used = ascii_window(p, digits, other ? ip_ctz(other) : 16, out, &n, count);
+		if (used == 0)
+			break;
+		p += used;
+	}
+
+	*pos = p;
+	return n;
+}
+
+/***************************************************************************
+ * Func: ascii_samples_avx2                                                *
+ *                                                                         *
+ * Desc: ascii_samples_sse41 with 32-byte windows                          *
+ *                                                                         *
+ * Params: pos - read position, advanced past the samples decoded          *
+ *         end - first byte past the raster                                *
+ *         out - decoded samples                                           *
+ *         count - number of samples wanted                                *
+ *                                                                         *
+ * Returns: number of samples decoded                                      *
+ ***************************************************************************/
+
+IP_TARGET_AVX2 unsigned long ascii_samples_avx2(unsigned char **pos,
+	unsigned char *end, unsigned char *out, unsigned long count)
+{
+	unsigned char *p = *pos;    /* current read position */
+	unsigned long n = 0;        /* samples decoded */
+	unsigned int digits, space; /* byte masks of the window */
+	unsigned int other;         /* bytes that are neither */
+	int used;                   /* bytes of the window used up */
+	__m256i v, d, w;
+
+	while (n < count && p + 32 <= end)
+	{
+		v = _mm256_loadu_si256((__m256i *)p);
+
+		d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+		digits = (unsigned int)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d));
+		w = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+		space = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+			_mm256_cmpeq_epi8(_mm256_min_epu8(w, _mm256_set1_epi8(4)), w)));
+
+		other = ~(digits | space);
+		used = ascii_window(p, digits, other ? ip_ctz(other) : 32, out, &n, count);
+		if (used == 0)
+			break;
+		p += used;
+	}
+
+	*pos = p;
+	return n;
+}
+
+#endif
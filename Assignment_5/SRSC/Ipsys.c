@@ -0,0 +1,508 @@
+/***************************************************************************
+ * File: ipsys.c                                                           *
+ *                                                                         *
+ * Desc: operating system services used by the image library               *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ipsys.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#endif
+
+#ifdef IP_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static int cpu_detected = -1;   /* features found by cpuid, -1 = not yet */
+static int cpu_mask = ~0;       /* features the caller allows */
+
+/***************************************************************************
+ * Func: ip_map_file                                                       *
+ *                                                                         *
+ * Desc: maps a whole file into memory                                     *
+ *                                                                         *
+ * Params: filename - name of file to map                                  *
+ *         copy_on_write - 0 maps the pages read-only, 1 maps them         *
+ *                         copy-on-write so they may be modified without   *
+ *                         touching the file                               *
+ *         size - returns the length of the mapping in bytes               *
+ *                                                                         *
+ * Returns: address of the first byte of the file                          *
+ ***************************************************************************/
+
+void *ip_map_file(char *filename, int copy_on_write, unsigned long *size)
+{
+	void *base;                 /* address of the mapped file */
+#ifdef _WIN32
+	HANDLE file;                /* handle of the open file */
+	HANDLE mapping;             /* handle of the file mapping object */
+	DWORD size_high;            /* upper 32 bits of file size */
+
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Unable to open %s for reading\n", filename);
+		exit(1);
+	}
+
+	*size = GetFileSize(file, &size_high);
+	if (*size == 0 || size_high != 0)
+	{
+		printf("Unable to map %s: bad file size\n", filename);
+		exit(1);
+	}
+
+	mapping = CreateFileMappingA(file, NULL,
+		copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		printf("Unable to map %s\n", filename);
+		exit(1);
+	}
+
+	base = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ,
+		0, 0, 0);
+	if (base == NULL)
+	{
+		printf("Unable to map %s\n", filename);
+		exit(1);
+	}
+
+	/* the view keeps the mapping object and the file alive */
+	CloseHandle(mapping);
+	CloseHandle(file);
+#else
+	int fd;                     /* descriptor of the open file */
+	struct stat st;             /* file status, used for the size */
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+	{
+		printf("Unable to open %s for reading\n", filename);
+		exit(1);
+	}
+
+	if (fstat(fd, &st) == -1 || st.st_size == 0)
+	{
+		printf("Unable to map %s: bad file size\n", filename);
+		exit(1);
+	}
+	*size = (unsigned long)st.st_size;
+
+	base = mmap(NULL, *size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ,
+		copy_on_write ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+	{
+		printf("Unable to map %s\n", filename);
+		exit(1);
+	}
+
+	/* the mapping stays valid after the descriptor is closed */
+	close(fd);
+#endif
+
+	return base;
+}
+
+/***************************************************************************
+ * Func: ip_unmap_file                                                     *
+ *                                                                         *
+ * Desc: releases a mapping made by ip_map_file                            *
+ *                                                                         *
+ * Params: base - address returned by ip_map_file                          *
+ *         size - length of the mapping in bytes                           *
+ ***************************************************************************/
+
+void ip_unmap_file(void *base, unsigned long size)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+#else
+	munmap(base, size);
+#endif
+}
+
+#ifdef IP_X86
+/***************************************************************************
+ * Func: cpuid                                                             *
+ *                                                                         *
+ * Desc: runs the cpuid instruction for a leaf and subleaf                 *
+ *                                                                         *
+ * Params: leaf, subleaf - function to query                               *
+ *         regs - returns eax, ebx, ecx and edx                            *
+ ***************************************************************************/
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int *)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/***************************************************************************
+ * Func: xcr0                                                              *
+ *                                                                         *
+ * Desc: reads the register telling which vector state the operating       *
+ *       system saves on a context switch                                  *
+ *                                                                         *
+ * Returns: low 32 bits of XCR0                                            *
+ ***************************************************************************/
+
+static unsigned int xcr0(void)
+{
+#ifdef _MSC_VER
+	return (unsigned int)_xgetbv(0);
+#else
+	unsigned int eax, edx;
+
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+#endif
+}
+#endif
+
+/***************************************************************************
+ * Func: ip_cpu_features                                                   *
+ *                                                                         *
+ * Desc: reports which vector instruction sets the kernels may use. the    *
+ *       cpu is only queried on the first call                             *
+ *                                                                         *
+ * Returns: IP_CPU_SSE41 and/or IP_CPU_AVX2, limited by                    *
+ *          ip_limit_cpu_features                                          *
+ ***************************************************************************/
+
+int ip_cpu_features(void)
+{
+	if (cpu_detected < 0)
+	{
+		int found = 0;          /* features found so far */
+#ifdef IP_X86
+		unsigned int regs[4];   /* eax, ebx, ecx, edx */
+		int max_leaf;
+
+		cpuid(0, 0, regs);
+		max_leaf = regs[0];
+
+		cpuid(1, 0, regs);
+		if ((regs[2] & (1 << 9)) && (regs[2] & (1 << 19)))
+			found |= IP_CPU_SSE41;
+
+		/* AVX2 also needs the OS to save the ymm registers (OSXSAVE, XCR0) */
+		if (max_leaf >= 7 && (regs[2] & (1 << 27)) && (regs[2] & (1 << 28))
+			&& (xcr0() & 6) == 6)
+		{
+			cpuid(7, 0, regs);
+			if (regs[1] & (1 << 5))
+				found |= IP_CPU_AVX2;
+		}
+#endif
+		cpu_detected = found;
+	}
+
+	return cpu_detected & cpu_mask;
+}
+
+/***************************************************************************
+ * Func: ip_limit_cpu_features                                             *
+ *                                                                         *
+ * Desc: restricts the instruction sets ip_cpu_features reports, e.g. 0    *
+ *       to force the scalar kernels when checking the vector ones         *
+ *                                                                         *
+ * Params: mask - features that may be used                                *
+ ***************************************************************************/
+
+void ip_limit_cpu_features(int mask)
+{
+	cpu_mask = mask;
+}
+
+/***************************************************************************
+ * Thread pool                                                             *
+ *                                                                         *
+ * the workers are started on the first parallel call and then sleep on a  *
+ * condition variable between jobs. a job is a number of independent       *
+ * tasks; workers and the calling thread take the next free task index     *
+ * until none are left. only one job runs at a time and tasks must not     *
+ * start jobs of their own                                                 *
+ ***************************************************************************/
+
+#ifdef _WIN32
+static CRITICAL_SECTION pool_lock;
+static CONDITION_VARIABLE pool_work;    /* a job was posted or quit set */
+static CONDITION_VARIABLE pool_done;    /* the last task of a job ended */
+static HANDLE pool_thread[IP_MAX_THREADS];
+#else
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static pthread_t pool_thread[IP_MAX_THREADS];
+#endif
+
+static int pool_ready = 0;      /* lock and conditions initialized */
+static int pool_threads = 1;    /* threads per job, the caller included */
+static int pool_workers = 0;    /* worker threads now running */
+static int pool_quit = 0;       /* tells the workers to exit */
+static unsigned pool_job = 0;   /* number of the job last posted */
+static ip_task job_task;        /* task function of the current job */
+static void *job_arg;           /* its argument */
+static int job_count;           /* tasks in the current job */
+static int job_next;            /* next task index to hand out */
+static int job_done;            /* tasks finished */
+
+/* take and release the pool lock */
+
+static void pool_enter(void)
+{
+#ifdef _WIN32
+	EnterCriticalSection(&pool_lock);
+#else
+	pthread_mutex_lock(&pool_lock);
+#endif
+}
+
+static void pool_leave(void)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(&pool_lock);
+#else
+	pthread_mutex_unlock(&pool_lock);
+#endif
+}
+
+/***************************************************************************
+ * Func: run_tasks                                                         *
+ *                                                                         *
+ * Desc: runs tasks of the current job until none are left to hand out.    *
+ *       called and returns with the pool lock held                        *
+ ***************************************************************************/
+
+static void run_tasks(void)
+{
+	int index;                  /* task taken */
+	ip_task task;
+	void *arg;
+
+	while (job_next < job_count)
+	{
+		index = job_next++;
+		task = job_task;
+		arg = job_arg;
+		pool_leave();
+		task(arg, index);
+		pool_enter();
+		if (++job_done == job_count)
+		{
+#ifdef _WIN32
+			WakeConditionVariable(&pool_done);
+#else
+			pthread_cond_signal(&pool_done);
+#endif
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: pool_worker                                                       *
+ *                                                                         *
+ * Desc: body of a worker thread: waits for a new job, helps run it and    *
+ *       goes back to sleep                                                *
+ ***************************************************************************/
+
+#ifdef _WIN32
+static DWORD WINAPI pool_worker(LPVOID unused)
+#else
+static void *pool_worker(void *unused)
+#endif
+{
+	unsigned seen;              /* last job this worker looked at */
+
+	(void)unused;
+	pool_enter();
+	seen = pool_job;
+	for (;;)
+	{
+		while (seen == pool_job && !pool_quit)
+		{
+#ifdef _WIN32
+			SleepConditionVariableCS(&pool_work, &pool_lock, INFINITE);
+#else
+			pthread_cond_wait(&pool_work, &pool_lock);
+#endif
+		}
+		if (pool_quit)
+			break;
+		seen = pool_job;
+		run_tasks();
+	}
+	pool_leave();
+
+	return 0;
+}
+
+/***************************************************************************
+ * Func: stop_workers, start_workers                                       *
+ *                                                                         *
+ * Desc: end all worker threads, or start count of them                    *
+ ***************************************************************************/
+
+static void stop_workers(void)
+{
+	int i;
+
+	pool_enter();
+	pool_quit = 1;
+#ifdef _WIN32
+	WakeAllConditionVariable(&pool_work);
+#else
+	pthread_cond_broadcast(&pool_work);
+#endif
+	pool_leave();
+
+	for (i = 0; i < pool_workers; i++)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(pool_thread[i], INFINITE);
+		CloseHandle(pool_thread[i]);
+#else
+		pthread_join(pool_thread[i], NULL);
+#endif
+	}
+	pool_workers = 0;
+	pool_quit = 0;
+}
+
+static void start_workers(int count)
+{
+	for (pool_workers = 0; pool_workers < count; pool_workers++)
+	{
+#ifdef _WIN32
+		pool_thread[pool_workers] = CreateThread(NULL, 0, pool_worker, NULL, 0, NULL);
+		if (pool_thread[pool_workers] == NULL)
+#else
+		if (pthread_create(&pool_thread[pool_workers], NULL, pool_worker, NULL) != 0)
+#endif
+		{
+			printf("Unable to start worker thread\n");
+			exit(1);
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: ip_set_threads                                                    *
+ *                                                                         *
+ * Desc: sets how many threads the parallel routines use. 1 runs every     *
+ *       job on the calling thread, 0 uses one thread per processor        *
+ *                                                                         *
+ * Params: count - number of threads, the calling thread included          *
+ ***************************************************************************/
+
+void ip_set_threads(int count)
+{
+	if (count <= 0)
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+
+		GetSystemInfo(&info);
+		count = (int)info.dwNumberOfProcessors;
+#else
+		count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	}
+	if (count > IP_MAX_THREADS)
+		count = IP_MAX_THREADS;
+	pool_threads = count;
+}
+
+/***************************************************************************
+ * Func: ip_get_threads                                                    *
+ *                                                                         *
+ * Returns: number of threads the parallel routines use                    *
+ ***************************************************************************/
+
+int ip_get_threads(void)
+{
+	return pool_threads;
+}
+
+/***************************************************************************
+ * Func: ip_parallel_for                                                   *
+ *                                                                         *
+ * Desc: calls task(arg, i) for i = 0 .. count - 1 on the thread pool and  *
+ *       returns when all calls have returned. tasks may run in any order  *
+ *       and at the same time, so each must only write its own data        *
+ *                                                                         *
+ * Params: count - number of tasks                                         *
+ *         task - function to call                                         *
+ *         arg - passed unchanged to every call                            *
+ ***************************************************************************/
+
+void ip_parallel_for(int count, ip_task task, void *arg)
+{
+	int i;
+
+	if (pool_threads <= 1 || count <= 1)
+	{
+		for (i = 0; i < count; i++)
+			task(arg, i);
+		return;
+	}
+
+	if (!pool_ready)
+	{
+#ifdef _WIN32
+		InitializeCriticalSection(&pool_lock);
+		InitializeConditionVariable(&pool_work);
+		InitializeConditionVariable(&pool_done);
+#endif
+		pool_ready = 1;
+	}
+	if (pool_workers != pool_threads - 1)
+	{
+		stop_workers();
+		start_workers(pool_threads - 1);
+	}
+
+	pool_enter();
+	job_task = task;
+	job_arg = arg;
+	job_count = count;
+	job_next = 0;
+	job_done = 0;
+	pool_job++;
+#ifdef _WIN32
+	WakeAllConditionVariable(&pool_work);
+#else
+	pthread_cond_broadcast(&pool_work);
+#endif
+
+	run_tasks();
+	while (job_done < job_count)
+	{
+#ifdef _WIN32
+		SleepConditionVariableCS(&pool_done, &pool_lock, INFINITE);
+#else
+		pthread_cond_wait(&pool_done, &pool_lock);
+#endif
+	}
+	pool_leave();
+}
@@ -0,0 +1,135 @@
+/***************************************************************************
+ * File: iptile.c                                                          *
+ *                                                                         *
+ * Desc: cache-blocked execution of neighbourhood filters. the output is   *
+ *       cut into tiles of a band of rows by a strip of columns, narrow    *
+ *       enough that the rows a filter keeps for one tile (its input       *
+ *       with the halo the kernel reaches past the tile, and any partial   *
+ *       sums) stay in the L2 cache while the band is worked down. on      *
+ *       images of ordinary width a strip is the whole row, so only very   *
+ *       wide images are split                                             *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* narrowest strip worth its halo */
+#define TILE_MIN_COLS  64
+
+/* bytes a tile's working set may take, see ip_set_tile_bytes */
+static size_t tile_bytes = IP_TILE_BYTES;
+
+/* work shared by the tasks of ip_run_tiles */
+typedef struct
+{
+	int rows, cols;             /* size of the output */
+	int tile_rows, tile_cols;   /* size of a tile */
+	int strips;                 /* tiles across the output */
+	ip_tile_task task;
+	void *arg;
+} tile_job;
+
+/***************************************************************************
+ * Func: ip_set_tile_bytes                                                 *
+ *                                                                         *
+ * Desc: sets the bytes a tile's working set may take, IP_TILE_BYTES at    *
+ *       first. a larger L2 cache, or one shared by fewer threads, can     *
+ *       afford wider tiles; 0 turns tiling off                            *
+ *                                                                         *
+ * Params: bytes - the budget                                              *
+ ***************************************************************************/
+
+void ip_set_tile_bytes(size_t bytes)
+{
+	tile_bytes = bytes;
+}
+
+/***************************************************************************
+ * Func: ip_tile_cols                                                      *
+ *                                                                         *
+ * Desc: picks the width of the strips a filter's output is cut into.      *
+ *       the strips are made equal and a multiple of 16 columns, so the    *
+ *       vector kernels see whole blocks                                   *
+ *                                                                         *
+ * Params: cols - columns of the output                                    *
+ *         bytes_per_col - working set of one column of a tile             *
+ *         halo - extra columns the filter reads beside a strip            *
+ *                                                                         *
+ * Returns: columns of one strip, cols when the whole row fits             *
+ ***************************************************************************/
+
+int ip_tile_cols(int cols, size_t bytes_per_col, int halo)
+{
+	size_t fit;                 /* columns the budget holds */
+	int strips, w;
+
+	if (tile_bytes == 0 || bytes_per_col == 0)
+		return cols;
+	fit = tile_bytes / bytes_per_col;
+	if (fit >= (size_t)cols + halo)
+		return cols;
+
+	w = (fit > (size_t)halo + TILE_MIN_COLS) ? (int)(fit - halo) : TILE_MIN_COLS;
+	strips = (cols + w - 1) / w;
+	w = (cols + strips - 1) / strips;
+	w = (w + 15) & ~15;
+	return MIN(w, cols);
+}
+
+/***************************************************************************
+ * Func: tile_task                                                         *
+ *                                                                         *
+ * Desc: thread pool task: runs tile index. tiles are numbered across      *
+ *       each band first, so the tasks running at once share the source    *
+ *       rows of one band                                                  *
+ ***************************************************************************/
+
+static void tile_task(void *arg, int index)
+{
+	tile_job *job = (tile_job *)arg;
+	ip_tile t;
+
+	t.y0 = (index / job->strips) * job->tile_rows;
+	t.x0 = (index % job->strips) * job->tile_cols;
+	t.y1 = MIN(t.y0 + job->tile_rows, job->rows);
+	t.x1 = MIN(t.x0 + job->tile_cols, job->cols);
+	job->task(job->arg, &t);
+}
+
+/***************************************************************************
+ * Func: ip_run_tiles                                                      *
+ *                                                                         *
+ * Desc: calls task(arg, tile) for every tile of an output on the thread   *
+ *       pool and returns when all have returned. tiles may run in any     *
+ *       order and at the same time, so each must only write its own       *
+ *       pixels                                                            *
+ *                                                                         *
+ * Params: rows, cols - size of the output                                 *
+ *         tile_rows - rows of a band                                      *
+ *         tile_cols - columns of a strip, e.g. from ip_tile_cols          *
+ *         task - function to call                                         *
+ *         arg - passed unchanged to every call                            *
+ ***************************************************************************/
+
+void ip_run_tiles(int rows, int cols, int tile_rows, int tile_cols,
+	ip_tile_task task, void *arg)
+{
+	tile_job job;
+	int bands;
+
+	if (rows <= 0 || cols <= 0)
+		return;
+	job.rows = rows;
+	job.cols = cols;
+	job.tile_rows = MAX(tile_rows, 1);
+	job.tile_cols = MAX(MIN(tile_cols, cols), 1);
+	job.strips = (cols + job.tile_cols - 1) / job.tile_cols;
+	job.task = task;
+	job.arg = arg;
+
+	bands = (rows + job.tile_rows - 1) / job.tile_rows;
+	ip_parallel_for(bands * job.strips, tile_task, &job);
+}
@@ -0,0 +1,453 @@
+/***************************************************************************
+ * File: ipwarp.c                                                          *
+ *                                                                         *
+ * Desc: mesh warping. the control grid of a mesh is spread evenly over    *
+ *       the output image and each node holds the source position to       *
+ *       sample there. mesh_remap interpolates the grid into a table of    *
+ *       source positions, one per output pixel, and remap_image samples   *
+ *       the source through it, so a table built once serves every frame   *
+ *       warped by the same mesh                                           *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* output rows built or sampled by one thread pool task */
+#define WARP_ROWS  32
+
+/* steps of a pixel the cubic weights are tabulated at */
+#define WARP_PHASES  64
+
+/* work shared by the tasks of mesh_remap */
+typedef struct
+{
+	mesh *m;
+	remap_table *t;
+	int *node;                  /* left-hand grid column per output column */
+	float *u;                   /* weight of the right-hand column */
+} remap_job;
+
+/* work shared by the tasks of remap_image */
+typedef struct
+{
+	image_ptr in;
+	image_ptr out;
+	int rows, cols;             /* source size */
+	int channels;
+	int method;
+	remap_table *t;
+	float cubic[WARP_PHASES + 1][4];    /* cubicConvKernel weights per phase */
+} warp_job;
+
+/* mesh and table kept by mesh_warp for the next frame */
+static mesh cached_mesh;
+static remap_table *cached_table = NULL;
+
+/***************************************************************************
+ * Func: grid_coord                                                        *
+ *                                                                         *
+ * Desc: places output sample o of a line of n samples on a grid of        *
+ *       nodes spread over the same line                                   *
+ *                                                                         *
+ * Params: o - output sample                                               *
+ *         n - samples in the line                                         *
+ *         nodes - grid nodes along the line, 2 or more                    *
+ *         weight - set to the weight of the node after the returned one   *
+ *                                                                         *
+ * Returns: the grid node at or before the sample, at most nodes - 2       *
+ ***************************************************************************/
+
+static int grid_coord(int o, int n, int nodes, float *weight)
+{
+	double g;                   /* position in grid steps */
+	int k;
+
+	g = (n > 1) ? (double)o * (nodes - 1) / (n - 1) : 0.0;
+	k = (int)g;
+	if (k > nodes - 2)
+		k = nodes - 2;
+	*weight = (float)(g - k);
+	return k;
+}
+
+/***************************************************************************
+ * Func: remap_task                                                        *
+ *                                                                         *
+ * Desc: fills WARP_ROWS rows of a remap table. the two grid rows around   *
+ *       an output row are blended once, then each pixel blends the two    *
+ *       nodes either side of it                                           *
+ *                                                                         *
+ * Params: arg - the remap_job                                             *
+ *         index - band of rows                                            *
+ ***************************************************************************/
+
+static void remap_task(void *arg, int index)
+{
+	remap_job *job = (remap_job *)arg;
+	mesh *m = job->m;
+	remap_table *t = job->t;
+	int *node = job->node;
+	float *u = job->u;
+	float *nx, *ny;             /* grid row blended to the output row */
+	float *px, *py;             /* output row of the table */
+	float *x0, *x1, *y0, *y1;   /* grid rows above and below */
+	float v;
+	int y, y_end, x, j, i;
+
+	nx = (float *)malloc(sizeof(float) * 2 * m->width);
+	if (nx == NULL)
+	{
+		printf("Error allocating remap row\n");
+		exit(1);
+	}
+	ny = nx + m->width;
+
+	y_end = MIN((index + 1) * WARP_ROWS, t->rows);
+	for (y = index * WARP_ROWS; y < y_end; y++)
+	{
+		i = grid_coord(y, t->rows, m->height, &v);
+		x0 = m->x_data + (long)i * m->width;
+		x1 = x0 + m->width;
+		y0 = m->y_data + (long)i * m->width;
+		y1 = y0 + m->width;
+		for (j = 0; j < m->width; j++)
+		{
+			nx[j] = x0[j] + v * (x1[j] - x0[j]);
+			ny[j] = y0[j] + v * (y1[j] - y0[j]);
+		}
+
+		px = t->x + (long)y * t->cols;
+		py = t->y + (long)y * t->cols;
+		for (x = 0; x < t->cols; x++)
+		{
+			j = node[x];
+			px[x] = nx[j] + u[x] * (nx[j + 1] - nx[j]);
+			py[x] = ny[j] + u[x] * (ny[j + 1] - ny[j]);
+		}
+	}
+
+	free(nx);
+}
+
+/***************************************************************************
+ * Func: mesh_remap                                                        *
+ *                                                                         *
+ * Desc: interpolates a mesh into a table of source positions, one per     *
+ *       output pixel. node (i, j) of the mesh sits at output row          *
+ *       i * (rows - 1) / (height - 1) and column j * (cols - 1) /         *
+ *       (width - 1), and holds the source column (x_data) and row         *
+ *       (y_data) to sample there; positions between nodes are bilinear    *
+ *                                                                         *
+ * Params: m - the mesh, 2 or more nodes each way                          *
+ *         rows - number of output rows                                    *
+ *         cols - number of output columns                                 *
+ *                                                                         *
+ * Returns: the table, to be freed with free_remap                         *
+ ***************************************************************************/
+
+remap_table *mesh_remap(mesh *m, int rows, int cols)
+{
+	remap_job job;
+	remap_table *t;
+	int x;
+
+	if (m->width < 2 || m->height < 2 || rows < 1 || cols < 1)
+	{
+		printf("mesh_remap: bad mesh %d x %d for %d x %d output\n",
+			m->width, m->height, cols, rows);
+		exit(1);
+	}
+
+	t = (remap_table *)malloc(sizeof(remap_table));
+	job.node = (int *)malloc(sizeof(int) * cols);
+	job.u = (float *)malloc(sizeof(float) * cols);
+	if (t == NULL || job.node == NULL || job.u == NULL ||
+		(t->x = (float *)malloc(sizeof(float) * 2 * rows * cols)) == NULL)
+	{
+		printf("Error allocating remap table\n");
+		exit(1);
+	}
+	t->rows = rows;
+	t->cols = cols;
+	t->y = t->x + (long)rows * cols;
+
+	for (x = 0; x < cols; x++)
+		job.node[x] = grid_coord(x, cols, m->width, &job.u[x]);
+
+	job.m = m;
+	job.t = t;
+	ip_parallel_for((rows + WARP_ROWS - 1) / WARP_ROWS, remap_task, &job);
+
+	free(job.node);
+	free(job.u);
+	return t;
+}
+
+/***************************************************************************
+ * Func: free_remap                                                        *
+ *                                                                         *
+ * Desc: frees a table from mesh_remap                                     *
+ *                                                                         *
+ * Params: t - the table                                                   *
+ ***************************************************************************/
+
+void free_remap(remap_table *t)
+{
+	if (t == NULL)
+		return;
+	free(t->x);
+	free(t);
+}
+
+/***************************************************************************
+ * Func: sample_bilinear                                                   *
+ *                                                                         *
+ * Desc: samples one pixel at a source position with BI_SHIFT-bit weights, *
+ *       the same fixed point as the bilinear resize. positions off the    *
+ *       image take the nearest border pixel                               *
+ *                                                                         *
+ * Params: job - the warp_job                                              *
+ *         sx, sy - source column and row                                  *
+ *         dst - output pixel                                              *
+ ***************************************************************************/
+
+static void sample_bilinear(warp_job *job, float sx, float sy, unsigned char *dst)
+{
+	int xi, yi, x1, y1, wx, wy, c, top, bottom;
+	unsigned char *p00, *p01, *p10, *p11;
+	int channels = job->channels;
+	long stride = (long)job->cols * channels;
+	float fx, fy;
+
+	sx = CLAMP(sx, -1.0f, (float)job->cols);
+	sy = CLAMP(sy, -1.0f, (float)job->rows);
+	fx = (float)floor(sx);
+	fy = (float)floor(sy);
+	wx = (int)((sx - fx) * BI_ONE + 0.5f);
+	wy = (int)((sy - fy) * BI_ONE + 0.5f);
+	xi = (int)fx;
+	yi = (int)fy;
+	x1 = xi + 1;
+	y1 = yi + 1;
+	xi = CLAMP(xi, 0, job->cols - 1);
+	yi = CLAMP(yi, 0, job->rows - 1);
+	x1 = CLAMP(x1, 0, job->cols - 1);
+	y1 = CLAMP(y1, 0, job->rows - 1);
+
+	p00 = job->in + yi * stride + (long)xi * channels;
+	p01 = job->in + yi * stride + (long)x1 * channels;
+	p10 = job->in + y1 * stride + (long)xi * channels;
+	p11 = job->in + y1 * stride + (long)x1 * channels;
+	for (c = 0; c < channels; c++)
+	{
+		top = (BI_ONE - wx) * p00[c] + wx * p01[c];
+		bottom = (BI_ONE - wx) * p10[c] + wx * p11[c];
+		dst[c] = (unsigned char)(((BI_ONE - wy) * top + wy * bottom +
+			(1 << (2 * BI_SHIFT - 1))) >> (2 * BI_SHIFT));
+	}
+}
+
+/***************************************************************************
+ * Func: sample_cubic                                                      *
+ *                                                                         *
+ * Desc: samples one pixel at a source position from its 4 x 4             *
+ *       neighbours, weighted by the cubic table of the job at the         *
+ *       nearest 1 / WARP_PHASES of a pixel and clipped to 0..255.         *
+ *       neighbours off the image take the nearest border pixel            *
+ *                                                                         *
+ * Params: job - the warp_job                                              *
+ *         sx, sy - source column and row                                  *
+ *         dst - output pixel                                              *
+ ***************************************************************************/
+
+static void sample_cubic(warp_job *job, float sx, float sy, unsigned char *dst)
+{
+	float *wx, *wy;             /* kernel weights of the 4 columns and rows */
+	long xo[4], yo[4];          /* offsets of the 4 columns and rows */
+	unsigned char *in = job->in;
+	float sum, row;
+	int xi, yi, k, c, i, v;
+	int channels = job->channels;
+
+	/* clamped to -2 or more, so truncating past +2 floors */
+	sx = CLAMP(sx, -2.0f, (float)job->cols + 1.0f);
+	sy = CLAMP(sy, -2.0f, (float)job->rows + 1.0f);
+	xi = (int)(sx + 2.0f) - 2;
+	yi = (int)(sy + 2.0f) - 2;
+	wx = job->cubic[(int)((sx - xi) * WARP_PHASES + 0.5f)];
+	wy = job->cubic[(int)((sy - yi) * WARP_PHASES + 0.5f)];
+	for (k = 0; k < 4; k++)
+	{
+		v = xi - 1 + k;
+		xo[k] = (long)CLAMP(v, 0, job->cols - 1) * channels;
+		v = yi - 1 + k;
+		yo[k] = (long)CLAMP(v, 0, job->rows - 1) * job->cols * channels;
+	}
+
+	for (c = 0; c < channels; c++)
+	{
+		sum = 0.5f;
+		for (i = 0; i < 4; i++)
+		{
+			row = wx[0] * in[yo[i] + xo[0] + c] + wx[1] * in[yo[i] + xo[1] + c] +
+				wx[2] * in[yo[i] + xo[2] + c] + wx[3] * in[yo[i] + xo[3] + c];
+			sum += wy[i] * row;
+		}
+		v = (int)floor(sum);
+		dst[c] = (unsigned char)CLAMP(v, 0, 255);
+	}
+}
+
+/***************************************************************************
+ * Func: warp_task                                                         *
+ *                                                                         *
+ * Desc: samples WARP_ROWS output rows through the remap table             *
+ *                                                                         *
+ * Params: arg - the warp_job                                              *
+ *         index - band of rows                                            *
+ ***************************************************************************/
+
+static void warp_task(void *arg, int index)
+{
+	warp_job *job = (warp_job *)arg;
+	remap_table *t = job->t;
+	int channels = job->channels;
+	float *px, *py;
+	unsigned char *dst;
+	int y, y_end, x, xi, yi, c;
+
+	y_end = MIN((index + 1) * WARP_ROWS, t->rows);
+	for (y = index * WARP_ROWS; y < y_end; y++)
+	{
+		px = t->x + (long)y * t->cols;
+		py = t->y + (long)y * t->cols;
+		dst = job->out + (long)y * t->cols * channels;
+		for (x = 0; x < t->cols; x++, dst += channels)
+		{
+			if (job->method == RESIZE_BILINEAR)
+				sample_bilinear(job, px[x], py[x], dst);
+			else if (job->method == RESIZE_CUBIC)
+				sample_cubic(job, px[x], py[x], dst);
+			else
+			{
+				xi = (int)floor(px[x] + 0.5f);
+				yi = (int)floor(py[x] + 0.5f);
+				xi = CLAMP(xi, 0, job->cols - 1);
+				yi = CLAMP(yi, 0, job->rows - 1);
+				for (c = 0; c < channels; c++)
+					dst[c] = job->in[((long)yi * job->cols + xi) * channels + c];
+			}
+		}
+	}
+}
+
+/***************************************************************************
+ * Func: remap_image                                                       *
+ *                                                                         *
+ * Desc: warps an image through a remap table. the output has the size     *
+ *       the table was built for, and positions off the source take the    *
+ *       nearest border pixel                                              *
+ *                                                                         *
+ * Params: in - source image                                               *
+ *         rows - number of source rows                                    *
+ *         cols - number of source columns                                 *
+ *         type - PGM or PPM                                               *
+ *         t - table from mesh_remap                                       *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC             *
+ *         out - t->rows * t->cols pixels, or NULL to allocate             *
+ *                                                                         *
+ * Returns: the warped image                                               *
+ ***************************************************************************/
+
+image_ptr remap_image(image_ptr in, int rows, int cols, int type,
+	remap_table *t, int method, image_ptr out)
+{
+	warp_job job;
+	int p, k;
+
+	job.channels = (type == PPM) ? 3 : 1;
+	if (out == NULL)
+	{
+		out = (image_ptr)IP_MALLOC((unsigned long)t->rows * t->cols * job.channels);
+		if (out == NULL)
+		{
+			printf("Error allocating warped image\n");
+			exit(1);
+		}
+	}
+
+	job.in = in;
+	job.out = out;
+	job.rows = rows;
+	job.cols = cols;
+	job.method = method;
+	job.t = t;
+	if (method == RESIZE_CUBIC)
+		for (p = 0; p <= WARP_PHASES; p++)
+			for (k = 0; k < 4; k++)
+				job.cubic[p][k] = cubicConvKernel((float)p / WARP_PHASES + 1 - k);
+	ip_parallel_for((t->rows + WARP_ROWS - 1) / WARP_ROWS, warp_task, &job);
+	return out;
+}
+
+/***************************************************************************
+ * Func: mesh_warp                                                         *
+ *                                                                         *
+ * Desc: warps an image by a mesh into an image of the same size. the      *
+ *       remap table is kept with a copy of the mesh, so frames warped by  *
+ *       an unchanged mesh skip building it again                          *
+ *                                                                         *
+ * Params: in - source image                                               *
+ *         rows - number of rows                                           *
+ *         cols - number of columns                                        *
+ *         type - PGM or PPM                                               *
+ *         m - the mesh, or NULL to free the kept table                    *
+ *         method - RESIZE_NN, RESIZE_BILINEAR or RESIZE_CUBIC             *
+ *         out - rows * cols pixels, or NULL to allocate                   *
+ *                                                                         *
+ * Returns: the warped image, NULL when m is NULL                          *
+ ***************************************************************************/
+
+image_ptr mesh_warp(image_ptr in, int rows, int cols, int type, mesh *m,
+	int method, image_ptr out)
+{
+	size_t nodes;
+
+	if (m != NULL && cached_table != NULL && cached_table->rows == rows &&
+		cached_table->cols == cols && cached_mesh.width == m->width &&
+		cached_mesh.height == m->height)
+	{
+		nodes = (size_t)m->width * m->height;
+		if (memcmp(cached_mesh.x_data, m->x_data, sizeof(float) * nodes) == 0 &&
+			memcmp(cached_mesh.y_data, m->y_data, sizeof(float) * nodes) == 0)
+			return remap_image(in, rows, cols, type, cached_table, method, out);
+	}
+
+	free_remap(cached_table);
+	free(cached_mesh.x_data);
+	cached_table = NULL;
+	cached_mesh.x_data = NULL;
+	if (m == NULL)
+		return NULL;
+
+	cached_table = mesh_remap(m, rows, cols);
+	nodes = (size_t)m->width * m->height;
+	cached_mesh.width = m->width;
+	cached_mesh.height = m->height;
+	cached_mesh.x_data = (float *)malloc(sizeof(float) * 2 * nodes);
+	if (cached_mesh.x_data == NULL)
+	{
+		printf("Error allocating mesh copy\n");
+		exit(1);
+	}
+	cached_mesh.y_data = cached_mesh.x_data + nodes;
+	memcpy(cached_mesh.x_data, m->x_data, sizeof(float) * nodes);
+	memcpy(cached_mesh.y_data, m->y_data, sizeof(float) * nodes);
+
+	return remap_image(in, rows, cols, type, cached_table, method, out);
+}
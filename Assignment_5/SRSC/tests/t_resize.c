@@ -0,0 +1,186 @@
+/***************************************************************************
+ * File: t_resize.c                                                        *
+ *                                                                         *
+ * Desc: checks of the resize paths, to run after a change to iplib.c or   *
+ *       ipsimd.c: at whole-number factors RESIZE_CUBIC must give the      *
+ *       bytes cubicSeparableInterpolation gives, and flat images must     *
+ *       stay flat through RESIZE_BILINEAR and RESIZE_CUBIC at 8 and 16    *
+ *       bits. every check runs at each cpu level. build it with the       *
+ *       library sources in place of List2_1.c; it prints what failed and  *
+ *       exits with 1, or 0 when all pass                                  *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ip.h"
+#include "ipsys.h"
+
+/* cpu feature masks the checks run at: scalar, SSE4.1, AVX2 */
+static int cpu_levels[] = { 0, IP_CPU_SSE41, IP_CPU_SSE41 | IP_CPU_AVX2 };
+
+static int failures;            /* checks failed so far */
+
+/***************************************************************************
+ * Func: random_image                                                      *
+ *                                                                         *
+ * Desc: an image of random samples                                        *
+ ***************************************************************************/
+
+static image_ptr random_image(int rows, int cols, int type)
+{
+	unsigned long n = (unsigned long)rows * cols * ((type == 5) ? 1 : 3);
+	image_ptr img = (image_ptr)malloc(n);
+	unsigned long i;
+
+	for (i = 0; i < n; i++)
+		img[i] = (unsigned char)(rand() >> 4);
+	return img;
+}
+
+/***************************************************************************
+ * Func: check_cubic_paths                                                 *
+ *                                                                         *
+ * Desc: RESIZE_CUBIC against cubicSeparableInterpolation_mem at           *
+ *       whole-number factors                                              *
+ ***************************************************************************/
+
+static void check_cubic_paths(int rows, int cols, int type, int x_scale,
+	int y_scale)
+{
+	image_ptr in, a, b;
+	int new_rows = rows * y_scale, new_cols = cols * x_scale;
+	unsigned long n, i, differ;
+
+	in = random_image(rows, cols, type);
+	n = (unsigned long)new_rows * new_cols * ((type == 5) ? 1 : 3);
+	a = resize_pnm_mem(in, rows, cols, &new_rows, &new_cols, type, RESIZE_CUBIC,
+		NULL, 0);
+	b = cubicSeparableInterpolation_mem(in, rows, cols, x_scale, y_scale, type,
+		NULL, 0);
+
+	differ = 0;
+	for (i = 0; i < n; i++)
+		differ += (a[i] != b[i]);
+	if (differ != 0)
+	{
+		printf("cubic %dx%d P%d x%d,%d: %lu of %lu samples differ\n", cols, rows,
+			type, x_scale, y_scale, differ, n);
+		failures++;
+	}
+
+	IP_FREE(a);
+	IP_FREE(b);
+	free(in);
+}
+
+/***************************************************************************
+ * Func: check_flat                                                        *
+ *                                                                         *
+ * Desc: a flat image resized with method must keep its grey level         *
+ ***************************************************************************/
+
+static void check_flat(int level, int new_rows, int new_cols, int type,
+	int method)
+{
+	image_ptr in, out;
+	int rows = 100, cols = 100;
+	unsigned long n, i, wrong;
+
+	n = (unsigned long)rows * cols * ((type == 5) ? 1 : 3);
+	in = (image_ptr)malloc(n);
+	memset(in, level, n);
+	out = resize_pnm_mem(in, rows, cols, &new_rows, &new_cols, type, method,
+		NULL, 0);
+
+	n = (unsigned long)new_rows * new_cols * ((type == 5) ? 1 : 3);
+	wrong = 0;
+	for (i = 0; i < n; i++)
+		wrong += (out[i] != level);
+	if (wrong != 0)
+	{
+		printf("flat %d to %dx%d P%d method %d: %lu of %lu samples wrong\n",
+			level, new_cols, new_rows, type, method, wrong, n);
+		failures++;
+	}
+
+	IP_FREE(out);
+	free(in);
+}
+
+/***************************************************************************
+ * Func: check_flat16                                                      *
+ *                                                                         *
+ * Desc: check_flat for resize_pnm16_mem, at a maxval of 4095              *
+ ***************************************************************************/
+
+static void check_flat16(int level, int new_rows, int new_cols, int type,
+	int method)
+{
+	image16_ptr in, out;
+	int rows = 100, cols = 100;
+	unsigned long n, i, wrong;
+
+	n = (unsigned long)rows * cols * ((type == 5) ? 1 : 3);
+	in = (image16_ptr)malloc(sizeof(unsigned short) * n);
+	for (i = 0; i < n; i++)
+		in[i] = (unsigned short)level;
+	out = resize_pnm16_mem(in, rows, cols, &new_rows, &new_cols, type, 4095,
+		method, NULL, 0);
+
+	n = (unsigned long)new_rows * new_cols * ((type == 5) ? 1 : 3);
+	wrong = 0;
+	for (i = 0; i < n; i++)
+		wrong += (out[i] != level);
+	if (wrong != 0)
+	{
+		printf("flat16 %d to %dx%d P%d method %d: %lu of %lu samples wrong\n",
+			level, new_cols, new_rows, type, method, wrong, n);
+		failures++;
+	}
+
+	IP_FREE(out);
+	free(in);
+}
+
+int main(void)
+{
+	static int levels[] = { 0, 1, 128, 254, 255 };
+	static int sizes[][2] = { { 333, 777 }, { 999, 999 }, { 37, 53 }, { 300, 300 } };
+	static int levels16[] = { 1, 2048, 4094, 4095 };
+	int cpu, type, f, k, s, m;
+
+	srand(1);
+	for (cpu = 0; cpu < 3; cpu++)
+	{
+		ip_limit_cpu_features(cpu_levels[cpu]);
+		for (type = 5; type <= 6; type++)
+		{
+			for (f = 1; f <= 5; f++)
+			{
+				check_cubic_paths(37, 53, type, f, f);
+				check_cubic_paths(37, 53, type, f, f % 3 + 1);
+			}
+			for (k = 0; k < 5; k++)
+				for (s = 0; s < 4; s++)
+					for (m = RESIZE_BILINEAR; m <= RESIZE_CUBIC; m++)
+						check_flat(levels[k], sizes[s][0], sizes[s][1], type, m);
+			for (k = 0; k < 4; k++)
+				for (m = RESIZE_BILINEAR; m <= RESIZE_CUBIC; m++)
+				{
+					check_flat16(levels16[k], 77, 133, type, m);
+					check_flat16(levels16[k], 250, 180, type, m);
+					check_flat16(levels16[k], 40, 60, type, m);
+				}
+		}
+	}
+
+	if (failures != 0)
+	{
+		printf("t_resize: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("t_resize: all checks passed\n");
+	return 0;
+}